@@ -81,6 +81,7 @@
 #include <syscall.h>
 #include <aio.h>
 #include <sched.h>
+#include <pthread.h>
 #include <utime.h>
 #include <sys/cdefs.h>
 #include <sys/errno.h>
@@ -129,6 +130,10 @@
 #  include <mcheck.h>
 #endif	/* __GLIBC__ */
 
+#if defined (__x86_64__) && defined (__GNUC__)
+#  include <immintrin.h>
+#endif
+
 /* accomodate OS differences */
 
 /* find out if this is one of the BSDs */
@@ -175,6 +180,13 @@ if defined(__FreeBSD__) || defined(__APPLE__) || defined(__OpenBSD__) || defined
 #  include <sys/queue.h>
 #  include <sys/sysinfo.h>
 #  include <sys/signalfd.h>
+#  include <sys/epoll.h>
+#  if defined (__has_include)
+#    if __has_include (<linux/io_uring.h>)
+#      include <linux/io_uring.h>
+#      define HAVE_IO_URING	1
+#    endif
+#  endif
 #  include <sys/inotify.h>
 #  include <sys/fanotify.h>
 #  include <sys/sysmacros.h>
@@ -195,6 +207,7 @@ if defined(__FreeBSD__) || defined(__APPLE__) || defined(__OpenBSD__) || defined
 #  include <linux/memfd.h>
 #  include <linux/kexec.h>
 #  include <linux/netlink.h>
+#  include <linux/filter.h>
 #  include <linux/rtnetlink.h>
 #  include <linux/loop.h>
 #  include <linux/connector.h>
@@ -0,0 +1,382 @@
+/*
+ * file copy engine shared by the Lua module and runtcl
+ *
+ * the data is copied with the cheapest method the kernel and the file
+ * systems involved support: a reflink (FICLONE), copy_file_range(2),
+ * sendfile(2) and finally a pread/pwrite loop. holes of sparse files
+ * are kept by copying only the extents reported by SEEK_DATA/SEEK_HOLE.
+ *
+ * public domain code
+ */
+
+#if defined (OSLinux) && ! defined (FICLONE)
+#  define FICLONE		_IOW(0x94, 9, int)
+#endif
+
+/* what to copy besides the data */
+enum {
+  FCOPY_MODE			= 0x0001,
+  FCOPY_OWNER			= 0x0002,
+  FCOPY_TIMES			= 0x0004,
+  FCOPY_XATTR			= 0x0008,
+  FCOPY_ALL			= 0x000f,
+  /* never share the data blocks with the source */
+  FCOPY_NOREFLINK		= 0x0010,
+  /* copy to a temporary file and rename it to dst at the end */
+  FCOPY_ATOMIC			= 0x0020,
+} ;
+
+/* copy methods, tried in this order */
+enum {
+  FCOPY_CFR = 0,
+  FCOPY_SENDFILE,
+  FCOPY_RW,
+} ;
+
+#define FCOPY_BUFSIZE		( 1024 * 1024 )
+
+/* copies len bytes (or up to EOF if len is negative) at offset off
+ * from ifd to ofd. * mp holds the method to start with and is updated
+ * when a method is not supported for these files.
+ */
+static int fcopy_range ( const int ifd, const int ofd, off_t off,
+  off_t len, int * const mp, char ** const bufp )
+{
+  ssize_t r = 0 ;
+
+#if defined (OSLinux)
+  while ( FCOPY_CFR == * mp && 0 != len ) {
+    loff_t io = off, oo = off ;
+
+    r = copy_file_range ( ifd, & io, ofd, & oo,
+      ( 0 > len || FCOPY_BUFSIZE * 64 < len ) ? FCOPY_BUFSIZE * 64 : (size_t) len, 0 ) ;
+
+    if ( 0 < r ) {
+      off += r ;
+      if ( 0 < len ) { len -= r ; }
+    } else if ( 0 == r ) {
+      /* EOF, but some pseudo file systems always report that */
+      if ( 0 > len || 0 == off ) { * mp = FCOPY_SENDFILE ; }
+      else { return 0 ; }
+    } else if ( EINTR != errno ) {
+      if ( EXDEV != errno && EINVAL != errno && ENOSYS != errno
+        && EOPNOTSUPP != errno && EBADF != errno )
+      {
+        return -1 ;
+      }
+      * mp = FCOPY_SENDFILE ;
+    }
+  }
+
+  /* sendfile(2) writes at the current file position */
+  if ( FCOPY_SENDFILE == * mp && 0 != len && 0 > lseek ( ofd, off, SEEK_SET ) ) {
+    return -1 ;
+  }
+
+  while ( FCOPY_SENDFILE == * mp && 0 != len ) {
+    r = sendfile ( ofd, ifd, & off,
+      ( 0 > len || FCOPY_BUFSIZE * 64 < len ) ? FCOPY_BUFSIZE * 64 : (size_t) len ) ;
+
+    if ( 0 < r ) {
+      if ( 0 < len ) { len -= r ; }
+    } else if ( 0 == r ) {
+      return 0 ;
+    } else if ( EINTR != errno ) {
+      if ( EINVAL != errno && ENOSYS != errno ) { return -1 ; }
+      * mp = FCOPY_RW ;
+    }
+  }
+#else
+  * mp = FCOPY_RW ;
+#endif
+
+  if ( 0 != len && NULL == * bufp ) {
+    * bufp = (char *) malloc ( FCOPY_BUFSIZE ) ;
+    if ( NULL == * bufp ) { return -1 ; }
+  }
+
+  while ( 0 != len ) {
+    ssize_t w, o = 0 ;
+
+    r = pread ( ifd, * bufp,
+      ( 0 > len || FCOPY_BUFSIZE < len ) ? FCOPY_BUFSIZE : (size_t) len, off ) ;
+
+    if ( 0 > r ) {
+      if ( EINTR == errno ) { continue ; }
+      return -1 ;
+    } else if ( 0 == r ) {
+      break ;
+    }
+
+    while ( o < r ) {
+      w = pwrite ( ofd, * bufp + o, r - o, off + o ) ;
+
+      if ( 0 > w ) {
+        if ( EINTR == errno ) { continue ; }
+        return -1 ;
+      }
+
+      o += w ;
+    }
+
+    off += r ;
+    if ( 0 < len ) { len -= r ; }
+  }
+
+  return 0 ;
+}
+
+/* copies the data of the file ifd refers to, holes are kept */
+static int fcopy_data ( const int ifd, const int ofd, const struct stat * const stp,
+  const unsigned int f )
+{
+  int i = 0, m = FCOPY_CFR ;
+  char * buf = NULL ;
+  off_t d = 0, h ;
+
+#if defined (OSLinux)
+  /* share the data blocks if the file system supports it */
+  if ( 0 == ( FCOPY_NOREFLINK & f ) && 0 < stp -> st_size
+    && 0 == ioctl ( ofd, FICLONE, ifd ) )
+  {
+    return 0 ;
+  }
+#endif
+
+  if ( 0 == stp -> st_size ) {
+    /* size unknown (e. g. /proc files): copy up to EOF */
+    i = fcopy_range ( ifd, ofd, 0, -1, & m, & buf ) ;
+    free ( buf ) ;
+    return i ;
+  }
+
+#if defined (SEEK_DATA) && defined (SEEK_HOLE)
+  if ( (off_t) stp -> st_blocks * 512 < stp -> st_size ) {
+    /* sparse file: copy only the data extents */
+    while ( stp -> st_size > d ) {
+      d = lseek ( ifd, d, SEEK_DATA ) ;
+
+      if ( 0 > d ) {
+        if ( ENXIO == errno ) { break ; }
+        /* not supported, copy everything */
+        d = 0 ;
+        goto all ;
+      }
+
+      h = lseek ( ifd, d, SEEK_HOLE ) ;
+      if ( 0 > h ) { h = stp -> st_size ; }
+      if ( fcopy_range ( ifd, ofd, d, h - d, & m, & buf ) ) {
+        i = -1 ;
+        break ;
+      }
+
+      d = h ;
+    }
+
+    goto done ;
+  }
+
+all :
+#endif
+  i = fcopy_range ( ifd, ofd, d, stp -> st_size - d, & m, & buf ) ;
+
+#if defined (SEEK_DATA) && defined (SEEK_HOLE)
+done :
+#endif
+  free ( buf ) ;
+  /* a trailing hole is not written at all */
+  if ( 0 == i && ftruncate ( ofd, stp -> st_size ) ) { i = -1 ; }
+
+  return i ;
+}
+
+#if defined (OSLinux)
+/* reads a list (name NULL) or value into * bp, which is grown as needed.
+ * the size is probed first and the call is repeated if the attribute
+ * grew in between. returns the length or -1.
+ */
+static ssize_t fcopy_xattr_get ( const int fd, const char * const name,
+  char ** const bp, size_t * const cap )
+{
+  ssize_t n ;
+  char * p ;
+
+  for ( ; ; ) {
+    if ( * cap ) {
+      n = name ? fgetxattr ( fd, name, * bp, * cap ) : flistxattr ( fd, * bp, * cap ) ;
+      if ( 0 <= n || ERANGE != errno ) { return n ; }
+    }
+
+    /* probe the size */
+    n = name ? fgetxattr ( fd, name, NULL, 0 ) : flistxattr ( fd, NULL, 0 ) ;
+    if ( 0 >= n ) { return n ; }
+    if ( (size_t) n <= * cap ) { continue ; }
+    p = (char *) realloc ( * bp, n ) ;
+    if ( NULL == p ) { return -1 ; }
+    * bp = p ;
+    * cap = n ;
+  }
+}
+#endif
+
+/* copies the extended attributes (Linux) */
+static int fcopy_xattrs ( const int ifd, const int ofd )
+{
+  int r = 0 ;
+#if defined (OSLinux)
+  ssize_t n, v ;
+  size_t ncap = 0, vcap = 0 ;
+  char * p, * e ;
+  char * names = NULL, * val = NULL ;
+
+  n = fcopy_xattr_get ( ifd, NULL, & names, & ncap ) ;
+
+  if ( 0 > n ) {
+    r = ( ENOTSUP == errno ) ? 0 : -1 ;
+    n = 0 ;
+  }
+
+  for ( p = names, e = names + n ; p < e ; p += 1 + strlen ( p ) ) {
+    v = fcopy_xattr_get ( ifd, p, & val, & vcap ) ;
+
+    /* removed in between */
+    if ( 0 > v && ENODATA == errno ) { continue ; }
+
+    if ( 0 > v || ( fsetxattr ( ofd, p, val, v, 0 ) && ENOTSUP != errno && EPERM != errno ) ) {
+      r = -1 ;
+      break ;
+    }
+  }
+
+  free ( names ) ;
+  free ( val ) ;
+#endif
+
+  return r ;
+}
+
+/* copies data and the requested metadata between two open files,
+ * stp points to the stat struct of the source file
+ */
+static int fcopy_fd ( const int ifd, const int ofd, const struct stat * const stp,
+  const unsigned int f )
+{
+  if ( fcopy_data ( ifd, ofd, stp, f ) ) { return -1 ; }
+
+  /* as unprivileged user we may not be able to give the file away */
+  if ( ( FCOPY_OWNER & f ) && fchown ( ofd, stp -> st_uid, stp -> st_gid )
+    && EPERM != errno )
+  {
+    return -1 ;
+  }
+
+  /* after fchown(2), which clears security.capability */
+  if ( ( FCOPY_XATTR & f ) && fcopy_xattrs ( ifd, ofd ) ) { return -1 ; }
+
+  /* after fchown(2), which clears the suid/sgid bits */
+  if ( ( FCOPY_MODE & f ) && fchmod ( ofd, 07777 & stp -> st_mode ) ) { return -1 ; }
+
+  if ( FCOPY_TIMES & f ) {
+    struct timespec ts [ 2 ] ;
+
+    ts [ 0 ] = stp -> st_atim ;
+    ts [ 1 ] = stp -> st_mtim ;
+    if ( futimens ( ofd, ts ) ) { return -1 ; }
+  }
+
+  return 0 ;
+}
+
+/* copies file src to dst, which must not be src itself (or a hard link
+ * of it) unless the copy is atomic. returns 0 on success or -1 and sets
+ * errno
+ */
+static int fcopy_path ( const char * const src, const char * const dst,
+  const unsigned int f )
+{
+  int e = 0, i = -1, ifd, ofd ;
+  size_t l = 0 ;
+  char * tmp = NULL ;
+  struct stat st ;
+
+  ifd = open ( src, O_RDONLY | O_CLOEXEC | O_NOCTTY ) ;
+  if ( 0 > ifd ) { return -1 ; }
+
+  /* check the source before dst is created or truncated */
+  if ( fstat ( ifd, & st ) ) {
+    e = errno ;
+  } else if ( ! S_ISREG( st . st_mode ) ) {
+    e = EINVAL ;
+  }
+
+  if ( e ) {
+    CLOSEFD( ifd )
+    errno = e ;
+    return -1 ;
+  }
+
+  if ( FCOPY_ATOMIC & f ) {
+    l = strlen ( dst ) ;
+    tmp = (char *) malloc ( l + 8 ) ;
+
+    if ( NULL == tmp ) {
+      CLOSEFD( ifd )
+      return -1 ;
+    }
+
+    (void) memcpy ( tmp, dst, l ) ;
+    (void) memcpy ( tmp + l, ".XXXXXX", 8 ) ;
+    ofd = mkostemp ( tmp, O_CLOEXEC ) ;
+
+    /* mkostemp(3) creates the file with mode 0600, give it the mode
+     * open(2) would have given it
+     */
+    if ( 0 <= ofd && 0 == ( FCOPY_MODE & f ) ) {
+      const mode_t m = umask ( 0 ) ;
+
+      (void) umask ( m ) ;
+      (void) fchmod ( ofd, 00777 & st . st_mode & ~ m ) ;
+    }
+  } else {
+    /* not truncated before it is known not to be the source */
+    ofd = open ( dst, O_WRONLY | O_CREAT | O_CLOEXEC | O_NOCTTY, 00644 ) ;
+
+    if ( 0 <= ofd ) {
+      struct stat ost ;
+
+      if ( fstat ( ofd, & ost ) ) {
+        e = errno ;
+      } else if ( st . st_dev == ost . st_dev && st . st_ino == ost . st_ino ) {
+        e = EINVAL ;
+      } else if ( ftruncate ( ofd, 0 ) ) {
+        e = errno ;
+      }
+
+      if ( e ) {
+        CLOSEFD( ofd )
+        CLOSEFD( ifd )
+        errno = e ;
+        return -1 ;
+      }
+    }
+  }
+
+  if ( 0 <= ofd ) {
+    i = fcopy_fd ( ifd, ofd, & st, f ) ;
+    e = errno ;
+    if ( close ( ofd ) && 0 == i && EINTR != errno ) { i = -1 ; e = errno ; }
+
+    if ( tmp ) {
+      if ( 0 == i && rename ( tmp, dst ) ) { i = -1 ; e = errno ; }
+      if ( i ) { (void) unlink ( tmp ) ; }
+    }
+  } else {
+    e = errno ;
+  }
+
+  free ( tmp ) ;
+  CLOSEFD( ifd )
+  errno = e ;
+
+  return i ;
+}
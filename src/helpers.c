@@ -895,55 +895,13 @@ static FILE * tempfile ( void )
 #endif
 }
 
-/* copies data between two given file descriptors */
-static ssize_t fd_copy ( const int ifd, const int ofd, const size_t len )
+/* copy the contents of file src to file dst,
+ * f selects the metadata to copy (see "fcopy.c")
+ */
+static int copy_file ( const char * const src, const char * const dst,
+  const unsigned int f )
 {
-#if defined (OSLinux)
-  off_t off = 0 ;
-
-  return sendfile ( ofd, ifd, & off, len ) ;
-/*
-  loff_t offi, offo ;
-  offi = offo = 0 ;
-  return copy_file_range ( ifd, & offi, ofd, & offo, len, 0 ) ;
-*/
-#else
-  int s ;
-  char buf [ 501 ] = { 0 } ;
-
-  while ( 0 < ( s = read ( ifd, buf, sizeof ( buf ) - 1 ) ) ) {
-    (void) write ( ofd, buf, s ) ;
-  }
-
-  return s ;
-#endif
-}
-
-/* copy the contents of file src to file dst */
-static int copy_file ( const char * const src, const char * const dst )
-{
-  const int ifd = open ( src, O_RDONLY | O_CLOEXEC ) ;
-  const int ofd = open ( src, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 00644 ) ;
-
-  if ( 0 <= ifd && 0 <= ofd ) {
-    int i = -3 ;
-    struct stat st ;
-
-    if ( ( 0 == fstat ( ofd, & st ) ) && S_ISREG( st . st_mode )
-      && ( 0 == fstat ( ifd, & st ) ) && S_ISREG( st . st_mode ) )
-    {
-      off_t o = lseek ( ifd, 0, SEEK_END ) ;
-      o = ( o < st . st_size ) ? st . st_size : o ;
-      (void) lseek ( ifd, 0, SEEK_SET ) ;
-      i = ( 0 < o ) ? fd_copy ( ifd, ofd, o ) : -5 ;
-    }
-
-    close_fd ( ifd ) ;
-    close_fd ( ofd ) ;
-    return i ;
-  }
-
-  return -1 ;
+  return fcopy_path ( src, dst, f ) ;
 }
 
 /* rename/move a given file from src to dst */
@@ -952,7 +910,8 @@ static int move_file ( const char * const src, const char * const dst )
   int i = rename ( src, dst ) ;
 
   if ( i && ( EXDEV == errno ) ) {
-    i = copy_file ( src, dst ) ;
+    /* keep the metadata and never leave a partial dst behind */
+    i = copy_file ( src, dst, FCOPY_ALL | FCOPY_ATOMIC ) ;
     i = ( 0 > i ) ? i : unlink ( src ) ;
   }
 
@@ -1008,10 +967,15 @@ static int mkpath ( mode_t m, char * const p, const size_t s )
   return -1 ;
 }
 
-/* recusrivly remove a given dir and its contents */
+/* recusrivly remove a given dir and its contents.
+ * on failure errno is set to the error of the first entry that could
+ * not be removed.
+ */
 static int rmr ( const int dirfd, const char * const path )
 {
-  struct stat st ;
+  int e = 0 ;
+  unsigned long n ;
+  rmtree_t rt ;
 
   if ( 0 == ( path && * path ) ) {
     errno = EINVAL ;
@@ -1022,52 +986,19 @@ static int rmr ( const int dirfd, const char * const path )
   } else if ( '.' == path [ 0 ] && '.' == path [ 1 ] && '\0' == path [ 2 ] ) {
     errno = ENOTEMPTY ;
     return -4 ;
-  } else if ( fstatat ( dirfd, path, & st, AT_SYMLINK_NOFOLLOW ) ) {
-    return -5 ;
-  } else if ( S_ISDIR( st . st_mode ) ) {
-    int i = unlinkat ( dirfd, path, AT_REMOVEDIR ) ;
-
-    if ( i && ( EEXIST == errno || ENOTEMPTY == errno ) ) {
-      const int fd = openat ( dirfd, path,
-        O_RDONLY | O_PATH | O_CLOEXEC | O_DIRECTORY | O_NOFOLLOW ) ;
-
-      if ( 0 > fd ) { return -6 ; }
-      else {
-        DIR * dp = fdopendir ( fd ) ;
-
-        if ( dp ) {
-          const char * str = NULL ;
-          struct dirent * dep = NULL ;
-
-          while ( NULL != ( dep = readdir ( dp ) ) ) {
-            str = dep -> d_name ;
-
-            if ( str && * str ) {
-              if ( '.' == str [ 0 ] && '\0' == str [ 1 ] ) {
-                continue ;
-              } else if ( '.' == str [ 0 ] && '.' == str [ 1 ] && '\0' == str [ 2 ] ) {
-                continue ;
-              }
-
-              i = rmr ( fd, str ) ? -7 : 0 ;
-            }
-          }
-
-          (void) closedir ( dp ) ;
-        }
-
-        (void) close_fd ( fd ) ;
-      }
+  }
 
-      return unlinkat ( dirfd, path, AT_REMOVEDIR ) ? -8 : i ;
-    }
+  rmtree_init ( & rt, 1, 0, 0 ) ;
+  n = rmtree ( dirfd, path, & rt ) ;
+  if ( n ) { e = rt . nfailed ? rt . failed [ 0 ] . err : EIO ; }
+  rmtree_free ( & rt ) ;
 
-    return i ;
-  } else {
-    return unlinkat ( dirfd, path, 0 ) ;
+  if ( n ) {
+    errno = e ;
+    return -7 ;
   }
 
-  return -9 ;
+  return 0 ;
 }
 
 /* remove a given file/path, calls rmr() for non emtpy dirs */
@@ -1333,150 +1264,316 @@ static int kill_all_sol ( const int sig )
 }
 #endif
 
-#if 0
-/* generic killall5 like function that kill(2)s/signals all running processes.
- * it does an exhaustive search for processes and kills ALL of them, EXCEPT;
- *	- itself
- *	- its parent process
+#if defined (OSLinux)
+static int sys_pidfd_open ( const pid_t pid, const unsigned int f )
+{
+#if defined (SYS_pidfd_open)
+  return syscall ( SYS_pidfd_open, pid, f ) ;
+#else
+  errno = ENOSYS ;
+  return -1 ;
+#endif
+}
+
+static int sys_pidfd_send_signal ( const int fd, const int sig )
+{
+#if defined (SYS_pidfd_send_signal)
+  return syscall ( SYS_pidfd_send_signal, fd, sig, NULL, 0 ) ;
+#else
+  errno = ENOSYS ;
+  return -1 ;
+#endif
+}
+
+/* writes a string to the file name relative to dirfd, e. g. a cgroup or
+ * sysfs control file
  */
-static void gen_kill_all ( const int s )
+static int write_str_at ( const int dirfd, const char * const name, const char * const s )
 {
-  if ( 0 < s && NSIG > s ) {
-    pid_t p ;
-    const pid_t mypid = getpid () ;
-    const pid_t ppid = getppid () ;
-    const pid_t m = sysconf ( _SC_CHILD_MAX ) ;
+  int i ;
+  const int fd = openat ( dirfd, name, O_WRONLY | O_CLOEXEC | O_NOCTTY ) ;
 
-    for ( p = 3 ; m >= p ; ++ p ) {
-      if ( mypid != p && ppid != p && 0 == kill ( p, 0 ) ) {
-        (void) kill ( p, s ) ;
-      }
+  if ( 0 > fd ) { return -1 ; }
+  i = ( (ssize_t) strlen ( s ) == write ( fd, s, strlen ( s ) ) ) ? 0 : -1 ;
+  CLOSEFD( fd )
+
+  return i ;
+}
+
+/* killall5 like shutdown kill engine.
+ * the victims are taken from one pass over /proc/<pid>/stat (session,
+ * kernel thread flag) or from the cgroup.procs files of the given
+ * cgroups, the whole pid range (up to pid_max) is only swept when
+ * /proc is not available. never signalled are: ourselves, our parent,
+ * pid 1, kernel threads, the omitted pids and (optionally) our own
+ * session.
+ * the signalled pids are collected, so the caller knows whom to wait for.
+ */
+
+/* PID_MAX_LIMIT of the kernel, used if pid_max can not be read */
+#define KILLALL_PID_MAX		( ( 4 < sizeof ( long ) ) ? 4 * 1024 * 1024 : 32768 )
+
+typedef struct {
+  int sig ;
+  /* signal through pidfds, no races with recycled pids */
+  char pidfd ;
+  /* spare the members of our own session */
+  char session ;
+  pid_t mypid ;
+  pid_t myppid ;
+  pid_t mysid ;
+  const pid_t * omit ;
+  size_t nomit ;
+  /* signalled processes */
+  pid_t * pids ;
+  size_t n ;
+  size_t cap ;
+  long errors ;
+} killall_t ;
+
+static void killall_init ( killall_t * const kt, const int sig )
+{
+  (void) memset ( kt, 0, sizeof ( killall_t ) ) ;
+  kt -> sig = sig ;
+  kt -> session = 1 ;
+  kt -> mypid = getpid () ;
+  kt -> myppid = getppid () ;
+  kt -> mysid = getsid ( 0 ) ;
+}
+
+static void killall_free ( killall_t * const kt )
+{
+  free ( kt -> pids ) ;
+  kt -> pids = NULL ;
+  kt -> n = kt -> cap = 0 ;
+}
+
+/* is pid one of the processes that must survive ? */
+static int killall_spared ( const killall_t * const kt, const pid_t pid )
+{
+  size_t i ;
+
+  if ( 2 > pid || kt -> mypid == pid || kt -> myppid == pid ) { return 1 ; }
+
+  for ( i = 0 ; kt -> nomit > i ; ++ i ) {
+    if ( pid == kt -> omit [ i ] ) { return 1 ; }
+  }
+
+  return 0 ;
+}
+
+static int killall_record ( killall_t * const kt, const pid_t pid )
+{
+  if ( kt -> cap <= kt -> n ) {
+    const size_t c = kt -> cap ? 2 * kt -> cap : 256 ;
+    pid_t * p = (pid_t *) realloc ( kt -> pids, c * sizeof ( pid_t ) ) ;
+
+    if ( NULL == p ) { return -1 ; }
+    kt -> pids = p ;
+    kt -> cap = c ;
+  }
+
+  kt -> pids [ kt -> n ++ ] = pid ;
+  return 0 ;
+}
+
+/* signals one process, the caller has already checked killall_spared() */
+static int killall_signal ( killall_t * const kt, const pid_t pid )
+{
+  int i = -1 ;
+
+  if ( kt -> pidfd ) {
+    const int fd = sys_pidfd_open ( pid, 0 ) ;
+
+    if ( 0 <= fd ) {
+      i = sys_pidfd_send_signal ( fd, kt -> sig ) ;
+      CLOSEFD( fd )
+    } else if ( ENOSYS == errno ) {
+      i = kill ( pid, kt -> sig ) ;
     }
+  } else {
+    i = kill ( pid, kt -> sig ) ;
+  }
+
+  if ( i ) {
+    /* it has exited in the meantime */
+    if ( ESRCH != errno ) { ++ kt -> errors ; }
+    return -1 ;
+  }
+
+  return killall_record ( kt, pid ) ;
+}
+
+static int killall_ptab_cb ( void * ctx, const ptab_proc_t * const pp )
+{
+  killall_t * const kt = (killall_t *) ctx ;
+
+  if ( 1 > pp -> sid || killall_spared ( kt, pp -> pid ) ) { return 0 ; }
+  if ( kt -> session && kt -> mysid == pp -> sid ) { return 0 ; }
+  (void) killall_signal ( kt, pp -> pid ) ;
+
+  return 0 ;
+}
+
+/* returns /proc/sys/kernel/pid_max or KILLALL_PID_MAX */
+static pid_t killall_pid_max ( void )
+{
+  long m = 0 ;
+  FILE * const fp = fopen ( "/proc/sys/kernel/pid_max", "r" ) ;
+
+  if ( fp ) {
+    if ( 1 != fscanf ( fp, "%ld", & m ) ) { m = 0 ; }
+    (void) fclose ( fp ) ;
   }
+
+  return ( 1 < m && KILLALL_PID_MAX >= m ) ? (pid_t) m : KILLALL_PID_MAX ;
 }
 
-/* kills all processes we are allowed to (except our own (P)PID and
- * possibly SID and kernel processes/threads)
- * regardless of /proc being mounted (Linux) or access to kvm
- * (BSD, SunOS, AIX)
+/* the fallback without /proc */
+static void killall_sweep ( killall_t * const kt )
+{
+  pid_t p, s ;
+  const pid_t max = killall_pid_max () ;
+
+  for ( p = 2 ; max > p ; ++ p ) {
+    if ( killall_spared ( kt, p ) ) { continue ; }
+    /* fails for unused pids */
+    s = getsid ( p ) ;
+    if ( 1 > s || ( kt -> session && kt -> mysid == s ) ) { continue ; }
+    (void) killall_signal ( kt, p ) ;
+  }
+}
+
+/* walks a cgroup and its descendants. the members are signalled if send
+ * is set and only recorded otherwise. returns the number of members that
+ * have to be spared.
  */
-static int kill_all_procs ( const int sig, const char pg,
-  const char pa, const char ses )
+static long killall_cgroup_procs ( killall_t * const kt, const int cgfd, const int send )
 {
-  if ( 0 <= sig && NSIG > sig ) {
-    int i, j, m, r ;
-    const int mypid = getpid () ;
-    const int myppid = getppid () ;
-    const int mysid = getsid ( 0 ) ;
-    const int mypgid = getpgrp () ;
-
-    r = 0 ;
-    m = sysconf ( _SC_CHILD_MAX ) ;
-    m = ( 1 < m ) ? m : 1 << 14 ;
-#if defined (OSLinux)
-    i = 3 ;
-#else
-    i = 2 ;
-#endif
+  int fd ;
+  long pid, n = 0 ;
+  FILE * fp ;
+  DIR * dirp ;
+  struct dirent * de ;
 
-    while ( i <= m && 0 == kill ( i, 0 ) ) {
-      if ( 1 > sig ) { ++ r ; goto inc ; }
-      else if ( 2 > i || mypid == i ) { goto inc ; }
-      else if ( pa && ( myppid == i ) ) { goto inc ; }
-      else if ( ses ) {
-        j = getsid ( i ) ;
-        if ( 1 > j || mysid == j ) { goto inc ; }
-      }
+  fd = openat ( cgfd, "cgroup.procs", O_RDONLY | O_CLOEXEC | O_NOCTTY ) ;
+
+  if ( 0 <= fd ) {
+    fp = fdopen ( fd, "r" ) ;
 
-      /* do not signal kernel processes/threads ( (P)PID == 2) on Linux */
-      j = getpgid ( i ) ;
-      if ( 0 < j && 1 < i && mypid != i ) {
-        if ( 0 == kill ( i, sig ) ) { ++ r ; }
-        if ( pg && ( 1 < j ) && ( mypgid != j )
-          && ( 0 == kill ( - i, sig ) ) )
-        { ++ r ; }
+    if ( NULL == fp ) {
+      CLOSEFD( fd )
+    } else {
+      while ( 1 == fscanf ( fp, "%ld", & pid ) ) {
+        if ( killall_spared ( kt, pid ) ) { ++ n ; }
+        else if ( send ) { (void) killall_signal ( kt, pid ) ; }
+        else { (void) killall_record ( kt, pid ) ; }
       }
 
-inc :
-      ++ i ;
+      (void) fclose ( fp ) ;
     }
+  }
 
-    return r ;
+  fd = dup ( cgfd ) ;
+  if ( 0 > fd ) { return n ; }
+  dirp = fdopendir ( fd ) ;
+
+  if ( NULL == dirp ) {
+    CLOSEFD( fd )
+    return n ;
   }
 
-  return -1 ;
+  while ( NULL != ( de = readdir ( dirp ) ) ) {
+    if ( DT_DIR != de -> d_type || '.' == de -> d_name [ 0 ] ) { continue ; }
+
+    fd = openat ( cgfd, de -> d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOCTTY ) ;
+
+    if ( 0 <= fd ) {
+      n += killall_cgroup_procs ( kt, fd, send ) ;
+      CLOSEFD( fd )
+    }
+  }
+
+  (void) closedir ( dirp ) ;
+
+  return n ;
 }
 
-/* killall5 like function that kills all running processes
- * execpt our own, our parent process and all members of session 1.
- * send a signal to all processes except process #1 and the processes in
- * our own session.
- * this function uses a very simple approach. it does an
- * exhaustive search for processes and kills ALL of them, EXCEPT;
- *	- itself
- *	- its parent process (usually a shell)
- *	- processes w/ session id of 1 or lower (init, kernel threads)
- *
- * the benefits of doing an exhaustive search for processes is that
- * there is no need for the /proc fs (or similar) to be mounted.
+/* signals the members of the cgroup cgfd refers to and its descendants.
+ * SIGKILL is sent with a single write to cgroup.kill when nobody has to
+ * be spared, other signals are sent while the cgroup is frozen, so
+ * nothing can fork behind our back.
  */
-static void killall5 ( const int sig )
+static void killall_cgroup_fd ( killall_t * const kt, const int cgfd )
 {
-  register int i, s ;
-#if defined (OSLinux)
-  /* needed to open /proc and read its contents */
-  DIR * dirp ;
-  struct dirent * ent ;
-#endif
-  const pid_t mypid = getpid () ;
-  const pid_t ppid = getppid () ;
-  const pid_t mysid = getsid ( 0 ) ;
+  int frozen = 0 ;
+  long spared ;
+  const size_t n0 = kt -> n ;
 
-  if ( 1 > sig || NSIG <= sig ) { return ; }
+  spared = killall_cgroup_procs ( kt, cgfd, 0 ) ;
 
-  /* kill ( -1, SIGSTOP ) ; */
-#if defined (OSLinux)
-  dirp = opendir ( "/proc" ) ;
+  if ( SIGKILL == kt -> sig && 0 == spared && 0 == write_str_at ( cgfd, "cgroup.kill", "1" ) ) {
+    return ;
+  }
 
-  if ( dirp ) {
-    register char sig_sent = 0 ;
+  /* forget the recorded members, they are recorded again when signalled */
+  kt -> n = n0 ;
 
-    while ( ( ent = readdir ( dirp ) ) )
-    {
-      i = atoi ( ent -> d_name ) ;
-      if ( 1 < i ) {
-        /* be careful about getsid when using PID arguments not
-         * belonging to our own session
-         */
-        s = getsid ( i ) ;
-        if ( 0 < s && mysid != s && mypid != i && ppid != i )
-        {
-          sig_sent = ( 0 == kill ( i, sig ) ) ? 3 : sig_sent ;
-        }
-      }
-    }
+  /* do not freeze ourselves (or whoever is spared) */
+  if ( 0 < kt -> sig && 0 == spared ) {
+    frozen = 0 == write_str_at ( cgfd, "cgroup.freeze", "1" ) ;
+  }
+
+  (void) killall_cgroup_procs ( kt, cgfd, 1 ) ;
+  if ( frozen ) { (void) write_str_at ( cgfd, "cgroup.freeze", "0" ) ; }
+}
+
+/* the same for a cgroup v2 path */
+static int killall_cgroup ( killall_t * const kt, const char * const cg )
+{
+  int cgfd ;
+  char path [ PATH_MAX + 1 ] ;
+
+  if ( 0 > snprintf ( path, sizeof ( path ), "/sys/fs/cgroup/%s", cg ) ) { return -1 ; }
+  cgfd = open ( path, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOCTTY ) ;
+  if ( 0 > cgfd ) { return -1 ; }
+
+  killall_cgroup_fd ( kt, cgfd ) ;
+  CLOSEFD( cgfd )
+
+  return 0 ;
+}
 
-    i = closedir ( dirp ) ;
-    if ( sig_sent ) { return ; }
+/* signals the processes of the given cgroups or, if there are none, all
+ * processes. returns the number of signalled processes or -1.
+ */
+static long killall ( killall_t * const kt, const char * const * const cgroups, const size_t ncg )
+{
+  size_t i ;
+  ptab_t pt ;
+
+  if ( 0 > kt -> sig || NSIG <= kt -> sig ) {
+    errno = EINVAL ;
+    return -1 ;
   }
 
-  /* this is the Linux solution without relying on /proc being mounted.
-   * is 65536 high enough ? pid_t is int on Linux.
-   */
-  for ( i = 2 ; 65536 > i ; ++ i )
-  {
-    /* again: be careful about getsid */
-    s = getsid ( i ) ;
-    if ( 1 < s && mysid != s && mypid != i && ppid != i ) {
-      (void) kill ( i, sig ) ;
+  if ( ncg ) {
+    for ( i = 0 ; ncg > i ; ++ i ) {
+      if ( killall_cgroup ( kt, cgroups [ i ] ) ) { ++ kt -> errors ; }
     }
+
+    return kt -> n ;
   }
 
-  /* use kvm on the BSDs and Solaris */
-#elif defined (OSbsd)
-#elif defined (OSsolaris)
-#endif
-  /* kill ( -1, SIGCONT ) ; */
+  ptab_init ( & pt ) ;
+
+  if ( 0 > ptab_scan ( & pt, killall_ptab_cb, kt ) ) {
+    killall_sweep ( kt ) ;
+  }
+
+  free ( pt . buf ) ;
+
+  return kt -> n ;
 }
 #endif
 
@@ -1512,15 +1609,18 @@ static void set_ctty ( const char * path, const int steal )
 }
 */
 
-/* searches a given pattern in a file (like grep -q) */
-static int file_regex ( const char * const file, const char * const pat )
+/* searches a compiled pattern in a file (like grep -q), so callers that
+ * check many files compile the pattern only once
+ */
+static int file_regexec ( const char * const file, const regex_t * const re )
 {
-  int r = 0, res = 0 ;
+  int res = 0 ;
+  size_t s, cap = 0 ;
+  ssize_t n ;
   FILE * fp = NULL ;
-  regex_t re ;
-  char buf [ 128 ] = { 0 } ;
+  char * buf = NULL ;
 
-  if ( 0 == ( file && pat && * file && * pat ) ) {
+  if ( 0 == ( file && re && * file ) ) {
     return 0 ;
   }
 
@@ -1529,44 +1629,51 @@ static int file_regex ( const char * const file, const char * const pat )
     return 0 ;
   }
 
+  /* whole lines, so matches are not split between reads */
+  while ( 0 < ( n = getline ( & buf, & cap, fp ) ) ) {
+    /* some /proc files have \0 separated content so we have to
+     * loop through all strings of the line */
+    for ( s = 0 ; n > s ; s += 1 + strlen ( buf + s ) ) {
+      if ( '\0' == buf [ s ] ) { continue ; }
+
+      if ( 0 == regexec ( re, buf + s, 0, NULL, 0 ) ) {
+        res = 1 ;
+        goto found ;
+      }
+    }
+  }
+
+found :
+  free ( buf ) ;
+  (void) fclose ( fp ) ;
+
+  return res ;
+}
+
+/* searches a given pattern in a file (like grep -q) */
+static int file_regex ( const char * const file, const char * const pat )
+{
+  int r = 0 ;
+  regex_t re ;
+  char buf [ 128 ] = { 0 } ;
+
+  if ( 0 == ( file && pat && * file && * pat ) ) {
+    return 0 ;
+  }
+
   r = regcomp ( & re, pat, REG_NOSUB | REG_EXTENDED ) ;
   if ( r ) {
     /* pattern failed to compile */
-    (void) fclose ( fp ) ;
     (void) regerror ( r, & re, buf, 127 ) ;
-    regfree ( & re ) ;
     (void) fprintf ( stderr, "error compiling regex pattern \"%s\" : %s\n",
       pat, buf ) ;
     return 0 ;
-  } else {
-    size_t s ;
-
-    while ( fgets ( buf, 127, fp ) ) {
-      /* some /proc files have \0 separated content so we have to
-       * loop through the whole buffer buf */
-      s = 0 ;
-      do {
-        if ( 0 == regexec ( & re, buf + s, 0, NULL, 0 ) ) {
-          res = 1 ;
-          goto found ;
-        }
-
-        s += 1 + strlen ( buf ) ;
-        /* len is the size of allocated buffer and we don't
-         * want call regexec BUFSIZE times. find next str */
-        while ( ( 126 > s ) && '\0' == buf [ s ] ) { ++ s ; }
-
-      } while ( 126 > s ) ;
-    }
   }
 
-  res = 0 ;
-
-found :
-  (void) fclose ( fp ) ;
+  r = file_regexec ( file, & re ) ;
   regfree ( & re ) ;
 
-  return res ;
+  return r ;
 }
 
 /* requires /proc to be mounted */
@@ -634,9 +634,290 @@ static int uevent_socket ( unsigned int s )
   return fd ;
 }
 
+/* max number of uevent match rules */
+#define UEVENT_MAX_RULES	16
+/* the in kernel filter looks for the end of the "ACTION@DEVPATH"
+ * header within this many bytes (must be a multiple of 8)
+ */
+#define UEVENT_BPF_SCAN	256
+
+/* uevent match rule, a NULL field matches everything */
+typedef struct {
+  const char * subsys ;
+  const char * action ;
+} uevent_rule_t ;
+
+/* collect an array of { subsystem = "...", action = "..." } rules from
+ * the table at stack index i. the strings stay referenced by the table.
+ */
+static int uevent_get_rules ( lua_State * const L, const int i,
+  uevent_rule_t * const r )
+{
+  int j, n = 0 ;
+
+  if ( 0 == lua_istable ( L, i ) ) { return 0 ; }
+
+  for ( j = 1 ; UEVENT_MAX_RULES >= j ; ++ j ) {
+    if ( LUA_TTABLE != lua_rawgeti ( L, i, j ) ) {
+      lua_pop ( L, 1 ) ;
+      break ;
+    }
+
+    (void) lua_getfield ( L, -1, "subsystem" ) ;
+    r [ n ] . subsys = lua_tostring ( L, -1 ) ;
+    (void) lua_getfield ( L, -2, "action" ) ;
+    r [ n ] . action = lua_tostring ( L, -1 ) ;
+    lua_pop ( L, 3 ) ;
+    ++ n ;
+  }
+
+  return n ;
+}
+
+/* check if any of the given rules matches an event */
+static int uevent_rules_match ( const uevent_rule_t * const r, const int n,
+  const char * const action, const char * const subsys )
+{
+  int i ;
+
+  for ( i = 0 ; n > i ; ++ i ) {
+    if ( r [ i ] . action && ( NULL == action || strcmp ( action, r [ i ] . action ) ) )
+    { continue ; }
+    if ( r [ i ] . subsys && ( NULL == subsys || strcmp ( subsys, r [ i ] . subsys ) ) )
+    { continue ; }
+    return 1 ;
+  }
+
+  return 0 ;
+}
+
+#define BPF_STMT_AT(f, pc, c, v) \
+  do { f [ pc ] . code = (c) ; f [ pc ] . jt = 0 ; f [ pc ] . jf = 0 ; \
+    f [ pc ] . k = (v) ; ++ pc ; } while ( 0 )
+#define BPF_JUMP_AT(f, pc, c, v, t, e) \
+  do { f [ pc ] . code = (c) ; f [ pc ] . jt = (t) ; f [ pc ] . jf = (e) ; \
+    f [ pc ] . k = (v) ; ++ pc ; } while ( 0 )
+
+/* number of instructions needed by bpf_cmp_str () for n bytes */
+static unsigned int bpf_cmp_len ( const size_t n )
+{
+  return 3 * ( n / 4 + ( 2 <= n % 4 ) + ( n % 2 ) ) ;
+}
+
+/* emit code that jumps to fail unless the packet has at least n bytes
+ * from offset X (if ind is set) or 0 on, a load past the end of the
+ * packet would end the program and drop the packet
+ */
+static unsigned int bpf_len_guard ( struct sock_filter * const f,
+  unsigned int pc, const int ind, const unsigned int n, const unsigned int fail )
+{
+  BPF_STMT_AT( f, pc, BPF_LD | BPF_W | BPF_LEN, 0 ) ;
+  if ( ind ) { BPF_STMT_AT( f, pc, BPF_ALU | BPF_SUB | BPF_X, 0 ) ; }
+  BPF_JUMP_AT( f, pc, BPF_JMP | BPF_JGE | BPF_K, n, 1, 0 ) ;
+  BPF_STMT_AT( f, pc, BPF_JMP | BPF_JA, fail - pc - 1 ) ;
+
+  return pc ;
+}
+
+/* number of instructions needed by bpf_len_guard () */
+#define BPF_GUARD_LEN(ind)	( 3 + ( (ind) ? 1 : 0 ) )
+
+/* emit code that compares n bytes of s with the packet at offset
+ * off (relative to X if ind is set) and jumps to fail on mismatch
+ */
+static unsigned int bpf_cmp_str ( struct sock_filter * const f,
+  unsigned int pc, const int ind, unsigned int off,
+  const unsigned char * s, size_t n, const unsigned int fail )
+{
+  const unsigned int m = ind ? BPF_IND : BPF_ABS ;
+
+  while ( n ) {
+    unsigned int v, sz ;
+
+    if ( 4 <= n ) {
+      v = ( s [ 0 ] << 24 ) | ( s [ 1 ] << 16 ) | ( s [ 2 ] << 8 ) | s [ 3 ] ;
+      sz = BPF_W ;
+      n -= 4 ; s += 4 ; off += 4 ;
+    } else if ( 2 <= n ) {
+      v = ( s [ 0 ] << 8 ) | s [ 1 ] ;
+      sz = BPF_H ;
+      n -= 2 ; s += 2 ; off += 2 ;
+    } else {
+      v = s [ 0 ] ;
+      sz = BPF_B ;
+      n -= 1 ; s += 1 ; off += 1 ;
+    }
+
+    BPF_STMT_AT( f, pc, BPF_LD | sz | m, off - ( BPF_W == sz ? 4 : BPF_H == sz ? 2 : 1 ) ) ;
+    BPF_JUMP_AT( f, pc, BPF_JMP | BPF_JEQ | BPF_K, v, 1, 0 ) ;
+    BPF_STMT_AT( f, pc, BPF_JMP | BPF_JA, fail - pc - 1 ) ;
+  }
+
+  return pc ;
+}
+
+/* compile the given rules into a classic BPF program and attach it
+ * to a uevent socket, so that the kernel drops events nobody asked for.
+ *
+ * kernel uevents look like "ACTION@DEVPATH\0ACTION=..\0DEVPATH=..\0
+ * SUBSYSTEM=..\0...", with ACTION, DEVPATH and SUBSYSTEM always coming
+ * first. the action is matched at the start of the header, the
+ * SUBSYSTEM value is located from the length of the header.
+ * events that do not have this layout are passed to user space.
+ * every compare is preceded by a check of the packet length, so a
+ * short packet only fails the rule at hand. actions and subsystems
+ * must be shorter than the scanned header window.
+ */
+static int uevent_attach_filter ( const int fd, const uevent_rule_t * const r,
+  const int n )
+{
+  int i ;
+  unsigned int c, j, pc = 0, found, subs, size = 0 ;
+  struct sock_fprog prog ;
+  struct sock_filter * f = NULL ;
+  char tmp [ UEVENT_BPF_SCAN ] ;
+
+  /* size of the program */
+  size = 5 + 53 * ( UEVENT_BPF_SCAN / 8 ) + 1 + 4 + BPF_GUARD_LEN( 1 )
+    + bpf_cmp_len ( 10 ) + 2 + 1 ;
+  for ( i = 0 ; n > i ; ++ i ) {
+    if ( ( r [ i ] . action && sizeof ( tmp ) - 1 <= strlen ( r [ i ] . action ) )
+      || ( r [ i ] . subsys && sizeof ( tmp ) - 1 <= strlen ( r [ i ] . subsys ) ) )
+    {
+      errno = EINVAL ;
+      return -1 ;
+    }
+
+    if ( r [ i ] . action ) {
+      size += BPF_GUARD_LEN( 0 ) + bpf_cmp_len ( 1 + strlen ( r [ i ] . action ) ) ;
+    }
+
+    if ( r [ i ] . subsys ) {
+      size += BPF_GUARD_LEN( 1 ) + bpf_cmp_len ( 1 + strlen ( r [ i ] . subsys ) ) ;
+    }
+
+    ++ size ;
+  }
+
+  if ( BPF_MAXINSNS < size ) {
+    errno = E2BIG ;
+    return -1 ;
+  }
+
+  f = (struct sock_filter *) calloc ( size, sizeof ( struct sock_filter ) ) ;
+  if ( NULL == f ) { return -1 ; }
+
+  /* drop messages from libudev */
+  BPF_STMT_AT( f, pc, BPF_LD | BPF_W | BPF_ABS, 0 ) ;
+  BPF_JUMP_AT( f, pc, BPF_JMP | BPF_JEQ | BPF_K, 0x6c696275, 0, 3 ) ;
+  BPF_STMT_AT( f, pc, BPF_LD | BPF_W | BPF_ABS, 4 ) ;
+  BPF_JUMP_AT( f, pc, BPF_JMP | BPF_JEQ | BPF_K, 0x64657600, 0, 1 ) ;
+  BPF_STMT_AT( f, pc, BPF_RET | BPF_K, 0 ) ;
+
+  /* find the end of the header, 8 bytes per round.
+   * X is left pointing behind the terminating NUL.
+   */
+  found = pc + 53 * ( UEVENT_BPF_SCAN / 8 ) + 1 ;
+
+  for ( c = 0 ; UEVENT_BPF_SCAN / 8 > c ; ++ c ) {
+    if ( 0 == c ) { BPF_STMT_AT( f, pc, BPF_LDX | BPF_W | BPF_IMM, 0 ) ; }
+    else { BPF_STMT_AT( f, pc, BPF_JMP | BPF_JA, 0 ) ; }
+
+    for ( j = 0 ; 8 > j ; ++ j ) {
+      BPF_STMT_AT( f, pc, BPF_LD | BPF_B | BPF_IND, j ) ;
+      BPF_JUMP_AT( f, pc, BPF_JMP | BPF_JEQ | BPF_K, 0, 18 + 2 * j, 0 ) ;
+    }
+
+    BPF_STMT_AT( f, pc, BPF_MISC | BPF_TXA, 0 ) ;
+    BPF_STMT_AT( f, pc, BPF_ALU | BPF_ADD | BPF_K, 8 ) ;
+    BPF_STMT_AT( f, pc, BPF_MISC | BPF_TAX, 0 ) ;
+    BPF_STMT_AT( f, pc, BPF_JMP | BPF_JA, 32 ) ;
+
+    for ( j = 0 ; 8 > j ; ++ j ) {
+      BPF_STMT_AT( f, pc, BPF_MISC | BPF_TXA, 0 ) ;
+      BPF_STMT_AT( f, pc, BPF_ALU | BPF_ADD | BPF_K, 1 + j ) ;
+      BPF_STMT_AT( f, pc, BPF_MISC | BPF_TAX, 0 ) ;
+      BPF_STMT_AT( f, pc, BPF_JMP | BPF_JA, found - pc - 1 ) ;
+    }
+  }
+
+  /* header too long, let user space decide */
+  BPF_STMT_AT( f, pc, BPF_RET | BPF_K, 0xffffffff ) ;
+
+  /* X = 2 * X + 15 is the offset of "SUBSYSTEM=" */
+  BPF_STMT_AT( f, pc, BPF_MISC | BPF_TXA, 0 ) ;
+  BPF_STMT_AT( f, pc, BPF_ALU | BPF_LSH | BPF_K, 1 ) ;
+  BPF_STMT_AT( f, pc, BPF_ALU | BPF_ADD | BPF_K, 15 ) ;
+  BPF_STMT_AT( f, pc, BPF_MISC | BPF_TAX, 0 ) ;
+
+  /* unexpected layout, let user space decide */
+  subs = pc + BPF_GUARD_LEN( 1 ) + bpf_cmp_len ( 10 ) + 1 ;
+  pc = bpf_len_guard ( f, pc, 1, 10, subs ) ;
+  pc = bpf_cmp_str ( f, pc, 1, 0, (const unsigned char *) "SUBSYSTEM=", 10, subs ) ;
+  BPF_JUMP_AT( f, pc, BPF_JMP | BPF_JA, 1, 0, 0 ) ;
+  BPF_STMT_AT( f, pc, BPF_RET | BPF_K, 0xffffffff ) ;
+
+  /* one block per rule, accept the event if any rule matches */
+  for ( i = 0 ; n > i ; ++ i ) {
+    unsigned int next = pc + 1 ;
+    size_t l = 0 ;
+
+    if ( r [ i ] . action ) {
+      next += BPF_GUARD_LEN( 0 ) + bpf_cmp_len ( 1 + strlen ( r [ i ] . action ) ) ;
+    }
+
+    if ( r [ i ] . subsys ) {
+      next += BPF_GUARD_LEN( 1 ) + bpf_cmp_len ( 1 + strlen ( r [ i ] . subsys ) ) ;
+    }
+
+    if ( r [ i ] . action ) {
+      l = strlen ( r [ i ] . action ) ;
+      (void) memcpy ( tmp, r [ i ] . action, l ) ;
+      tmp [ l ++ ] = '@' ;
+      pc = bpf_len_guard ( f, pc, 0, l, next ) ;
+      pc = bpf_cmp_str ( f, pc, 0, 0, (const unsigned char *) tmp, l, next ) ;
+    }
+
+    if ( r [ i ] . subsys ) {
+      l = 1 + strlen ( r [ i ] . subsys ) ;
+      pc = bpf_len_guard ( f, pc, 1, 10 + l, next ) ;
+      pc = bpf_cmp_str ( f, pc, 1, 10, (const unsigned char *) r [ i ] . subsys,
+        l, next ) ;
+    }
+
+    BPF_STMT_AT( f, pc, BPF_RET | BPF_K, 0xffffffff ) ;
+  }
+
+  /* no rule matched */
+  BPF_STMT_AT( f, pc, BPF_RET | BPF_K, 0 ) ;
+
+  prog . len = pc ;
+  prog . filter = f ;
+  i = setsockopt ( fd, SOL_SOCKET, SO_ATTACH_FILTER, & prog, sizeof ( prog ) ) ;
+
+  {
+    const int e = errno ;
+    free ( f ) ;
+    errno = e ;
+  }
+
+  return i ;
+}
+
+/* create a uevent socket
+ * arg 1: optional receive buffer size
+ * arg 2: optional array of { subsystem = "...", action = "..." } rules.
+ *        only events matching one of them are delivered. the rules are
+ *        compiled into a socket filter, so uninteresting events are
+ *        dropped by the kernel.
+ * returns the socket fd and a boolean telling if the filter could be
+ * attached. if not, pass the same rules to read_uevent () instead.
+ */
 static int Luevent_socket ( lua_State * L )
 {
+  int fd, n ;
   unsigned int s = 0 ;
+  uevent_rule_t r [ UEVENT_MAX_RULES ] ;
 
   if ( geteuid () || getuid () ) {
     return luaL_error ( L, "must be super user" ) ;
@@ -644,79 +925,212 @@ static int Luevent_socket ( lua_State * L )
 
   s = luaL_optinteger ( L, 1, 0 ) ;
   s = ( 4095 < s ) ? s : 65536 ;
-  return res_lt ( L, 0, uevent_socket ( s ) ) ;
+  n = uevent_get_rules ( L, 2, r ) ;
+  fd = uevent_socket ( s ) ;
+
+  if ( 0 > fd ) {
+    return res_lt ( L, 0, fd ) ;
+  }
+
+  lua_pushinteger ( L, fd ) ;
+  lua_pushboolean ( L, 0 < n && 0 == uevent_attach_filter ( fd, r, n ) ) ;
+  return 2 ;
 }
 
-/* read kernel uevents */
-static int Lread_uevent ( lua_State * L )
-{
-  const int sd = luaL_checkinteger ( L, 1 ) ;
+/* number of datagrams fetched per recvmmsg(2) call and max size of each */
+#define UEVENT_BATCH	32
+#define UEVENT_MSG_SIZE	( 8 * 1024 )
+#define UEVENT_MAX_FILTER	16
 
-  /*
-  if ( geteuid () || getuid () ) {
-    return luaL_error ( L, "must be super user" ) ;
-  }
-  */
+/* receive buffer for uevents, shared by all reads.
+ * in many cases, a system sits for *days* waiting
+ * for a new uevent notification to come in.
+ * the buffer is mmap(2)ed lazily, so it is not allocated
+ * until the first read.
+ */
+static char * uevent_buf = NULL ;
 
-  if ( 0 > sd ) {
-    return luaL_argerror ( L, 1, "invalid fd" ) ;
-  } else {
-    ssize_t r = 0 ;
-    char buf [ 1 + ( 4 * 1024 ) ] = { 0 } ;
+/* returns the value of a given key in a uevent payload or NULL */
+static const char * uevent_get ( const char * p, const char * const e,
+  const char * const key, const size_t kl )
+{
+  while ( p < e ) {
+    const size_t n = strnlen ( p, e - p ) ;
+
+    if ( n > kl && '=' == p [ kl ] && 0 == memcmp ( p, key, kl ) ) {
+      return p + kl + 1 ;
+    }
 
-    do {
-      r = read ( sd, buf, sizeof ( buf ) - 1 ) ;
-    } while ( 0 > r && EINTR == errno ) ;
+    p += 1 + n ;
   }
 
-  return 0 ;
+  return NULL ;
 }
 
-#define BUF_SIZE	( 16 * 1024 )
+/* push the KEY=VALUE pairs of a uevent payload as a table */
+static void uevent_push ( lua_State * const L, const char * p,
+  const char * const e )
+{
+  lua_createtable ( L, 0, 8 ) ;
+
+  while ( p < e ) {
+    const size_t n = strnlen ( p, e - p ) ;
+    const char * eq = (const char *) memchr ( p, '=', n ) ;
+
+    if ( eq && eq > p ) {
+      (void) lua_pushlstring ( L, p, eq - p ) ;
+      (void) lua_pushlstring ( L, eq + 1, n - ( eq - p ) - 1 ) ;
+      lua_rawset ( L, -3 ) ;
+    }
 
-static int Lread_mmap_uevent ( lua_State * L )
+    p += 1 + n ;
+  }
+}
+
+/* read kernel uevents
+ * arg 1: uevent socket fd (from uevent_socket ())
+ * arg 2: optional subsystem name, array of subsystem names or an
+ *        options table { subsystem = ..., rules = ..., nonblock = true }
+ *        where rules is an array of { subsystem = ..., action = ... }
+ *        match rules as taken by uevent_socket ()
+ * drains up to UEVENT_BATCH datagrams with a single recvmmsg(2) call
+ * and returns the number of events and an array of tables holding
+ * their KEY=VALUE pairs (ACTION, DEVPATH, SUBSYSTEM, SEQNUM, ...).
+ * messages from user space (e. g. libudev) are dropped.
+ */
+static int Lread_uevent ( lua_State * L )
 {
+  int i, j, k, nf = 0, nb = 0, nr = 0 ;
+  const char * flt [ UEVENT_MAX_FILTER ] ;
+  uevent_rule_t r [ UEVENT_MAX_RULES ] ;
+  struct mmsghdr mm [ UEVENT_BATCH ] ;
+  struct iovec iov [ UEVENT_BATCH ] ;
+  struct sockaddr_nl sa [ UEVENT_BATCH ] ;
   const int sd = luaL_checkinteger ( L, 1 ) ;
 
   if ( 0 > sd ) {
     return luaL_argerror ( L, 1, "invalid fd" ) ;
+  }
+
+  /* collect the match rules (index 3) and the subsystem filter (index 4) */
+  lua_settop ( L, 2 ) ;
+
+  if ( lua_istable ( L, 2 ) ) {
+    (void) lua_getfield ( L, 2, "nonblock" ) ;
+    nb = lua_toboolean ( L, -1 ) ;
+    lua_pop ( L, 1 ) ;
+    (void) lua_getfield ( L, 2, "rules" ) ;
+    nr = uevent_get_rules ( L, 3, r ) ;
+    (void) lua_getfield ( L, 2, "subsystem" ) ;
+
+    /* a plain array of subsystem names */
+    if ( lua_isnil ( L, 3 ) && lua_isnil ( L, 4 ) ) {
+      lua_pushvalue ( L, 2 ) ;
+      lua_replace ( L, 4 ) ;
+    }
   } else {
-    int i ;
-    ssize_t r = 0 ;
-    char * ptr = NULL ;
-
-   /* in many cases, a system sits for *days* waiting
-    * for a new uevent notification to come in.
-    * we use a fresh mmap so that the buffer is not allocated
-    * until the kernel actually starts filling it.
-    */
-    ptr = mmap ( NULL, BUF_SIZE,
+    lua_pushnil ( L ) ;
+    lua_pushvalue ( L, 2 ) ;
+  }
+
+  if ( lua_isstring ( L, 4 ) ) {
+    flt [ nf ++ ] = lua_tostring ( L, 4 ) ;
+  } else if ( lua_istable ( L, 4 ) ) {
+    for ( i = 1 ; UEVENT_MAX_FILTER >= i ; ++ i ) {
+      if ( LUA_TSTRING != lua_rawgeti ( L, 4, i ) ) {
+        lua_pop ( L, 1 ) ;
+        break ;
+      }
+
+      /* the string stays referenced by the filter table */
+      flt [ nf ++ ] = lua_tostring ( L, -1 ) ;
+      lua_pop ( L, 1 ) ;
+    }
+  }
+
+  if ( NULL == uevent_buf ) {
+    uevent_buf = (char *) mmap ( NULL, UEVENT_BATCH * UEVENT_MSG_SIZE,
       PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 ) ;
 
-    if ( MAP_FAILED == ptr ) {
-      i = errno ;
-      lua_pushinteger ( L, -1 ) ;
-      lua_pushinteger ( L, i ) ;
+    if ( MAP_FAILED == uevent_buf ) {
+      uevent_buf = NULL ;
+      return res_nil ( L ) ;
+    }
+  }
+
+  (void) memset ( mm, 0, sizeof ( mm ) ) ;
+
+  for ( i = 0 ; UEVENT_BATCH > i ; ++ i ) {
+    iov [ i ] . iov_base = uevent_buf + i * UEVENT_MSG_SIZE ;
+    iov [ i ] . iov_len = UEVENT_MSG_SIZE - 1 ;
+    mm [ i ] . msg_hdr . msg_iov = iov + i ;
+    mm [ i ] . msg_hdr . msg_iovlen = 1 ;
+    mm [ i ] . msg_hdr . msg_name = sa + i ;
+    mm [ i ] . msg_hdr . msg_namelen = sizeof ( struct sockaddr_nl ) ;
+  }
+
+  /* block until the first datagram arrives (unless nonblock is set),
+   * then take whatever else is queued without blocking
+   */
+  do {
+    j = recvmmsg ( sd, mm, UEVENT_BATCH,
+      nb ? MSG_DONTWAIT : MSG_WAITFORONE, NULL ) ;
+  } while ( 0 > j && EINTR == errno ) ;
+
+  if ( 0 > j ) {
+    if ( EAGAIN == errno || EWOULDBLOCK == errno ) {
+      lua_pushinteger ( L, 0 ) ;
+      lua_newtable ( L ) ;
       return 2 ;
     }
 
-    do {
-      /* here we block, possibly for a very long time */
-      r = read ( sd, ptr, BUF_SIZE - 1 ) ;
-    } while ( 0 > r && EINTR == errno ) ;
+    return res_nil ( L ) ;
+  }
 
-    if ( 0 > r ) {
-      i = errno ;
-    } else if ( 0 < r ) {
-    } else if ( 0 == r ) {
+  lua_createtable ( L, j, 0 ) ;
+
+  for ( i = k = 0 ; j > i ; ++ i ) {
+    const char * p = iov [ i ] . iov_base ;
+    const char * e = p + mm [ i ] . msg_len ;
+    const char * h = NULL ;
+
+    /* make sure the last string is terminated */
+    uevent_buf [ i * UEVENT_MSG_SIZE + mm [ i ] . msg_len ] = '\0' ;
+
+    /* only accept (complete) messages sent by the kernel */
+    if ( 0 != sa [ i ] . nl_pid || ( MSG_TRUNC & mm [ i ] . msg_hdr . msg_flags )
+      || 8 > mm [ i ] . msg_len || 0 == memcmp ( p, "libudev", 8 ) )
+    {
+      continue ;
     }
 
-    (void) munmap ( ptr, BUF_SIZE ) ;
-    lua_pushinteger ( L, r ) ;
-    return 1 ;
+    /* skip the "ACTION@DEVPATH" header */
+    h = (const char *) memchr ( p, '\0', e - p ) ;
+    if ( NULL == h || NULL == memchr ( p, '@', h - p ) ) { continue ; }
+    p = 1 + h ;
+
+    if ( nf ) {
+      const char * v = uevent_get ( p, e, "SUBSYSTEM", 9 ) ;
+      int m ;
+
+      if ( NULL == v ) { continue ; }
+      for ( m = 0 ; nf > m && strcmp ( v, flt [ m ] ) ; ++ m ) { ; }
+      if ( nf <= m ) { continue ; }
+    }
+
+    if ( nr && 0 == uevent_rules_match ( r, nr, uevent_get ( p, e, "ACTION", 6 ),
+      uevent_get ( p, e, "SUBSYSTEM", 9 ) ) )
+    {
+      continue ;
+    }
+
+    uevent_push ( L, p, e ) ;
+    lua_rawseti ( L, -2, ++ k ) ;
   }
 
-  return 0 ;
+  lua_pushinteger ( L, k ) ;
+  lua_insert ( L, -2 ) ;
+  return 2 ;
 }
 
 #if 0
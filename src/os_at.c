@@ -235,4 +235,19 @@ static int u_fstatat ( lua_State * const L )
   return luaL_error ( L, "pathname expected" ) ;
 }
 
+#  if defined (OSLinux) && defined (STATX_BASIC_STATS)
+/* statxat ( dirfd, path [, mask [, flags [, st]]] )
+ * like statx() in os_file.c, but relative to dirfd
+ */
+static int u_statxat ( lua_State * const L )
+{
+  const int dirfd = luaL_checkinteger ( L, 1 ) ;
+  const char * const path = luaL_checkstring ( L, 2 ) ;
+  const unsigned int mask = luaL_optinteger ( L, 3, STATX_BASIC_STATS ) ;
+  const int f = luaL_optinteger ( L, 4, 0 ) ;
+
+  return statx_push ( L, dirfd, path, f, mask, 5 ) ;
+}
+#  endif
+
 #endif
@@ -0,0 +1,749 @@
+/*
+ * reusable byte buffers
+ *
+ * a buffer object owns a growable memory block (malloc(3)ed, or
+ * mmap(2)ed when large) that data can be read into from fds and
+ * written out from again without creating Lua strings.
+ * unread data lies between head and tail, new data is appended at tail.
+ * slices reference a part of the buffer and only create a Lua string
+ * when asked to.
+ */
+
+#define BUFFER_METATABLE "Buffer Metatable"
+#define SLICE_METATABLE "Buffer Slice Metatable"
+#define LBUF_MIN_SIZE 4096
+#define LBUF_MMAP_MIN ( 1 << 20 )
+#define LBUF_READ_MIN 65536
+
+typedef struct {
+  char * data ;
+  size_t cap ;
+  size_t head ;		/* start of unread data */
+  size_t tail ;		/* end of data */
+  unsigned int gen ;	/* bumped whenever data is moved or reused */
+  char mapped ;		/* 1: anonymous mapping, 2: private file mapping */
+} lbuf_t ;
+
+typedef struct {
+  size_t off ;
+  size_t len ;
+  unsigned int gen ;
+} lbuf_slice_t ;
+
+static lbuf_t * lbuf_check ( lua_State * const L, const int i )
+{
+  lbuf_t * bp = (lbuf_t *) luaL_checkudata ( L, i, BUFFER_METATABLE ) ;
+
+  luaL_argcheck ( L, NULL != bp -> data, i, "freed buffer" ) ;
+  return bp ;
+}
+
+/* returns the buffer at stack index i or NULL if it is not a buffer */
+static lbuf_t * lbuf_test ( lua_State * const L, const int i )
+{
+  lbuf_t * bp = (lbuf_t *) luaL_testudata ( L, i, BUFFER_METATABLE ) ;
+
+  if ( bp ) {
+    luaL_argcheck ( L, NULL != bp -> data, i, "freed buffer" ) ;
+  }
+
+  return bp ;
+}
+
+static char * lbuf_alloc ( const size_t s, char * const mapped )
+{
+  char * p = NULL ;
+
+  if ( LBUF_MMAP_MIN <= s ) {
+    p = (char *) mmap ( NULL, s, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 ) ;
+    * mapped = 1 ;
+    return ( MAP_FAILED == p ) ? NULL : p ;
+  }
+
+  * mapped = 0 ;
+  return (char *) malloc ( s ) ;
+}
+
+static void lbuf_release ( lbuf_t * const bp )
+{
+  if ( bp -> data ) {
+    if ( bp -> mapped ) { (void) munmap ( bp -> data, bp -> cap ) ; }
+    else { free ( bp -> data ) ; }
+  }
+
+  bp -> data = NULL ;
+  bp -> cap = bp -> head = bp -> tail = 0 ;
+  ++ bp -> gen ;
+}
+
+/* make room for at least n more bytes at the tail.
+ * returns 0 on success, -1 if out of memory.
+ */
+static int lbuf_reserve ( lbuf_t * const bp, const size_t n )
+{
+  size_t s ;
+  char * p = NULL, m = 0 ;
+
+  if ( bp -> cap - bp -> tail >= n ) { return 0 ; }
+
+  /* moving the unread data to the front might already suffice */
+  if ( bp -> head && bp -> cap - bp -> tail + bp -> head >= n
+    && bp -> tail - bp -> head <= bp -> head )
+  {
+    (void) memmove ( bp -> data, bp -> data + bp -> head, bp -> tail - bp -> head ) ;
+    bp -> tail -= bp -> head ;
+    bp -> head = 0 ;
+    ++ bp -> gen ;
+    return 0 ;
+  }
+
+  for ( s = ( LBUF_MIN_SIZE > bp -> cap ) ? LBUF_MIN_SIZE : bp -> cap ;
+    s - bp -> tail < n ; s *= 2 )
+  {
+    if ( SIZE_MAX / 2 < s ) { errno = ENOMEM ; return -1 ; }
+  }
+
+#if defined (OSLinux)
+  /* a file mapping can not grow beyond the end of the file */
+  if ( 1 == bp -> mapped ) {
+    p = (char *) mremap ( bp -> data, bp -> cap, s, MREMAP_MAYMOVE ) ;
+    if ( MAP_FAILED == p ) { return -1 ; }
+    bp -> data = p ;
+    bp -> cap = s ;
+    ++ bp -> gen ;
+    return 0 ;
+  }
+#endif
+
+  if ( 0 == bp -> mapped && LBUF_MMAP_MIN > s ) {
+    p = (char *) realloc ( bp -> data, s ) ;
+    if ( NULL == p ) { return -1 ; }
+  } else {
+    p = lbuf_alloc ( s, & m ) ;
+    if ( NULL == p ) { return -1 ; }
+    (void) memcpy ( p, bp -> data, bp -> tail ) ;
+    if ( bp -> mapped ) { (void) munmap ( bp -> data, bp -> cap ) ; }
+    else { free ( bp -> data ) ; }
+    bp -> mapped = m ;
+  }
+
+  bp -> data = p ;
+  bp -> cap = s ;
+  ++ bp -> gen ;
+  return 0 ;
+}
+
+/* mark n bytes of unread data as consumed */
+static void lbuf_consume ( lbuf_t * const bp, const size_t n )
+{
+  bp -> head += ( n < bp -> tail - bp -> head ) ? n : bp -> tail - bp -> head ;
+
+  if ( bp -> head == bp -> tail ) {
+    bp -> head = bp -> tail = 0 ;
+    ++ bp -> gen ;
+  }
+}
+
+/* read from fd into the buffer, at most max bytes (0 = no limit).
+ * returns the result of read(2).
+ */
+static ssize_t lbuf_read_fd ( lbuf_t * const bp, const int fd, size_t max )
+{
+  ssize_t r ;
+
+  if ( 0 == max ) {
+    max = bp -> cap - bp -> tail ;
+    max = ( LBUF_READ_MIN > max ) ? LBUF_READ_MIN : max ;
+  }
+
+  if ( lbuf_reserve ( bp, max ) ) { return -1 ; }
+
+  do { r = read ( fd, bp -> data + bp -> tail, max ) ; }
+  while ( 0 > r && EINTR == errno ) ;
+
+  if ( 0 < r ) { bp -> tail += r ; }
+  return r ;
+}
+
+/* convert Lua string style positions (1 based, negative values count
+ * from the end) into an offset and length relative to the unread data
+ */
+static void lbuf_range ( const size_t len, lua_Integer i, lua_Integer j,
+  size_t * const off, size_t * const n )
+{
+  if ( 0 > i ) { i = ( (lua_Integer) len + i < 0 ) ? 1 : (lua_Integer) len + i + 1 ; }
+  else if ( 0 == i ) { i = 1 ; }
+  if ( 0 > j ) { j = (lua_Integer) len + j + 1 ; }
+  else if ( (lua_Integer) len < j ) { j = len ; }
+
+  if ( i > j ) {
+    * off = 0 ;
+    * n = 0 ;
+  } else {
+    * off = i - 1 ;
+    * n = j - i + 1 ;
+  }
+}
+
+/* create a new buffer, optional arg: initial capacity */
+static int Lbuffer ( lua_State * const L )
+{
+  lbuf_t * bp = NULL ;
+  lua_Integer s = luaL_optinteger ( L, 1, LBUF_MIN_SIZE ) ;
+
+  s = ( LBUF_MIN_SIZE < s ) ? s : LBUF_MIN_SIZE ;
+  bp = (lbuf_t *) lua_newuserdata ( L, sizeof ( lbuf_t ) ) ;
+  (void) memset ( bp, 0, sizeof ( lbuf_t ) ) ;
+  luaL_getmetatable ( L, BUFFER_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+  bp -> data = lbuf_alloc ( s, & bp -> mapped ) ;
+
+  if ( NULL == bp -> data ) {
+    return res_nil ( L ) ;
+  }
+
+  bp -> cap = s ;
+  return 1 ;
+}
+
+/* buf:read_into ( fd [, max] )
+ * appends data read from fd, returns the number of bytes read
+ * (0 at EOF) or nil, error message and errno
+ */
+static int lbuf_read_into ( lua_State * const L )
+{
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+  const int fd = luaL_checkinteger ( L, 2 ) ;
+  const lua_Integer max = luaL_optinteger ( L, 3, 0 ) ;
+  ssize_t r ;
+
+  luaL_argcheck ( L, 0 <= fd, 2, "invalid fd" ) ;
+  r = lbuf_read_fd ( bp, fd, ( 0 < max ) ? max : 0 ) ;
+
+  if ( 0 > r ) {
+    return res_nil ( L ) ;
+  }
+
+  lua_pushinteger ( L, r ) ;
+  return 1 ;
+}
+
+/* buf:read_file ( path [, map] )
+ * appends the contents of a file, /proc and /sys files are read up to
+ * EOF. if map is true, the buffer is empty and path is a large regular
+ * file, the file is mapped privately instead of copied. the file must
+ * not be truncated while the data is used then (SIGBUS).
+ * returns the number of bytes added or nil, error message and errno.
+ */
+static int lbuf_read_file ( lua_State * const L )
+{
+  int e = 0, fd ;
+  ssize_t r ;
+  size_t n = 0 ;
+  struct stat st ;
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+  const char * const path = luaL_checkstring ( L, 2 ) ;
+  const int map = lua_toboolean ( L, 3 ) ;
+
+  fd = open ( path, O_RDONLY | O_NONBLOCK | O_CLOEXEC | O_NOCTTY ) ;
+  if ( 0 > fd ) { return res_nil ( L ) ; }
+
+  if ( fstat ( fd, & st ) ) {
+    e = errno ;
+  } else if ( map && S_ISREG( st . st_mode ) && LBUF_MMAP_MIN <= st . st_size
+    && bp -> head == bp -> tail )
+  {
+    char * p = (char *) mmap ( NULL, st . st_size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE, fd, 0 ) ;
+
+    if ( MAP_FAILED != p ) {
+      lbuf_release ( bp ) ;
+      bp -> data = p ;
+      bp -> cap = bp -> tail = n = st . st_size ;
+      bp -> mapped = 2 ;
+      goto done ;
+    }
+  }
+
+  /* size is only a hint, pseudo files report 0 or 4096 */
+  if ( 0 == e && lbuf_reserve ( bp, ( 0 < st . st_size ) ? (size_t) st . st_size + 1
+    : LBUF_MIN_SIZE ) )
+  {
+    e = errno ;
+  }
+
+  while ( 0 == e ) {
+    r = lbuf_read_fd ( bp, fd, 0 ) ;
+
+    if ( 0 > r ) {
+      e = errno ;
+    } else if ( 0 == r ) {
+      break ;
+    } else {
+      n += r ;
+      if ( S_ISREG( st . st_mode ) && (size_t) st . st_size == n ) { break ; }
+    }
+  }
+
+done :
+  CLOSEFD( fd )
+
+  if ( e ) {
+    errno = e ;
+    return res_nil ( L ) ;
+  }
+
+  lua_pushinteger ( L, n ) ;
+  return 1 ;
+}
+
+/* buf:write_from ( fd [, max] )
+ * writes unread data to fd and consumes what was written.
+ * returns the number of bytes written or nil, error message and errno
+ */
+static int lbuf_write_from ( lua_State * const L )
+{
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+  const int fd = luaL_checkinteger ( L, 2 ) ;
+  const lua_Integer max = luaL_optinteger ( L, 3, 0 ) ;
+  size_t n = bp -> tail - bp -> head ;
+  ssize_t r = 0 ;
+
+  luaL_argcheck ( L, 0 <= fd, 2, "invalid fd" ) ;
+  n = ( 0 < max && (size_t) max < n ) ? (size_t) max : n ;
+
+  if ( n ) {
+    do { r = write ( fd, bp -> data + bp -> head, n ) ; }
+    while ( 0 > r && EINTR == errno ) ;
+
+    if ( 0 > r ) {
+      return res_nil ( L ) ;
+    }
+
+    lbuf_consume ( bp, r ) ;
+  }
+
+  lua_pushinteger ( L, r ) ;
+  return 1 ;
+}
+
+/* buf:splice ( fd_in, fd_out [, len] )
+ * moves up to len bytes from fd_in to fd_out. splice(2) is used when
+ * one of the fds is a pipe, so the data never enters user space,
+ * otherwise the data is read into the free space of the buffer and
+ * written from there, the unread data of the buffer is not touched.
+ * bytes that were read but could not be written are left appended to
+ * the buffer. returns the number of bytes moved or nil, error message
+ * and errno.
+ */
+static int lbuf_splice ( lua_State * const L )
+{
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+  const int in = luaL_checkinteger ( L, 2 ) ;
+  const int out = luaL_checkinteger ( L, 3 ) ;
+  const lua_Integer len = luaL_optinteger ( L, 4, LBUF_READ_MIN ) ;
+  ssize_t r = -1, w = 0 ;
+  size_t n = 0 ;
+  char * p ;
+
+  luaL_argcheck ( L, 0 <= in, 2, "invalid fd" ) ;
+  luaL_argcheck ( L, 0 <= out, 3, "invalid fd" ) ;
+  luaL_argcheck ( L, 0 < len, 4, "invalid length" ) ;
+
+#if defined (OSLinux)
+  do { r = splice ( in, NULL, out, NULL, len, SPLICE_F_MOVE ) ; }
+  while ( 0 > r && EINTR == errno ) ;
+
+  if ( 0 <= r ) {
+    lua_pushinteger ( L, r ) ;
+    return 1 ;
+  } else if ( EINVAL != errno ) {
+    return res_nil ( L ) ;
+  }
+#endif
+
+  /* no pipe involved, copy through the buffer */
+  r = lbuf_read_fd ( bp, in, len ) ;
+  if ( 0 > r ) { return res_nil ( L ) ; }
+
+  /* the new data is at the end, the buffer may have moved */
+  p = bp -> data + bp -> tail - r ;
+
+  while ( (size_t) r > n ) {
+    w = write ( out, p + n, r - n ) ;
+
+    if ( 0 > w ) {
+      if ( EINTR == errno ) { continue ; }
+      break ;
+    }
+
+    n += w ;
+  }
+
+  /* drop what was written, keep the rest */
+  (void) memmove ( p, p + n, r - n ) ;
+  bp -> tail -= n ;
+
+  if ( 0 > w ) {
+    return res_nil ( L ) ;
+  }
+
+  lua_pushinteger ( L, n ) ;
+  return 1 ;
+}
+
+/* buf:append ( str, ... ) */
+static int lbuf_append ( lua_State * const L )
+{
+  int i ;
+  size_t s = 0 ;
+  const char * str = NULL ;
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+  const int n = lua_gettop ( L ) ;
+
+  for ( i = 2 ; n >= i ; ++ i ) {
+    str = luaL_checklstring ( L, i, & s ) ;
+
+    if ( lbuf_reserve ( bp, s ) ) {
+      return luaL_error ( L, "out of memory" ) ;
+    }
+
+    (void) memcpy ( bp -> data + bp -> tail, str, s ) ;
+    bp -> tail += s ;
+  }
+
+  lua_settop ( L, 1 ) ;
+  return 1 ;
+}
+
+/* helper function for the line and record methods */
+static int lbuf_next_record ( lua_State * const L, lbuf_t * const bp,
+  const char * const sep, const size_t sl, const int keep )
+{
+  char * p = bp -> data + bp -> head ;
+  const size_t n = bp -> tail - bp -> head ;
+  char * e = NULL ;
+
+  if ( 1 == sl ) {
+    e = (char *) memchr ( p, sep [ 0 ], n ) ;
+  } else {
+    e = (char *) memmem ( p, n, sep, sl ) ;
+  }
+
+  if ( NULL == e ) { return 0 ; }
+
+  (void) lua_pushlstring ( L, p, ( e - p ) + ( keep ? sl : 0 ) ) ;
+  lbuf_consume ( bp, ( e - p ) + sl ) ;
+  return 1 ;
+}
+
+/* buf:line ( [keep_newline] )
+ * returns (and consumes) the next complete line or nothing
+ */
+static int lbuf_line ( lua_State * const L )
+{
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+
+  return lbuf_next_record ( L, bp, "\n", 1, lua_toboolean ( L, 2 ) ) ;
+}
+
+/* iterator function returned by buf:lines () */
+static int lbuf_lines_iter ( lua_State * const L )
+{
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+
+  return lbuf_next_record ( L, bp, "\n", 1, 0 ) ;
+}
+
+/* for line in buf:lines () do ... end */
+static int lbuf_lines ( lua_State * const L )
+{
+  (void) lbuf_check ( L, 1 ) ;
+  lua_pushcfunction ( L, lbuf_lines_iter ) ;
+  lua_pushvalue ( L, 1 ) ;
+  return 2 ;
+}
+
+/* buf:record ( sep [, keep_sep] )
+ * returns (and consumes) the next record terminated by sep or nothing
+ */
+static int lbuf_record ( lua_State * const L )
+{
+  size_t sl = 0 ;
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+  const char * sep = luaL_checklstring ( L, 2, & sl ) ;
+
+  luaL_argcheck ( L, 0 < sl, 2, "empty separator" ) ;
+  return lbuf_next_record ( L, bp, sep, sl, lua_toboolean ( L, 3 ) ) ;
+}
+
+/* buf:find ( str [, init] ) returns the position of str in the
+ * unread data or nothing
+ */
+static int lbuf_find ( lua_State * const L )
+{
+  size_t sl = 0, off, n ;
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+  const char * str = luaL_checklstring ( L, 2, & sl ) ;
+  const size_t len = bp -> tail - bp -> head ;
+  const char * p = NULL ;
+
+  lbuf_range ( len, luaL_optinteger ( L, 3, 1 ), -1, & off, & n ) ;
+  if ( n < sl ) { return 0 ; }
+
+  p = (const char *) memmem ( bp -> data + bp -> head + off, n, str, sl ) ;
+  if ( NULL == p ) { return 0 ; }
+
+  lua_pushinteger ( L, 1 + ( p - ( bp -> data + bp -> head ) ) ) ;
+  return 1 ;
+}
+
+/* buf:tostring ( [i [, j]] ) copies (a part of) the unread data
+ * into a Lua string
+ */
+static int lbuf_tostring ( lua_State * const L )
+{
+  size_t off, n ;
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+
+  lbuf_range ( bp -> tail - bp -> head, luaL_optinteger ( L, 2, 1 ),
+    luaL_optinteger ( L, 3, -1 ), & off, & n ) ;
+  (void) lua_pushlstring ( L, bp -> data + bp -> head + off, n ) ;
+  return 1 ;
+}
+
+/* buf:slice ( i [, j] ) returns a slice object referencing a part of
+ * the unread data without copying it
+ */
+static int lbuf_slice ( lua_State * const L )
+{
+  size_t off, n ;
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+  lbuf_slice_t * sp = NULL ;
+
+  lbuf_range ( bp -> tail - bp -> head, luaL_checkinteger ( L, 2 ),
+    luaL_optinteger ( L, 3, -1 ), & off, & n ) ;
+  sp = (lbuf_slice_t *) lua_newuserdata ( L, sizeof ( lbuf_slice_t ) ) ;
+  sp -> off = bp -> head + off ;
+  sp -> len = n ;
+  sp -> gen = bp -> gen ;
+  luaL_getmetatable ( L, SLICE_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+  /* keep the buffer alive as long as the slice */
+  lua_pushvalue ( L, 1 ) ;
+  lua_setuservalue ( L, -2 ) ;
+  return 1 ;
+}
+
+/* buf:consume ( n ) drops n bytes of unread data */
+static int lbuf_consume_m ( lua_State * const L )
+{
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+  const lua_Integer n = luaL_checkinteger ( L, 2 ) ;
+
+  luaL_argcheck ( L, 0 <= n, 2, "negative length" ) ;
+  lbuf_consume ( bp, n ) ;
+  lua_settop ( L, 1 ) ;
+  return 1 ;
+}
+
+/* buf:clear () drops all data */
+static int lbuf_clear ( lua_State * const L )
+{
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+
+  bp -> head = bp -> tail = 0 ;
+  ++ bp -> gen ;
+  lua_settop ( L, 1 ) ;
+  return 1 ;
+}
+
+/* buf:reserve ( n ) makes sure n bytes can be appended without growing */
+static int lbuf_reserve_m ( lua_State * const L )
+{
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+  const lua_Integer n = luaL_checkinteger ( L, 2 ) ;
+
+  luaL_argcheck ( L, 0 <= n, 2, "negative length" ) ;
+
+  if ( lbuf_reserve ( bp, n ) ) {
+    return res_nil ( L ) ;
+  }
+
+  lua_settop ( L, 1 ) ;
+  return 1 ;
+}
+
+/* buf:len () returns the length of the unread data */
+static int lbuf_len ( lua_State * const L )
+{
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+
+  lua_pushinteger ( L, bp -> tail - bp -> head ) ;
+  return 1 ;
+}
+
+/* buf:cap () returns the current capacity */
+static int lbuf_cap ( lua_State * const L )
+{
+  lbuf_t * bp = lbuf_check ( L, 1 ) ;
+
+  lua_pushinteger ( L, bp -> cap ) ;
+  return 1 ;
+}
+
+/* frees the memory of a buffer */
+static int lbuf_free ( lua_State * const L )
+{
+  lbuf_t * bp = (lbuf_t *) luaL_checkudata ( L, 1, BUFFER_METATABLE ) ;
+
+  lbuf_release ( bp ) ;
+  return 0 ;
+}
+
+/* returns the data referenced by a slice, raises an error if the
+ * buffer has moved or reused its data since the slice was created
+ */
+static const char * slice_data ( lua_State * const L, size_t * const len )
+{
+  lbuf_slice_t * sp = (lbuf_slice_t *) luaL_checkudata ( L, 1, SLICE_METATABLE ) ;
+  lbuf_t * bp = NULL ;
+
+  (void) lua_getuservalue ( L, 1 ) ;
+  bp = (lbuf_t *) lua_touserdata ( L, -1 ) ;
+  lua_pop ( L, 1 ) ;
+
+  if ( NULL == bp || NULL == bp -> data || sp -> gen != bp -> gen ) {
+    (void) luaL_error ( L, "stale buffer slice" ) ;
+    return NULL ;
+  }
+
+  * len = sp -> len ;
+  return bp -> data + sp -> off ;
+}
+
+/* slice:tostring () */
+static int slice_tostring ( lua_State * const L )
+{
+  size_t n = 0 ;
+  const char * p = slice_data ( L, & n ) ;
+
+  (void) lua_pushlstring ( L, p, n ) ;
+  return 1 ;
+}
+
+/* slice:len () */
+static int slice_len ( lua_State * const L )
+{
+  lbuf_slice_t * sp = (lbuf_slice_t *) luaL_checkudata ( L, 1, SLICE_METATABLE ) ;
+
+  lua_pushinteger ( L, sp -> len ) ;
+  return 1 ;
+}
+
+/* slice:valid () checks if the slice still refers to the original data */
+static int slice_valid ( lua_State * const L )
+{
+  lbuf_slice_t * sp = (lbuf_slice_t *) luaL_checkudata ( L, 1, SLICE_METATABLE ) ;
+  lbuf_t * bp = NULL ;
+
+  (void) lua_getuservalue ( L, 1 ) ;
+  bp = (lbuf_t *) lua_touserdata ( L, -1 ) ;
+  lua_pushboolean ( L, bp && bp -> data && sp -> gen == bp -> gen ) ;
+  return 1 ;
+}
+
+/* slice:find ( str [, init] ) */
+static int slice_find ( lua_State * const L )
+{
+  size_t n = 0, sl = 0, off, m ;
+  const char * p = slice_data ( L, & n ) ;
+  const char * str = luaL_checklstring ( L, 2, & sl ) ;
+  const char * q = NULL ;
+
+  lbuf_range ( n, luaL_optinteger ( L, 3, 1 ), -1, & off, & m ) ;
+  if ( m < sl ) { return 0 ; }
+
+  q = (const char *) memmem ( p + off, m, str, sl ) ;
+  if ( NULL == q ) { return 0 ; }
+
+  lua_pushinteger ( L, 1 + ( q - p ) ) ;
+  return 1 ;
+}
+
+/* creates the buffer and slice metatables */
+static int buffer_create_meta ( lua_State * const L )
+{
+  luaL_newmetatable ( L, SLICE_METATABLE ) ;
+
+  /* method table */
+  lua_newtable ( L ) ;
+  lua_pushcfunction ( L, slice_tostring ) ;
+  lua_setfield ( L, -2, "tostring" ) ;
+  lua_pushcfunction ( L, slice_len ) ;
+  lua_setfield ( L, -2, "len" ) ;
+  lua_pushcfunction ( L, slice_valid ) ;
+  lua_setfield ( L, -2, "valid" ) ;
+  lua_pushcfunction ( L, slice_find ) ;
+  lua_setfield ( L, -2, "find" ) ;
+
+  /* metamethods */
+  lua_setfield ( L, -2, "__index" ) ;
+  lua_pushcfunction ( L, slice_tostring ) ;
+  lua_setfield ( L, -2, "__tostring" ) ;
+  lua_pushcfunction ( L, slice_len ) ;
+  lua_setfield ( L, -2, "__len" ) ;
+  lua_pop ( L, 1 ) ;
+
+  luaL_newmetatable ( L, BUFFER_METATABLE ) ;
+
+  /* method table */
+  lua_newtable ( L ) ;
+  lua_pushcfunction ( L, lbuf_read_into ) ;
+  lua_setfield ( L, -2, "read_into" ) ;
+  lua_pushcfunction ( L, lbuf_write_from ) ;
+  lua_setfield ( L, -2, "write_from" ) ;
+  lua_pushcfunction ( L, lbuf_read_file ) ;
+  lua_setfield ( L, -2, "read_file" ) ;
+  lua_pushcfunction ( L, lbuf_splice ) ;
+  lua_setfield ( L, -2, "splice" ) ;
+  lua_pushcfunction ( L, lbuf_append ) ;
+  lua_setfield ( L, -2, "append" ) ;
+  lua_pushcfunction ( L, lbuf_line ) ;
+  lua_setfield ( L, -2, "line" ) ;
+  lua_pushcfunction ( L, lbuf_lines ) ;
+  lua_setfield ( L, -2, "lines" ) ;
+  lua_pushcfunction ( L, lbuf_record ) ;
+  lua_setfield ( L, -2, "record" ) ;
+  lua_pushcfunction ( L, lbuf_find ) ;
+  lua_setfield ( L, -2, "find" ) ;
+  lua_pushcfunction ( L, lbuf_slice ) ;
+  lua_setfield ( L, -2, "slice" ) ;
+  lua_pushcfunction ( L, lbuf_tostring ) ;
+  lua_setfield ( L, -2, "tostring" ) ;
+  lua_pushcfunction ( L, lbuf_consume_m ) ;
+  lua_setfield ( L, -2, "consume" ) ;
+  lua_pushcfunction ( L, lbuf_clear ) ;
+  lua_setfield ( L, -2, "clear" ) ;
+  lua_pushcfunction ( L, lbuf_reserve_m ) ;
+  lua_setfield ( L, -2, "reserve" ) ;
+  lua_pushcfunction ( L, lbuf_len ) ;
+  lua_setfield ( L, -2, "len" ) ;
+  lua_pushcfunction ( L, lbuf_cap ) ;
+  lua_setfield ( L, -2, "cap" ) ;
+  lua_pushcfunction ( L, lbuf_free ) ;
+  lua_setfield ( L, -2, "free" ) ;
+
+  /* metamethods */
+  lua_setfield ( L, -2, "__index" ) ;
+  lua_pushcfunction ( L, lbuf_tostring ) ;
+  lua_setfield ( L, -2, "__tostring" ) ;
+  lua_pushcfunction ( L, lbuf_len ) ;
+  lua_setfield ( L, -2, "__len" ) ;
+  lua_pushcfunction ( L, lbuf_free ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+
+  return 1 ;
+}
+
@@ -0,0 +1,892 @@
+/*
+ * cgroup v2 management (Linux)
+ *
+ * a cgroup object keeps the directory fd of its cgroup open, the control
+ * and accounting files are opened relative to it, so neither teardown
+ * nor accounting has to resolve paths again or scan /proc.
+ * the fd can be passed as cgroup to spawn() (CLONE_INTO_CGROUP).
+ *
+ * pressure stall information (system wide or per cgroup) can be read
+ * and watched with triggers, whose fds signal POLLPRI.
+ */
+
+#if defined (OSLinux)
+
+#define CGROUP_METATABLE "Cgroup Metatable"
+#define CGROUP_ROOT	"/sys/fs/cgroup"
+
+typedef struct {
+  int fd ;
+  /* absolute path of the cgroup directory */
+  char * path ;
+} cgroup_t ;
+
+static cgroup_t * cgroup_check ( lua_State * const L )
+{
+  cgroup_t * cg = (cgroup_t *) luaL_checkudata ( L, 1, CGROUP_METATABLE ) ;
+
+  luaL_argcheck ( L, 0 <= cg -> fd, 1, "closed cgroup" ) ;
+  return cg ;
+}
+
+/* reads the control file name of a cgroup into the read_file() scratch
+ * buffer and terminates it with a NUL. returns the length or -1.
+ */
+static ssize_t cgroup_read ( lua_State * const L, const int cgfd, const char * const name )
+{
+  int fd, e ;
+  ssize_t r ;
+  struct stat st ;
+  rdfile_scratch_t * sp = rdfile_scratch ( L ) ;
+
+  fd = openat ( cgfd, name, O_RDONLY | O_CLOEXEC | O_NOCTTY ) ;
+  if ( 0 > fd ) { return -1 ; }
+
+  /* control files have no size */
+  (void) memset ( & st, 0, sizeof ( st ) ) ;
+  r = read_fd_all ( fd, & st, & sp -> data, & sp -> cap ) ;
+  e = errno ;
+  CLOSEFD( fd )
+
+  /* make room for the NUL */
+  if ( 0 <= r && (size_t) r == sp -> cap ) {
+    char * p = (char *) realloc ( sp -> data, sp -> cap + 1 ) ;
+
+    if ( NULL == p ) { return -1 ; }
+    sp -> data = p ;
+    ++ sp -> cap ;
+  }
+
+  if ( 0 > r ) {
+    errno = e ;
+    return -1 ;
+  }
+
+  sp -> data [ r ] = '\0' ;
+  return r ;
+}
+
+/* pushes a value of a stat file as number if it is one */
+static void cgroup_push_value ( lua_State * const L, const char * const s, const size_t l )
+{
+  char * e = NULL ;
+  const long long i = strtoll ( s, & e, 10 ) ;
+
+  if ( l && e == s + l ) {
+    lua_pushinteger ( L, i ) ;
+    return ;
+  }
+
+  {
+    const double d = strtod ( s, & e ) ;
+
+    if ( l && e == s + l ) { lua_pushnumber ( L, d ) ; }
+    else { (void) lua_pushlstring ( L, s, l ) ; }
+  }
+}
+
+/* parses the flat keyed ("key value") and the nested keyed ("key a=1
+ * b=2") formats of the stat, events and pressure files into a table
+ */
+static void cgroup_push_stat ( lua_State * const L, char * s )
+{
+  char * e, * k, * v, * eq ;
+
+  lua_newtable ( L ) ;
+
+  for ( ; * s ; s = e ) {
+    e = strchr ( s, '\n' ) ;
+    if ( e ) { * e ++ = '\0' ; }
+    else { e = s + strlen ( s ) ; }
+
+    k = strtok_r ( s, " ", & v ) ;
+    if ( NULL == k ) { continue ; }
+    s = strtok_r ( NULL, " ", & v ) ;
+
+    if ( NULL == s ) {
+      lua_pushboolean ( L, 1 ) ;
+    } else if ( NULL == ( eq = strchr ( s, '=' ) ) ) {
+      cgroup_push_value ( L, s, strlen ( s ) ) ;
+    } else {
+      lua_newtable ( L ) ;
+
+      for ( ; s ; s = strtok_r ( NULL, " ", & v ) ) {
+        eq = strchr ( s, '=' ) ;
+        if ( NULL == eq ) { continue ; }
+        (void) lua_pushlstring ( L, s, eq - s ) ;
+        cgroup_push_value ( L, eq + 1, strlen ( eq + 1 ) ) ;
+        lua_rawset ( L, -3 ) ;
+      }
+    }
+
+    lua_setfield ( L, -2, k ) ;
+  }
+}
+
+/* returns the value of key in cgroup.events or -1 */
+static int cgroup_event ( lua_State * const L, const int cgfd, const char * const key )
+{
+  char * p ;
+  const size_t l = strlen ( key ) ;
+
+  if ( 0 > cgroup_read ( L, cgfd, "cgroup.events" ) ) { return -1 ; }
+
+  for ( p = rdfile_scratch ( L ) -> data ; p && * p ; ) {
+    if ( 0 == strncmp ( p, key, l ) && ' ' == p [ l ] ) { return atoi ( p + l + 1 ) ; }
+    p = strchr ( p, '\n' ) ;
+    if ( p ) { ++ p ; }
+  }
+
+  errno = ENOENT ;
+  return -1 ;
+}
+
+/* removes the empty sub groups of a cgroup, depth first */
+static int cgroup_rmdir_subs ( const int cgfd )
+{
+  int fd, r = 0 ;
+  DIR * dirp ;
+  struct dirent * de ;
+
+  fd = dup ( cgfd ) ;
+  if ( 0 > fd ) { return -1 ; }
+  dirp = fdopendir ( fd ) ;
+
+  if ( NULL == dirp ) {
+    CLOSEFD( fd )
+    return -1 ;
+  }
+
+  while ( NULL != ( de = readdir ( dirp ) ) ) {
+    if ( DT_DIR != de -> d_type || '.' == de -> d_name [ 0 ] ) { continue ; }
+
+    fd = openat ( cgfd, de -> d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOCTTY ) ;
+    if ( 0 > fd ) { r = -1 ; continue ; }
+    if ( cgroup_rmdir_subs ( fd ) ) { r = -1 ; }
+    CLOSEFD( fd )
+    if ( unlinkat ( cgfd, de -> d_name, AT_REMOVEDIR ) ) { r = -1 ; }
+  }
+
+  (void) closedir ( dirp ) ;
+
+  return r ;
+}
+
+/* cgroup_open ( path [, create [, mode]] )
+ * opens (and with create, creates including the missing parents) a
+ * cgroup. path is relative to the cgroup2 mount point /sys/fs/cgroup,
+ * like the paths in /proc/<pid>/cgroup.
+ */
+static int Lcgroup_open ( lua_State * const L )
+{
+  size_t l ;
+  cgroup_t * cg ;
+  const char * path = luaL_checklstring ( L, 1, & l ) ;
+  const int create = lua_toboolean ( L, 2 ) ;
+  const mode_t mode = luaL_optinteger ( L, 3, 0755 ) ;
+  char * s, * p ;
+
+  while ( '/' == * path ) { ++ path ; -- l ; }
+
+  cg = (cgroup_t *) lua_newuserdata ( L, sizeof ( cgroup_t ) ) ;
+  cg -> fd = -1 ;
+  cg -> path = NULL ;
+  luaL_getmetatable ( L, CGROUP_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+
+  s = (char *) malloc ( sizeof ( CGROUP_ROOT ) + 1 + l ) ;
+  if ( NULL == s ) { return res_nil ( L ) ; }
+  (void) sprintf ( s, "%s/%s", CGROUP_ROOT, path ) ;
+  cg -> path = s ;
+
+  if ( create ) {
+    for ( p = s + sizeof ( CGROUP_ROOT ) ; p ; ) {
+      p = strchr ( p, '/' ) ;
+      if ( p ) { * p = '\0' ; }
+
+      if ( mkdir ( s, mode ) && EEXIST != errno ) {
+        if ( p ) { * p = '/' ; }
+        return res_nil ( L ) ;
+      }
+
+      if ( p ) { * p ++ = '/' ; }
+    }
+  }
+
+  cg -> fd = open ( s, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOCTTY ) ;
+  if ( 0 > cg -> fd ) { return res_nil ( L ) ; }
+
+  return 1 ;
+}
+
+static int cgroup_fileno ( lua_State * const L )
+{
+  cgroup_t * cg = cgroup_check ( L ) ;
+
+  lua_pushinteger ( L, cg -> fd ) ;
+  return 1 ;
+}
+
+static int cgroup_path ( lua_State * const L )
+{
+  cgroup_t * cg = cgroup_check ( L ) ;
+
+  /* the part after the mount point, "/" for the root cgroup */
+  (void) lua_pushstring ( L, cg -> path + sizeof ( CGROUP_ROOT ) - 1 ) ;
+  return 1 ;
+}
+
+/* cg:procs ( [threads] ) returns an array of the member pids (tids) */
+static int cgroup_procs ( lua_State * const L )
+{
+  int i = 0 ;
+  char * p, * e ;
+  cgroup_t * cg = cgroup_check ( L ) ;
+  const char * name = lua_toboolean ( L, 2 ) ? "cgroup.threads" : "cgroup.procs" ;
+
+  if ( 0 > cgroup_read ( L, cg -> fd, name ) ) { return res_nil ( L ) ; }
+  lua_newtable ( L ) ;
+
+  for ( p = rdfile_scratch ( L ) -> data ; * p ; p = e ) {
+    const long pid = strtol ( p, & e, 10 ) ;
+
+    if ( e == p ) { break ; }
+    lua_pushinteger ( L, pid ) ;
+    lua_rawseti ( L, -2, ++ i ) ;
+  }
+
+  return 1 ;
+}
+
+/* cg:attach ( [pid] ) moves a process (default: ourselves) into the cgroup */
+static int cgroup_attach ( lua_State * const L )
+{
+  cgroup_t * cg = cgroup_check ( L ) ;
+  char buf [ 32 ] ;
+
+  (void) snprintf ( buf, sizeof ( buf ), "%ld", (long) luaL_optinteger ( L, 2, 0 ) ) ;
+  return resne0 ( L, "attach", write_str_at ( cg -> fd, "cgroup.procs", buf ) ) ;
+}
+
+/* cg:fork ()
+ * like pidfd_fork(), but the child moves itself into the cgroup before
+ * it returns (it exits with 127 if that fails). the child keeps running
+ * Lua, so fork(2) is used instead of clone3(2) with CLONE_INTO_CGROUP.
+ */
+static int cgroup_fork ( lua_State * const L )
+{
+  int fd = -1 ;
+  pid_t pid ;
+  cgroup_t * cg = cgroup_check ( L ) ;
+
+  (void) fflush ( NULL ) ;
+  pid = fork () ;
+
+  if ( 0 == pid ) {
+    if ( write_str_at ( cg -> fd, "cgroup.procs", "0" ) ) { _exit ( 127 ) ; }
+  } else if ( 0 < pid ) {
+    fd = sys_pidfd_open ( pid, 0 ) ;
+  }
+
+  if ( 0 > pid ) {
+    return res_nil ( L ) ;
+  } else if ( 0 == pid ) {
+    lua_pushinteger ( L, 0 ) ;
+    return 1 ;
+  }
+
+  (void) pidfd_push ( L, fd, pid ) ;
+  return 1 ;
+}
+
+/* cg:kill ( [sig] )
+ * signals all members of the cgroup and its sub groups (SIGKILL by
+ * default, sent via cgroup.kill). we and our parent are spared.
+ * returns the number and an array of the signalled pids.
+ */
+static int cgroup_kill ( lua_State * const L )
+{
+  size_t i ;
+  killall_t kt ;
+  cgroup_t * cg = cgroup_check ( L ) ;
+
+  killall_init ( & kt, luaL_optinteger ( L, 2, SIGKILL ) ) ;
+  luaL_argcheck ( L, 0 <= kt . sig && NSIG > kt . sig, 2, "invalid signal number" ) ;
+  kt . session = 0 ;
+  killall_cgroup_fd ( & kt, cg -> fd ) ;
+
+  lua_pushinteger ( L, kt . n ) ;
+  lua_createtable ( L, kt . n, 0 ) ;
+
+  for ( i = 0 ; kt . n > i ; ++ i ) {
+    lua_pushinteger ( L, kt . pids [ i ] ) ;
+    lua_rawseti ( L, -2, 1 + i ) ;
+  }
+
+  killall_free ( & kt ) ;
+
+  return 2 ;
+}
+
+static int cgroup_freeze ( lua_State * const L )
+{
+  cgroup_t * cg = cgroup_check ( L ) ;
+
+  return resne0 ( L, "freeze", write_str_at ( cg -> fd, "cgroup.freeze", "1" ) ) ;
+}
+
+static int cgroup_thaw ( lua_State * const L )
+{
+  cgroup_t * cg = cgroup_check ( L ) ;
+
+  return resne0 ( L, "thaw", write_str_at ( cg -> fd, "cgroup.freeze", "0" ) ) ;
+}
+
+/* cg:frozen () and cg:populated () read cgroup.events */
+static int cgroup_frozen ( lua_State * const L )
+{
+  cgroup_t * cg = cgroup_check ( L ) ;
+  const int i = cgroup_event ( L, cg -> fd, "frozen" ) ;
+
+  if ( 0 > i ) { return res_nil ( L ) ; }
+  lua_pushboolean ( L, i ) ;
+  return 1 ;
+}
+
+static int cgroup_populated ( lua_State * const L )
+{
+  cgroup_t * cg = cgroup_check ( L ) ;
+  const int i = cgroup_event ( L, cg -> fd, "populated" ) ;
+
+  if ( 0 > i ) { return res_nil ( L ) ; }
+  lua_pushboolean ( L, i ) ;
+  return 1 ;
+}
+
+/* cg:wait_empty ( [timeout] )
+ * waits (at most timeout ms, default forever) until the cgroup and its
+ * sub groups have no members left, cgroup.events signals the change.
+ * returns true or false on timeout.
+ */
+static int cgroup_wait_empty ( lua_State * const L )
+{
+  int i ;
+  struct pollfd pfd ;
+  char buf [ 256 ] ;
+  cgroup_t * cg = cgroup_check ( L ) ;
+  const int tmo = luaL_optinteger ( L, 2, -1 ) ;
+
+  pfd . fd = openat ( cg -> fd, "cgroup.events", O_RDONLY | O_CLOEXEC | O_NOCTTY ) ;
+  if ( 0 > pfd . fd ) { return res_nil ( L ) ; }
+  pfd . events = POLLPRI ;
+
+  for ( ; ; ) {
+    i = cgroup_event ( L, cg -> fd, "populated" ) ;
+    if ( 0 >= i ) { break ; }
+
+    /* the fd was opened before the check, so no change is missed */
+    pfd . revents = 0 ;
+    i = poll ( & pfd, 1, tmo ) ;
+
+    if ( 0 > i && EINTR == errno ) { continue ; }
+    if ( 0 >= i ) { i = ( 0 == i ) ? 1 : -1 ; break ; }
+
+    /* rereading rearms the notification */
+    (void) lseek ( pfd . fd, 0, SEEK_SET ) ;
+    while ( 0 < read ( pfd . fd, buf, sizeof ( buf ) ) ) { ; }
+  }
+
+  CLOSEFD( pfd . fd )
+  if ( 0 > i ) { return res_nil ( L ) ; }
+  lua_pushboolean ( L, 0 == i ) ;
+
+  return 1 ;
+}
+
+/* cg:get ( file ) returns the contents of a control file */
+static int cgroup_get ( lua_State * const L )
+{
+  ssize_t r ;
+  cgroup_t * cg = cgroup_check ( L ) ;
+
+  r = cgroup_read ( L, cg -> fd, luaL_checkstring ( L, 2 ) ) ;
+  if ( 0 > r ) { return res_nil ( L ) ; }
+  (void) lua_pushlstring ( L, rdfile_scratch ( L ) -> data, r ) ;
+
+  return 1 ;
+}
+
+/* cg:set ( file, value ) writes a control file */
+static int cgroup_set ( lua_State * const L )
+{
+  cgroup_t * cg = cgroup_check ( L ) ;
+  const char * f = luaL_checkstring ( L, 2 ) ;
+
+  return resne0 ( L, f, write_str_at ( cg -> fd, f, luaL_checkstring ( L, 3 ) ) ) ;
+}
+
+/* cg:stat ( file )
+ * parses an accounting file, e. g. memory.stat, cpu.stat, io.stat or
+ * memory.pressure into a table. numbers are converted, nested keyed
+ * lines ("some avg10=0.00 ...") become sub tables.
+ */
+static int cgroup_stat ( lua_State * const L )
+{
+  cgroup_t * cg = cgroup_check ( L ) ;
+
+  if ( 0 > cgroup_read ( L, cg -> fd, luaL_checkstring ( L, 2 ) ) ) { return res_nil ( L ) ; }
+  cgroup_push_stat ( L, rdfile_scratch ( L ) -> data ) ;
+
+  return 1 ;
+}
+
+/* cg:limit ( t )
+ * sets resource limits, the keys are control file names with '_'
+ * instead of '.', e. g. { memory_max = "512M", cpu_max = "50000 100000",
+ * pids_max = 64, io_max = "8:0 rbps=1048576" }.
+ */
+static int cgroup_limit ( lua_State * const L )
+{
+  size_t l ;
+  cgroup_t * cg = cgroup_check ( L ) ;
+  char name [ 64 ] ;
+
+  luaL_checktype ( L, 2, LUA_TTABLE ) ;
+  lua_pushnil ( L ) ;
+
+  while ( lua_next ( L, 2 ) ) {
+    const char * k, * v ;
+    char * p ;
+
+    /* converting a number key would confuse lua_next() */
+    if ( LUA_TSTRING != lua_type ( L, -2 ) ) { return luaL_argerror ( L, 2, "invalid limit name" ) ; }
+    k = lua_tolstring ( L, -2, & l ) ;
+    v = luaL_checkstring ( L, -1 ) ;
+
+    if ( sizeof ( name ) <= l ) { return luaL_argerror ( L, 2, "invalid limit name" ) ; }
+    (void) memcpy ( name, k, l + 1 ) ;
+    for ( p = name ; * p ; ++ p ) { if ( '_' == * p ) { * p = '.' ; } }
+
+    if ( write_str_at ( cg -> fd, name, v ) ) {
+      return res_nil ( L ) ;
+    }
+
+    lua_pop ( L, 1 ) ;
+  }
+
+  lua_pushboolean ( L, 1 ) ;
+  return 1 ;
+}
+
+/* cg:enable ( controllers )
+ * enables (or with a leading '-' disables) controllers for the sub
+ * groups, e. g. "memory cpu io pids"
+ */
+static int cgroup_enable ( lua_State * const L )
+{
+  luaL_Buffer b ;
+  cgroup_t * cg = cgroup_check ( L ) ;
+  const char * s = luaL_checkstring ( L, 2 ) ;
+  const char * e ;
+
+  luaL_buffinit ( L, & b ) ;
+
+  while ( * s ) {
+    while ( ' ' == * s || '\t' == * s ) { ++ s ; }
+    if ( '\0' == * s ) { break ; }
+    for ( e = s ; * e && ' ' != * e && '\t' != * e ; ++ e ) { ; }
+    if ( '-' != * s && '+' != * s ) { luaL_addchar ( & b, '+' ) ; }
+    luaL_addlstring ( & b, s, e - s ) ;
+    luaL_addchar ( & b, ' ' ) ;
+    s = e ;
+  }
+
+  luaL_pushresult ( & b ) ;
+  return resne0 ( L, "enable", write_str_at ( cg -> fd, "cgroup.subtree_control",
+    lua_tostring ( L, -1 ) ) ) ;
+}
+
+static int cgroup_close ( lua_State * const L )
+{
+  cgroup_t * cg = (cgroup_t *) luaL_checkudata ( L, 1, CGROUP_METATABLE ) ;
+
+  if ( 0 <= cg -> fd ) {
+    CLOSEFD( cg -> fd )
+    cg -> fd = -1 ;
+  }
+
+  free ( cg -> path ) ;
+  cg -> path = NULL ;
+
+  return 0 ;
+}
+
+/* cg:remove ()
+ * removes the cgroup and its sub groups, which all have to be empty
+ * (see kill() and wait_empty()). the object is closed.
+ */
+static int cgroup_remove ( lua_State * const L )
+{
+  int i ;
+  cgroup_t * cg = cgroup_check ( L ) ;
+
+  (void) cgroup_rmdir_subs ( cg -> fd ) ;
+  i = rmdir ( cg -> path ) ;
+  if ( 0 == i ) { (void) cgroup_close ( L ) ; }
+
+  return resne0 ( L, "remove", i ) ;
+}
+
+/* creates the cgroup metatable */
+static int cgroup_create_meta ( lua_State * const L )
+{
+  luaL_newmetatable ( L, CGROUP_METATABLE ) ;
+
+  /* method table */
+  lua_newtable ( L ) ;
+  lua_pushcfunction ( L, cgroup_fileno ) ;
+  lua_setfield ( L, -2, "fileno" ) ;
+  lua_pushcfunction ( L, cgroup_path ) ;
+  lua_setfield ( L, -2, "path" ) ;
+  lua_pushcfunction ( L, cgroup_procs ) ;
+  lua_setfield ( L, -2, "procs" ) ;
+  lua_pushcfunction ( L, cgroup_attach ) ;
+  lua_setfield ( L, -2, "attach" ) ;
+  lua_pushcfunction ( L, cgroup_fork ) ;
+  lua_setfield ( L, -2, "fork" ) ;
+  lua_pushcfunction ( L, cgroup_kill ) ;
+  lua_setfield ( L, -2, "kill" ) ;
+  lua_pushcfunction ( L, cgroup_freeze ) ;
+  lua_setfield ( L, -2, "freeze" ) ;
+  lua_pushcfunction ( L, cgroup_thaw ) ;
+  lua_setfield ( L, -2, "thaw" ) ;
+  lua_pushcfunction ( L, cgroup_frozen ) ;
+  lua_setfield ( L, -2, "frozen" ) ;
+  lua_pushcfunction ( L, cgroup_populated ) ;
+  lua_setfield ( L, -2, "populated" ) ;
+  lua_pushcfunction ( L, cgroup_wait_empty ) ;
+  lua_setfield ( L, -2, "wait_empty" ) ;
+  lua_pushcfunction ( L, cgroup_get ) ;
+  lua_setfield ( L, -2, "get" ) ;
+  lua_pushcfunction ( L, cgroup_set ) ;
+  lua_setfield ( L, -2, "set" ) ;
+  lua_pushcfunction ( L, cgroup_stat ) ;
+  lua_setfield ( L, -2, "stat" ) ;
+  lua_pushcfunction ( L, cgroup_limit ) ;
+  lua_setfield ( L, -2, "limit" ) ;
+  lua_pushcfunction ( L, cgroup_enable ) ;
+  lua_setfield ( L, -2, "enable" ) ;
+  lua_pushcfunction ( L, cgroup_remove ) ;
+  lua_setfield ( L, -2, "remove" ) ;
+  lua_pushcfunction ( L, cgroup_close ) ;
+  lua_setfield ( L, -2, "close" ) ;
+
+  /* metamethods */
+  lua_setfield ( L, -2, "__index" ) ;
+  lua_pushcfunction ( L, cgroup_close ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+
+  return 1 ;
+}
+
+/* pressure stall information */
+
+#define PSI_METATABLE "PSI Trigger Metatable"
+
+/* one line ("some" or "full") of a pressure file */
+typedef struct {
+  double avg10 ;
+  double avg60 ;
+  double avg300 ;
+  /* stall time in us */
+  unsigned long long total ;
+} psi_line_t ;
+
+typedef struct {
+  psi_line_t some ;
+  psi_line_t full ;
+  /* the full line is missing for cpu on older kernels */
+  char has_full ;
+} psi_t ;
+
+typedef struct {
+  int fd ;
+} psi_trigger_t ;
+
+/* parses "[0-9]+(.[0-9]+)?" without the locale dependent strtod() */
+static const char * psi_num ( const char * s, double * const dp )
+{
+  double d = 0, f = 1 ;
+
+  while ( '0' <= * s && '9' >= * s ) { d = 10 * d + ( * s ++ - '0' ) ; }
+
+  if ( '.' == * s ) {
+    for ( ++ s ; '0' <= * s && '9' >= * s ; ++ s ) {
+      f /= 10 ;
+      d += f * ( * s - '0' ) ;
+    }
+  }
+
+  * dp = d ;
+  return s ;
+}
+
+/* parses the fields after "some " or "full " */
+static const char * psi_parse_line ( const char * s, psi_line_t * const lp )
+{
+  while ( * s && '\n' != * s ) {
+    while ( ' ' == * s ) { ++ s ; }
+
+    if ( 0 == strncmp ( s, "avg10=", 6 ) ) { s = psi_num ( s + 6, & lp -> avg10 ) ; }
+    else if ( 0 == strncmp ( s, "avg60=", 6 ) ) { s = psi_num ( s + 6, & lp -> avg60 ) ; }
+    else if ( 0 == strncmp ( s, "avg300=", 7 ) ) { s = psi_num ( s + 7, & lp -> avg300 ) ; }
+    else if ( 0 == strncmp ( s, "total=", 6 ) ) {
+      for ( s += 6, lp -> total = 0 ; '0' <= * s && '9' >= * s ; ++ s ) {
+        lp -> total = 10 * lp -> total + ( * s - '0' ) ;
+      }
+    } else {
+      /* unknown field */
+      while ( * s && ' ' != * s && '\n' != * s ) { ++ s ; }
+    }
+  }
+
+  return s ;
+}
+
+/* parses the contents of a pressure file, returns 0 or -1 */
+static int psi_parse ( const char * s, psi_t * const pp )
+{
+  int n = 0 ;
+
+  (void) memset ( pp, 0, sizeof ( psi_t ) ) ;
+
+  while ( * s ) {
+    if ( 0 == strncmp ( s, "some ", 5 ) ) {
+      s = psi_parse_line ( s + 5, & pp -> some ) ;
+      ++ n ;
+    } else if ( 0 == strncmp ( s, "full ", 5 ) ) {
+      s = psi_parse_line ( s + 5, & pp -> full ) ;
+      pp -> has_full = 1 ;
+    } else {
+      while ( * s && '\n' != * s ) { ++ s ; }
+    }
+
+    if ( '\n' == * s ) { ++ s ; }
+  }
+
+  return n ? 0 : -1 ;
+}
+
+static void psi_push_line ( lua_State * const L, const psi_line_t * const lp )
+{
+  lua_createtable ( L, 0, 4 ) ;
+  lua_pushnumber ( L, lp -> avg10 ) ;
+  lua_setfield ( L, -2, "avg10" ) ;
+  lua_pushnumber ( L, lp -> avg60 ) ;
+  lua_setfield ( L, -2, "avg60" ) ;
+  lua_pushnumber ( L, lp -> avg300 ) ;
+  lua_setfield ( L, -2, "avg300" ) ;
+  lua_pushinteger ( L, lp -> total ) ;
+  lua_setfield ( L, -2, "total" ) ;
+}
+
+/* reads and pushes the pressure file fd refers to */
+static int psi_push ( lua_State * const L, const int fd )
+{
+  ssize_t r ;
+  psi_t ps ;
+  char buf [ 256 ] ;
+
+  r = pread ( fd, buf, sizeof ( buf ) - 1, 0 ) ;
+  if ( 0 > r ) { return res_nil ( L ) ; }
+  buf [ r ] = '\0' ;
+
+  if ( psi_parse ( buf, & ps ) ) {
+    errno = EINVAL ;
+    return res_nil ( L ) ;
+  }
+
+  lua_createtable ( L, 0, 2 ) ;
+  psi_push_line ( L, & ps . some ) ;
+  lua_setfield ( L, -2, "some" ) ;
+
+  if ( ps . has_full ) {
+    psi_push_line ( L, & ps . full ) ;
+    lua_setfield ( L, -2, "full" ) ;
+  }
+
+  return 1 ;
+}
+
+/* opens the pressure file of resource ("cpu", "memory", "io" or "irq"),
+ * system wide or of the cgroup at index i (a cgroup object or path)
+ */
+static int psi_open ( lua_State * const L, const char * const res, const int i, const int flags )
+{
+  char path [ PATH_MAX + 1 ] ;
+  cgroup_t * cg ;
+
+  luaL_argcheck ( L, NULL == strchr ( res, '/' ) && 32 > strlen ( res ), 1, "invalid resource" ) ;
+
+  if ( lua_isnoneornil ( L, i ) ) {
+    (void) snprintf ( path, sizeof ( path ), "/proc/pressure/%s", res ) ;
+    return open ( path, flags | O_CLOEXEC | O_NOCTTY ) ;
+  }
+
+  (void) snprintf ( path, sizeof ( path ), "%s.pressure", res ) ;
+  cg = (cgroup_t *) luaL_testudata ( L, i, CGROUP_METATABLE ) ;
+
+  if ( cg ) {
+    luaL_argcheck ( L, 0 <= cg -> fd, i, "closed cgroup" ) ;
+    return openat ( cg -> fd, path, flags | O_CLOEXEC | O_NOCTTY ) ;
+  }
+
+  (void) snprintf ( path, sizeof ( path ), "%s/%s/%s.pressure", CGROUP_ROOT,
+    luaL_checkstring ( L, i ), res ) ;
+  return open ( path, flags | O_CLOEXEC | O_NOCTTY ) ;
+}
+
+/* psi ( resource [, cgroup] )
+ * returns the pressure of resource ("cpu", "memory", "io" or "irq") as
+ * { some = { avg10, avg60, avg300, total }, full = { ... } }, system wide
+ * or of a cgroup (object or path). the averages are percentages, total
+ * is the stall time in us.
+ */
+static int Lpsi ( lua_State * const L )
+{
+  int e, r ;
+  const int fd = psi_open ( L, luaL_checkstring ( L, 1 ), 2, O_RDONLY ) ;
+
+  if ( 0 > fd ) { return res_nil ( L ) ; }
+  r = psi_push ( L, fd ) ;
+  e = errno ;
+  CLOSEFD( fd )
+  errno = e ;
+
+  return r ;
+}
+
+/* psi_trigger ( resource, trigger [, cgroup] )
+ * registers a trigger like "some 150000 1000000" (stall time and window
+ * in us) on a pressure file. the returned object's fileno signals POLLPRI
+ * (EPOLLPRI) whenever the threshold is exceeded within the window.
+ * without CAP_SYS_RESOURCE the window has to be a multiple of 2 s.
+ */
+static int Lpsi_trigger ( lua_State * const L )
+{
+  int e ;
+  size_t l ;
+  psi_trigger_t * tp ;
+  const char * res = luaL_checkstring ( L, 1 ) ;
+  const char * tr = luaL_checklstring ( L, 2, & l ) ;
+
+  tp = (psi_trigger_t *) lua_newuserdata ( L, sizeof ( psi_trigger_t ) ) ;
+  tp -> fd = -1 ;
+  luaL_getmetatable ( L, PSI_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+
+  tp -> fd = psi_open ( L, res, 3, O_RDWR | O_NONBLOCK ) ;
+  if ( 0 > tp -> fd ) { return res_nil ( L ) ; }
+
+  /* the kernel expects the terminating NUL */
+  if ( 0 > write ( tp -> fd, tr, l + 1 ) ) {
+    e = errno ;
+    CLOSEFD( tp -> fd )
+    tp -> fd = -1 ;
+    errno = e ;
+    return res_nil ( L ) ;
+  }
+
+  return 1 ;
+}
+
+static psi_trigger_t * psi_check ( lua_State * const L )
+{
+  psi_trigger_t * tp = (psi_trigger_t *) luaL_checkudata ( L, 1, PSI_METATABLE ) ;
+
+  luaL_argcheck ( L, 0 <= tp -> fd, 1, "closed psi trigger" ) ;
+  return tp ;
+}
+
+static int psi_fileno ( lua_State * const L )
+{
+  psi_trigger_t * tp = psi_check ( L ) ;
+
+  lua_pushinteger ( L, tp -> fd ) ;
+  return 1 ;
+}
+
+/* tr:read () returns the current pressure like psi() */
+static int psi_read ( lua_State * const L )
+{
+  psi_trigger_t * tp = psi_check ( L ) ;
+
+  return psi_push ( L, tp -> fd ) ;
+}
+
+/* tr:fired ( [timeout] )
+ * waits at most timeout ms (default 0) for the trigger, returns a boolean
+ */
+static int psi_fired ( lua_State * const L )
+{
+  int i ;
+  struct pollfd pfd ;
+  psi_trigger_t * tp = psi_check ( L ) ;
+  const int tmo = luaL_optinteger ( L, 2, 0 ) ;
+
+  pfd . fd = tp -> fd ;
+  pfd . events = POLLPRI ;
+  pfd . revents = 0 ;
+
+  do {
+    i = poll ( & pfd, 1, tmo ) ;
+  } while ( 0 > i && EINTR == errno ) ;
+
+  if ( 0 > i ) { return res_nil ( L ) ; }
+  if ( POLLERR & pfd . revents ) {
+    /* the pressure file (cgroup) is gone */
+    errno = ENODEV ;
+    return res_nil ( L ) ;
+  }
+
+  lua_pushboolean ( L, 0 != ( POLLPRI & pfd . revents ) ) ;
+  return 1 ;
+}
+
+static int psi_close ( lua_State * const L )
+{
+  psi_trigger_t * tp = (psi_trigger_t *) luaL_checkudata ( L, 1, PSI_METATABLE ) ;
+
+  if ( 0 <= tp -> fd ) {
+    CLOSEFD( tp -> fd )
+    tp -> fd = -1 ;
+  }
+
+  return 0 ;
+}
+
+/* creates the psi trigger metatable */
+static int psi_create_meta ( lua_State * const L )
+{
+  luaL_newmetatable ( L, PSI_METATABLE ) ;
+
+  /* method table */
+  lua_newtable ( L ) ;
+  lua_pushcfunction ( L, psi_fileno ) ;
+  lua_setfield ( L, -2, "fileno" ) ;
+  lua_pushcfunction ( L, psi_read ) ;
+  lua_setfield ( L, -2, "read" ) ;
+  lua_pushcfunction ( L, psi_fired ) ;
+  lua_setfield ( L, -2, "fired" ) ;
+  lua_pushcfunction ( L, psi_close ) ;
+  lua_setfield ( L, -2, "close" ) ;
+
+  /* metamethods */
+  lua_setfield ( L, -2, "__index" ) ;
+  lua_pushcfunction ( L, psi_close ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+
+  return 1 ;
+}
+
+#endif
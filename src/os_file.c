@@ -4,6 +4,8 @@
 
 #define DIR_METATABLE "Directory Metatable"
 #define LOCK_METATABLE "Lock Metatable"
+#define WALK_METATABLE "Walk Metatable"
+#define STATX_METATABLE "Statx Metatable"
 
 typedef struct dir_data_s {
   char closed ;
@@ -1062,6 +1064,234 @@ static int get_stat_res ( lua_State * const L, struct stat * sp )
   return 1 ;
 }
 
+#if defined (OSLinux) && defined (STATX_BASIC_STATS)
+/* push the fields of a statx structure that the kernel actually filled
+ * in (according to stx_mask) as a table
+ */
+static int get_statx_res ( lua_State * const L, const struct statx * sp )
+{
+  const unsigned int m = sp -> stx_mask ;
+
+  lua_createtable ( L, 0, 20 ) ;
+
+#define STX_FIELD(f, v) (void) lua_pushliteral ( L, f ) ; \
+  lua_pushinteger ( L, v ) ; lua_rawset ( L, -3 ) ;
+
+  if ( STATX_INO & m ) { STX_FIELD( "ino", sp -> stx_ino ) }
+  if ( STATX_UID & m ) { STX_FIELD( "uid", sp -> stx_uid ) }
+  if ( STATX_GID & m ) { STX_FIELD( "gid", sp -> stx_gid ) }
+  if ( ( STATX_TYPE | STATX_MODE ) & m ) { STX_FIELD( "mode", sp -> stx_mode ) }
+  if ( STATX_SIZE & m ) { STX_FIELD( "size", sp -> stx_size ) }
+  if ( STATX_NLINK & m ) { STX_FIELD( "nlink", sp -> stx_nlink ) }
+  if ( STATX_BLOCKS & m ) { STX_FIELD( "blocks", sp -> stx_blocks ) }
+  if ( STATX_ATIME & m ) {
+    STX_FIELD( "atime", sp -> stx_atime . tv_sec )
+    STX_FIELD( "atimensec", sp -> stx_atime . tv_nsec )
+  }
+  if ( STATX_CTIME & m ) {
+    STX_FIELD( "ctime", sp -> stx_ctime . tv_sec )
+    STX_FIELD( "ctimensec", sp -> stx_ctime . tv_nsec )
+  }
+  if ( STATX_MTIME & m ) {
+    STX_FIELD( "mtime", sp -> stx_mtime . tv_sec )
+    STX_FIELD( "mtimensec", sp -> stx_mtime . tv_nsec )
+  }
+  if ( STATX_BTIME & m ) {
+    STX_FIELD( "btime", sp -> stx_btime . tv_sec )
+    STX_FIELD( "btimensec", sp -> stx_btime . tv_nsec )
+  }
+#  if defined (STATX_MNT_ID)
+  if ( STATX_MNT_ID & m ) { STX_FIELD( "mnt_id", sp -> stx_mnt_id ) }
+#  endif
+
+  /* these are always filled in */
+  STX_FIELD( "blksize", sp -> stx_blksize )
+  STX_FIELD( "attributes", sp -> stx_attributes )
+  STX_FIELD( "attributes_mask", sp -> stx_attributes_mask )
+  STX_FIELD( "dev", makedev ( sp -> stx_dev_major, sp -> stx_dev_minor ) )
+  STX_FIELD( "rdev", makedev ( sp -> stx_rdev_major, sp -> stx_rdev_minor ) )
+  STX_FIELD( "mask", m )
+
+#undef STX_FIELD
+
+  return 1 ;
+}
+
+/*
+ * statx results as userdata, the fields are only converted when they
+ * are accessed and a result can be refilled by later calls
+ */
+
+/* the stx_mask bit of the mount id (Linux 5.8) */
+#if defined (STATX_MNT_ID)
+#  define STATX_MNT_ID_BIT	STATX_MNT_ID
+#else
+#  define STATX_MNT_ID_BIT	0x00001000U
+#endif
+
+/* the fields and the stx_mask bit that tells if they are valid */
+static const struct {
+  const char * name ;
+  unsigned int need ;
+} statx_fields [] = {
+  { "ino",		STATX_INO },
+  { "uid",		STATX_UID },
+  { "gid",		STATX_GID },
+  { "mode",		STATX_TYPE | STATX_MODE },
+  { "size",		STATX_SIZE },
+  { "nlink",		STATX_NLINK },
+  { "blocks",		STATX_BLOCKS },
+  { "atime",		STATX_ATIME },
+  { "atimensec",	STATX_ATIME },
+  { "ctime",		STATX_CTIME },
+  { "ctimensec",	STATX_CTIME },
+  { "mtime",		STATX_MTIME },
+  { "mtimensec",	STATX_MTIME },
+  { "btime",		STATX_BTIME },
+  { "btimensec",	STATX_BTIME },
+  { "mnt_id",		STATX_MNT_ID_BIT },
+  { "blksize",		0 },
+  { "attributes",	0 },
+  { "attributes_mask",	0 },
+  { "dev",		0 },
+  { "rdev",		0 },
+  { "mask",		0 },
+} ;
+
+static int64_t statx_field ( const struct statx * const sp, const int i )
+{
+  switch ( i ) {
+    case 0 : return sp -> stx_ino ;
+    case 1 : return sp -> stx_uid ;
+    case 2 : return sp -> stx_gid ;
+    case 3 : return sp -> stx_mode ;
+    case 4 : return sp -> stx_size ;
+    case 5 : return sp -> stx_nlink ;
+    case 6 : return sp -> stx_blocks ;
+    case 7 : return sp -> stx_atime . tv_sec ;
+    case 8 : return sp -> stx_atime . tv_nsec ;
+    case 9 : return sp -> stx_ctime . tv_sec ;
+    case 10 : return sp -> stx_ctime . tv_nsec ;
+    case 11 : return sp -> stx_mtime . tv_sec ;
+    case 12 : return sp -> stx_mtime . tv_nsec ;
+    case 13 : return sp -> stx_btime . tv_sec ;
+    case 14 : return sp -> stx_btime . tv_nsec ;
+#  if defined (STATX_MNT_ID)
+    case 15 : return sp -> stx_mnt_id ;
+#  endif
+    case 16 : return sp -> stx_blksize ;
+    case 17 : return sp -> stx_attributes ;
+    case 18 : return sp -> stx_attributes_mask ;
+    case 19 : return makedev ( sp -> stx_dev_major, sp -> stx_dev_minor ) ;
+    case 20 : return makedev ( sp -> stx_rdev_major, sp -> stx_rdev_minor ) ;
+    case 21 : return sp -> stx_mask ;
+  }
+
+  return 0 ;
+}
+
+/* __index metamethod, upvalue 1 maps the field names to their index
+ * in statx_fields[] and the method names to the methods.
+ * fields the kernel did not fill in are nil.
+ */
+static int statx_index ( lua_State * const L )
+{
+  int i ;
+  const struct statx * sp = (const struct statx *) luaL_checkudata ( L, 1, STATX_METATABLE ) ;
+
+  lua_pushvalue ( L, 2 ) ;
+  (void) lua_rawget ( L, lua_upvalueindex( 1 ) ) ;
+
+  if ( lua_isinteger ( L, -1 ) ) {
+    i = lua_tointeger ( L, -1 ) ;
+
+    if ( statx_fields [ i ] . need && 0 == ( statx_fields [ i ] . need & sp -> stx_mask ) ) {
+      lua_pushnil ( L ) ;
+    } else {
+      lua_pushinteger ( L, statx_field ( sp, i ) ) ;
+    }
+  }
+
+  return 1 ;
+}
+
+/* st:table () returns all valid fields as table */
+static int statx_table ( lua_State * const L )
+{
+  return get_statx_res ( L, (const struct statx *) luaL_checkudata ( L, 1, STATX_METATABLE ) ) ;
+}
+
+/* calls statx(2) and pushes the result, the statx userdata at index ui
+ * is reused if present.
+ */
+static int statx_push ( lua_State * const L, const int dirfd, const char * const path,
+  const int flags, const unsigned int mask, const int ui )
+{
+  struct statx * sp = (struct statx *) luaL_testudata ( L, ui, STATX_METATABLE ) ;
+  struct statx stx ;
+
+  if ( statx ( dirfd, path, flags, mask, & stx ) ) {
+    return res_nil ( L ) ;
+  }
+
+  if ( sp ) {
+    lua_pushvalue ( L, ui ) ;
+  } else {
+    sp = (struct statx *) lua_newuserdata ( L, sizeof ( struct statx ) ) ;
+    luaL_getmetatable ( L, STATX_METATABLE ) ;
+    lua_setmetatable ( L, -2 ) ;
+  }
+
+  (void) memcpy ( sp, & stx, sizeof ( struct statx ) ) ;
+
+  return 1 ;
+}
+
+/* statx ( file [, mask [, flags [, st]]] )
+ * file is a path or an open fd, mask defaults to STATX_BASIC_STATS and
+ * flags to 0 (AT_SYMLINK_NOFOLLOW, AT_STATX_DONT_SYNC, ...).
+ * returns a statx object whose fields (the names used by stat()
+ * plus btime, mnt_id and attributes) are read on access, nil if the
+ * kernel did not fill them in. the object st is refilled if given.
+ */
+static int Lstatx ( lua_State * const L )
+{
+  const unsigned int mask = luaL_optinteger ( L, 2, STATX_BASIC_STATS ) ;
+  const int flags = luaL_optinteger ( L, 3, 0 ) ;
+
+  if ( lua_isinteger ( L, 1 ) ) {
+    return statx_push ( L, lua_tointeger ( L, 1 ), "", AT_EMPTY_PATH | flags, mask, 4 ) ;
+  }
+
+  return statx_push ( L, AT_FDCWD, luaL_checkstring ( L, 1 ), flags, mask, 4 ) ;
+}
+
+/* creates the statx metatable */
+static int statx_create_meta ( lua_State * const L )
+{
+  int i ;
+
+  luaL_newmetatable ( L, STATX_METATABLE ) ;
+
+  /* field and method lookup table */
+  lua_createtable ( L, 0, ARRAY_SIZE( statx_fields ) + 1 ) ;
+
+  for ( i = 0 ; (int) ARRAY_SIZE( statx_fields ) > i ; ++ i ) {
+    lua_pushinteger ( L, i ) ;
+    lua_setfield ( L, -2, statx_fields [ i ] . name ) ;
+  }
+
+  lua_pushcfunction ( L, statx_table ) ;
+  lua_setfield ( L, -2, "table" ) ;
+
+  /* metamethods */
+  lua_pushcclosure ( L, statx_index, 1 ) ;
+  lua_setfield ( L, -2, "__index" ) ;
+
+  return 1 ;
+}
+#endif
+
 /* wrapper for the stat() syscall */
 static int u_stat ( lua_State * const L )
 {
@@ -1165,17 +1395,41 @@ static int mode_is_sock ( lua_State * const L )
   return 1 ;
 }
 
-/* copies the contents of one file to another */
+/* copies the contents of one file to another.
+ * optional 3rd arg: true to also copy mode, owner, timestamps and
+ * extended attributes or a table selecting them { mode = true,
+ * owner = true, times = true, xattrs = true, reflink = false }
+ */
 static int Lcopy_file ( lua_State * const L )
 {
+  unsigned int f = 0 ;
   const char * src = luaL_checkstring ( L, 1 ) ;
   const char * dst = luaL_checkstring ( L, 2 ) ;
 
+  if ( lua_istable ( L, 3 ) ) {
+    (void) lua_getfield ( L, 3, "mode" ) ;
+    if ( lua_toboolean ( L, -1 ) ) { f |= FCOPY_MODE ; }
+    (void) lua_getfield ( L, 3, "owner" ) ;
+    if ( lua_toboolean ( L, -1 ) ) { f |= FCOPY_OWNER ; }
+    (void) lua_getfield ( L, 3, "times" ) ;
+    if ( lua_toboolean ( L, -1 ) ) { f |= FCOPY_TIMES ; }
+    (void) lua_getfield ( L, 3, "xattrs" ) ;
+    if ( lua_toboolean ( L, -1 ) ) { f |= FCOPY_XATTR ; }
+    if ( LUA_TBOOLEAN == lua_getfield ( L, 3, "reflink" )
+      && 0 == lua_toboolean ( L, -1 ) )
+    {
+      f |= FCOPY_NOREFLINK ;
+    }
+    lua_pop ( L, 5 ) ;
+  } else if ( lua_toboolean ( L, 3 ) ) {
+    f = FCOPY_ALL ;
+  }
+
   if ( src && dst && * src && * dst ) {
     int i = 0 ;
 
     errno = 0 ;
-    i = copy_file ( src, dst ) ;
+    i = copy_file ( src, dst, f ) ;
 
     if ( i && errno ) {
       i = errno ;
@@ -1217,58 +1471,459 @@ static int Lmove_file ( lua_State * const L )
   return 0 ;
 }
 
-/* read a given file at once into a Lua string */
+/*
+ * reading whole files
+ */
+
+#define RDFILE_MIN		4096
+/* larger files are read directly into the Lua string */
+#define RDFILE_SCRATCH_MAX	( 1 << 20 )
+#define RDFILE_SCRATCH		"read_file scratch buffer"
+
+typedef struct {
+  char * data ;
+  size_t cap ;
+} rdfile_scratch_t ;
+
+static int rdfile_scratch_gc ( lua_State * const L )
+{
+  rdfile_scratch_t * sp = (rdfile_scratch_t *) lua_touserdata ( L, 1 ) ;
+
+  if ( sp ) {
+    free ( sp -> data ) ;
+    sp -> data = NULL ;
+    sp -> cap = 0 ;
+  }
+
+  return 0 ;
+}
+
+/* returns the scratch buffer of this Lua state, it is kept in the
+ * registry and grows up to RDFILE_SCRATCH_MAX bytes
+ */
+static rdfile_scratch_t * rdfile_scratch ( lua_State * const L )
+{
+  rdfile_scratch_t * sp ;
+
+  if ( LUA_TUSERDATA == lua_getfield ( L, LUA_REGISTRYINDEX, RDFILE_SCRATCH ) ) {
+    sp = (rdfile_scratch_t *) lua_touserdata ( L, -1 ) ;
+    lua_pop ( L, 1 ) ;
+    return sp ;
+  }
+
+  lua_pop ( L, 1 ) ;
+  sp = (rdfile_scratch_t *) lua_newuserdata ( L, sizeof ( rdfile_scratch_t ) ) ;
+  sp -> data = NULL ;
+  sp -> cap = 0 ;
+  lua_createtable ( L, 0, 1 ) ;
+  lua_pushcfunction ( L, rdfile_scratch_gc ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+  lua_setmetatable ( L, -2 ) ;
+  lua_setfield ( L, LUA_REGISTRYINDEX, RDFILE_SCRATCH ) ;
+
+  return sp ;
+}
+
+/* reads fd up to EOF into * bp (of size * cp, grown as needed).
+ * /proc and /sys files report a size of 0 or 4096, so size is only a
+ * hint and reading goes on until EOF unless a regular file was read
+ * completely. returns the number of bytes read or -1.
+ */
+static ssize_t read_fd_all ( const int fd, const struct stat * const stp,
+  char ** const bp, size_t * const cp )
+{
+  ssize_t r ;
+  size_t n = 0, s ;
+  char * p ;
+
+  s = ( 0 < stp -> st_size ) ? (size_t) stp -> st_size + 1 : RDFILE_MIN ;
+
+  for ( ; ; ) {
+    if ( * cp < s ) {
+      p = (char *) realloc ( * bp, s ) ;
+      if ( NULL == p ) { return -1 ; }
+      * bp = p ;
+      * cp = s ;
+    }
+
+    r = read ( fd, * bp + n, * cp - n ) ;
+
+    if ( 0 > r ) {
+      if ( EINTR == errno ) { continue ; }
+      return -1 ;
+    } else if ( 0 == r ) {
+      break ;
+    }
+
+    n += r ;
+    if ( S_ISREG( stp -> st_mode ) && (size_t) stp -> st_size == n ) { break ; }
+    if ( * cp == n ) { s = 2 * * cp ; }
+  }
+
+  return n ;
+}
+
+/* reads the file fd refers to and pushes its contents as string.
+ * returns 0 or an errno value (and pushes nothing).
+ */
+static int read_file_push ( lua_State * const L, const int fd,
+  rdfile_scratch_t * const sp )
+{
+  ssize_t r ;
+  struct stat st ;
+
+  if ( fstat ( fd, & st ) ) { return errno ; }
+
+  if ( S_ISREG( st . st_mode ) && RDFILE_SCRATCH_MAX <= st . st_size ) {
+    /* large file: read straight into the string, without any
+     * intermediate copy
+     */
+    size_t n = 0 ;
+    luaL_Buffer b ;
+    char * p = luaL_buffinitsize ( L, & b, st . st_size ) ;
+
+    while ( (size_t) st . st_size > n ) {
+      r = read ( fd, p + n, st . st_size - n ) ;
+
+      if ( 0 > r ) {
+        if ( EINTR == errno ) { continue ; }
+        r = errno ;
+        luaL_pushresultsize ( & b, 0 ) ;
+        lua_pop ( L, 1 ) ;
+        return r ;
+      } else if ( 0 == r ) {
+        break ;
+      }
+
+      n += r ;
+    }
+
+    luaL_pushresultsize ( & b, n ) ;
+    return 0 ;
+  }
+
+  r = read_fd_all ( fd, & st, & sp -> data, & sp -> cap ) ;
+  if ( 0 > r ) { return errno ? errno : ENOMEM ; }
+  (void) lua_pushlstring ( L, sp -> data, r ) ;
+
+  /* do not keep a buffer grown by an unusually large pseudo file */
+  if ( RDFILE_SCRATCH_MAX < sp -> cap ) {
+    free ( sp -> data ) ;
+    sp -> data = NULL ;
+    sp -> cap = 0 ;
+  }
+
+  return 0 ;
+}
+
+/* read a given file at once into a Lua string.
+ * returns the size and the contents or a negative value and errno
+ * (-3 if the file can not be opened, -9 if reading fails).
+ * works for /proc and /sys files that do not report their size.
+ */
 static int Lread_file ( lua_State * const L )
 {
   const char * path = luaL_checkstring ( L, 1 ) ;
 
   if ( path && * path ) {
-    int i = open ( path, O_RDONLY | O_NONBLOCK | O_CLOEXEC | O_NOCTTY ) ;
+    int e ;
+    const int fd = open ( path, O_RDONLY | O_NONBLOCK | O_CLOEXEC | O_NOCTTY ) ;
 
-    if ( 0 > i ) {
+    if ( 0 > fd ) {
       /* the open call failed */
-      i = errno ;
+      e = errno ;
       lua_pushinteger ( L, -3 ) ;
-      lua_pushinteger ( L, i ) ;
+      lua_pushinteger ( L, e ) ;
       return 2 ;
-    } else {
-      /* get the file size */
-      off_t o = lseek ( i, 0, SEEK_END ) ;
-      int e = errno ;
-
-      /* (re)set offset to the beginning of the file */
-      if ( 0 < o && 0 == lseek ( i, 0, SEEK_SET ) ) {
-        luaL_Buffer b ;
-        char * p = luaL_buffinitsize ( L, & b, o ) ;
-        const ssize_t s = read ( i, p, o ) ;
-        e = errno ;
-
-        if ( 0 > s ) {
-          lua_pushinteger ( L, -9 ) ;
-          lua_pushinteger ( L, e ) ;
-        } else {
-          lua_pushinteger ( L, s ) ;
-        }
+    }
 
-        luaL_pushresultsize ( & b, o ) ;
-      } else {
-        lua_pushinteger ( L, -5 ) ;
-        lua_pushinteger ( L, e ) ;
-      }
+    e = read_file_push ( L, fd, rdfile_scratch ( L ) ) ;
+    close_fd ( fd ) ;
 
-      close_fd ( i ) ;
+    if ( e ) {
+      lua_pushinteger ( L, -9 ) ;
+      lua_pushinteger ( L, e ) ;
       return 2 ;
     }
+
+    lua_pushinteger ( L, luaL_len ( L, -1 ) ) ;
+    lua_insert ( L, -2 ) ;
+    return 2 ;
   }
 
   return 0 ;
 }
 
+/* read_files ( paths )
+ * reads a list of (small) files, e. g. /proc/<pid>/stat of many
+ * processes. returns the number of files read, an array with the
+ * contents (false for failed files) and a table that maps the
+ * indexes of the failed files to errno.
+ */
+static int Lread_files ( lua_State * const L )
+{
+  int e, fd ;
+  lua_Integer i, n, ok = 0 ;
+  const char * path ;
+  rdfile_scratch_t * sp ;
+
+  luaL_checktype ( L, 1, LUA_TTABLE ) ;
+  n = luaL_len ( L, 1 ) ;
+  sp = rdfile_scratch ( L ) ;
+  lua_settop ( L, 1 ) ;
+  lua_createtable ( L, (int) n, 0 ) ;
+  lua_newtable ( L ) ;
+
+  for ( i = 1 ; n >= i ; ++ i ) {
+    /* strings only, they stay referenced by the table after the pop */
+    if ( LUA_TSTRING != lua_rawgeti ( L, 1, i ) ) {
+      return luaL_error ( L, "file name expected at index %d", (int) i ) ;
+    }
+
+    path = lua_tostring ( L, -1 ) ;
+    lua_pop ( L, 1 ) ;
+
+    fd = open ( path, O_RDONLY | O_NONBLOCK | O_CLOEXEC | O_NOCTTY ) ;
+
+    if ( 0 > fd ) {
+      e = errno ;
+    } else {
+      e = read_file_push ( L, fd, sp ) ;
+      close_fd ( fd ) ;
+    }
+
+    if ( e ) {
+      lua_pushinteger ( L, e ) ;
+      lua_rawseti ( L, 3, i ) ;
+      lua_pushboolean ( L, 0 ) ;
+    } else {
+      ++ ok ;
+    }
+
+    lua_rawseti ( L, 2, i ) ;
+  }
+
+  lua_pushinteger ( L, ok ) ;
+  lua_insert ( L, 2 ) ;
+  return 3 ;
+}
+
 /*
  * directory related functions
  */
 
-/* returns the contents of a given directory in a new table */
+/* columns of the typed directory listings */
+enum {
+  DIRCOL_NAME = 0,
+  DIRCOL_TYPE,
+  DIRCOL_INO,
+  DIRCOL_MODE,
+  DIRCOL_SIZE,
+  DIRCOL_MTIME,
+  DIRCOL_BTIME,
+  DIRCOL_MAX,
+} ;
+
+static const char * const dircol_names [ DIRCOL_MAX ] = {
+  "name", "type", "ino", "mode", "size", "mtime", "btime",
+} ;
+
+#define DIRCOL_BIT(c)	( 1U << (c) )
+#define DIRCOL_BASIC	( DIRCOL_BIT( DIRCOL_NAME ) | DIRCOL_BIT( DIRCOL_TYPE ) \
+  | DIRCOL_BIT( DIRCOL_INO ) )
+
+/* a directory entry and the fields that could be obtained for it */
+typedef struct {
+  const char * name ;
+  unsigned int cols ;
+  char type [ 2 ] ;
+  int64_t val [ DIRCOL_MAX ] ;
+} dirent_info_t ;
+
+/* gets the wanted columns (bits of cols) for the entry de of the
+ * directory fd, only stats the entry when needed.
+ */
+static void dirent_info ( const int fd, const struct dirent * const de,
+  const unsigned int cols, dirent_info_t * const ip )
+{
+  ip -> name = de -> d_name ;
+  ip -> cols = DIRCOL_BASIC ;
+  ip -> type [ 0 ] = walk_type_char ( de -> d_type ) ;
+  ip -> type [ 1 ] = '\0' ;
+  ip -> val [ DIRCOL_INO ] = de -> d_ino ;
+
+  if ( 0 == ( ~ DIRCOL_BASIC & cols ) && DT_UNKNOWN != de -> d_type ) { return ; }
+
+#if defined (OSLinux) && defined (STATX_BASIC_STATS)
+  {
+    struct statx stx ;
+
+    if ( statx ( fd, de -> d_name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+      STATX_TYPE | STATX_MODE | ( DIRCOL_BIT( DIRCOL_SIZE ) & cols ? STATX_SIZE : 0 )
+      | ( DIRCOL_BIT( DIRCOL_MTIME ) & cols ? STATX_MTIME : 0 )
+      | ( DIRCOL_BIT( DIRCOL_BTIME ) & cols ? STATX_BTIME : 0 ), & stx ) )
+    {
+      return ;
+    }
+
+    if ( STATX_TYPE & stx . stx_mask ) {
+      ip -> type [ 0 ] = walk_type_char ( IFTODT( stx . stx_mode ) ) ;
+    }
+
+    if ( STATX_MODE & stx . stx_mask ) {
+      ip -> cols |= DIRCOL_BIT( DIRCOL_MODE ) ;
+      ip -> val [ DIRCOL_MODE ] = stx . stx_mode ;
+    }
+
+    if ( STATX_SIZE & stx . stx_mask ) {
+      ip -> cols |= DIRCOL_BIT( DIRCOL_SIZE ) ;
+      ip -> val [ DIRCOL_SIZE ] = stx . stx_size ;
+    }
+
+    if ( STATX_MTIME & stx . stx_mask ) {
+      ip -> cols |= DIRCOL_BIT( DIRCOL_MTIME ) ;
+      ip -> val [ DIRCOL_MTIME ] = stx . stx_mtime . tv_sec ;
+    }
+
+    if ( STATX_BTIME & stx . stx_mask ) {
+      ip -> cols |= DIRCOL_BIT( DIRCOL_BTIME ) ;
+      ip -> val [ DIRCOL_BTIME ] = stx . stx_btime . tv_sec ;
+    }
+  }
+#else
+  {
+    struct stat st ;
+
+    if ( fstatat ( fd, de -> d_name, & st, AT_SYMLINK_NOFOLLOW ) ) { return ; }
+
+    ip -> type [ 0 ] = walk_type_char ( IFTODT( st . st_mode ) ) ;
+    ip -> cols |= DIRCOL_BIT( DIRCOL_MODE ) | DIRCOL_BIT( DIRCOL_SIZE )
+      | DIRCOL_BIT( DIRCOL_MTIME ) ;
+    ip -> val [ DIRCOL_MODE ] = st . st_mode ;
+    ip -> val [ DIRCOL_SIZE ] = st . st_size ;
+    ip -> val [ DIRCOL_MTIME ] = st . st_mtime ;
+  }
+#endif
+
+  ip -> cols &= cols ;
+}
+
+/* pushes a column value of an entry, false if it is not available */
+static void dirent_push_col ( lua_State * const L, const dirent_info_t * const ip,
+  const int c )
+{
+  if ( DIRCOL_NAME == c ) {
+    (void) lua_pushstring ( L, ip -> name ) ;
+  } else if ( DIRCOL_TYPE == c ) {
+    (void) lua_pushstring ( L, ip -> type ) ;
+  } else if ( DIRCOL_BIT( c ) & ip -> cols ) {
+    lua_pushinteger ( L, ip -> val [ c ] ) ;
+  } else {
+    lua_pushboolean ( L, 0 ) ;
+  }
+}
+
+/* gets the options of the typed dir listings from the table at index i:
+ * columnar (boolean) and stat (true for all fields or a STATX_* mask).
+ * returns the wanted columns.
+ */
+static unsigned int dir_get_opts ( lua_State * const L, const int i, int * const colp )
+{
+  unsigned int cols = DIRCOL_BASIC ;
+
+  * colp = 0 ;
+  if ( 0 == lua_istable ( L, i ) ) { return cols ; }
+
+  lua_getfield ( L, i, "columnar" ) ;
+  * colp = lua_toboolean ( L, -1 ) ;
+  lua_getfield ( L, i, "stat" ) ;
+
+  if ( lua_isinteger ( L, -1 ) ) {
+#if defined (OSLinux) && defined (STATX_BASIC_STATS)
+    const unsigned int m = lua_tointeger ( L, -1 ) ;
+
+    if ( ( STATX_TYPE | STATX_MODE ) & m ) { cols |= DIRCOL_BIT( DIRCOL_MODE ) ; }
+    if ( STATX_SIZE & m ) { cols |= DIRCOL_BIT( DIRCOL_SIZE ) ; }
+    if ( STATX_MTIME & m ) { cols |= DIRCOL_BIT( DIRCOL_MTIME ) ; }
+    if ( STATX_BTIME & m ) { cols |= DIRCOL_BIT( DIRCOL_BTIME ) ; }
+#endif
+  } else if ( lua_toboolean ( L, -1 ) ) {
+    cols = DIRCOL_BIT( DIRCOL_MAX ) - 1 ;
+  }
+
+  lua_pop ( L, 2 ) ;
+
+  return cols ;
+}
+
+/* reads up to max (all if negative) entries besides . and .. from dirp
+ * and pushes them either as array of tables or as a table of parallel
+ * arrays (one per column). returns the number of entries.
+ */
+static int dir_read_typed ( lua_State * const L, DIR * const dirp, const int max,
+  const int columnar, const unsigned int cols )
+{
+  int c, n = 0, top ;
+  struct dirent * de ;
+  dirent_info_t di ;
+  const int fd = dirfd ( dirp ) ;
+
+  if ( columnar ) {
+    lua_createtable ( L, 0, DIRCOL_MAX ) ;
+    top = lua_gettop ( L ) ;
+    for ( c = 0 ; DIRCOL_MAX > c ; ++ c ) { lua_newtable ( L ) ; }
+  } else {
+    lua_newtable ( L ) ;
+    top = lua_gettop ( L ) ;
+  }
+
+  while ( ( 0 > max || max > n ) && NULL != ( de = readdir ( dirp ) ) ) {
+    if ( '.' == de -> d_name [ 0 ] && ( '\0' == de -> d_name [ 1 ]
+      || ( '.' == de -> d_name [ 1 ] && '\0' == de -> d_name [ 2 ] ) ) )
+    {
+      continue ;
+    }
+
+    dirent_info ( fd, de, cols, & di ) ;
+    ++ n ;
+
+    if ( columnar ) {
+      for ( c = 0 ; DIRCOL_MAX > c ; ++ c ) {
+        if ( DIRCOL_BIT( c ) & cols ) {
+          dirent_push_col ( L, & di, c ) ;
+          lua_rawseti ( L, top + 1 + c, n ) ;
+        }
+      }
+    } else {
+      lua_createtable ( L, 0, DIRCOL_MAX ) ;
+
+      for ( c = 0 ; DIRCOL_MAX > c ; ++ c ) {
+        if ( DIRCOL_BIT( c ) & di . cols ) {
+          dirent_push_col ( L, & di, c ) ;
+          lua_setfield ( L, -2, dircol_names [ c ] ) ;
+        }
+      }
+
+      lua_rawseti ( L, top, n ) ;
+    }
+  }
+
+  if ( columnar ) {
+    for ( c = DIRCOL_MAX - 1 ; 0 <= c ; -- c ) {
+      if ( DIRCOL_BIT( c ) & cols ) { lua_setfield ( L, top, dircol_names [ c ] ) ; }
+      else { lua_pop ( L, 1 ) ; }
+    }
+  }
+
+  return n ;
+}
+
+/* returns the contents of a given directory in a new table and the
+ * number of entries. with an options table as 2nd arg (see dir_get_opts())
+ * . and .. are skipped and every entry is returned with its name, type
+ * letter and inode number from the dirent, plus mode, size, mtime and
+ * btime if requested, as record or in columns.
+ */
 static int list_dir ( lua_State * const L )
 {
   int i = 0 ;
@@ -1285,12 +1940,19 @@ static int list_dir ( lua_State * const L )
     return 2 ;
   }
 
-  lua_newtable( L ) ;
-  i = 0 ;
+  if ( lua_istable ( L, 2 ) ) {
+    int columnar ;
+    const unsigned int cols = dir_get_opts ( L, 2, & columnar ) ;
+
+    i = dir_read_typed ( L, dp, -1, columnar, cols ) ;
+  } else {
+    lua_newtable( L ) ;
+    i = 0 ;
 
-  while ( NULL != ( d = readdir ( dp ) ) ) {
-    (void) lua_pushstring ( L, d -> d_name ) ;
-    lua_rawseti ( L, -2, ++ i ) ;
+    while ( NULL != ( d = readdir ( dp ) ) ) {
+      (void) lua_pushstring ( L, d -> d_name ) ;
+      lua_rawseti ( L, -2, ++ i ) ;
+    }
   }
 
   (void) closedir ( dp ) ;
@@ -1327,6 +1989,30 @@ static int dir_iter ( lua_State * const L )
   return 0 ;
 }
 
+/* dir:read ( n [, opts] )
+ * returns up to n typed entries (like list_dir() with options)
+ * or nothing at the end of the directory
+ */
+static int dir_read ( lua_State * const L )
+{
+  int columnar ;
+  unsigned int cols ;
+  dir_data_t * dp = (dir_data_t *) luaL_checkudata ( L, 1, DIR_METATABLE ) ;
+  const int max = luaL_checkinteger ( L, 2 ) ;
+
+  luaL_argcheck ( L, 0 == dp -> closed, 1, "closed directory" ) ;
+  luaL_argcheck ( L, 0 < max, 2, "positive number expected" ) ;
+  cols = dir_get_opts ( L, 3, & columnar ) ;
+
+  if ( 0 == dir_read_typed ( L, dp -> dirp, max, columnar, cols ) ) {
+    (void) closedir ( dp -> dirp ) ;
+    dp -> closed = 3 ;
+    return 0 ;
+  }
+
+  return 1 ;
+}
+
 /* closes directory iterators */
 static int dir_close ( lua_State * const L )
 {
@@ -1375,6 +2061,8 @@ static int dir_create_meta ( lua_State * const L )
   lua_newtable ( L ) ;
   lua_pushcfunction ( L, dir_iter ) ;
   lua_setfield ( L, -2, "next" ) ;
+  lua_pushcfunction ( L, dir_read ) ;
+  lua_setfield ( L, -2, "read" ) ;
   lua_pushcfunction ( L, dir_close ) ;
   lua_setfield ( L, -2, "close" ) ;
 
@@ -1386,7 +2074,228 @@ static int dir_create_meta ( lua_State * const L )
   return 1 ;
 }
 
-/* TODO: wrapper for nftw(3) */
+/*
+ * directory tree walker
+ */
+
+typedef struct {
+  char closed ;
+  walk_t w ;
+  walk_rec_t * recs ;
+} walk_data_t ;
+
+/* pushes a batch of walk records as array of tables */
+static void walk_push_recs ( lua_State * const L, walk_rec_t * const rp, const size_t n )
+{
+  size_t i ;
+  char t [ 2 ] = { 0, 0 } ;
+
+  lua_createtable ( L, (int) n, 0 ) ;
+
+  for ( i = 0 ; n > i ; ++ i ) {
+    lua_createtable ( L, 0, rp [ i ] . has_stat ? 11 : 5 ) ;
+    (void) lua_pushstring ( L, rp [ i ] . path ) ;
+    lua_setfield ( L, -2, "path" ) ;
+    (void) lua_pushstring ( L, rp [ i ] . path + rp [ i ] . name ) ;
+    lua_setfield ( L, -2, "name" ) ;
+    t [ 0 ] = walk_type_char ( rp [ i ] . type ) ;
+    (void) lua_pushstring ( L, t ) ;
+    lua_setfield ( L, -2, "type" ) ;
+    lua_pushinteger ( L, rp [ i ] . depth ) ;
+    lua_setfield ( L, -2, "depth" ) ;
+    lua_pushinteger ( L, rp [ i ] . ino ) ;
+    lua_setfield ( L, -2, "ino" ) ;
+
+    if ( rp [ i ] . err ) {
+      lua_pushinteger ( L, rp [ i ] . err ) ;
+      lua_setfield ( L, -2, "errno" ) ;
+    }
+
+    if ( rp [ i ] . has_stat ) {
+      lua_pushinteger ( L, rp [ i ] . mode ) ;
+      lua_setfield ( L, -2, "mode" ) ;
+      lua_pushinteger ( L, rp [ i ] . size ) ;
+      lua_setfield ( L, -2, "size" ) ;
+      lua_pushinteger ( L, rp [ i ] . mtime ) ;
+      lua_setfield ( L, -2, "mtime" ) ;
+      lua_pushinteger ( L, rp [ i ] . uid ) ;
+      lua_setfield ( L, -2, "uid" ) ;
+      lua_pushinteger ( L, rp [ i ] . gid ) ;
+      lua_setfield ( L, -2, "gid" ) ;
+      lua_pushinteger ( L, rp [ i ] . nlink ) ;
+      lua_setfield ( L, -2, "nlink" ) ;
+    }
+
+    lua_rawseti ( L, -2, 1 + i ) ;
+  }
+}
+
+/* returns the next batch of entries or nothing when the walk is done */
+static int walk_iter ( lua_State * const L )
+{
+  size_t i, n ;
+  walk_data_t * wp = (walk_data_t *) luaL_checkudata ( L, 1, WALK_METATABLE ) ;
+
+  if ( wp -> closed ) { return 0 ; }
+
+  n = walk_next ( & wp -> w, wp -> recs ) ;
+
+  if ( 0 == n ) {
+    /* done, the threads and buffers can be released */
+    walk_stop ( & wp -> w ) ;
+    free ( wp -> recs ) ;
+    wp -> recs = NULL ;
+    wp -> closed = 3 ;
+    return 0 ;
+  }
+
+  walk_push_recs ( L, wp -> recs, n ) ;
+  for ( i = 0 ; n > i ; ++ i ) { free ( wp -> recs [ i ] . path ) ; }
+
+  return 1 ;
+}
+
+/* stops a walk */
+static int walk_close ( lua_State * const L )
+{
+  walk_data_t * wp = (walk_data_t *) luaL_checkudata ( L, 1, WALK_METATABLE ) ;
+
+  if ( 0 == wp -> closed ) {
+    walk_stop ( & wp -> w ) ;
+    free ( wp -> recs ) ;
+    wp -> recs = NULL ;
+    wp -> closed = 3 ;
+  }
+
+  return 0 ;
+}
+
+/* walk ( path [, opts] )
+ * walks the directory tree below path and returns an iterator (and the
+ * walk object) for generic for loops. every call returns an array of up
+ * to opts.batch (default 256) entries, each a table with the fields
+ * path, name, type (one of the find(1) -type letters), depth and ino,
+ * mode, size, mtime, uid, gid and nlink if stat is requested and errno
+ * for dirs that could not be read.
+ * options: glob (pattern for the name), regex (extended regex for the
+ * path), type (string of type letters, e. g. "fd"), min_size, max_size,
+ * newer, older (mtime in seconds since the epoch), maxdepth,
+ * one_filesystem, stat, threads (walk subtrees in parallel) and batch.
+ * dirs are always descended, the filters only select what is returned.
+ */
+static int Lwalk ( lua_State * const L )
+{
+  int i ;
+  const char * s ;
+  walk_data_t * wp ;
+  const char * const path = luaL_checkstring ( L, 1 ) ;
+
+  luaL_argcheck ( L, '\0' != * path, 1, "pathname expected" ) ;
+  lua_pushcfunction ( L, walk_iter ) ;
+  wp = (walk_data_t *) lua_newuserdata ( L, sizeof ( walk_data_t ) ) ;
+  wp -> closed = 3 ;
+  wp -> recs = NULL ;
+  luaL_getmetatable ( L, WALK_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+  walk_init ( & wp -> w ) ;
+  wp -> closed = 0 ;
+
+  if ( lua_istable ( L, 2 ) ) {
+    lua_getfield ( L, 2, "threads" ) ;
+    wp -> w . threads = luaL_optinteger ( L, -1, 1 ) ;
+    lua_getfield ( L, 2, "batch" ) ;
+    wp -> w . batch = luaL_optinteger ( L, -1, 256 ) ;
+    lua_getfield ( L, 2, "maxdepth" ) ;
+    wp -> w . maxdepth = luaL_optinteger ( L, -1, -1 ) ;
+    lua_getfield ( L, 2, "one_filesystem" ) ;
+    wp -> w . one_fs = lua_toboolean ( L, -1 ) ;
+    lua_getfield ( L, 2, "stat" ) ;
+    wp -> w . need_stat = lua_toboolean ( L, -1 ) ;
+    lua_getfield ( L, 2, "min_size" ) ;
+    wp -> w . min_size = luaL_optinteger ( L, -1, -1 ) ;
+    lua_getfield ( L, 2, "max_size" ) ;
+    wp -> w . max_size = luaL_optinteger ( L, -1, -1 ) ;
+    lua_getfield ( L, 2, "newer" ) ;
+    wp -> w . newer = luaL_optinteger ( L, -1, 0 ) ;
+    lua_getfield ( L, 2, "older" ) ;
+    wp -> w . older = luaL_optinteger ( L, -1, 0 ) ;
+    lua_pop ( L, 9 ) ;
+
+    if ( 0 <= wp -> w . min_size || 0 <= wp -> w . max_size
+      || wp -> w . newer || wp -> w . older )
+    {
+      wp -> w . need_stat = 1 ;
+    }
+
+    lua_getfield ( L, 2, "type" ) ;
+    s = luaL_optstring ( L, -1, NULL ) ;
+
+    for ( ; s && * s ; ++ s ) {
+      switch ( * s ) {
+        case 'f' : wp -> w . types |= 1U << DT_REG ; break ;
+        case 'd' : wp -> w . types |= 1U << DT_DIR ; break ;
+        case 'l' : wp -> w . types |= 1U << DT_LNK ; break ;
+        case 'c' : wp -> w . types |= 1U << DT_CHR ; break ;
+        case 'b' : wp -> w . types |= 1U << DT_BLK ; break ;
+        case 'p' : wp -> w . types |= 1U << DT_FIFO ; break ;
+        case 's' : wp -> w . types |= 1U << DT_SOCK ; break ;
+        default :
+          return luaL_argerror ( L, 2, "invalid type letter" ) ;
+      }
+    }
+
+    lua_getfield ( L, 2, "glob" ) ;
+    s = luaL_optstring ( L, -1, NULL ) ;
+    if ( s && NULL == ( wp -> w . glob = strdup ( s ) ) ) {
+      return luaL_error ( L, "out of memory" ) ;
+    }
+
+    lua_getfield ( L, 2, "regex" ) ;
+    s = luaL_optstring ( L, -1, NULL ) ;
+
+    if ( s ) {
+      i = regcomp ( & wp -> w . re, s, REG_EXTENDED | REG_NOSUB ) ;
+      if ( i ) { return luaL_argerror ( L, 2, "invalid regex" ) ; }
+      wp -> w . has_re = 1 ;
+    }
+
+    lua_pop ( L, 3 ) ;
+  }
+
+  wp -> recs = (walk_rec_t *) malloc ( ( 0 < wp -> w . batch ? wp -> w . batch : 256 )
+    * sizeof ( walk_rec_t ) ) ;
+  if ( NULL == wp -> recs ) {
+    return luaL_error ( L, "out of memory" ) ;
+  }
+
+  i = walk_start ( & wp -> w, AT_FDCWD, path ) ;
+
+  if ( i ) {
+    return luaL_error ( L, "cannot walk %s: %s", path, strerror ( i ) ) ;
+  }
+
+  return 2 ;
+}
+
+/* creates the tree walker metatable */
+static int walk_create_meta ( lua_State * const L )
+{
+  luaL_newmetatable ( L, WALK_METATABLE ) ;
+
+  /* method table */
+  lua_newtable ( L ) ;
+  lua_pushcfunction ( L, walk_iter ) ;
+  lua_setfield ( L, -2, "next" ) ;
+  lua_pushcfunction ( L, walk_close ) ;
+  lua_setfield ( L, -2, "close" ) ;
+
+  /* metamethods */
+  lua_setfield ( L, -2, "__index" ) ;
+  lua_pushcfunction ( L, walk_close ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+
+  return 1 ;
+}
 
 /* remove given files/dirs (recursively) */
 static int Lrm ( lua_State * const L )
@@ -1465,97 +2374,66 @@ static int rm_dir ( const char * pathname, const char top )
 }
 #endif
 
-/* helper function that removes files recursively */
-static int rmd ( const char top, const char * path )
+/* (recursively) remove given files/directories.
+ * an optional table as last arg holds options:
+ *   threads (number of worker threads, default 1),
+ *   one_filesystem (do not descend into mount points),
+ *   dry_run (only count what would be removed).
+ * returns the number of entries that could not be removed and a table
+ * with the fields files, dirs, errors and failed (a list of
+ * { path, errno } pairs for the first errors).
+ */
+static int Lrmr ( lua_State * const L )
 {
-  int i, r = 0, fd = -1 ;
-  DIR * dp ;
-  struct dirent * de ;
-  struct stat st ;
-
-  fd = open ( path, O_CLOEXEC | O_PATH | O_DIRECTORY | O_NOFOLLOW ) ;
-  if ( 0 > fd ) { return 1 ; }
-
-  dp = fdopendir ( fd ) ;
-  if ( NULL == dp ) {
-    close_fd ( fd ) ;
-    return 1 ;
+  int i, n = lua_gettop ( L ), threads = 1 ;
+  char one_fs = 0, dry_run = 0 ;
+  unsigned long r = 0 ;
+  const char * path = NULL ;
+  rmtree_t rt ;
+
+  if ( 0 < n && lua_istable ( L, n ) ) {
+    lua_getfield ( L, n, "threads" ) ;
+    threads = luaL_optinteger ( L, -1, 1 ) ;
+    lua_getfield ( L, n, "one_filesystem" ) ;
+    one_fs = lua_toboolean ( L, -1 ) ;
+    lua_getfield ( L, n, "dry_run" ) ;
+    dry_run = lua_toboolean ( L, -1 ) ;
+    lua_pop ( L, 3 ) ;
+    -- n ;
   }
 
-  while ( NULL != ( de = readdir ( dp ) ) )
-  {
-    if ( '.' == de -> d_name [ 0 ] ) {
-       if ( '\0' == de -> d_name [ 1 ] ) { continue ; }
-       else if ( '.' == de -> d_name [ 1 ] && '\0' == de -> d_name [ 2 ] )
-       { continue ; }
-    }
-
-    if ( DT_DIR == de -> d_type ) {
-      i = unlinkat ( fd, de -> d_name, AT_REMOVEDIR ) ;
-
-      if ( i && ( ENOTEMPTY == errno || EEXIST == errno ) ) {
-        r += rmd ( 0, de -> d_name ) ;
-      } else if ( i ) { ++ r ; }
-
-      continue ;
-    } else if ( DT_UNKNOWN != de -> d_type ) {
-      r -= unlinkat ( fd, de -> d_name, 0 ) ;
-      continue ;
-    }
+  for ( i = 1 ; n >= i ; ++ i ) { (void) luaL_checkstring ( L, i ) ; }
 
-    if ( 0 == fstatat ( fd, de -> d_name, & st, AT_SYMLINK_NOFOLLOW ) ) {
-      if ( S_ISDIR ( st . st_mode ) ) {
-        i = unlinkat ( fd, de -> d_name, AT_REMOVEDIR ) ;
+  rmtree_init ( & rt, threads, one_fs, dry_run ) ;
 
-        if ( i && ( ENOTEMPTY == errno || EEXIST == errno ) ) {
-          r += rmd ( 0, de -> d_name ) ;
-        } else if ( i ) { ++ r ; }
-      } else {
-        r -= unlinkat ( fd, de -> d_name, 0 ) ;
-      }
-    }
+  for ( i = 1 ; n >= i ; ++ i ) {
+    path = lua_tostring ( L, i ) ;
+    if ( * path ) { r += rmtree ( AT_FDCWD, path, & rt ) ; }
   }
 
-  r -= closedir ( dp ) ;
-  close_fd ( fd ) ;
-  if ( top && rmdir ( path ) ) { return 1 ; }
-
-  return r ;
-}
-
-/* (recursively) remove given files/directories */
-static int Lrmr ( lua_State * const L )
-{
-  const int n = lua_gettop ( L ) ;
-
-  if ( 0 < n ) {
-    int i, j, r = 0 ;
-    struct stat st ;
-    const char * path = NULL ;
-
-    for ( i = 1 ; n >= i ; ++ i ) {
-      path = luaL_checkstring ( L, i ) ;
-
-      if ( path && * path ) {
-        j = lstat ( path, & st ) ;
-
-        if ( 0 == j && 0 < st . st_nlink ) {
-          if ( S_ISDIR( st . st_mode ) ) {
-            j = rmdir ( path ) ;
-
-            if ( j && ( ENOTEMPTY == errno || EEXIST == errno ) )
-            { r += rmd ( 3, path ) ; }
-            else if ( j ) { ++ r ; }
-          } else { r -= unlink ( path ) ; }
-        }
-      }
-    }
-
-    lua_pushinteger ( L, r ) ;
-    return 1 ;
+  lua_pushinteger ( L, r ) ;
+  lua_createtable ( L, 0, 4 ) ;
+  lua_pushinteger ( L, rt . files ) ;
+  lua_setfield ( L, -2, "files" ) ;
+  lua_pushinteger ( L, rt . dirs ) ;
+  lua_setfield ( L, -2, "dirs" ) ;
+  lua_pushinteger ( L, rt . errors ) ;
+  lua_setfield ( L, -2, "errors" ) ;
+  lua_createtable ( L, rt . nfailed, 0 ) ;
+
+  for ( i = 0 ; rt . nfailed > i ; ++ i ) {
+    lua_createtable ( L, 0, 2 ) ;
+    lua_pushstring ( L, rt . failed [ i ] . path ) ;
+    lua_setfield ( L, -2, "path" ) ;
+    lua_pushinteger ( L, rt . failed [ i ] . err ) ;
+    lua_setfield ( L, -2, "errno" ) ;
+    lua_rawseti ( L, -2, 1 + i ) ;
   }
 
-  return 0 ;
+  lua_setfield ( L, -2, "failed" ) ;
+  rmtree_free ( & rt ) ;
+
+  return 2 ;
 }
 
 /* add wrapper for makedev ? */
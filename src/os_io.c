@@ -246,13 +246,30 @@ static int Swrite ( lua_State * const L )
 
 #define BUF_LEN		801
 
-/* wrapper function for the read syscall */
+/* wrapper function for the read syscall.
+ * an optional buffer object as 3rd arg receives the data instead of
+ * a new Lua string.
+ */
 static int Sread ( lua_State * const L )
 {
   int i = luaL_checkinteger ( L, 1 ) ;
   size_t s = (lua_Unsigned) luaL_checkinteger ( L, 2 ) ;
+  lbuf_t * bp = lbuf_test ( L, 3 ) ;
+
+  if ( bp && 0 <= i && 0 < s ) {
+    ssize_t r = lbuf_read_fd ( bp, i, s ) ;
+
+    if ( 0 > r ) {
+      i = errno ;
+      lua_pushinteger ( L, -3 ) ;
+      lua_pushinteger ( L, i ) ;
+      return 2 ;
+    }
 
-  if ( 0 <= i && 0 < s ) {
+    lua_pushinteger ( L, r ) ;
+    lua_pushvalue ( L, 3 ) ;
+    return ( 0 < r ) ? 2 : 1 ;
+  } else if ( 0 <= i && 0 < s ) {
     if ( 0 < s && BUF_LEN > s ) {
       char buf [ BUF_LEN ] = { 0 } ;
 
@@ -264,7 +281,7 @@ static int Sread ( lua_State * const L )
         return 2 ;
       } else if ( 0 < i ) {
         lua_pushinteger ( L, i ) ;
-        lua_pushstring ( L, buf ) ;
+        (void) lua_pushlstring ( L, buf, i ) ;
         return 2 ;
       } else if ( 0 == i ) {
         lua_pushinteger ( L, 0 ) ;
@@ -275,7 +292,7 @@ static int Sread ( lua_State * const L )
       luaL_Buffer b ;
       char * p = luaL_buffinitsize ( L, & b, s ) ;
       i = read ( i, p, s ) ;
-      luaL_pushresultsize ( & b, s ) ;
+      luaL_pushresultsize ( & b, ( 0 < i ) ? i : 0 ) ;
 
       if ( 0 > i ) {
         i = errno ;
@@ -295,11 +312,39 @@ static int Sread ( lua_State * const L )
   return 0 ;
 }
 
+/* helper function for Lbuf_read and Lbuf_read_close that reads into
+ * a buffer object (given as 2nd arg) instead of creating a Lua string
+ */
+static int buf_read_into ( lua_State * const L, lbuf_t * const bp,
+  const int fd, const int cl )
+{
+  const ssize_t s = lbuf_read_fd ( bp, fd, 0 ) ;
+
+  if ( 0 == s ) {
+    /* reached EOF */
+    if ( cl ) { CLOSEFD( fd ) }
+    lua_pushnil ( L ) ;
+    return 1 ;
+  } else if ( 0 > s ) {
+    const int e = errno ;
+    lua_pushnil ( L ) ;
+    lua_pushinteger ( L, e ) ;
+    return 2 ;
+  }
+
+  lua_pushvalue ( L, 2 ) ;
+  lua_pushinteger ( L, s ) ;
+  return 2 ;
+}
+
 static int Lbuf_read ( lua_State * const L )
 {
   const int fd = luaL_checkinteger ( L, 1 ) ;
+  lbuf_t * bp = lbuf_test ( L, 2 ) ;
 
-  if ( 0 <= fd ) {
+  if ( bp && 0 <= fd ) {
+    return buf_read_into ( L, bp, fd, 0 ) ;
+  } else if ( 0 <= fd ) {
     ssize_t s = 0 ;
     char buf [ 1024 ] = { 0 } ;
 
@@ -328,8 +373,11 @@ static int Lbuf_read ( lua_State * const L )
 static int Lbuf_read_close ( lua_State * const L )
 {
   const int fd = luaL_checkinteger ( L, 1 ) ;
+  lbuf_t * bp = lbuf_test ( L, 2 ) ;
 
-  if ( 0 <= fd ) {
+  if ( bp && 0 <= fd ) {
+    return buf_read_into ( L, bp, fd, 1 ) ;
+  } else if ( 0 <= fd ) {
     ssize_t s = 0 ;
     char buf [ 1024 ] = { 0 } ;
 
@@ -505,95 +553,70 @@ static int Lfd_has_data ( lua_State * const L )
   return 1 ;
 }
 
-/* check if a number of given fds is ready for reading using select(2) */
-static int Lfds_have_data ( lua_State * const L )
+/* helper function that polls a number of fds (given as Lua integer args
+ * starting at stack index "first") for input using poll(2).
+ * unlike select(2) this is not limited to fds below FD_SETSIZE
+ * and costs O(number of fds) rather than O(highest fd).
+ */
+static int poll_input_fds ( lua_State * const L, const int first,
+  const int tmout )
 {
   const int n = lua_gettop ( L ) ;
 
-  if ( 0 < n ) {
-    int i = luaL_checkinteger ( L, 1 ) ;
-
-    if ( 0 <= i ) {
-      int j, m = i ;
-      struct timeval tv ;
-      fd_set fds ;
-
-      tv . tv_sec = 0 ;
-      tv . tv_usec = 0 ;
-      FD_ZERO( & fds ) ;
-      FD_SET( i, & fds ) ;
-
-      for ( j = 2 ; n >= j ; ++ j ) {
-        i = luaL_checkinteger ( L, j ) ;
-        if ( 0 <= i ) {
-          m = ( m < i ) ? i : m ;
-          FD_SET( i, & fds ) ;
-        }
+  if ( first <= n ) {
+    int i, j, k = 0 ;
+    struct pollfd * pfd = (struct pollfd *)
+      alloca ( ( 1 + n - first ) * sizeof ( struct pollfd ) ) ;
+
+    for ( j = first ; n >= j ; ++ j ) {
+      i = luaL_checkinteger ( L, j ) ;
+      if ( 0 <= i ) {
+        pfd [ k ] . fd = i ;
+        pfd [ k ] . events = POLLIN ;
+        pfd [ k ] . revents = 0 ;
+        ++ k ;
       }
+    }
 
-      j = select ( 1 + m, & fds, NULL, NULL, & tv ) ;
-      if ( 0 > j ) {
-        j = errno ;
-        lua_pushinteger ( L, -1 ) ;
-        lua_pushinteger ( L, j ) ;
-        return 2 ;
-      } else {
-        lua_pushinteger ( L, j ) ;
-        return 1 ;
-      }
+    if ( 1 > k ) {
+      lua_pushinteger ( L, -3 ) ;
+      return 1 ;
     }
 
-    lua_pushinteger ( L, -3 ) ;
+    j = poll ( pfd, k, tmout ) ;
+    if ( 0 > j ) {
+      j = errno ;
+      lua_pushinteger ( L, -1 ) ;
+      lua_pushinteger ( L, j ) ;
+      return 2 ;
+    }
+
+    lua_pushinteger ( L, j ) ;
     return 1 ;
   }
 
   return 0 ;
 }
 
+/* check if a number of given fds is ready for reading */
+static int Lfds_have_data ( lua_State * const L )
+{
+  return poll_input_fds ( L, 1, 0 ) ;
+}
+
 /* wait for some time until a number of given fds become
- * ready for reading using select(2)
+ * ready for reading
  */
 static int Lwait_for_fd_data ( lua_State * const L )
 {
-  const int n = lua_gettop ( L ) ;
-
-  if ( 2 < n ) {
-    int i = luaL_checkinteger ( L, 3 ) ;
-
-    if ( 0 <= i ) {
-      int j, m = i ;
-      struct timeval tv ;
-      fd_set fds ;
-
-      j = luaL_checkinteger ( L, 1 ) ;
-      tv . tv_sec = ( 0 < j ) ? j : 0 ;
-      j = luaL_checkinteger ( L, 2 ) ;
-      tv . tv_usec = ( 0 < j && 999999 >= j ) ? j : 0 ;
-      FD_ZERO( & fds ) ;
-      FD_SET( i, & fds ) ;
-
-      for ( j = 2 ; n >= j ; ++ j ) {
-        i = luaL_checkinteger ( L, j ) ;
-        if ( 0 <= i ) {
-          m = ( m < i ) ? i : m ;
-          FD_SET( i, & fds ) ;
-        }
-      }
-
-      j = select ( 1 + m, & fds, NULL, NULL, & tv ) ;
-      if ( 0 > j ) {
-        j = errno ;
-        lua_pushinteger ( L, -1 ) ;
-        lua_pushinteger ( L, j ) ;
-        return 2 ;
-      } else {
-        lua_pushinteger ( L, j ) ;
-        return 1 ;
-      }
-    }
+  if ( 2 < lua_gettop ( L ) ) {
+    long int s = luaL_checkinteger ( L, 1 ) ;
+    long int u = luaL_checkinteger ( L, 2 ) ;
 
-    lua_pushinteger ( L, -3 ) ;
-    return 1 ;
+    s = ( 0 < s ) ? s : 0 ;
+    u = ( 0 < u && 999999 >= u ) ? u : 0 ;
+    s = ( INT_MAX / 1000 > s ) ? 1000 * s + u / 1000 : INT_MAX ;
+    return poll_input_fds ( L, 3, (int) s ) ;
   }
 
   return 0 ;
@@ -605,8 +628,7 @@ static int Lfd_has_input ( lua_State * const L )
 
   if ( 0 < n ) {
     long int s, u ;
-    struct timeval tv ;
-    fd_set fds ;
+    struct pollfd pfd ;
     int i = luaL_checkinteger ( L, 1 ) ;
 
     s = u = 0 ;
@@ -614,11 +636,11 @@ static int Lfd_has_input ( lua_State * const L )
     if ( 2 < n ) { u = luaL_checkinteger ( L, 3 ) ; }
     s = ( 0 < s ) ? s : 0 ;
     u = ( 0 < u ) ? u : 0 ;
-    tv . tv_sec = s ;
-    tv . tv_usec = u ;
-    FD_ZERO( & fds ) ;
-    FD_SET( i, & fds ) ;
-    i = select ( 1 + i, & fds, NULL, NULL, & tv ) ;
+    s = ( INT_MAX / 1000 > s ) ? 1000 * s + u / 1000 : INT_MAX ;
+    pfd . fd = i ;
+    pfd . events = POLLIN ;
+    pfd . revents = 0 ;
+    i = poll ( & pfd, 1, (int) s ) ;
 
     if ( 0 > i ) {
       i = errno ;
@@ -665,6 +687,202 @@ static int Lpoll_input_fd ( lua_State * const L )
   return 0 ;
 }
 
+#if defined (OSLinux)
+/*
+ * persistent epoll(7) instances.
+ * the interest set lives in the kernel, so supervising many fds
+ * costs one epoll_wait(2) call per loop iteration instead of
+ * rebuilding an fd set each time. ready (fd, events) pairs are
+ * stored into a result table that is reused by every wait() call.
+ */
+
+#define EPOLL_METATABLE "Epoll Metatable"
+#define EPOLL_MAXEVENTS 64
+
+typedef struct {
+  int fd ;
+  int maxev ;
+  int last ;
+  struct epoll_event ev [ 1 ] ;
+} epoll_obj_t ;
+
+static epoll_obj_t * epoll_check ( lua_State * const L )
+{
+  epoll_obj_t * ep = (epoll_obj_t *) luaL_checkudata ( L, 1, EPOLL_METATABLE ) ;
+
+  luaL_argcheck ( L, 0 <= ep -> fd, 1, "closed epoll instance" ) ;
+  return ep ;
+}
+
+/* helper function for the add and mod methods */
+static int epoll_ctl_fd ( lua_State * const L, const int op )
+{
+  epoll_obj_t * ep = epoll_check ( L ) ;
+  const int fd = luaL_checkinteger ( L, 2 ) ;
+  struct epoll_event ev ;
+
+  luaL_argcheck ( L, 0 <= fd, 2, "invalid fd" ) ;
+  ev . events = (uint32_t) luaL_optinteger ( L, 3, EPOLLIN ) ;
+  ev . data . u64 = 0 ;
+  ev . data . fd = fd ;
+
+  /* optional 4th arg: true for edge triggered mode */
+  if ( lua_toboolean ( L, 4 ) ) { ev . events |= EPOLLET ; }
+
+  return resne0 ( L, "epoll_ctl", epoll_ctl ( ep -> fd, op, fd, & ev ) ) ;
+}
+
+/* add a fd to the interest set */
+static int epoll_add ( lua_State * const L )
+{
+  return epoll_ctl_fd ( L, EPOLL_CTL_ADD ) ;
+}
+
+/* change the events monitored for a fd */
+static int epoll_mod ( lua_State * const L )
+{
+  return epoll_ctl_fd ( L, EPOLL_CTL_MOD ) ;
+}
+
+/* remove a fd from the interest set */
+static int epoll_del ( lua_State * const L )
+{
+  epoll_obj_t * ep = epoll_check ( L ) ;
+  const int fd = luaL_checkinteger ( L, 2 ) ;
+  struct epoll_event ev = { 0 } ;
+
+  luaL_argcheck ( L, 0 <= fd, 2, "invalid fd" ) ;
+  return resne0 ( L, "epoll_ctl", epoll_ctl ( ep -> fd, EPOLL_CTL_DEL, fd, & ev ) ) ;
+}
+
+/* wait for events (timeout in milliseconds, default -1 = forever).
+ * returns the number of ready fds and the (reused) result table
+ * { fd1, events1, fd2, events2, ... }
+ */
+static int epoll_wait_ev ( lua_State * const L )
+{
+  int i, n ;
+  epoll_obj_t * ep = epoll_check ( L ) ;
+  const int tmout = luaL_optinteger ( L, 2, -1 ) ;
+
+  n = epoll_wait ( ep -> fd, ep -> ev, ep -> maxev, tmout ) ;
+
+  if ( 0 > n ) {
+    return res_nil ( L ) ;
+  }
+
+  (void) lua_getuservalue ( L, 1 ) ;
+
+  for ( i = 0 ; n > i ; ++ i ) {
+    lua_pushinteger ( L, ep -> ev [ i ] . data . fd ) ;
+    lua_rawseti ( L, -2, 1 + 2 * i ) ;
+    lua_pushinteger ( L, ep -> ev [ i ] . events ) ;
+    lua_rawseti ( L, -2, 2 + 2 * i ) ;
+  }
+
+  /* clear stale entries left over from the previous call */
+  for ( i = 2 * n ; 2 * ep -> last > i ; ++ i ) {
+    lua_pushnil ( L ) ;
+    lua_rawseti ( L, -2, 1 + i ) ;
+  }
+
+  ep -> last = n ;
+  lua_pushinteger ( L, n ) ;
+  lua_insert ( L, -2 ) ;
+  return 2 ;
+}
+
+static int epoll_fileno ( lua_State * const L )
+{
+  epoll_obj_t * ep = epoll_check ( L ) ;
+
+  lua_pushinteger ( L, ep -> fd ) ;
+  return 1 ;
+}
+
+/* closes epoll instances */
+static int epoll_close ( lua_State * const L )
+{
+  epoll_obj_t * ep = (epoll_obj_t *) luaL_checkudata ( L, 1, EPOLL_METATABLE ) ;
+
+  if ( 0 <= ep -> fd ) {
+    CLOSEFD( ep -> fd )
+    ep -> fd = -1 ;
+  }
+
+  return 0 ;
+}
+
+/* create a new epoll instance, optional arg: max events per wait() */
+static int Lepoll ( lua_State * const L )
+{
+  epoll_obj_t * ep = NULL ;
+  int n = luaL_optinteger ( L, 1, EPOLL_MAXEVENTS ) ;
+
+  n = ( 0 < n && 4096 >= n ) ? n : EPOLL_MAXEVENTS ;
+  ep = (epoll_obj_t *) lua_newuserdata ( L, sizeof ( epoll_obj_t )
+    + ( n - 1 ) * sizeof ( struct epoll_event ) ) ;
+  ep -> fd = -1 ;
+  ep -> maxev = n ;
+  ep -> last = 0 ;
+  luaL_getmetatable ( L, EPOLL_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+  lua_createtable ( L, 2 * n, 0 ) ;
+  lua_setuservalue ( L, -2 ) ;
+  ep -> fd = epoll_create1 ( EPOLL_CLOEXEC ) ;
+
+  if ( 0 > ep -> fd ) {
+    return res_nil ( L ) ;
+  }
+
+  return 1 ;
+}
+
+/* creates epoll metatable */
+static int epoll_create_meta ( lua_State * const L )
+{
+  luaL_newmetatable ( L, EPOLL_METATABLE ) ;
+
+  /* method table */
+  lua_newtable ( L ) ;
+  lua_pushcfunction ( L, epoll_add ) ;
+  lua_setfield ( L, -2, "add" ) ;
+  lua_pushcfunction ( L, epoll_mod ) ;
+  lua_setfield ( L, -2, "mod" ) ;
+  lua_pushcfunction ( L, epoll_del ) ;
+  lua_setfield ( L, -2, "del" ) ;
+  lua_pushcfunction ( L, epoll_wait_ev ) ;
+  lua_setfield ( L, -2, "wait" ) ;
+  lua_pushcfunction ( L, epoll_fileno ) ;
+  lua_setfield ( L, -2, "fileno" ) ;
+  lua_pushcfunction ( L, epoll_close ) ;
+  lua_setfield ( L, -2, "close" ) ;
+
+  /* metamethods */
+  lua_setfield ( L, -2, "__index" ) ;
+  lua_pushcfunction ( L, epoll_close ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+
+  return 1 ;
+}
+
+/* constants used by epoll_ctl(2) */
+static void add_epoll_flags ( lua_State * const L )
+{
+  L_ADD_CONST( L, EPOLLIN )
+  L_ADD_CONST( L, EPOLLOUT )
+  L_ADD_CONST( L, EPOLLPRI )
+  L_ADD_CONST( L, EPOLLERR )
+  L_ADD_CONST( L, EPOLLHUP )
+  L_ADD_CONST( L, EPOLLRDHUP )
+  L_ADD_CONST( L, EPOLLET )
+  L_ADD_CONST( L, EPOLLONESHOT )
+#  if defined (EPOLLEXCLUSIVE)
+  L_ADD_CONST( L, EPOLLEXCLUSIVE )
+#  endif
+}
+#endif
+
 static int Lredirio ( lua_State * const L )
 {
   int i = 0 ;
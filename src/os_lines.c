@@ -0,0 +1,341 @@
+/*
+ * line reader
+ *
+ * splits the data of an fd or buffer object into lines on the C side.
+ * the newlines are searched with memchr(3) in a window that is reused
+ * for the whole stream, an optional regex or pattern set is applied to
+ * each line in place and only the matching lines are handed to Lua
+ * (or just counted). lines that are not complete yet stay in the window
+ * (or buffer), so a log can be followed by calling the reader again
+ * when more data is available.
+ */
+
+#define LINES_METATABLE "Line Reader Metatable"
+
+/* kinds of matchers */
+enum {
+  LINES_ALL			= 0,
+  LINES_REGEX,
+  LINES_PATSET,
+} ;
+
+typedef struct {
+  /* -1 when reading from a buffer object */
+  int fd ;
+  char eof ;
+  /* EOF is not final, an unterminated last line is kept */
+  char follow ;
+  char invert ;
+  char mtype ;
+  /* window used when reading from the fd */
+  lbuf_t win ;
+  /* the window in use, win or the buffer object */
+  lbuf_t * bp ;
+  /* unread bytes already searched for a newline */
+  size_t scan ;
+  const void * m ;
+  /* stream offset of the window head and of the last line */
+  unsigned long long off ;
+  unsigned long long start ;
+  unsigned long long lineno ;
+} lines_t ;
+
+static int lines_stop ( void * const ctx, const size_t pat, const size_t end )
+{
+  return 1 ;
+}
+
+/* applies the matcher to a NUL terminated line */
+static int lines_match ( const lines_t * const lp, const char * const line,
+  const size_t len )
+{
+  int r = 1 ;
+  uint32_t s = 0 ;
+
+  switch ( lp -> mtype ) {
+    case LINES_REGEX :
+      r = 0 == regexec ( & ( (const regex_obj_t *) lp -> m ) -> re, line, 0, NULL, 0 ) ;
+      break ;
+    case LINES_PATSET :
+      r = patset_scan ( (const patset_t *) lp -> m, line, len, & s, 0, lines_stop, NULL ) ;
+      break ;
+    default :
+      break ;
+  }
+
+  return r != lp -> invert ;
+}
+
+/* looks for the next matching line and sets * lp to its start (NUL
+ * terminated) and * np to its length. the line stays valid until the
+ * next call. returns 1 if there is one, 0 if no complete line is
+ * available (EOF, the fd would block or the buffer is drained) or -1
+ * on read errors.
+ */
+static int lines_next ( lines_t * const lp, const char ** const linep, size_t * const np )
+{
+  ssize_t r ;
+  size_t avail, len, skip ;
+  char * line, * nl ;
+  lbuf_t * const bp = lp -> bp ;
+
+  /* a buffer object may have been changed in between */
+  if ( 0 > lp -> fd ) { lp -> scan = 0 ; }
+  /* a followed file may have grown */
+  if ( lp -> follow ) { lp -> eof = 0 ; }
+
+  for ( ; ; ) {
+    /* a freed buffer object, the window is allocated by the first read */
+    if ( 0 > lp -> fd && NULL == bp -> data ) { return 0 ; }
+
+    line = bp -> data + bp -> head ;
+    avail = bp -> tail - bp -> head ;
+    nl = ( avail > lp -> scan ) ? (char *) memchr ( line + lp -> scan, '\n', avail - lp -> scan ) : NULL ;
+
+    if ( nl ) {
+      len = nl - line ;
+      skip = len + 1 ;
+      * nl = '\0' ;
+    } else if ( lp -> eof && avail ) {
+      /* the last line without a newline */
+      if ( lbuf_reserve ( bp, 1 ) ) { return -1 ; }
+      line = bp -> data + bp -> head ;
+      len = skip = avail ;
+      line [ len ] = '\0' ;
+    } else if ( 0 > lp -> fd || lp -> eof ) {
+      return 0 ;
+    } else {
+      lp -> scan = avail ;
+      r = lbuf_read_fd ( bp, lp -> fd, 0 ) ;
+
+      if ( 0 == r ) {
+        lp -> eof = 1 ;
+        if ( lp -> follow ) { return 0 ; }
+      } else if ( 0 > r ) {
+        return ( EAGAIN == errno || EWOULDBLOCK == errno ) ? 0 : -1 ;
+      }
+
+      continue ;
+    }
+
+    lp -> scan = 0 ;
+    lp -> start = lp -> off ;
+    lp -> off += skip ;
+    ++ lp -> lineno ;
+    /* only moves head, the data stays in place */
+    lbuf_consume ( bp, skip ) ;
+
+    if ( lines_match ( lp, line, len ) ) {
+      * linep = line ;
+      * np = len ;
+      return 1 ;
+    }
+  }
+
+  return 0 ;
+}
+
+/* lines ( fd | buffer [, matcher [, opts]] )
+ * creates a line reader. matcher is a regex object, a pattern set or
+ * an extended regex string, only lines that match are returned.
+ * opts: invert (return the lines that do not match), follow (EOF is
+ * not final, like tail -f). the fd is not closed by the reader.
+ */
+static int Llines ( lua_State * const L )
+{
+  lines_t * lp ;
+  lbuf_t * bp = lbuf_test ( L, 1 ) ;
+  const int fd = bp ? -1 : luaL_checkinteger ( L, 1 ) ;
+
+  luaL_argcheck ( L, bp || 0 <= fd, 1, "fd or buffer expected" ) ;
+  lua_settop ( L, 3 ) ;
+
+  /* compile strings into regex objects */
+  if ( LUA_TSTRING == lua_type ( L, 2 ) ) {
+    lua_pushcfunction ( L, Lregcomp ) ;
+    lua_pushvalue ( L, 2 ) ;
+    lua_pushinteger ( L, REG_NOSUB ) ;
+    lua_call ( L, 2, 2 ) ;
+    if ( lua_isnil ( L, -2 ) ) { return luaL_argerror ( L, 2, lua_tostring ( L, -1 ) ) ; }
+    lua_pop ( L, 1 ) ;
+    lua_replace ( L, 2 ) ;
+  }
+
+  lp = (lines_t *) lua_newuserdata ( L, sizeof ( lines_t ) ) ;
+  (void) memset ( lp, 0, sizeof ( lines_t ) ) ;
+  lp -> fd = fd ;
+  lp -> bp = bp ? bp : & lp -> win ;
+
+  if ( lua_istable ( L, 3 ) ) {
+    lua_getfield ( L, 3, "invert" ) ;
+    lp -> invert = lua_toboolean ( L, -1 ) ;
+    lua_getfield ( L, 3, "follow" ) ;
+    lp -> follow = lua_toboolean ( L, -1 ) ;
+    lua_pop ( L, 2 ) ;
+  }
+
+  if ( luaL_testudata ( L, 2, REGEX_METATABLE ) ) {
+    lp -> mtype = LINES_REGEX ;
+    lp -> m = lua_touserdata ( L, 2 ) ;
+    luaL_argcheck ( L, ( (const regex_obj_t *) lp -> m ) -> ok, 2, "invalid regex" ) ;
+  } else if ( luaL_testudata ( L, 2, PATSET_METATABLE ) ) {
+    lp -> mtype = LINES_PATSET ;
+    lp -> m = lua_touserdata ( L, 2 ) ;
+    luaL_argcheck ( L, 0 < ( (const patset_t *) lp -> m ) -> npat, 2, "freed pattern set" ) ;
+  } else if ( ! lua_isnil ( L, 2 ) ) {
+    return luaL_argerror ( L, 2, "regex, pattern set or string expected" ) ;
+  }
+
+  luaL_getmetatable ( L, LINES_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+
+  /* keep the buffer and the matcher alive as long as the reader */
+  lua_createtable ( L, 2, 0 ) ;
+  lua_pushvalue ( L, 1 ) ;
+  lua_rawseti ( L, -2, 1 ) ;
+  lua_pushvalue ( L, 2 ) ;
+  lua_rawseti ( L, -2, 2 ) ;
+  lua_setuservalue ( L, -2 ) ;
+
+  return 1 ;
+}
+
+static lines_t * lines_check ( lua_State * const L )
+{
+  lines_t * lp = (lines_t *) luaL_checkudata ( L, 1, LINES_METATABLE ) ;
+
+  luaL_argcheck ( L, NULL != lp -> bp, 1, "closed line reader" ) ;
+  return lp ;
+}
+
+/* lr:next () also lr () so it can be used in generic for loops
+ * returns the next matching line (without the newline), its number and
+ * its (1 based) stream offset or nil if no complete line is available
+ * (nil, error message and errno on read errors)
+ */
+static int lines_next_m ( lua_State * const L )
+{
+  size_t len ;
+  const char * line ;
+  lines_t * lp = lines_check ( L ) ;
+  const int r = lines_next ( lp, & line, & len ) ;
+
+  if ( 0 > r ) { return res_nil ( L ) ; }
+  if ( 0 == r ) { return 0 ; }
+
+  lua_pushlstring ( L, line, len ) ;
+  lua_pushinteger ( L, lp -> lineno ) ;
+  lua_pushinteger ( L, 1 + lp -> start ) ;
+
+  return 3 ;
+}
+
+/* lr:count ( [max] )
+ * counts the matching lines that are available (up to max)
+ */
+static int lines_count ( lua_State * const L )
+{
+  int r = 0 ;
+  size_t len ;
+  lua_Integer n = 0 ;
+  const char * line ;
+  lines_t * lp = lines_check ( L ) ;
+  const lua_Integer max = luaL_optinteger ( L, 2, 0 ) ;
+
+  while ( ( 0 >= max || max > n ) && 0 < ( r = lines_next ( lp, & line, & len ) ) ) { ++ n ; }
+  if ( 0 > r ) { return res_nil ( L ) ; }
+
+  lua_pushinteger ( L, n ) ;
+  return 1 ;
+}
+
+/* lr:offsets ( [max] )
+ * like count, but returns the arrays of the numbers and the (1 based)
+ * stream offsets of the matching lines
+ */
+static int lines_offsets ( lua_State * const L )
+{
+  int r = 0 ;
+  size_t len ;
+  lua_Integer n = 0 ;
+  const char * line ;
+  lines_t * lp = lines_check ( L ) ;
+  const lua_Integer max = luaL_optinteger ( L, 2, 0 ) ;
+
+  lua_newtable ( L ) ;
+  lua_newtable ( L ) ;
+
+  while ( ( 0 >= max || max > n ) && 0 < ( r = lines_next ( lp, & line, & len ) ) ) {
+    ++ n ;
+    lua_pushinteger ( L, lp -> lineno ) ;
+    lua_rawseti ( L, -3, n ) ;
+    lua_pushinteger ( L, 1 + lp -> start ) ;
+    lua_rawseti ( L, -2, n ) ;
+  }
+
+  if ( 0 > r ) { return res_nil ( L ) ; }
+
+  return 2 ;
+}
+
+/* lr:eof () returns true once the fd reached EOF (for now when
+ * following) and all lines have been read
+ */
+static int lines_eof ( lua_State * const L )
+{
+  const lines_t * lp = lines_check ( L ) ;
+
+  lua_pushboolean ( L, lp -> eof && lp -> bp -> tail == lp -> bp -> head ) ;
+  return 1 ;
+}
+
+/* lr:position () returns the number of lines read and the stream
+ * offset of the unread data
+ */
+static int lines_position ( lua_State * const L )
+{
+  const lines_t * lp = lines_check ( L ) ;
+
+  lua_pushinteger ( L, lp -> lineno ) ;
+  lua_pushinteger ( L, lp -> off ) ;
+  return 2 ;
+}
+
+static int lines_close ( lua_State * const L )
+{
+  lines_t * lp = (lines_t *) luaL_checkudata ( L, 1, LINES_METATABLE ) ;
+
+  lbuf_release ( & lp -> win ) ;
+  lp -> bp = NULL ;
+  return 0 ;
+}
+
+/* creates the line reader metatable */
+static int lines_create_meta ( lua_State * const L )
+{
+  luaL_newmetatable ( L, LINES_METATABLE ) ;
+
+  /* method table */
+  lua_newtable ( L ) ;
+  lua_pushcfunction ( L, lines_next_m ) ;
+  lua_setfield ( L, -2, "next" ) ;
+  lua_pushcfunction ( L, lines_count ) ;
+  lua_setfield ( L, -2, "count" ) ;
+  lua_pushcfunction ( L, lines_offsets ) ;
+  lua_setfield ( L, -2, "offsets" ) ;
+  lua_pushcfunction ( L, lines_eof ) ;
+  lua_setfield ( L, -2, "eof" ) ;
+  lua_pushcfunction ( L, lines_position ) ;
+  lua_setfield ( L, -2, "position" ) ;
+  lua_pushcfunction ( L, lines_close ) ;
+  lua_setfield ( L, -2, "close" ) ;
+
+  /* metamethods */
+  lua_setfield ( L, -2, "__index" ) ;
+  lua_pushcfunction ( L, lines_next_m ) ;
+  lua_setfield ( L, -2, "__call" ) ;
+  lua_pushcfunction ( L, lines_close ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+
+  return 1 ;
+}
@@ -24,10 +24,13 @@ static const char Key = 'X' ;
 #include "os_svipc.c"
 #include "os_file.c"
 #include "os_at.c"
+#include "os_buf.c"
 #include "os_io.c"
 #include "os_env.c"
 #include "os_match.c"
 #include "os_regex.c"
+#include "os_sqrex.c"
+#include "os_lines.c"
 #include "os_pw.c"
 #include "os_fs.c"
 #include "os_socket.c"
@@ -43,11 +46,17 @@ static const char Key = 'X' ;
 #if defined (OSLinux)
   /* Linux specific functions */
 #  include "os_Linux.c"
+#  include "os_uring.c"
+#  include "os_pidfd.c"
+#  include "os_pgrep.c"
+#  include "os_netlink.c"
+#  include "os_cgroup.c"
 #elif defined (OSfreebsd)
 #elif defined (OSsolaris) || defined (OSsunos5)
 #  include "os_streams.c"
 #endif
 
+#include "os_spawn.c"
 #include "os_sig.c"
 
 /* this procedure exports important posix constants to Lua */
@@ -84,6 +93,45 @@ static void add_const ( lua_State * const L )
   L_ADD_CONST( L, AT_NO_AUTOMOUNT )
 #endif
 
+  /* statx(2) masks */
+#if defined (OSLinux) && defined (STATX_BASIC_STATS)
+  L_ADD_CONST( L, STATX_TYPE )
+  L_ADD_CONST( L, STATX_MODE )
+  L_ADD_CONST( L, STATX_NLINK )
+  L_ADD_CONST( L, STATX_UID )
+  L_ADD_CONST( L, STATX_GID )
+  L_ADD_CONST( L, STATX_ATIME )
+  L_ADD_CONST( L, STATX_MTIME )
+  L_ADD_CONST( L, STATX_CTIME )
+  L_ADD_CONST( L, STATX_INO )
+  L_ADD_CONST( L, STATX_SIZE )
+  L_ADD_CONST( L, STATX_BLOCKS )
+  L_ADD_CONST( L, STATX_BASIC_STATS )
+  L_ADD_CONST( L, STATX_BTIME )
+  L_ADD_CONST( L, STATX_ALL )
+#  if defined (STATX_MNT_ID)
+  L_ADD_CONST( L, STATX_MNT_ID )
+#  endif
+  L_ADD_CONST( L, AT_STATX_SYNC_AS_STAT )
+  L_ADD_CONST( L, AT_STATX_FORCE_SYNC )
+  L_ADD_CONST( L, AT_STATX_DONT_SYNC )
+  L_ADD_CONST( L, STATX_ATTR_COMPRESSED )
+  L_ADD_CONST( L, STATX_ATTR_IMMUTABLE )
+  L_ADD_CONST( L, STATX_ATTR_APPEND )
+  L_ADD_CONST( L, STATX_ATTR_NODUMP )
+  L_ADD_CONST( L, STATX_ATTR_ENCRYPTED )
+  L_ADD_CONST( L, STATX_ATTR_AUTOMOUNT )
+#  if defined (STATX_ATTR_MOUNT_ROOT)
+  L_ADD_CONST( L, STATX_ATTR_MOUNT_ROOT )
+#  endif
+#  if defined (STATX_ATTR_VERITY)
+  L_ADD_CONST( L, STATX_ATTR_VERITY )
+#  endif
+#  if defined (STATX_ATTR_DAX)
+  L_ADD_CONST( L, STATX_ATTR_DAX )
+#  endif
+#endif
+
   /* constants used by wait(p)id */
   L_ADD_CONST( L, WNOHANG )
   L_ADD_CONST( L, WNOWAIT )
@@ -94,9 +142,10 @@ static void add_const ( lua_State * const L )
   L_ADD_CONST( L, P_ALL )
   L_ADD_CONST( L, P_PID )
   L_ADD_CONST( L, P_PGID )
-  /*
-  L_ADD_CONST( L, P_PIDFD )
-  */
+#if defined (OSLinux)
+  lua_pushinteger ( L, WAIT_P_PIDFD ) ;
+  lua_setfield ( L, -2, "P_PIDFD" ) ;
+#endif
 
   /* constants used by clock_(g,s)ettime(2) et al */
 #if defined (_POSIX_TIMERS) && (0 < _POSIX_TIMERS)
@@ -377,6 +426,19 @@ static void add_const ( lua_State * const L )
 #ifdef SIGRTMAX
   L_ADD_CONST( L, SIGRTMAX )
 #endif
+  /* si_code values as returned by signalfd reads */
+  L_ADD_CONST( L, SI_USER )
+  L_ADD_CONST( L, SI_QUEUE )
+  L_ADD_CONST( L, SI_TIMER )
+#ifdef SI_KERNEL
+  L_ADD_CONST( L, SI_KERNEL )
+#endif
+  L_ADD_CONST( L, CLD_EXITED )
+  L_ADD_CONST( L, CLD_KILLED )
+  L_ADD_CONST( L, CLD_DUMPED )
+  L_ADD_CONST( L, CLD_TRAPPED )
+  L_ADD_CONST( L, CLD_STOPPED )
+  L_ADD_CONST( L, CLD_CONTINUED )
 
   /* socket(2) constants */
   add_socket_flags ( L ) ;
@@ -468,6 +530,9 @@ static void add_const ( lua_State * const L )
   /* constants used by reboot(2) */
   add_reboot_flags ( L ) ;
 
+  /* constants used by epoll_ctl(2) */
+  add_epoll_flags ( L ) ;
+
   /* constants for the clone/unshare(2) Linux syscalls */
   L_ADD_CONST( L, CLONE_FILES )
   L_ADD_CONST( L, CLONE_FS )
@@ -675,6 +740,19 @@ static const luaL_Reg sys_func [ ] =
   { "wait",			u_wait		},
   { "waitpid",			u_waitpid	},
   { "waitid",			u_waitid	},
+  { "spawn",			Lspawn		},
+  { "spawn_many",		Lspawn_many	},
+#if defined (OSLinux)
+  { "pidfd_open",		Lpidfd_open	},
+  { "pidfd_fork",		Lpidfd_fork	},
+  { "proc_table",		Lproc_table	},
+  { "find_pids",		Lfind_pids	},
+  { "killall5",			Lkillall5	},
+  { "proc_monitor",		Lproc_monitor	},
+  { "cgroup_open",		Lcgroup_open	},
+  { "psi",			Lpsi		},
+  { "psi_trigger",		Lpsi_trigger	},
+#endif
   { "set_subreaper",		Lset_subreaper	},
   { "is_subreaper",		Lis_subreaper	},
   { "exit",			u_exit		},
@@ -812,9 +890,7 @@ static const luaL_Reg sys_func [ ] =
   { "got_sig",			Lgot_sig	},
   { "trap_sig",			Ltrap_sig	},
 #if defined (OSLinux)
-  /*
   { "signalfd",			Lsignalfd	},
-  */
 #endif
   /* end of imported functions from "os_sig.c" */
 
@@ -862,6 +938,9 @@ static const luaL_Reg sys_func [ ] =
   { "stat",			u_stat		},
   { "lstat",			u_lstat		},
   { "fstat",			u_fstat		},
+#if defined (OSLinux) && defined (STATX_BASIC_STATS)
+  { "statx",			Lstatx		},
+#endif
   { "S_ISBLK",			mode_is_blk	},
   { "S_ISCHR",			mode_is_chr	},
   { "S_ISDIR",			mode_is_dir	},
@@ -890,12 +969,14 @@ static const luaL_Reg sys_func [ ] =
   { "copy_file",		Lcopy_file	},
   { "move_file",		Lmove_file	},
   { "read_file",		Lread_file	},
+  { "read_files",		Lread_files	},
   { "ftruncate",		Sftruncate	},
   { "fchmod",			Sfchmod		},
   { "scandir",			Sscandir	},
   { "list_dir",			get_dirent	},
   { "list_dir",			list_dir	},
   { "dir",			dir_iter_factory	},
+  { "walk",			Lwalk		},
   { "rm",			Lrm		},
   { "rmr",			Lrmr		},
 /*{ "fchown",			Sfchown		},	*/
@@ -922,6 +1003,7 @@ static const luaL_Reg sys_func [ ] =
   { "read",			Sread	},
   { "buf_read",			Lbuf_read	},
   { "buf_read_close",		Lbuf_read_close		},
+  { "buffer",			Lbuffer		},
   { "write",			Swrite	},
   { "pipe",			u_pipe	},
   { "open_pipe",		Lpipe	},
@@ -948,6 +1030,8 @@ static const luaL_Reg sys_func [ ] =
 #if defined (OSLinux)
   { "memfd_create",		Smemfd_create	},
   { "pipe2",			u_pipe2	},
+  { "epoll",			Lepoll		},
+  { "uring",			Luring		},
 #endif
   /* end of imported functions from "os_io.c" */
 
@@ -965,6 +1049,9 @@ static const luaL_Reg sys_func [ ] =
   { "fchownat",			u_fchownat	},
   { "utimensat",		u_utimensat	},
   { "fstatat",			u_fstatat	},
+#  if defined (OSLinux) && defined (STATX_BASIC_STATS)
+  { "statxat",			u_statxat	},
+#  endif
   /* end of imported functions from "os_at.c" */
 #endif
 
@@ -983,6 +1070,7 @@ static const luaL_Reg sys_func [ ] =
   { "glob",			u_glob		},
   { "wordexp",			u_wordexp	},
   { "fnmatch",			u_fnmatch	},
+  { "patset",			Lpatset		},
   /* end of imported functions from "os_match.c" */
 
   /* functions imported from "os_regex.c": */
@@ -990,8 +1078,15 @@ static const luaL_Reg sys_func [ ] =
   { "sregmatch",		simple_regmatch	},
   { "grep",			l_grep		},
   { "ncgrep",			l_ncgrep	},
+  { "regcomp",			Lregcomp	},
+  { "sqrex",			Lsqrex		},
+  { "sqrex_bench",		Lsqrex_bench	},
   /* end of imported functions from "os_regex.c" */
 
+  /* functions imported from "os_lines.c": */
+  { "lines",			Llines		},
+  /* end of imported functions from "os_lines.c" */
+
   /* functions imported from "os_fs.c": */
   { "statvfs",			Sstatvfs	},
   { "fstatvfs",			Sfstatvfs	},
@@ -1041,6 +1136,8 @@ static const luaL_Reg sys_func [ ] =
   { "capget",			Scapget		},
   { "capset",			Scapset		},
   { "sysinfo",			u_sysinfo	},
+  { "uevent_socket",		Luevent_socket	},
+  { "read_uevent",		Lread_uevent	},
   /*
   { "set_ns",			l_setns		},
   { "set_name_space",		l_setns		},
@@ -1113,6 +1210,35 @@ static int openMod ( lua_State * const L )
 
   /* create a metatable for directory iterators */
   (void) dir_create_meta ( L ) ;
+  (void) walk_create_meta ( L ) ;
+#if defined (OSLinux) && defined (STATX_BASIC_STATS)
+  /* create a metatable for statx results */
+  (void) statx_create_meta ( L ) ;
+#endif
+  /* create metatables for buffers and buffer slices */
+  (void) buffer_create_meta ( L ) ;
+  /* create a metatable for compiled regexes */
+  (void) regex_create_meta ( L ) ;
+  /* create a metatable for SQRex patterns */
+  (void) sqrex_create_meta ( L ) ;
+  (void) patset_create_meta ( L ) ;
+  (void) lines_create_meta ( L ) ;
+#if defined (OSLinux)
+  /* create a metatable for epoll instances */
+  (void) epoll_create_meta ( L ) ;
+  /* create a metatable for io rings */
+  (void) uring_create_meta ( L ) ;
+  /* create a metatable for process handles */
+  (void) pidfd_create_meta ( L ) ;
+  /* create a metatable for signal fds */
+  (void) sigfd_create_meta ( L ) ;
+  /* create a metatable for process monitors */
+  (void) procmon_create_meta ( L ) ;
+  /* create a metatable for cgroups */
+  (void) cgroup_create_meta ( L ) ;
+  /* create a metatable for psi triggers */
+  (void) psi_create_meta ( L ) ;
+#endif
   /* add posix wrapper functions to module table */
   luaL_newlib ( L, sys_func ) ;
   /* add posix constants to module */
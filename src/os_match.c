@@ -194,3 +194,255 @@ static int u_wordexp ( lua_State * const L )
   return luaL_argerror ( L, 1, "pattern string required" ) ;
 }
 
+
+/* literal pattern sets (see patset.c) */
+
+#define PATSET_METATABLE "Pattern Set Metatable"
+
+typedef struct {
+  lua_State * L ;
+  /* collect all matches or only the first of each pattern */
+  int all ;
+  lua_Integer n ;
+  /* end offset of the first match (test) */
+  size_t end ;
+  /* one flag per pattern */
+  char * seen ;
+  const patset_t * ps ;
+} patset_ctx_t ;
+
+/* patset ( patterns [, icase] )
+ * compiles an array of (non empty) literal strings into one matcher
+ * that finds all of them in a single pass over the text.
+ */
+static int Lpatset ( lua_State * const L )
+{
+  size_t i, n ;
+  patset_t * ps ;
+  const char ** pats ;
+  size_t * lens ;
+  const int icase = lua_toboolean ( L, 2 ) ;
+
+  luaL_checktype ( L, 1, LUA_TTABLE ) ;
+  n = lua_rawlen ( L, 1 ) ;
+  luaL_argcheck ( L, 0 < n && INT32_MAX > n, 1, "non empty array of strings expected" ) ;
+
+  /* the strings stay referenced by the table while compiling */
+  pats = (const char **) lua_newuserdata ( L, n * ( sizeof ( char * ) + sizeof ( size_t ) ) ) ;
+  lens = (size_t *) ( pats + n ) ;
+
+  for ( i = 0 ; n > i ; ++ i ) {
+    lua_rawgeti ( L, 1, 1 + i ) ;
+    if ( LUA_TSTRING != lua_type ( L, -1 ) ) { return luaL_argerror ( L, 1, "array of strings expected" ) ; }
+    pats [ i ] = lua_tolstring ( L, -1, & lens [ i ] ) ;
+    if ( 0 == lens [ i ] ) { return luaL_argerror ( L, 1, "empty pattern" ) ; }
+    lua_pop ( L, 1 ) ;
+  }
+
+  ps = (patset_t *) lua_newuserdata ( L, sizeof ( patset_t ) ) ;
+  (void) memset ( ps, 0, sizeof ( patset_t ) ) ;
+  luaL_getmetatable ( L, PATSET_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+
+  if ( patset_build ( ps, pats, lens, n, icase ) ) { return res_nil ( L ) ; }
+
+  return 1 ;
+}
+
+static patset_t * patset_check ( lua_State * const L )
+{
+  patset_t * ps = (patset_t *) luaL_checkudata ( L, 1, PATSET_METATABLE ) ;
+
+  luaL_argcheck ( L, 0 < ps -> npat, 1, "freed pattern set" ) ;
+  return ps ;
+}
+
+/* returns the text at index i, a string or the unread part of a buffer */
+static const char * patset_text ( lua_State * const L, const int i, size_t * const len )
+{
+  const lbuf_t * bp = lbuf_test ( L, i ) ;
+
+  if ( bp ) {
+    * len = bp -> tail - bp -> head ;
+    return bp -> data + bp -> head ;
+  }
+
+  return luaL_checklstring ( L, i, len ) ;
+}
+
+/* appends a match to the id and position arrays at stack index 1 and 2
+ * from the top
+ */
+static int patset_collect ( void * const ctx, const size_t pat, const size_t end )
+{
+  patset_ctx_t * const cp = (patset_ctx_t *) ctx ;
+
+  if ( 0 == cp -> all ) {
+    if ( cp -> seen [ pat ] ) { return 0 ; }
+    cp -> seen [ pat ] = 1 ;
+  }
+
+  ++ cp -> n ;
+  lua_pushinteger ( cp -> L, 1 + pat ) ;
+  lua_rawseti ( cp -> L, -3, cp -> n ) ;
+  lua_pushinteger ( cp -> L, 1 + end - cp -> ps -> plen [ pat ] ) ;
+  lua_rawseti ( cp -> L, -2, cp -> n ) ;
+
+  return 0 ;
+}
+
+static int patset_first ( void * const ctx, const size_t pat, const size_t end )
+{
+  patset_ctx_t * const cp = (patset_ctx_t *) ctx ;
+
+  cp -> n = 1 + pat ;
+  cp -> end = end ;
+  return 1 ;
+}
+
+static void patset_ctx_init ( lua_State * const L, patset_ctx_t * const cp,
+  const patset_t * const ps, const int i )
+{
+  cp -> L = L ;
+  cp -> ps = ps ;
+  cp -> n = 0 ;
+  cp -> all = lua_toboolean ( L, i ) ;
+  cp -> seen = cp -> all ? NULL : (char *) lua_newuserdata ( L, ps -> npat ) ;
+  if ( cp -> seen ) { (void) memset ( cp -> seen, 0, ps -> npat ) ; }
+  lua_newtable ( L ) ;
+  lua_newtable ( L ) ;
+}
+
+/* ps:scan ( text [, all [, state]] )
+ * returns an array of the (1 based) indices of the patterns found in a
+ * string or buffer, an array of their start offsets and the matcher
+ * state. only the first occurrence of each pattern is reported unless
+ * all is true. passing the state of the previous call continues that
+ * scan, so matches that span texts fed one after the other are found
+ * (their start offsets are below 1 then).
+ */
+static int patset_scan_text ( lua_State * const L )
+{
+  size_t len ;
+  uint32_t s ;
+  patset_ctx_t c ;
+  const patset_t * ps = patset_check ( L ) ;
+  const char * str = patset_text ( L, 2, & len ) ;
+  const lua_Integer st = luaL_optinteger ( L, 4, 0 ) ;
+
+  luaL_argcheck ( L, 0 <= st && (lua_Integer) ps -> nstates > st, 4, "invalid state" ) ;
+  s = st ;
+  lua_settop ( L, 3 ) ;
+  patset_ctx_init ( L, & c, ps, 3 ) ;
+  (void) patset_scan ( ps, str, len, & s, 0, patset_collect, & c ) ;
+  lua_pushinteger ( L, s ) ;
+
+  return 3 ;
+}
+
+/* ps:scan_fd ( fd [, all] )
+ * like scan, but reads the text from fd (up to EOF) in chunks
+ */
+static int patset_scan_fdesc ( lua_State * const L )
+{
+  patset_ctx_t c ;
+  const patset_t * ps = patset_check ( L ) ;
+  const int fd = luaL_checkinteger ( L, 2 ) ;
+
+  patset_ctx_init ( L, & c, ps, 3 ) ;
+  if ( 0 > patset_scan_fd ( ps, fd, patset_collect, & c ) ) { return res_nil ( L ) ; }
+
+  return 2 ;
+}
+
+/* ps:scan_file ( path [, all] )
+ * like scan, but reads the text from a file
+ */
+static int patset_scan_file ( lua_State * const L )
+{
+  int fd, e ;
+  ssize_t r ;
+  patset_ctx_t c ;
+  const patset_t * ps = patset_check ( L ) ;
+  const char * path = luaL_checkstring ( L, 2 ) ;
+
+  patset_ctx_init ( L, & c, ps, 3 ) ;
+  fd = open ( path, O_RDONLY | O_CLOEXEC | O_NOCTTY ) ;
+  if ( 0 > fd ) { return res_nil ( L ) ; }
+  r = patset_scan_fd ( ps, fd, patset_collect, & c ) ;
+  e = errno ;
+  CLOSEFD( fd )
+  errno = e ;
+  if ( 0 > r ) { return res_nil ( L ) ; }
+
+  return 2 ;
+}
+
+/* ps:test ( text )
+ * returns the index of the pattern that ends first in a string or
+ * buffer and its start offset or nil if none occurs (every call starts
+ * a new scan, see scan for continuing one)
+ */
+static int patset_test ( lua_State * const L )
+{
+  size_t len ;
+  uint32_t s = 0 ;
+  patset_ctx_t c ;
+  const patset_t * ps = patset_check ( L ) ;
+  const char * str = patset_text ( L, 2, & len ) ;
+
+  c . n = 0 ;
+
+  if ( patset_scan ( ps, str, len, & s, 0, patset_first, & c ) ) {
+    lua_pushinteger ( L, c . n ) ;
+    lua_pushinteger ( L, 1 + c . end - ps -> plen [ c . n - 1 ] ) ;
+    return 2 ;
+  }
+
+  lua_pushnil ( L ) ;
+  return 1 ;
+}
+
+static int patset_count ( lua_State * const L )
+{
+  const patset_t * ps = patset_check ( L ) ;
+
+  lua_pushinteger ( L, ps -> npat ) ;
+  return 1 ;
+}
+
+static int patset_gc ( lua_State * const L )
+{
+  patset_t * ps = (patset_t *) luaL_checkudata ( L, 1, PATSET_METATABLE ) ;
+
+  patset_free ( ps ) ;
+  return 0 ;
+}
+
+/* creates the patset metatable */
+static int patset_create_meta ( lua_State * const L )
+{
+  luaL_newmetatable ( L, PATSET_METATABLE ) ;
+
+  /* method table */
+  lua_newtable ( L ) ;
+  lua_pushcfunction ( L, patset_scan_text ) ;
+  lua_setfield ( L, -2, "scan" ) ;
+  lua_pushcfunction ( L, patset_scan_fdesc ) ;
+  lua_setfield ( L, -2, "scan_fd" ) ;
+  lua_pushcfunction ( L, patset_scan_file ) ;
+  lua_setfield ( L, -2, "scan_file" ) ;
+  lua_pushcfunction ( L, patset_test ) ;
+  lua_setfield ( L, -2, "test" ) ;
+  lua_pushcfunction ( L, patset_count ) ;
+  lua_setfield ( L, -2, "count" ) ;
+
+  /* metamethods */
+  lua_setfield ( L, -2, "__index" ) ;
+  lua_pushcfunction ( L, patset_count ) ;
+  lua_setfield ( L, -2, "__len" ) ;
+  lua_pushcfunction ( L, patset_gc ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+
+  return 1 ;
+}
@@ -1,447 +1,669 @@
 /*
- * netlink uevents
+ * netlink: process events (proc connector) and uevents
  */
 
-#if 0
-#include <sys/types.h>
-#include <unistd.h>
-#include <sys/socket.h>
-#include <linux/netlink.h>
-#include <linux/connector.h>
-#define _LINUX_TIME_H
-#include <linux/cn_proc.h>
-#include <errno.h>
+#if defined (OSLinux)
 
-/* socket for netlink connection  */
-static int nl_sock ;
+/*
+ * process table that is seeded once from /proc and then kept up to date
+ * by the fork/exec/exit/id/sid/comm events of the proc connector
+ * (needs CAP_NET_ADMIN). only processes (thread group leaders) are
+ * tracked.
+ */
+
+#define PROCMON_METATABLE "Process Monitor Metatable"
+#define PROCMON_BUFSIZE		8192
+
+typedef struct procmon_ent_s procmon_ent_t ;
+
+struct procmon_ent_s {
+  procmon_ent_t * next ;
+  pid_t pid ;
+  pid_t ppid ;
+  pid_t sid ;
+  uid_t uid ;
+  gid_t gid ;
+  char comm [ 16 ] ;
+  char * exe ;
+  /* children index, only built and used by pm:children () */
+  procmon_ent_t * kids ;
+  procmon_ent_t * sibling ;
+} ;
+
+typedef struct {
+  int fd ;
+  char exe ;
+  size_t n ;
+  /* number of buckets, a power of 2 */
+  size_t nb ;
+  procmon_ent_t ** tab ;
+} procmon_t ;
+
+static procmon_ent_t ** procmon_slot ( procmon_t * const pm, const pid_t pid )
+{
+  procmon_ent_t ** pp = pm -> tab + ( (size_t) pid & ( pm -> nb - 1 ) ) ;
+
+  while ( * pp && pid != ( * pp ) -> pid ) { pp = & ( * pp ) -> next ; }
 
-#define NL_MESSAGE_SIZE (sizeof(struct nlmsghdr) + sizeof(struct cn_msg) + \
-                         sizeof(int))
+  return pp ;
+}
 
-void connect_to_netlink ( void )
+static procmon_ent_t * procmon_get ( procmon_t * const pm, const pid_t pid )
 {
-  struct sockaddr_nl sa_nl; /* netlink interface info */
-  char buff[NL_MESSAGE_SIZE];
-  struct nlmsghdr *hdr; /* for telling netlink what we want */
-  struct cn_msg *msg;   /* the actual connector message */
+  return * procmon_slot ( pm, pid ) ;
+}
 
-  /* connect to netlink socket */
-  nl_sock = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_CONNECTOR);
+/* doubles the number of buckets when the table gets crowded */
+static void procmon_grow ( procmon_t * const pm )
+{
+  size_t i, nb = 2 * pm -> nb ;
+  procmon_ent_t * ep, * np ;
+  procmon_ent_t ** tab = (procmon_ent_t **) calloc ( nb, sizeof ( procmon_ent_t * ) ) ;
+
+  if ( NULL == tab ) { return ; }
 
-  if (-1 == nl_sock) {
-    rb_raise(rb_eStandardError, "%s", strerror(errno));
+  for ( i = 0 ; pm -> nb > i ; ++ i ) {
+    for ( ep = pm -> tab [ i ] ; ep ; ep = np ) {
+      np = ep -> next ;
+      ep -> next = tab [ (size_t) ep -> pid & ( nb - 1 ) ] ;
+      tab [ (size_t) ep -> pid & ( nb - 1 ) ] = ep ;
+    }
   }
 
-  bzero(&sa_nl, sizeof(sa_nl));
-  sa_nl.nl_family = AF_NETLINK;
-  sa_nl.nl_groups = CN_IDX_PROC;
-  //sa_nl.nl_pid = getpid();
-  sa_nl.nl_pid = 0 ;
+  free ( pm -> tab ) ;
+  pm -> tab = tab ;
+  pm -> nb = nb ;
+}
+
+/* returns the entry of pid, a new one if it is not in the table yet */
+static procmon_ent_t * procmon_add ( procmon_t * const pm, const pid_t pid )
+{
+  procmon_ent_t ** pp ;
+
+  if ( 2 * pm -> nb < pm -> n ) { procmon_grow ( pm ) ; }
+  pp = procmon_slot ( pm, pid ) ;
 
-  if ( 0 > bind(nl_sock, (struct sockaddr *)&sa_nl, sizeof(sa_nl))) {
-    rb_raise(rb_eStandardError, "%s", strerror(errno));
+  if ( NULL == * pp ) {
+    * pp = (procmon_ent_t *) calloc ( 1, sizeof ( procmon_ent_t ) ) ;
+    if ( NULL == * pp ) { return NULL ; }
+    ( * pp ) -> pid = pid ;
+    ++ pm -> n ;
   }
 
-  /* Fill header */
-  hdr = (struct nlmsghdr *)buff;
-  hdr->nlmsg_len = NL_MESSAGE_SIZE;
-  hdr->nlmsg_type = NLMSG_DONE;
-  hdr->nlmsg_flags = 0;
-  hdr->nlmsg_seq = 0;
-  hdr->nlmsg_pid = getpid();
-
-  /* Fill message */
-  msg = (struct cn_msg *)NLMSG_DATA(hdr);
-  msg->id.idx = CN_IDX_PROC;  /* Connecting to process information */
-  msg->id.val = CN_VAL_PROC;
-  msg->seq = 0;
-  msg->ack = 0;
-  msg->flags = 0;
-  msg->len = sizeof(int);
-  * (int *) msg->data = PROC_CN_MCAST_LISTEN;
-
-  if (-1 == send ( nl_sock, hdr, hdr -> nlmsg_len, 0 ) ) {
-    rb_raise ( rb_eStandardError, "%s", strerror ( errno ) ) ;
+  return * pp ;
+}
+
+static void procmon_del ( procmon_t * const pm, const pid_t pid )
+{
+  procmon_ent_t ** pp = procmon_slot ( pm, pid ) ;
+  procmon_ent_t * ep = * pp ;
+
+  if ( ep ) {
+    * pp = ep -> next ;
+    free ( ep -> exe ) ;
+    free ( ep ) ;
+    -- pm -> n ;
   }
 }
 
-/* end of Ruby Ext */
+static void procmon_clear ( procmon_t * const pm )
+{
+  size_t i ;
 
-#ifndef SO_RCVBUFFORCE
-#define SO_RCVBUFFORCE 33
-#endif
-enum { RCVBUF = 2 * 1024 * 1024 } ;
+  for ( i = 0 ; pm -> tab && pm -> nb > i ; ++ i ) {
+    while ( pm -> tab [ i ] ) { procmon_del ( pm, pm -> tab [ i ] -> pid ) ; }
+  }
+}
 
-int uevent_main ( int argc, char ** argv )
+/* rereads comm (and exe) of a process after exec(2) */
+static void procmon_refresh ( procmon_t * const pm, procmon_ent_t * const ep )
 {
   int fd ;
-  struct sockaddr_nl sa ;
+  ssize_t r ;
+  char path [ 64 ] ;
+  char buf [ PATH_MAX + 1 ] ;
+
+  (void) snprintf ( path, sizeof ( path ), "/proc/%d/comm", (int) ep -> pid ) ;
+  fd = open ( path, O_RDONLY | O_CLOEXEC | O_NOCTTY ) ;
+
+  if ( 0 <= fd ) {
+    r = read ( fd, ep -> comm, sizeof ( ep -> comm ) - 1 ) ;
+    if ( 0 < r && '\n' == ep -> comm [ r - 1 ] ) { -- r ; }
+    ep -> comm [ ( 0 < r ) ? r : 0 ] = '\0' ;
+    CLOSEFD( fd )
+  }
+
+  if ( pm -> exe ) {
+    free ( ep -> exe ) ;
+    ep -> exe = NULL ;
+    (void) snprintf ( path, sizeof ( path ), "/proc/%d/exe", (int) ep -> pid ) ;
+    r = readlink ( path, buf, sizeof ( buf ) - 1 ) ;
 
-  INIT_G() ;
-  argv ++ ;
-
-  // Subscribe for UEVENT kernel messages
-  sa.nl_family = AF_NETLINK;
-  sa.nl_pad = 0;
-  sa.nl_pid = getpid();
-  sa.nl_groups = 1 << 0;
-  fd = xsocket(AF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
-  xbind ( fd, (struct sockaddr *) &sa, sizeof(sa) ) ;
-  close_on_exec_on ( fd ) ;
-
-	// Without a sufficiently big RCVBUF, a ton of simultaneous events
-	// can trigger ENOBUFS on read, which is unrecoverable.
-	// Reproducer:
-	//	uevent mdev &
-	// 	find /sys -name uevent -exec sh -c 'echo add >"{}"' ';'
-	//
-	// SO_RCVBUFFORCE (root only) can go above net.core.rmem_max sysctl
-  setsockopt_SOL_SOCKET_int ( fd, SO_RCVBUF,      RCVBUF ) ;
-  setsockopt_SOL_SOCKET_int ( fd, SO_RCVBUFFORCE, RCVBUF ) ;
-
-  if ( 0 ) {
-    int z ;
-    socklen_t zl = sizeof ( z ) ;
-    getsockopt ( fd, SOL_SOCKET, SO_RCVBUF, &z, &zl ) ;
-    bb_error_msg ( "SO_RCVBUF:%d", z ) ;
+    if ( 0 < r ) {
+      buf [ r ] = '\0' ;
+      ep -> exe = strdup ( buf ) ;
+    }
   }
+}
 
-  while ( 1 ) {
-    int idx ;
-    ssize_t len ;
-    char * netbuf ;
-    char * s, * end ;
-
-		// In many cases, a system sits for *days* waiting
-		// for a new uevent notification to come in.
-		// We use a fresh mmap so that buffer is not allocated
-		// until kernel actually starts filling it.
-		netbuf = mmap(NULL, BUFFER_SIZE,
-					PROT_READ | PROT_WRITE,
-					MAP_PRIVATE | MAP_ANON,
-					/* ignored: */ -1, 0);
-		if (netbuf == MAP_FAILED)
-			bb_perror_msg_and_die("mmap");
-
-		// Here we block, possibly for a very long time
-		len = safe_read(fd, netbuf, BUFFER_SIZE - 1);
-		if (len < 0)
-			bb_perror_msg_and_die("read");
-		end = netbuf + len;
-		*end = '\0';
-
-		// Each netlink message starts with "ACTION@/path"
-		// (which we currently ignore),
-		// followed by environment variables.
-		if (!argv[0])
-			putchar('\n');
-		idx = 0;
-		s = netbuf;
-		while (s < end) {
-			if ( ! argv [ 0 ] )
-				puts ( s );
-			if ( strchr ( s, '=' ) && idx < MAX_ENV )
-				env [ idx ++ ] = s ;
-			s += strlen(s) + 1;
-		}
-
-		env [ idx ] = NULL ;
-		idx = 0 ;
-		while ( env [ idx ] )
-			putenv ( env [ idx ++ ] ) ;
-
-		if ( argv [ 0 ] )
-			spawn_and_wait ( argv ) ;
-		idx = 0 ;
-		while ( env [ idx ] )
-			bb_unsetenv ( env [ idx ++ ] ) ;
-		munmap ( netbuf, BUFFER_SIZE ) ;
+static int procmon_seed_add ( void * ctx, const ptab_proc_t * const pp )
+{
+  procmon_t * const pm = (procmon_t * ) ctx ;
+  procmon_ent_t * const ep = procmon_add ( pm, pp -> pid ) ;
+
+  if ( ep ) {
+    ep -> ppid = pp -> ppid ;
+    ep -> sid = pp -> sid ;
+    ep -> uid = pp -> uid ;
+    ep -> gid = pp -> gid ;
+    (void) snprintf ( ep -> comm, sizeof ( ep -> comm ), "%.15s", pp -> comm ) ;
+    free ( ep -> exe ) ;
+    ep -> exe = pp -> exe ? strdup ( pp -> exe ) : NULL ;
   }
 
   return 0 ;
 }
 
-/*
- * Arachsys uevent(d)
+/* (re)builds the table from /proc */
+static int procmon_seed ( procmon_t * const pm )
+{
+  long r ;
+  ptab_t pt ;
+
+  procmon_clear ( pm ) ;
+  ptab_init ( & pt ) ;
+  pt . kthreads = 1 ;
+  pt . want = pm -> exe ? PTAB_EXE : 0 ;
+  r = ptab_scan ( & pt, procmon_seed_add, pm ) ;
+  free ( pt . buf ) ;
+
+  return ( 0 > r ) ? -1 : 0 ;
+}
+
+/* subscribes to the process events */
+static int procmon_listen ( const int fd, const int op )
+{
+  char buf [ NLMSG_SPACE( sizeof ( struct cn_msg ) + sizeof ( int ) ) ] ;
+  struct nlmsghdr * nh = (struct nlmsghdr *) buf ;
+  struct cn_msg * cm = (struct cn_msg *) NLMSG_DATA( nh ) ;
+
+  (void) memset ( buf, 0, sizeof ( buf ) ) ;
+  nh -> nlmsg_len = NLMSG_LENGTH( sizeof ( struct cn_msg ) + sizeof ( int ) ) ;
+  nh -> nlmsg_type = NLMSG_DONE ;
+  nh -> nlmsg_pid = getpid () ;
+  cm -> id . idx = CN_IDX_PROC ;
+  cm -> id . val = CN_VAL_PROC ;
+  cm -> len = sizeof ( int ) ;
+  (void) memcpy ( cm -> data, & op, sizeof ( int ) ) ;
+
+  return ( 0 > send ( fd, buf, nh -> nlmsg_len, 0 ) ) ? -1 : 0 ;
+}
+
+static procmon_t * procmon_check ( lua_State * const L )
+{
+  procmon_t * pm = (procmon_t *) luaL_checkudata ( L, 1, PROCMON_METATABLE ) ;
+
+  luaL_argcheck ( L, 0 <= pm -> fd, 1, "closed process monitor" ) ;
+  return pm ;
+}
+
+/* pushes an entry as table */
+static void procmon_push_ent ( lua_State * const L, const procmon_ent_t * const ep )
+{
+  lua_createtable ( L, 0, 7 ) ;
+  lua_pushinteger ( L, ep -> pid ) ;
+  lua_setfield ( L, -2, "pid" ) ;
+  lua_pushinteger ( L, ep -> ppid ) ;
+  lua_setfield ( L, -2, "ppid" ) ;
+  lua_pushinteger ( L, ep -> sid ) ;
+  lua_setfield ( L, -2, "sid" ) ;
+  lua_pushinteger ( L, ep -> uid ) ;
+  lua_setfield ( L, -2, "uid" ) ;
+  lua_pushinteger ( L, ep -> gid ) ;
+  lua_setfield ( L, -2, "gid" ) ;
+  (void) lua_pushstring ( L, ep -> comm ) ;
+  lua_setfield ( L, -2, "comm" ) ;
+
+  if ( ep -> exe ) {
+    (void) lua_pushstring ( L, ep -> exe ) ;
+    lua_setfield ( L, -2, "exe" ) ;
+  }
+}
+
+/* applies an event to the table, pushes an event record if ev is set.
+ * returns 1 if a record was pushed.
  */
+static int procmon_event ( lua_State * const L, procmon_t * const pm,
+  const struct proc_event * const pe, const int ev )
+{
+  pid_t pid = 0 ;
+  const char * what = NULL ;
+  procmon_ent_t * ep, * pp ;
+
+  switch ( pe -> what ) {
+    case PROC_EVENT_FORK :
+      /* new threads are not tracked */
+      if ( pe -> event_data . fork . child_pid != pe -> event_data . fork . child_tgid ) {
+        return 0 ;
+      }
+
+      pid = pe -> event_data . fork . child_tgid ;
+      ep = procmon_add ( pm, pid ) ;
+      if ( NULL == ep ) { return 0 ; }
+      ep -> ppid = pe -> event_data . fork . parent_tgid ;
+      pp = procmon_get ( pm, ep -> ppid ) ;
+
+      /* everything else is inherited */
+      if ( pp ) {
+        ep -> sid = pp -> sid ;
+        ep -> uid = pp -> uid ;
+        ep -> gid = pp -> gid ;
+        (void) memcpy ( ep -> comm, pp -> comm, sizeof ( ep -> comm ) ) ;
+        free ( ep -> exe ) ;
+        ep -> exe = pp -> exe ? strdup ( pp -> exe ) : NULL ;
+      }
+
+      what = "fork" ;
+      break ;
+
+    case PROC_EVENT_EXEC :
+      pid = pe -> event_data . exec . process_tgid ;
+      ep = procmon_add ( pm, pid ) ;
+      if ( ep ) { procmon_refresh ( pm, ep ) ; }
+      what = "exec" ;
+      break ;
+
+    case PROC_EVENT_UID :
+      pid = pe -> event_data . id . process_tgid ;
+      ep = procmon_get ( pm, pid ) ;
+      if ( ep ) { ep -> uid = pe -> event_data . id . e . euid ; }
+      what = "uid" ;
+      break ;
+
+    case PROC_EVENT_GID :
+      pid = pe -> event_data . id . process_tgid ;
+      ep = procmon_get ( pm, pid ) ;
+      if ( ep ) { ep -> gid = pe -> event_data . id . e . egid ; }
+      what = "gid" ;
+      break ;
+
+    case PROC_EVENT_SID :
+      pid = pe -> event_data . sid . process_tgid ;
+      ep = procmon_get ( pm, pid ) ;
+      if ( ep ) { ep -> sid = pid ; }
+      what = "sid" ;
+      break ;
+
+    case PROC_EVENT_COMM :
+      /* threads can have their own names */
+      if ( pe -> event_data . comm . process_pid != pe -> event_data . comm . process_tgid ) {
+        return 0 ;
+      }
+
+      pid = pe -> event_data . comm . process_tgid ;
+      ep = procmon_get ( pm, pid ) ;
+      if ( ep ) {
+        (void) memcpy ( ep -> comm, pe -> event_data . comm . comm, sizeof ( ep -> comm ) ) ;
+        ep -> comm [ sizeof ( ep -> comm ) - 1 ] = '\0' ;
+      }
+      what = "comm" ;
+      break ;
+
+    case PROC_EVENT_EXIT :
+      if ( pe -> event_data . exit . process_pid != pe -> event_data . exit . process_tgid ) {
+        return 0 ;
+      }
+
+      pid = pe -> event_data . exit . process_tgid ;
+
+      if ( ev ) {
+        lua_createtable ( L, 0, 4 ) ;
+        (void) lua_pushliteral ( L, "exit" ) ;
+        lua_setfield ( L, -2, "event" ) ;
+        lua_pushinteger ( L, pid ) ;
+        lua_setfield ( L, -2, "pid" ) ;
+        lua_pushinteger ( L, pe -> event_data . exit . exit_code ) ;
+        lua_setfield ( L, -2, "status" ) ;
+
+        if ( NULL != ( ep = procmon_get ( pm, pid ) ) ) {
+          (void) lua_pushstring ( L, ep -> comm ) ;
+          lua_setfield ( L, -2, "comm" ) ;
+        }
+      }
+
+      procmon_del ( pm, pid ) ;
+      return ev ;
+
+    default :
+      return 0 ;
+  }
+
+  if ( 0 == ev ) { return 0 ; }
+
+  if ( NULL != ( ep = procmon_get ( pm, pid ) ) ) {
+    procmon_push_ent ( L, ep ) ;
+  } else {
+    lua_createtable ( L, 0, 2 ) ;
+    lua_pushinteger ( L, pid ) ;
+    lua_setfield ( L, -2, "pid" ) ;
+  }
 
-#include <errno.h>
-#include <signal.h>
-#include <stdarg.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <asm/types.h>
-#include <linux/netlink.h>
-#include <sys/socket.h>
-
-void error(int status, int errnum, char *format, ...) {
-  va_list args;
-
-  fprintf(stderr, "%s: ", progname);
-  va_start(args, format);
-  vfprintf(stderr, format, args);
-  va_end(args);
-  if (errnum != 0)
-    fprintf(stderr, ": %s\n", strerror(errnum));
-  else
-    fputc('\n', stderr);
-  if (status != 0)
-    exit(status);
+  (void) lua_pushstring ( L, what ) ;
+  lua_setfield ( L, -2, "event" ) ;
+
+  return 1 ;
 }
 
-/* Pass on HUP, INT, TERM, USR1, USR2 signals, and exit on SIGTERM. */
-int uevent_main ( int argc, char ** argv )
+/* pm:update ( [events] )
+ * applies all pending events to the table without blocking.
+ * returns the number of events and, if events is true, an array of
+ * event records (the entry fields plus event = "fork", "exec", "uid",
+ * "gid", "sid", "comm" or "exit" and the wait status for "exit").
+ * if events were lost (socket buffer overrun) the table is rebuilt from
+ * /proc and an "overrun" record is added.
+ */
+static int procmon_update ( lua_State * const L )
 {
-  char buffer[BUFFER + 1], *cursor, *separator;
-  int sock;
-  ssize_t length;
-  struct sockaddr_nl addr;
-
-  if (argc > 1)
-    subprocess(argv + 1);
-
-  memset(&addr, 0, sizeof(addr));
-  addr.nl_family = AF_NETLINK;
-  addr.nl_pid = getpid();
-  addr.nl_groups = 1;
-
-  if ((sock = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_)) < 0)
-    error(EXIT_FAILURE, errno, "socket");
-
-  if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
-    error(EXIT_FAILURE, errno, "bind");
-
-  while ( 1 ) {
-    if ((length = recv(sock, &buffer, sizeof(buffer) - 1, 0)) < 0) {
-      if (errno != EAGAIN && errno != EINTR)
-        error(EXIT_FAILURE, errno, "recv");
-      continue;
+  int i = 0, n = 0 ;
+  ssize_t r ;
+  struct nlmsghdr * nh ;
+  procmon_t * pm = procmon_check ( L ) ;
+  const int ev = lua_toboolean ( L, 2 ) ;
+  char buf [ PROCMON_BUFSIZE ] __attribute__ ( ( aligned ( NLMSG_ALIGNTO ) ) ) ;
+
+  if ( ev ) { lua_newtable ( L ) ; }
+
+  for ( ; ; ) {
+    r = recv ( pm -> fd, buf, sizeof ( buf ), MSG_DONTWAIT ) ;
+
+    if ( 0 > r ) {
+      if ( EINTR == errno ) { continue ; }
+      if ( EAGAIN == errno || EWOULDBLOCK == errno ) { break ; }
+
+      if ( ENOBUFS == errno ) {
+        (void) procmon_seed ( pm ) ;
+        ++ n ;
+
+        if ( ev ) {
+          lua_createtable ( L, 0, 1 ) ;
+          (void) lua_pushliteral ( L, "overrun" ) ;
+          lua_setfield ( L, -2, "event" ) ;
+          lua_rawseti ( L, -2, ++ i ) ;
+        }
+
+        continue ;
+      }
+
+      return res_nil ( L ) ;
     }
 
-    /* Null-terminate the uevent and replace stray newlines with spaces. */
-    buffer[length] = 0;
-    for (cursor = buffer; cursor < buffer + length; cursor++)
-      if (*cursor == '\n')
-        *cursor = ' ';
-
-    if (strlen(buffer) >= length - 1) {
-      /* No properties; fake a simple environment based on the header. */
-      if ((cursor = strchr(buffer, '@'))) {
-        *cursor++ = 0;
-        printf("ACTION %s\n", buffer);
-        printf("DEVPATH %s\n", cursor);
-      }
-    } else {
-      /* Ignore header as properties will include ACTION and DEVPATH. */
-      cursor = buffer;
-      while (cursor += strlen(cursor) + 1, cursor < buffer + length) {
-        if ((separator = strchr(cursor, '=')))
-          *separator = ' ';
-        puts(cursor);
+    for ( nh = (struct nlmsghdr *) buf ; NLMSG_OK( nh, (size_t) r ) ; nh = NLMSG_NEXT( nh, r ) ) {
+      const struct cn_msg * cm = (const struct cn_msg *) NLMSG_DATA( nh ) ;
+
+      if ( NLMSG_NOOP == nh -> nlmsg_type || NLMSG_ERROR == nh -> nlmsg_type ) { continue ; }
+      if ( CN_IDX_PROC != cm -> id . idx || CN_VAL_PROC != cm -> id . val ) { continue ; }
+      if ( sizeof ( struct proc_event ) > cm -> len ) { continue ; }
+
+      if ( procmon_event ( L, pm, (const struct proc_event *) cm -> data, ev ) ) {
+        lua_rawseti ( L, -2, ++ i ) ;
       }
+
+      ++ n ;
     }
-    putchar('\n');
-    fflush(stdout);
   }
 
-  return EXIT_FAILURE;
+  lua_pushinteger ( L, n ) ;
+  if ( ev ) { lua_insert ( L, -2 ) ; return 2 ; }
+
+  return 1 ;
 }
 
-/*
- * Netlink functions for IFUP/IFDN/GW events
+/* pm:get ( pid ) returns the entry of a process or nil */
+static int procmon_getm ( lua_State * const L )
+{
+  procmon_t * pm = procmon_check ( L ) ;
+  const procmon_ent_t * ep = procmon_get ( pm, luaL_checkinteger ( L, 2 ) ) ;
+
+  if ( NULL == ep ) { return 0 ; }
+  procmon_push_ent ( L, ep ) ;
+
+  return 1 ;
+}
+
+/* pm:ancestors ( pid ) returns the pids of the parent, its parent etc */
+static int procmon_ancestors ( lua_State * const L )
+{
+  int i = 0 ;
+  procmon_t * pm = procmon_check ( L ) ;
+  const procmon_ent_t * ep = procmon_get ( pm, luaL_checkinteger ( L, 2 ) ) ;
+
+  lua_newtable ( L ) ;
+
+  /* guard against loops caused by missed events */
+  while ( ep && 0 < ep -> ppid && (size_t) i < pm -> n ) {
+    lua_pushinteger ( L, ep -> ppid ) ;
+    lua_rawseti ( L, -2, ++ i ) ;
+    ep = procmon_get ( pm, ep -> ppid ) ;
+  }
+
+  return 1 ;
+}
+
+/* pm:children ( pid [, all] ) returns the pids of the children of a
+ * process, of all its descendants if all is true
  */
+static int procmon_children ( lua_State * const L )
+{
+  int i = 0, j = 0 ;
+  size_t b ;
+  procmon_ent_t * ep, * pp ;
+  procmon_t * pm = procmon_check ( L ) ;
+  const lua_Integer pid = luaL_checkinteger ( L, 2 ) ;
+  const int all = lua_toboolean ( L, 3 ) ;
+
+  lua_settop ( L, 3 ) ;
+  lua_newtable ( L ) ;
+
+  for ( b = 0 ; pm -> nb > b ; ++ b ) {
+    for ( ep = pm -> tab [ b ] ; ep ; ep = ep -> next ) {
+      if ( pid == ep -> ppid && pid != ep -> pid ) {
+        lua_pushinteger ( L, ep -> pid ) ;
+        lua_rawseti ( L, -2, ++ i ) ;
+      }
+    }
+  }
 
-#include <arpa/inet.h>
-#include <errno.h>
-#include <net/if.h>		/* IFNAMSIZ */
-#include <sys/socket.h>
-#include <linux/types.h>
-#include <linux/netlink.h>
-#include <linux/rtnetlink.h>
-#include <unistd.h>
+  if ( 0 == all || 0 == i ) { return 1 ; }
 
-static int nlmsg_validate ( struct nlmsghdr * nh, size_t len )
+  /* links the children of every process in one pass */
+  for ( b = 0 ; pm -> nb > b ; ++ b ) {
+    for ( ep = pm -> tab [ b ] ; ep ; ep = ep -> next ) { ep -> kids = NULL ; }
+  }
+
+  for ( b = 0 ; pm -> nb > b ; ++ b ) {
+    for ( ep = pm -> tab [ b ] ; ep ; ep = ep -> next ) {
+      if ( ep -> pid != ep -> ppid && NULL != ( pp = procmon_get ( pm, ep -> ppid ) ) ) {
+        ep -> sibling = pp -> kids ;
+        pp -> kids = ep ;
+      }
+    }
+  }
+
+  /* the array doubles as queue of the parents still to visit, the
+   * bound guards against loops caused by missed events
+   */
+  while ( j < i && (size_t) i <= pm -> n ) {
+    (void) lua_rawgeti ( L, -1, ++ j ) ;
+    pp = procmon_get ( pm, lua_tointeger ( L, -1 ) ) ;
+    lua_pop ( L, 1 ) ;
+
+    for ( ep = pp ? pp -> kids : NULL ; ep ; ep = ep -> sibling ) {
+      lua_pushinteger ( L, ep -> pid ) ;
+      lua_rawseti ( L, -2, ++ i ) ;
+    }
+  }
+
+  return 1 ;
+}
+
+/* pm:find ( filter ) returns the pids of the processes that match all
+ * fields of the filter table: ppid, sid, uid, gid, comm and exe
+ * (a path or a file name)
+ */
+static int procmon_find ( lua_State * const L )
 {
-	if (!NLMSG_OK(nh, len))
-		return 1;
+  int i = 0 ;
+  size_t b ;
+  const procmon_ent_t * ep ;
+  procmon_t * pm = procmon_check ( L ) ;
+  lua_Integer ppid, sid, uid, gid ;
+  const char * comm, * exe ;
+
+  luaL_checktype ( L, 2, LUA_TTABLE ) ;
+  lua_getfield ( L, 2, "ppid" ) ;
+  ppid = luaL_optinteger ( L, -1, -1 ) ;
+  lua_getfield ( L, 2, "sid" ) ;
+  sid = luaL_optinteger ( L, -1, -1 ) ;
+  lua_getfield ( L, 2, "uid" ) ;
+  uid = luaL_optinteger ( L, -1, -1 ) ;
+  lua_getfield ( L, 2, "gid" ) ;
+  gid = luaL_optinteger ( L, -1, -1 ) ;
+  lua_getfield ( L, 2, "comm" ) ;
+  comm = luaL_optstring ( L, -1, NULL ) ;
+  lua_getfield ( L, 2, "exe" ) ;
+  exe = luaL_optstring ( L, -1, NULL ) ;
+  lua_newtable ( L ) ;
+
+  for ( b = 0 ; pm -> nb > b ; ++ b ) {
+    for ( ep = pm -> tab [ b ] ; ep ; ep = ep -> next ) {
+      if ( 0 <= ppid && ppid != ep -> ppid ) { continue ; }
+      if ( 0 <= sid && sid != ep -> sid ) { continue ; }
+      if ( 0 <= uid && uid != ep -> uid ) { continue ; }
+      if ( 0 <= gid && gid != ep -> gid ) { continue ; }
+      if ( comm && strcmp ( comm, ep -> comm ) ) { continue ; }
+      if ( exe && ( NULL == ep -> exe || 0 == ptab_path_match ( exe, ep -> exe ) ) ) {
+        continue ;
+      }
 
-	if (nh->nlmsg_type == NLMSG_DONE) {
-		_d("Done with netlink messages.");
-		return 1;
-	}
+      lua_pushinteger ( L, ep -> pid ) ;
+      lua_rawseti ( L, -2, ++ i ) ;
+    }
+  }
 
-	if (nh->nlmsg_type == NLMSG_ERROR) {
-		_d("Netlink reports error.");
-		return 1;
-	}
+  return 1 ;
+}
+
+static int procmon_count ( lua_State * const L )
+{
+  procmon_t * pm = procmon_check ( L ) ;
 
-	return 0;
+  lua_pushinteger ( L, pm -> n ) ;
+  return 1 ;
 }
 
-static void nl_route ( struct nlmsghdr * nlmsg )
+static int procmon_fileno ( lua_State * const L )
 {
-	struct rtmsg *r;
-	struct rtattr *a;
-	int la;
-	int gw = 0, dst = 0, mask = 0, idx = 0;
-
-	if ( nlmsg -> nlmsg_len < NLMSG_LENGTH( sizeof ( struct rtmsg ) ) ) {
-		_e("Packet too small or truncated!");
-		return;
-	}
-
-	r  = NLMSG_DATA(nlmsg);
-	a  = RTM_RTA(r);
-	la = RTM_PAYLOAD(nlmsg);
-	while (RTA_OK(a, la)) {
-		void *data = RTA_DATA(a);
-		switch (a->rta_type) {
-		case RTA_GATEWAY:
-			gw = *((int *)data);
-			//_d("GW: 0x%04x", gw);
-			break;
-
-		case RTA_DST:
-			dst = *((int *)data);
-			mask = r->rtm_dst_len;
-			//_d("MASK: 0x%04x", mask);
-			break;
-
-		case RTA_OIF:
-			idx = *((int *)data);
-			//_d("IDX: 0x%04x", idx);
-			break;
-		}
-
-		a = RTA_NEXT(a, la);
-	}
-
-	if ((!dst && !mask) && (gw || idx)) {
-		if (nlmsg->nlmsg_type == RTM_DELROUTE)
-			cond_clear("net/route/default");
-		else
-			cond_set("net/route/default");
-	}
+  procmon_t * pm = procmon_check ( L ) ;
+
+  lua_pushinteger ( L, pm -> fd ) ;
+  return 1 ;
 }
 
-static void nl_link(struct nlmsghdr *nlmsg)
+static int procmon_close ( lua_State * const L )
 {
-	int la;
-	char ifname[IFNAMSIZ + 1];
-	struct rtattr *a;
-	struct ifinfomsg *i;
-
-	if (nlmsg->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg))) {
-		_e("Packet too small or truncated!");
-		return;
-	}
-
-	i  = NLMSG_DATA(nlmsg);
-	a  = (struct rtattr *)((char *)i + NLMSG_ALIGN(sizeof(struct ifinfomsg)));
-	la = NLMSG_PAYLOAD(nlmsg, sizeof(struct ifinfomsg));
-
-	while (RTA_OK(a, la)) {
-		if (a->rta_type == IFLA_IFNAME) {
-			char msg[MAX_ARG_LEN];
-
-			strlcpy(ifname, RTA_DATA(a), sizeof(ifname));
-			switch (nlmsg->nlmsg_type) {
-			case RTM_NEWLINK:
-				/*
-				 * New interface has appearad, or interface flags has changed.
-				 * Check ifi_flags here to see if the interface is UP/DOWN
-				 */
-				if (i->ifi_change & IFF_UP) {
-					snprintf(msg, sizeof(msg), "net/%s/up", ifname);
-
-					if (i->ifi_flags & IFF_UP)
-						cond_set(msg);
-					else
-						cond_clear(msg);
-
-					if (string_compare("lo", ifname)) {
-						snprintf(msg, sizeof(msg), "net/%s/exist", ifname);
-						cond_set(msg);
-					}
-				} else {
-					snprintf(msg, sizeof(msg), "net/%s/exist", ifname);
-					cond_set(msg);
-				}
-				break;
-
-			case RTM_DELLINK:
-				/* NOTE: Interface has dissapeared, not link down ... */
-				snprintf(msg, sizeof(msg), "net/%s/exist", ifname);
-				cond_clear(msg);
-				break;
-
-			case RTM_NEWADDR:
-				_d("%s: New Address", ifname);
-				break;
-
-			case RTM_DELADDR:
-				_d("%s: Deconfig Address", ifname);
-				break;
-
-			default:
-				_d("%s: Msg 0x%x", ifname, nlmsg->nlmsg_type);
-				break;
-			}
-		}
-
-		a = RTA_NEXT(a, la);
-	}
+  procmon_t * pm = (procmon_t *) luaL_checkudata ( L, 1, PROCMON_METATABLE ) ;
+
+  if ( 0 <= pm -> fd ) {
+    (void) procmon_listen ( pm -> fd, PROC_CN_MCAST_IGNORE ) ;
+    CLOSEFD( pm -> fd )
+    pm -> fd = -1 ;
+  }
+
+  procmon_clear ( pm ) ;
+  free ( pm -> tab ) ;
+  pm -> tab = NULL ;
+  pm -> nb = 0 ;
+
+  return 0 ;
 }
 
-static void nl_callback(void *UNUSED(arg), int sd, int UNUSED(events))
+/* proc_monitor ( [exe] )
+ * subscribes to the proc connector and builds the process table from
+ * /proc. exe paths are tracked too if exe is true. the fileno becomes
+ * readable when events are pending, call update() then.
+ */
+static int Lproc_monitor ( lua_State * const L )
 {
-	ssize_t len;
-	static char buf[4096];
-	struct nlmsghdr *nh;
-
-	memset(buf, 0, sizeof(buf));
-	len = recv(sd, buf, sizeof(buf), 0);
-	if (len < 0) {
-		if (errno != EINTR)	/* Signal */
-			_pe("recv()");
-		return;
-	}
-
-	for (nh = (struct nlmsghdr *)buf; !nlmsg_validate(nh, len); nh = NLMSG_NEXT(nh, len)) {
-		//_d("Well formed netlink message received. type %d ...", nh->nlmsg_type);
-		if (nh->nlmsg_type == RTM_NEWROUTE || nh->nlmsg_type == RTM_DELROUTE)
-			nl_route(nh);
-		else
-			nl_link(nh);
-	}
+  int e ;
+  procmon_t * pm ;
+  struct sockaddr_nl sa ;
+  const int sz = 1 << 20 ;
+
+  pm = (procmon_t *) lua_newuserdata ( L, sizeof ( procmon_t ) ) ;
+  (void) memset ( pm, 0, sizeof ( procmon_t ) ) ;
+  pm -> fd = -1 ;
+  luaL_getmetatable ( L, PROCMON_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+  pm -> exe = lua_toboolean ( L, 1 ) ;
+  pm -> nb = 1024 ;
+  pm -> tab = (procmon_ent_t **) calloc ( pm -> nb, sizeof ( procmon_ent_t * ) ) ;
+  if ( NULL == pm -> tab ) { return res_nil ( L ) ; }
+
+  pm -> fd = socket ( PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_CONNECTOR ) ;
+  if ( 0 > pm -> fd ) { return res_nil ( L ) ; }
+
+  (void) memset ( & sa, 0, sizeof ( sa ) ) ;
+  sa . nl_family = AF_NETLINK ;
+  sa . nl_groups = CN_IDX_PROC ;
+  sa . nl_pid = 0 ;
+  (void) setsockopt ( pm -> fd, SOL_SOCKET, SO_RCVBUF, & sz, sizeof ( sz ) ) ;
+
+  /* subscribe first, so no process is missed while /proc is read */
+  if ( bind ( pm -> fd, (struct sockaddr *) & sa, sizeof ( sa ) )
+    || procmon_listen ( pm -> fd, PROC_CN_MCAST_LISTEN ) || procmon_seed ( pm ) )
+  {
+    e = errno ;
+    CLOSEFD( pm -> fd )
+    pm -> fd = -1 ;
+    errno = e ;
+    return res_nil ( L ) ;
+  }
+
+  return 1 ;
 }
 
-PLUGIN_INIT( plugin_init )
+/* creates the process monitor metatable */
+static int procmon_create_meta ( lua_State * const L )
 {
-	int sd;
-	struct sockaddr_nl sa;
-
-	sd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
-	if (sd < 0) {
-		_pe("socket()");
-		return;
-	}
-
-	memset(&sa, 0, sizeof(sa));
-	sa.nl_family = AF_NETLINK;
-	sa.nl_groups = RTMGRP_IPV4_ROUTE | RTMGRP_LINK; // | RTMGRP_NOTIFY | RTMGRP_IPV4_IFADDR;
-	sa.nl_pid    = getpid();
-
-	if (bind(sd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
-		_pe("bind()");
-		close(sd);
-		return;
-	}
-
-  plugin.io.fd = sd ;
-  plugin_register ( & plugin ) ;
+  luaL_newmetatable ( L, PROCMON_METATABLE ) ;
+
+  /* method table */
+  lua_newtable ( L ) ;
+  lua_pushcfunction ( L, procmon_update ) ;
+  lua_setfield ( L, -2, "update" ) ;
+  lua_pushcfunction ( L, procmon_getm ) ;
+  lua_setfield ( L, -2, "get" ) ;
+  lua_pushcfunction ( L, procmon_ancestors ) ;
+  lua_setfield ( L, -2, "ancestors" ) ;
+  lua_pushcfunction ( L, procmon_children ) ;
+  lua_setfield ( L, -2, "children" ) ;
+  lua_pushcfunction ( L, procmon_find ) ;
+  lua_setfield ( L, -2, "find" ) ;
+  lua_pushcfunction ( L, procmon_count ) ;
+  lua_setfield ( L, -2, "count" ) ;
+  lua_pushcfunction ( L, procmon_fileno ) ;
+  lua_setfield ( L, -2, "fileno" ) ;
+  lua_pushcfunction ( L, procmon_close ) ;
+  lua_setfield ( L, -2, "close" ) ;
+
+  /* metamethods */
+  lua_setfield ( L, -2, "__index" ) ;
+  lua_pushcfunction ( L, procmon_count ) ;
+  lua_setfield ( L, -2, "__len" ) ;
+  lua_pushcfunction ( L, procmon_close ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+
+  return 1 ;
 }
 
-#endif /* #if 0 */
+#endif
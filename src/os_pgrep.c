@@ -1,300 +1,392 @@
 /*
- * find/match running processes by pid, executable, owner etc
+ * find/match/signal running processes by pid, executable, owner etc
+ * (Linux, built on the /proc scanner in ptab.c)
  */
 
-#if defined(__linux__) || defined(__GNU__) || \
-  (defined (__FreeBSD_kernel__) && defined(__GLIBC__))
-
-
-/* checks if a given pid belongs to an executable given by it's
- * absolute (i. e. starting with a '/' !) path.
+/* columns of the process table */
+enum {
+  PCOL_PID = 0,
+  PCOL_PPID,
+  PCOL_PGID,
+  PCOL_SID,
+  PCOL_UID,
+  PCOL_STATE,
+  PCOL_COMM,
+  PCOL_START,
+  PCOL_RSS,
+  PCOL_EXE,
+  PCOL_ARGV,
+  PCOL_CGROUP,
+  PCOL_MAX,
+} ;
+
+static const char * const pcol_names [ PCOL_MAX ] = {
+  "pid", "ppid", "pgid", "sid", "uid", "state", "comm", "start", "rss",
+  "exe", "argv", "cgroup",
+} ;
+
+typedef struct {
+  lua_State * L ;
+  /* stack index of the first column table */
+  int top ;
+  int n ;
+  unsigned int want ;
+  double tck ;
+  long psize ;
+  /* the scan and the scratch buffer it borrowed */
+  const ptab_t * pt ;
+  rdfile_scratch_t * sp ;
+} pcol_ctx_t ;
+
+/* hands the (maybe moved) scan buffer back to the scratch buffer before
+ * the callbacks touch Lua, which may raise an error and unwind past
+ * ptab_scan()
  */
-static int pid_is_exec ( const int pid, char * exe )
+static void pcol_sync ( const pcol_ctx_t * const cp )
 {
-  if ( ( 0 < pid ) && exe && ( '/' == * exe ) ) {
-    int i = 0 ;
-    struct stat st ;
-    /*
-    int c = 0, i = 0 ;
-    FILE * fp = NULL ;
-    char buf [ 33 ] = { 0 } ;
-
-    exe = basename_c ( exe ) ;
-    (void) snprintf( buf, sizeof ( buf ), "/proc/%d/stat", pid ) ;
-    fp = fopen ( buf, "r" ) ;
-
-    if ( fp ) {
-      while ( EOF != ( c = getc ( fp ) ) && '(' != c ) ;
-
-      if ( '(' == c ) {
-        while ( ( c = getc ( fp ) ) != EOF && c == * exe )
-        { ++ exe ; }
-
-        if ( ')' == c && * exe == '\0' ) { i = 1 ; }
-      }
+  cp -> sp -> data = cp -> pt -> buf ;
+  cp -> sp -> cap = cp -> pt -> cap ;
+}
 
-      (void) fclose ( fp ) ;
-    }
-    */
-    i = stat ( exe, & st ) ;
-    if ( ( 0 == i ) && S_ISREG( st . st_mode ) && ( 0 < st . st_nlink )
-      && ( 0 < st . st_size ) )
-    {
-      //readlink () ;
-    }
-  }
+/* pushes the arguments as array */
+static void ptab_push_argv ( lua_State * const L, const char * const a, const size_t len )
+{
+  int i = 0 ;
+  size_t l = 0 ;
 
-  return 0 ;
+  lua_newtable ( L ) ;
+
+  while ( len > l ) {
+    (void) lua_pushstring ( L, a + l ) ;
+    lua_rawseti ( L, -2, ++ i ) ;
+    l += 1 + strlen ( a + l ) ;
+  }
 }
 
-static int pid_is_argv ( const int pid, const char ** argv )
+static int pcol_add ( void * ctx, const ptab_proc_t * const pp )
 {
-  if ( 0 < pid && argv && * argv && ** argv ) {
-    int fd ;
-    ssize_t bytes ;
-    char * p ;
-    char cmd [ 33 ] = { 0 } ;
-    char buf [ 1 + PATH_MAX ] = { 0 } ;
-
-    (void) snprintf ( cmd, sizeof ( cmd ) - 1,
-      "/proc/%d/cmdline", pid ) ;
-    fd = open ( cmd, O_RDONLY ) ;
-
-    if ( 0 > fd ) { return 0 ; }
-    else {
-      bytes = read ( fd, buf, sizeof ( buf ) - 1 ) ;
-      (void) close_fd ( fd ) ;
-    }
+  pcol_ctx_t * const cp = (pcol_ctx_t *) ctx ;
+  lua_State * const L = cp -> L ;
+  const int n = ++ cp -> n ;
+  char s [ 2 ] = { 0, 0 } ;
+
+  pcol_sync ( cp ) ;
+
+#define PCOL_INT(c, v) lua_pushinteger ( L, v ) ; \
+  lua_rawseti ( L, cp -> top + c, n ) ;
+
+  PCOL_INT( PCOL_PID, pp -> pid )
+  PCOL_INT( PCOL_PPID, pp -> ppid )
+  PCOL_INT( PCOL_PGID, pp -> pgid )
+  PCOL_INT( PCOL_SID, pp -> sid )
+  PCOL_INT( PCOL_UID, pp -> uid )
+  PCOL_INT( PCOL_RSS, (lua_Integer) pp -> rss * cp -> psize )
+
+#undef PCOL_INT
+
+  s [ 0 ] = pp -> state ;
+  (void) lua_pushstring ( L, s ) ;
+  lua_rawseti ( L, cp -> top + PCOL_STATE, n ) ;
+  (void) lua_pushstring ( L, pp -> comm ) ;
+  lua_rawseti ( L, cp -> top + PCOL_COMM, n ) ;
+  lua_pushnumber ( L, pp -> start / cp -> tck ) ;
+  lua_rawseti ( L, cp -> top + PCOL_START, n ) ;
+
+  if ( PTAB_EXE & cp -> want ) {
+    if ( pp -> exe ) { (void) lua_pushstring ( L, pp -> exe ) ; }
+    else { lua_pushboolean ( L, 0 ) ; }
+    lua_rawseti ( L, cp -> top + PCOL_EXE, n ) ;
+  }
 
-    if ( 0 > bytes ) { return 0 ; }
-    buf [ bytes ] = '\0' ;
-    p = buf ;
+  if ( PTAB_ARGV & cp -> want ) {
+    ptab_push_argv ( L, pp -> argv, pp -> argvlen ) ;
+    lua_rawseti ( L, cp -> top + PCOL_ARGV, n ) ;
+  }
 
-    while ( argv && * argv ) {
-      if ( 0 != strcmp ( * argv, p ) ) { return 0 ; }
+  if ( PTAB_CGROUP & cp -> want ) {
+    if ( pp -> cgroup ) { (void) lua_pushstring ( L, pp -> cgroup ) ; }
+    else { lua_pushboolean ( L, 0 ) ; }
+    lua_rawseti ( L, cp -> top + PCOL_CGROUP, n ) ;
+  }
 
-      ++ argv ;
-      p += 1 + strlen ( p ) ;
-      if ( (unsigned) (p - buffer) > sizeof ( buffer ) )
-      { return 0 ; }
-    }
+  return 0 ;
+}
 
-    return 1 ;
-  }
+static int pid_add ( void * ctx, const ptab_proc_t * const pp )
+{
+  pcol_ctx_t * const cp = (pcol_ctx_t *) ctx ;
+
+  pcol_sync ( cp ) ;
+  lua_pushinteger ( cp -> L, pp -> pid ) ;
+  lua_rawseti ( cp -> L, cp -> top, ++ cp -> n ) ;
 
   return 0 ;
 }
 
-static int Lfind_proc ( lua_State * L )
+/* gets the filters from the options table at index i. the strings stay
+ * referenced by the table, the argv array is allocated as userdata on
+ * the stack.
+ */
+static void ptab_get_opts ( lua_State * const L, const int i, ptab_t * const pt )
 {
-  /* args: const char * exec, char ** argv, uid_t uid, pid_t pid */
-  char container_pid = 0 ;
-  char openvz_host = 0 ;
-  char * line = NULL ;
-  size_t len = 0 ;
-  pid_t p ;
-  char * pp = NULL ;
-  struct dirent * entry ;
-  FILE * fp ;
-  struct stat sb ;
-  char buffer [ PATH_MAX ] ;
-  DIR * procdir = opendir ( "/proc" ) ;
-
-  if ( NULL == procdir ) { return 0 ; }
-
-  /* If /proc/self/status contains EnvID: 0, then we are an OpenVZ host,
-   * and we will need to filter out processes that are inside containers
-   * from our list of pids.
-   */
-  if ( fexists ( "/proc/self/status" ) ) {
-    fp = fopen ( "/proc/self/status", "r" ) ;
-
-    if ( fp ) {
-      while ( 0 == feof ( fp ) ) {
-        rc_getline ( & line, & len, fp ) ;
-        if ( 0 == strncmp ( line, "envID:\t0", 8 ) ) {
-          openvz_host = 1 ; break ;
-        }
-      }
+  size_t j ;
+  const char ** av ;
+
+  ptab_init ( pt ) ;
+  if ( lua_isnoneornil ( L, i ) ) { return ; }
+  luaL_checktype ( L, i, LUA_TTABLE ) ;
+
+  lua_getfield ( L, i, "ppid" ) ;
+  pt -> ppid = luaL_optinteger ( L, -1, -1 ) ;
+  lua_getfield ( L, i, "pgid" ) ;
+  pt -> pgid = luaL_optinteger ( L, -1, -1 ) ;
+  lua_getfield ( L, i, "sid" ) ;
+  pt -> sid = luaL_optinteger ( L, -1, -1 ) ;
+  lua_getfield ( L, i, "uid" ) ;
+  pt -> has_uid = ! lua_isnil ( L, -1 ) ;
+  pt -> uid = luaL_optinteger ( L, -1, 0 ) ;
+  lua_getfield ( L, i, "kthreads" ) ;
+  pt -> kthreads = lua_toboolean ( L, -1 ) ;
+  lua_pop ( L, 5 ) ;
+
+  lua_getfield ( L, i, "comm" ) ;
+  pt -> comm = luaL_optstring ( L, -1, NULL ) ;
+  lua_getfield ( L, i, "exe" ) ;
+  pt -> exe = luaL_optstring ( L, -1, NULL ) ;
+  lua_getfield ( L, i, "cgroup" ) ;
+  pt -> cgroup = luaL_optstring ( L, -1, NULL ) ;
+  lua_pop ( L, 3 ) ;
+
+  /* extra columns, e. g. "exe argv" */
+  lua_getfield ( L, i, "columns" ) ;
+
+  if ( lua_isstring ( L, -1 ) ) {
+    const char * const s = lua_tostring ( L, -1 ) ;
+
+    if ( strstr ( s, "exe" ) ) { pt -> want |= PTAB_EXE ; }
+    if ( strstr ( s, "argv" ) ) { pt -> want |= PTAB_ARGV ; }
+    if ( strstr ( s, "cgroup" ) ) { pt -> want |= PTAB_CGROUP ; }
+  }
+
+  lua_pop ( L, 1 ) ;
 
-      (void) fclose( fp ) ;
+  lua_getfield ( L, i, "argv" ) ;
+
+  if ( lua_istable ( L, -1 ) ) {
+    pt -> argc = luaL_len ( L, -1 ) ;
+    av = (const char **) lua_newuserdata ( L, ( 1 + pt -> argc ) * sizeof ( char * ) ) ;
+
+    for ( j = 0 ; pt -> argc > j ; ++ j ) {
+      (void) lua_rawgeti ( L, -2, 1 + j ) ;
+      av [ j ] = lua_tostring ( L, -1 ) ;
+      if ( NULL == av [ j ] ) { luaL_argerror ( L, i, "argv must be an array of strings" ) ; }
+      lua_pop ( L, 1 ) ;
     }
-  }
 
-  while ( NULL != ( entry = readdir ( procdir ) ) )
-  {
-		if ( sscanf( entry -> d_name, "%d", & p ) != 1 )
-			continue ;
-		if ( openrc_pid != 0 && openrc_pid == p )
-			continue ;
-		if ( pid != 0 && pid != p )
-			continue ;
-		if ( uid ) {
-			snprintf( buffer, sizeof( buffer ), "/proc/%d", p ) ;
-			if ( stat( buffer, & sb ) != 0 || sb . st_uid != uid )
-				continue ;
-		}
-		if ( exec && 0 == pid_is_exec ( p, exec ) )
-			continue ;
-		if ( argv &&
-		    0 == pid_is_argv ( p, (char **) argv ) )
-			continue ;
-		/* If this is an OpenVZ host, filter out container processes */
-		if ( openvz_host ) {
-			snprintf( buffer, sizeof( buffer ), "/proc/%d/status", p ) ;
-			if ( fexists( buffer ) ) {
-				fp = fopen( buffer, "r" ) ;
-				if ( ! fp )
-					continue ;
-				while ( ! feof( fp ) ) {
-					rc_getline( & line, & len, fp ) ;
-					if ( strncmp( line, "envID:", 6 ) == 0 ) {
-						container_pid = ! ( strncmp( line, "envID:\t0", 8 ) == 0 ) ;
-						break ;
-					}
-				}
-				fclose( fp ) ;
-			}
-		}
-		if ( container_pid )
-			continue ;
-		if ( ! pids ) {
-			pids = xmalloc( sizeof( * pids ) ) ;
-			LIST_INIT( pids ) ;
-		}
-		pi = xmalloc( sizeof( *pi ) ) ;
-		pi -> pid = p ;
-		LIST_INSERT_HEAD( pids, pi, entries ) ;
+    av [ j ] = NULL ;
+    pt -> argv = av ;
+    /* keep the array (and the strings via the options table) alive */
+    lua_replace ( L, -2 ) ;
+  } else if ( ! lua_isnil ( L, -1 ) ) {
+    luaL_argerror ( L, i, "argv must be an array of strings" ) ;
   }
+}
 
-  if ( line ) { free ( line ) ; }
-  if ( procdir ) { (void) closedir ( procdir ) ; }
+/* pushes a closed directory userdata that gets the /proc DIR of the
+ * scan, its __gc closes it if a callback raises an error
+ */
+static void ptab_guard_dir ( lua_State * const L, ptab_t * const pt )
+{
+  dir_data_t * const dp = (dir_data_t *) lua_newuserdata ( L, sizeof ( dir_data_t ) ) ;
 
-  return pids ;
+  dp -> closed = 0 ;
+  dp -> dirp = NULL ;
+  luaL_getmetatable ( L, DIR_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+  pt -> dirpp = & dp -> dirp ;
 }
 
-
-#elif defined (OSbsd)
-
-
-# if defined (OSnetbsd) || defined (OSopenbsd)
-#  define _KVM_GETPROC2
-#  define _KINFO_PROC kinfo_proc2
-#  define _KVM_GETARGV kvm_getargv2
-#  define _GET_KINFO_UID(kp) (kp.p_ruid)
-#  define _GET_KINFO_COMM(kp) (kp.p_comm)
-#  define _GET_KINFO_PID(kp) (kp.p_pid)
-#  define _KVM_PATH NULL
-#  define _KVM_FLAGS KVM_NO_FILES
-# elif defined (OSfreebsd) || defined (OSdragonfly)
-#  ifndef KERN_PROC_PROC
-#    define KERN_PROC_PROC KERN_PROC_ALL
-#  endif
-#  define _KINFO_PROC kinfo_proc
-#  define _KVM_GETARGV kvm_getargv
-#  if defined (OSdragonfly)
-#    define _GET_KINFO_UID(kp) (kp.kp_ruid)
-#    define _GET_KINFO_COMM(kp) (kp.kp_comm)
-#    define _GET_KINFO_PID(kp) (kp.kp_pid)
-#  elif defined (OSfreebsd)
-#    define _GET_KINFO_UID(kp) (kp.ki_ruid)
-#    define _GET_KINFO_COMM(kp) (kp.ki_comm)
-#    define _GET_KINFO_PID(kp) (kp.ki_pid)
-#  endif
-#  define _KVM_PATH _PATH_DEVNULL
-#  define _KVM_FLAGS O_RDONLY
-# endif
-
-static int Lfind_pids ( lua_State * L )
+/* proc_table ( [opts] )
+ * returns the number of processes and a snapshot of the process table
+ * as columns (parallel arrays): pid, ppid, pgid, sid, uid (effective),
+ * state, comm, start (seconds after boot) and rss (bytes), plus exe,
+ * argv and cgroup if listed in opts.columns.
+ * filters (opts): ppid, pgid, sid, uid, comm, exe (path or file name),
+ * argv (array of leading arguments), cgroup (v2 path, includes the
+ * sub groups) and kthreads (include kernel threads).
+ */
+static int Lproc_table ( lua_State * const L )
 {
-  /* args: char * exec, char ** argv, uid_t uid, pid_t pid */
-  int i = 0 ;
-  int processes = 0 ;
-  int match = 0 ;
-  int pargc = 0 ;
-  char ** pargv ;
-  pid_t p = 0 ;
-  char ** arg ;
-  static kvm_t * kd = NULL;
-  struct _KINFO_PROC * kp = NULL ;
-  char errbuf [ 1 + _POSIX2_LINE_MAX ] = { 0 } ;
-
-  if ( ( kd = kvm_openfiles ( _KVM_PATH, _KVM_PATH,
-    NULL, _KVM_FLAGS, errbuf ) ) == NULL )
-  {
-    (void) fprintf ( stderr, "kvm_open: %s\n", errbuf ) ;
-    return 0 ;
+  int i ;
+  long r ;
+  ptab_t pt ;
+  pcol_ctx_t c ;
+  rdfile_scratch_t * sp = rdfile_scratch ( L ) ;
+
+  lua_settop ( L, 1 ) ;
+  ptab_get_opts ( L, 1, & pt ) ;
+  ptab_guard_dir ( L, & pt ) ;
+
+  c . L = L ;
+  c . n = 0 ;
+  c . want = pt . want | ( pt . exe ? PTAB_EXE : 0 ) | ( pt . argc ? PTAB_ARGV : 0 )
+    | ( pt . cgroup ? PTAB_CGROUP : 0 ) ;
+  c . tck = sysconf ( _SC_CLK_TCK ) ;
+  c . psize = sysconf ( _SC_PAGESIZE ) ;
+  c . top = lua_gettop ( L ) + 1 ;
+  if ( 0 >= c . tck ) { c . tck = 100 ; }
+  for ( i = 0 ; PCOL_MAX > i ; ++ i ) { lua_newtable ( L ) ; }
+
+  /* scan with the scratch buffer shared with read_file() */
+  pt . want = c . want ;
+  pt . buf = sp -> data ;
+  pt . cap = sp -> cap ;
+  c . pt = & pt ;
+  c . sp = sp ;
+  r = ptab_scan ( & pt, pcol_add, & c ) ;
+  pcol_sync ( & c ) ;
+
+  if ( 0 > r ) {
+    return res_nil ( L ) ;
   }
 
-#ifdef _KVM_GETPROC2
-  kp = kvm_getproc2 ( kd, KERN_PROC_ALL, 0, sizeof ( * kp ), & processes ) ;
-#else
-  kp = kvm_getprocs ( kd, KERN_PROC_PROC, 0, & processes ) ;
-#endif
-  if ( ( kp == NULL && processes > 0 ) || (kp != NULL && processes < 0 ) )
-  {
-    (void) fprintf ( stderr, "kvm_getprocs: %s\n", kvm_geterr ( kd ) ) ;
-    kvm_close ( kd ) ;
-    return 0 ;
+  lua_createtable ( L, 0, PCOL_MAX ) ;
+
+  for ( i = 0 ; PCOL_MAX > i ; ++ i ) {
+    if ( PCOL_EXE == i && 0 == ( PTAB_EXE & c . want ) ) { continue ; }
+    if ( PCOL_ARGV == i && 0 == ( PTAB_ARGV & c . want ) ) { continue ; }
+    if ( PCOL_CGROUP == i && 0 == ( PTAB_CGROUP & c . want ) ) { continue ; }
+    lua_pushvalue ( L, c . top + i ) ;
+    lua_setfield ( L, -2, pcol_names [ i ] ) ;
   }
 
-  if ( exec ) { exec = basename_c ( exec ) ; }
+  lua_pushinteger ( L, c . n ) ;
+  lua_insert ( L, -2 ) ;
+  return 2 ;
+}
 
-  for ( i = 0 ; i < processes ; ++ i )
-  {
-    p = _GET_KINFO_PID( kp [ i ] ) ;
-    if ( 0 < pid && pid != p ) continue ;
+/* find_pids ( [opts] )
+ * returns the number and an array of the pids of the processes that
+ * match the filters of proc_table()
+ */
+static int Lfind_pids ( lua_State * const L )
+{
+  long r ;
+  ptab_t pt ;
+  pcol_ctx_t c ;
+  rdfile_scratch_t * sp = rdfile_scratch ( L ) ;
+
+  lua_settop ( L, 1 ) ;
+  ptab_get_opts ( L, 1, & pt ) ;
+  ptab_guard_dir ( L, & pt ) ;
+  pt . want = 0 ;
+  lua_newtable ( L ) ;
+  c . L = L ;
+  c . n = 0 ;
+  c . top = lua_gettop ( L ) ;
+
+  pt . buf = sp -> data ;
+  pt . cap = sp -> cap ;
+  c . pt = & pt ;
+  c . sp = sp ;
+  r = ptab_scan ( & pt, pid_add, & c ) ;
+  pcol_sync ( & c ) ;
+
+  if ( 0 > r ) {
+    return res_nil ( L ) ;
+  }
 
-    if ( uid != 0 && uid != _GET_KINFO_UID(kp[i]))
-      continue ;
+  lua_pushinteger ( L, c . n ) ;
+  lua_insert ( L, -2 ) ;
+  return 2 ;
+}
 
-    if ( exec ) {
-      if ( ! _GET_KINFO_COMM( kp [ i ] ) ||
-        0 != strcmp ( exec, _GET_KINFO_COMM( kp [ i ] ) ) )
-      { continue ; }
-    }
+/* killall5 ( sig [, opts] )
+ * sends sig to all processes except ourselves, our parent, pid 1, kernel
+ * threads and the members of our own session (the session of a process
+ * is read from /proc/<pid>/stat, the pid range is only swept without /proc).
+ * opts.session = false signals our own session too, opts.omit is an
+ * array of pids to spare and opts.pidfd = true signals via pidfds.
+ * opts.cgroups is an array of cgroup v2 paths, only their members (and
+ * those of their sub groups) are signalled then. the groups are frozen
+ * meanwhile, SIGKILL is sent via cgroup.kill. signal 0 just lists the
+ * processes that would be hit.
+ * returns the number and an array of the signalled pids and the number
+ * of failed signals.
+ */
+static int Lkillall5 ( lua_State * const L )
+{
+  long r ;
+  size_t i, ncg = 0 ;
+  killall_t kt ;
+  const char ** cgs = NULL ;
+  pid_t * omit ;
+  const lua_Integer sig = luaL_checkinteger ( L, 1 ) ;
+
+  luaL_argcheck ( L, 0 <= sig && NSIG > sig, 1, "invalid signal number" ) ;
+  killall_init ( & kt, sig ) ;
+  lua_settop ( L, 2 ) ;
+
+  if ( ! lua_isnil ( L, 2 ) ) {
+    luaL_checktype ( L, 2, LUA_TTABLE ) ;
+    lua_getfield ( L, 2, "session" ) ;
+    kt . session = lua_isnil ( L, -1 ) || lua_toboolean ( L, -1 ) ;
+    lua_getfield ( L, 2, "pidfd" ) ;
+    kt . pidfd = lua_toboolean ( L, -1 ) ;
+    lua_pop ( L, 2 ) ;
+
+    /* the arrays are kept on the stack as userdata */
+    lua_getfield ( L, 2, "omit" ) ;
+
+    if ( lua_istable ( L, -1 ) ) {
+      kt . nomit = luaL_len ( L, -1 ) ;
+      omit = (pid_t *) lua_newuserdata ( L, ( 1 + kt . nomit ) * sizeof ( pid_t ) ) ;
+
+      for ( i = 0 ; kt . nomit > i ; ++ i ) {
+        (void) lua_rawgeti ( L, -2, 1 + i ) ;
+        omit [ i ] = luaL_checkinteger ( L, -1 ) ;
+        lua_pop ( L, 1 ) ;
+      }
 
-    if ( argv && * argv ) {
-      pargv = _KVM_GETARGV( kd, & kp [ i ], pargc ) ;
-      if ( ! pargv || ! * pargv ) continue ;
-      arg = argv ;
-      match = 1 ;
-
-      while ( * arg && * pargv )
-				if ( strcmp( * arg ++, * pargv ++ ) != 0) {
-					match = 0 ;
-					break ;
-				}
-      if ( 0 == match ) continue ;
+      kt . omit = omit ;
+    } else if ( ! lua_isnil ( L, -1 ) ) {
+      luaL_argerror ( L, 2, "omit must be an array of pids" ) ;
     }
 
-    /*
-    if ( NULL == pids ) {
-      pids = xmalloc ( sizeof ( * pids ) ) ;
-      LIST_INIT( pids ) ;
-    }
+    lua_getfield ( L, 2, "cgroups" ) ;
+
+    if ( lua_istable ( L, -1 ) ) {
+      ncg = luaL_len ( L, -1 ) ;
+      cgs = (const char **) lua_newuserdata ( L, ( 1 + ncg ) * sizeof ( char * ) ) ;
 
-    pi = xmalloc ( sizeof ( * pi ) ) ;
-    pi -> pid = p ;
-    LIST_INSERT_HEAD( pids, pi, entries ) ;
-    */
+      for ( i = 0 ; ncg > i ; ++ i ) {
+        (void) lua_rawgeti ( L, -2, 1 + i ) ;
+        cgs [ i ] = lua_tostring ( L, -1 ) ;
+        if ( NULL == cgs [ i ] ) { luaL_argerror ( L, 2, "cgroups must be an array of strings" ) ; }
+        lua_pop ( L, 1 ) ;
+      }
+    } else if ( ! lua_isnil ( L, -1 ) ) {
+      luaL_argerror ( L, 2, "cgroups must be an array of strings" ) ;
+    }
   }
 
-  kvm_close ( kd ) ;
+  r = killall ( & kt, cgs, ncg ) ;
 
-  return 0 ;
-}
+  if ( 0 > r ) {
+    killall_free ( & kt ) ;
+    return res_nil ( L ) ;
+  }
 
+  lua_pushinteger ( L, r ) ;
+  lua_createtable ( L, kt . n, 0 ) ;
 
-#elif defined (OSsolaris) || defined (OSsunos5)
+  for ( i = 0 ; kt . n > i ; ++ i ) {
+    lua_pushinteger ( L, kt . pids [ i ] ) ;
+    lua_rawseti ( L, -2, 1 + i ) ;
+  }
 
-#else
-# warning "Platform not (yet ?) supported !"
+  lua_pushinteger ( L, kt . errors ) ;
+  killall_free ( & kt ) ;
 
-static int Lfind_proc ( lua_State * L )
-{
-  return 0 ;
+  return 3 ;
 }
-
-#endif
-
@@ -0,0 +1,261 @@
+/*
+ * process handles built on pid file descriptors (Linux)
+ *
+ * a handle refers to exactly one process, signals sent through it can
+ * never hit a recycled pid and its fd becomes readable when the process
+ * terminates, so it can be added to an epoll instance or passed to the
+ * poll based functions instead of waiting for SIGCHLD.
+ * on kernels without pidfds the handle falls back to the plain pid.
+ */
+
+#if defined (OSLinux)
+
+#define PIDFD_METATABLE "Pidfd Metatable"
+
+/* P_PIDFD is only an enum value in newer glibc versions */
+#define WAIT_P_PIDFD	((idtype_t) 3)
+
+#if ! defined (CLONE_PIDFD)
+#  define CLONE_PIDFD		0x00001000
+#endif
+#if ! defined (CLONE_INTO_CGROUP)
+#  define CLONE_INTO_CGROUP	0x200000000ULL
+#endif
+
+/* struct clone_args of clone3(2) up to cgroup (the size needed for
+ * CLONE_INTO_CGROUP)
+ */
+typedef struct {
+  uint64_t flags ;
+  uint64_t pidfd ;
+  uint64_t child_tid ;
+  uint64_t parent_tid ;
+  uint64_t exit_signal ;
+  uint64_t stack ;
+  uint64_t stack_size ;
+  uint64_t tls ;
+  uint64_t set_tid ;
+  uint64_t set_tid_size ;
+  uint64_t cgroup ;
+} pidfd_clone_args_t ;
+
+typedef struct {
+  int fd ;
+  pid_t pid ;
+  int reaped ;
+} pidfd_obj_t ;
+
+/* pushes a new handle for the given process */
+static pidfd_obj_t * pidfd_push ( lua_State * const L, const int fd, const pid_t pid )
+{
+  pidfd_obj_t * pp = (pidfd_obj_t *) lua_newuserdata ( L, sizeof ( pidfd_obj_t ) ) ;
+
+  pp -> fd = fd ;
+  pp -> pid = pid ;
+  pp -> reaped = 0 ;
+  luaL_getmetatable ( L, PIDFD_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+
+  return pp ;
+}
+
+static pidfd_obj_t * pidfd_check ( lua_State * const L )
+{
+  pidfd_obj_t * pp = (pidfd_obj_t *) luaL_checkudata ( L, 1, PIDFD_METATABLE ) ;
+
+  luaL_argcheck ( L, 0 < pp -> pid, 1, "closed process handle" ) ;
+  return pp ;
+}
+
+static int pidfd_getpid ( lua_State * const L )
+{
+  pidfd_obj_t * pp = pidfd_check ( L ) ;
+
+  lua_pushinteger ( L, pp -> pid ) ;
+  return 1 ;
+}
+
+/* returns the pidfd or -1 when pidfds are not supported */
+static int pidfd_fileno ( lua_State * const L )
+{
+  pidfd_obj_t * pp = pidfd_check ( L ) ;
+
+  lua_pushinteger ( L, pp -> fd ) ;
+  return 1 ;
+}
+
+/* sends a signal (default SIGTERM) to the process */
+static int pidfd_kill ( lua_State * const L )
+{
+  int i ;
+  pidfd_obj_t * pp = pidfd_check ( L ) ;
+  const int sig = luaL_optinteger ( L, 2, SIGTERM ) ;
+
+  if ( 0 <= pp -> fd ) {
+    i = sys_pidfd_send_signal ( pp -> fd, sig ) ;
+  } else if ( pp -> reaped ) {
+    /* the pid may already belong to another process */
+    errno = ESRCH ;
+    i = -1 ;
+  } else {
+    i = kill ( pp -> pid, sig ) ;
+  }
+
+  return resne0 ( L, "pidfd_send_signal", i ) ;
+}
+
+/* wait for a state change of the process, optional arg: waitid(2)
+ * flags (default WEXITED | WNOHANG).
+ * returns pid, state and status like waitid() or nothing when
+ * the process has not changed its state yet.
+ */
+static int pidfd_wait ( lua_State * const L )
+{
+  int i ;
+  siginfo_t si ;
+  pidfd_obj_t * pp = pidfd_check ( L ) ;
+  const int f = luaL_optinteger ( L, 2, WEXITED | WNOHANG ) ;
+
+  (void) memset ( & si, 0, sizeof ( siginfo_t ) ) ;
+
+  do {
+    si . si_pid = 0 ;
+    if ( 0 <= pp -> fd ) {
+      i = waitid ( WAIT_P_PIDFD, pp -> fd, & si, f ) ;
+    } else {
+      i = waitid ( P_PID, pp -> pid, & si, f ) ;
+    }
+  } while ( ( 0 > i ) && ( EINTR == errno ) ) ;
+
+  if ( 0 > i ) {
+    return res_nil ( L ) ;
+  }
+
+  if ( 0 < si . si_pid ) {
+    if ( 0 == ( WNOWAIT & f ) && ( CLD_EXITED == si . si_code
+      || CLD_KILLED == si . si_code || CLD_DUMPED == si . si_code ) )
+    {
+      pp -> reaped = 1 ;
+    }
+
+    return get_waitid_res ( L, & si ) ;
+  }
+
+  return 0 ;
+}
+
+/* checks without blocking or reaping if the process has terminated */
+static int pidfd_exited ( lua_State * const L )
+{
+  int i ;
+  pidfd_obj_t * pp = pidfd_check ( L ) ;
+
+  if ( pp -> reaped ) {
+    i = 1 ;
+  } else if ( 0 <= pp -> fd ) {
+    struct pollfd pfd ;
+
+    pfd . fd = pp -> fd ;
+    pfd . events = POLLIN ;
+    pfd . revents = 0 ;
+    i = poll ( & pfd, 1, 0 ) ;
+    if ( 0 > i ) { return res_nil ( L ) ; }
+  } else {
+    siginfo_t si ;
+
+    si . si_pid = 0 ;
+    i = waitid ( P_PID, pp -> pid, & si, WEXITED | WNOHANG | WNOWAIT ) ;
+    if ( 0 > i ) { return res_nil ( L ) ; }
+    i = 0 < si . si_pid ;
+  }
+
+  lua_pushboolean ( L, i ) ;
+  return 1 ;
+}
+
+/* closes the pidfd, the process is neither signalled nor reaped */
+static int pidfd_close ( lua_State * const L )
+{
+  pidfd_obj_t * pp = (pidfd_obj_t *) luaL_checkudata ( L, 1, PIDFD_METATABLE ) ;
+
+  if ( 0 <= pp -> fd ) {
+    CLOSEFD( pp -> fd )
+    pp -> fd = -1 ;
+  }
+
+  pp -> pid = -1 ;
+  return 0 ;
+}
+
+/* get a handle for an existing process */
+static int Lpidfd_open ( lua_State * const L )
+{
+  int fd ;
+  const pid_t pid = luaL_checkinteger ( L, 1 ) ;
+
+  luaL_argcheck ( L, 0 < pid, 1, "invalid pid" ) ;
+  fd = sys_pidfd_open ( pid, 0 ) ;
+
+  if ( 0 > fd ) {
+    return res_nil ( L ) ;
+  }
+
+  (void) pidfd_push ( L, fd, pid ) ;
+  return 1 ;
+}
+
+/* fork(2) replacement that returns a process handle for the child
+ * in the parent and 0 in the child process.
+ * the child keeps running Lua, so it is created by fork(2) and not by
+ * a raw clone3(2). a not yet reaped child can not be replaced by
+ * another process, so opening its pidfd afterwards is safe.
+ */
+static int Lpidfd_fork ( lua_State * const L )
+{
+  int fd = -1 ;
+  pid_t pid ;
+
+  (void) fflush ( NULL ) ;
+  pid = fork () ;
+  if ( 0 < pid ) { fd = sys_pidfd_open ( pid, 0 ) ; }
+
+  if ( 0 > pid ) {
+    return res_nil ( L ) ;
+  } else if ( 0 == pid ) {
+    lua_pushinteger ( L, 0 ) ;
+    return 1 ;
+  }
+
+  (void) pidfd_push ( L, fd, pid ) ;
+  return 1 ;
+}
+
+/* creates the process handle metatable */
+static int pidfd_create_meta ( lua_State * const L )
+{
+  luaL_newmetatable ( L, PIDFD_METATABLE ) ;
+
+  /* method table */
+  lua_newtable ( L ) ;
+  lua_pushcfunction ( L, pidfd_getpid ) ;
+  lua_setfield ( L, -2, "pid" ) ;
+  lua_pushcfunction ( L, pidfd_fileno ) ;
+  lua_setfield ( L, -2, "fileno" ) ;
+  lua_pushcfunction ( L, pidfd_kill ) ;
+  lua_setfield ( L, -2, "kill" ) ;
+  lua_pushcfunction ( L, pidfd_wait ) ;
+  lua_setfield ( L, -2, "wait" ) ;
+  lua_pushcfunction ( L, pidfd_exited ) ;
+  lua_setfield ( L, -2, "exited" ) ;
+  lua_pushcfunction ( L, pidfd_close ) ;
+  lua_setfield ( L, -2, "close" ) ;
+
+  /* metamethods */
+  lua_setfield ( L, -2, "__index" ) ;
+  lua_pushcfunction ( L, pidfd_close ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+
+  return 1 ;
+}
+
+#endif
@@ -1223,6 +1223,33 @@ static int u_waitpid ( lua_State * const L )
   return get_exit_status ( L, w ) ;
 }
 
+/* helper function that pushes the pid, state and status of a child
+ * as returned by waitid(2)
+ */
+static int get_waitid_res ( lua_State * const L, const siginfo_t * const sip )
+{
+  lua_pushinteger ( L, sip -> si_pid ) ;
+
+  if ( CLD_EXITED == sip -> si_code ) {
+    (void) lua_pushliteral ( L, "exited" ) ;
+  } else if ( CLD_KILLED == sip -> si_code ) {
+    (void) lua_pushliteral ( L, "signaled" ) ;
+  } else if ( CLD_DUMPED == sip -> si_code ) {
+    (void) lua_pushliteral ( L, "coredump" ) ;
+  } else if ( CLD_STOPPED == sip -> si_code ) {
+    (void) lua_pushliteral ( L, "stopped" ) ;
+  } else if ( CLD_CONTINUED == sip -> si_code ) {
+    (void) lua_pushliteral ( L, "continued" ) ;
+  } else if ( CLD_TRAPPED == sip -> si_code ) {
+    (void) lua_pushliteral ( L, "trapped" ) ;
+  } else {
+    (void) lua_pushliteral ( L, "unknown" ) ;
+  }
+
+  lua_pushinteger ( L, sip -> si_status ) ;
+  return 3 ;
+}
+
 /* wrapper for the waitid(2) syscall */
 static int u_waitid ( lua_State * const L )
 {
@@ -1252,26 +1279,7 @@ static int u_waitid ( lua_State * const L )
   }
 
   if ( 0 == i && 0 < si . si_pid ) {
-    lua_pushinteger ( L, si . si_pid ) ;
-
-    if ( CLD_EXITED == si . si_code ) {
-      (void) lua_pushliteral ( L, "exited" ) ;
-    } else if ( CLD_KILLED == si . si_code ) {
-      (void) lua_pushliteral ( L, "signaled" ) ;
-    } else if ( CLD_DUMPED == si . si_code ) {
-      (void) lua_pushliteral ( L, "coredump" ) ;
-    } else if ( CLD_STOPPED == si . si_code ) {
-      (void) lua_pushliteral ( L, "stopped" ) ;
-    } else if ( CLD_CONTINUED == si . si_code ) {
-      (void) lua_pushliteral ( L, "continued" ) ;
-    } else if ( CLD_TRAPPED == si . si_code ) {
-      (void) lua_pushliteral ( L, "trapped" ) ;
-    } else {
-      (void) lua_pushliteral ( L, "unknown" ) ;
-    }
-
-    lua_pushinteger ( L, si . si_status ) ;
-    return 3 ;
+    return get_waitid_res ( L, & si ) ;
   }
 
   return 0 ;
@@ -5,6 +5,129 @@
 /* upper limit for the number of saved regex subexpression matches */
 #define NSUB	100
 
+/* number of compiled patterns kept by the string based functions */
+#define REGEX_CACHE_SIZE	32
+#define REGEX_CACHE "regex cache"
+#define REGEX_METATABLE "Regex Metatable"
+
+typedef struct {
+  char * pat ;
+  int flags ;
+  /* tick of the last use */
+  unsigned long used ;
+  regex_t re ;
+} regex_cache_ent_t ;
+
+/* LRU cache keyed by (pattern, flags), one per Lua state */
+typedef struct {
+  unsigned long tick ;
+  regex_cache_ent_t ent [ REGEX_CACHE_SIZE ] ;
+} regex_cache_t ;
+
+/* compiled pattern of ux.regcomp() */
+typedef struct {
+  int ok ;
+  int nosub ;
+  regex_t re ;
+} regex_obj_t ;
+
+static int regex_cache_gc ( lua_State * const L )
+{
+  size_t i ;
+  regex_cache_t * cp = (regex_cache_t *) lua_touserdata ( L, 1 ) ;
+
+  for ( i = 0 ; cp && REGEX_CACHE_SIZE > i ; ++ i ) {
+    if ( cp -> ent [ i ] . pat ) {
+      regfree ( & cp -> ent [ i ] . re ) ;
+      free ( cp -> ent [ i ] . pat ) ;
+      cp -> ent [ i ] . pat = NULL ;
+    }
+  }
+
+  return 0 ;
+}
+
+/* returns the regex cache of the Lua state, it is created on first use
+ * and freed together with the state
+ */
+static regex_cache_t * regex_cache ( lua_State * const L )
+{
+  regex_cache_t * cp ;
+
+  if ( LUA_TUSERDATA == lua_getfield ( L, LUA_REGISTRYINDEX, REGEX_CACHE ) ) {
+    cp = (regex_cache_t *) lua_touserdata ( L, -1 ) ;
+    lua_pop ( L, 1 ) ;
+    return cp ;
+  }
+
+  lua_pop ( L, 1 ) ;
+  cp = (regex_cache_t *) lua_newuserdata ( L, sizeof ( regex_cache_t ) ) ;
+  (void) memset ( cp, 0, sizeof ( regex_cache_t ) ) ;
+  lua_createtable ( L, 0, 1 ) ;
+  lua_pushcfunction ( L, regex_cache_gc ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+  lua_setmetatable ( L, -2 ) ;
+  lua_setfield ( L, LUA_REGISTRYINDEX, REGEX_CACHE ) ;
+
+  return cp ;
+}
+
+/* returns the compiled pattern from the cache (compiling it on a miss)
+ * or NULL with the regcomp error code in * ep and the message in buf.
+ * the result is only valid until the next call.
+ */
+static const regex_t * regex_cached ( lua_State * const L, const char * const pat,
+  const int flags, int * const ep, char * const buf, const size_t len )
+{
+  size_t i, v = 0 ;
+  regex_t re ;
+  regex_cache_t * cp = regex_cache ( L ) ;
+  regex_cache_ent_t * e ;
+
+  for ( i = 0 ; REGEX_CACHE_SIZE > i ; ++ i ) {
+    e = cp -> ent + i ;
+
+    if ( e -> pat && flags == e -> flags && 0 == strcmp ( pat, e -> pat ) ) {
+      e -> used = ++ cp -> tick ;
+      return & e -> re ;
+    }
+
+    /* the empty or least recently used slot */
+    if ( cp -> ent [ v ] . pat && ( NULL == e -> pat || e -> used < cp -> ent [ v ] . used ) ) {
+      v = i ;
+    }
+  }
+
+  * ep = regcomp ( & re, pat, flags ) ;
+
+  if ( * ep ) {
+    (void) regerror ( * ep, & re, buf, len - 1 ) ;
+    return NULL ;
+  }
+
+  e = cp -> ent + v ;
+
+  if ( e -> pat ) {
+    regfree ( & e -> re ) ;
+    free ( e -> pat ) ;
+  }
+
+  e -> pat = strdup ( pat ) ;
+
+  if ( NULL == e -> pat ) {
+    regfree ( & re ) ;
+    * ep = REG_ESPACE ;
+    (void) snprintf ( buf, len, "%s", strerror ( ENOMEM ) ) ;
+    return NULL ;
+  }
+
+  e -> flags = flags ;
+  e -> re = re ;
+  e -> used = ++ cp -> tick ;
+
+  return & e -> re ;
+}
+
 /* See if a given string contains/matches the given regex pattern.
  * Does not return matching substrings. It only returns true
  * (string contains a matching substring) or false.
@@ -15,22 +138,20 @@ static int simple_regmatch ( lua_State * L )
   const char * str = luaL_checkstring ( L, 2 ) ;
 
   if ( pat && str && * pat && * str ) {
-    regex_t preg ;
-    int r = regcomp ( & preg, pat, REG_NOSUB | REG_EXTENDED ) ;
+    int r = 0 ;
+    char errbuf [ 256 ] = { 0 } ;
+    const regex_t * preg = regex_cached ( L, pat, REG_NOSUB | REG_EXTENDED, & r,
+      errbuf, sizeof ( errbuf ) ) ;
 
-    if ( r ) {
+    if ( NULL == preg ) {
       /* pattern failed to compile */
-      char errbuf [ 256 ] = { 0 } ;
-      (void) regerror ( r, & preg, errbuf, sizeof ( errbuf ) - 1 ) ;
-      regfree ( & preg ) ;
       lua_pushboolean ( L, 0 ) ;
       (void) lua_pushstring ( L, errbuf ) ;
       lua_pushinteger ( L, r ) ;
       return 3 ;
     }
 
-    r = regexec ( & preg, str, 0, NULL, 0 ) ;
-    regfree ( & preg ) ;
+    r = regexec ( preg, str, 0, NULL, 0 ) ;
     lua_pushboolean ( L, r ? 0 : 1 ) ;
     return 1 ;
   }
@@ -44,19 +165,15 @@ static int regmatch ( lua_State * L, const char * const pat,
 {
   if ( pat && str && * pat && * str ) {
     int i = 0 ;
-    regex_t re ;
+    const regex_t * re ;
+    char buf [ 256 ] = { 0 } ;
 
     /* always use extended POSIX regex matching */
     f |= REG_EXTENDED ;
-    i = regcomp ( & re, pat, f ) ;
+    re = regex_cached ( L, pat, f, & i, buf, sizeof ( buf ) ) ;
 
-    if ( i ) {
+    if ( NULL == re ) {
       /* the regex pattern failed to compile */
-      char buf [ 256 ] = { 0 } ;
-
-      (void) regerror ( i, & re, buf, sizeof ( buf ) - 1 ) ;
-      /* is that ok for a non compiling pattern? */
-      regfree ( & re ) ;
       (void) lua_pushnil ( L ) ;
       (void) lua_pushstring ( L, buf ) ;
       (void) lua_pushinteger ( L, i ) ;
@@ -67,7 +184,7 @@ static int regmatch ( lua_State * L, const char * const pat,
       regmatch_t pmatch [ 1 + NSUB ] ;
       i = 0 ;
 
-      while ( 0 == regexec ( & re, s, ARRAY_SIZE( pmatch ), pmatch, f2 ) )
+      while ( 0 == regexec ( re, s, ARRAY_SIZE( pmatch ), pmatch, f2 ) )
       {
         int j = 0 ;
         regoff_t len ;
@@ -91,8 +208,6 @@ static int regmatch ( lua_State * L, const char * const pat,
         ++ i ;
       }
 
-      regfree ( & re ) ;
-
       if ( 1 > i ) {
         lua_pushnil ( L ) ;
       }
@@ -148,3 +263,263 @@ static int l_grep ( lua_State * L )
   return luaL_error ( L, "missing args" ) ;
 }
 
+/* regcomp ( pattern [, flags] )
+ * compiles an extended POSIX regex (flags: REG_ICASE, REG_NEWLINE,
+ * REG_NOSUB) once for repeated use. returns a regex object or nil, the
+ * error message and the regcomp error code.
+ */
+static int Lregcomp ( lua_State * const L )
+{
+  int i ;
+  regex_obj_t * rp ;
+  const char * pat = luaL_checkstring ( L, 1 ) ;
+  const int f = luaL_optinteger ( L, 2, 0 ) | REG_EXTENDED ;
+
+  rp = (regex_obj_t *) lua_newuserdata ( L, sizeof ( regex_obj_t ) ) ;
+  rp -> ok = 0 ;
+  luaL_getmetatable ( L, REGEX_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+
+  i = regcomp ( & rp -> re, pat, f ) ;
+
+  if ( i ) {
+    char buf [ 256 ] = { 0 } ;
+
+    (void) regerror ( i, & rp -> re, buf, sizeof ( buf ) - 1 ) ;
+    lua_pushnil ( L ) ;
+    (void) lua_pushstring ( L, buf ) ;
+    lua_pushinteger ( L, i ) ;
+    return 3 ;
+  }
+
+  rp -> ok = 1 ;
+  rp -> nosub = 0 != ( REG_NOSUB & f ) ;
+  return 1 ;
+}
+
+static regex_obj_t * regex_check ( lua_State * const L )
+{
+  regex_obj_t * rp = (regex_obj_t *) luaL_checkudata ( L, 1, REGEX_METATABLE ) ;
+
+  luaL_argcheck ( L, rp -> ok, 1, "invalid regex" ) ;
+  return rp ;
+}
+
+/* runs the regex on str from the (1 based, possibly negative) offset
+ * * op on. returns the number of valid entries in pm or -1 if there is
+ * no match, * op is the 0 based start offset then.
+ */
+static int regex_exec ( const regex_obj_t * const rp, const char * const str,
+  const size_t len, lua_Integer init, size_t * const op, regmatch_t * const pm, size_t npm )
+{
+  if ( 0 > init ) { init += len + 1 ; }
+  if ( 1 > init ) { init = 1 ; }
+  * op = init - 1 ;
+
+  /* no offsets with REG_NOSUB */
+  if ( rp -> nosub ) { npm = 0 ; }
+  else if ( npm > 1 + rp -> re . re_nsub ) { npm = 1 + rp -> re . re_nsub ; }
+
+  if ( len < * op || regexec ( & rp -> re, str + * op, npm, pm, ( * op ) ? REG_NOTBOL : 0 ) ) {
+    return -1 ;
+  }
+
+  return npm ;
+}
+
+/* pushes the match offsets like string.find(): start and end of the
+ * match, then of every capture (false for captures that did not take
+ * part). returns the number of pushed values.
+ */
+static int regex_push_offsets ( lua_State * const L, const regmatch_t * const pm,
+  const int n, const size_t off )
+{
+  int j ;
+
+  luaL_checkstack ( L, 2 * n, "too many captures" ) ;
+
+  for ( j = 0 ; n > j ; ++ j ) {
+    if ( 0 > pm [ j ] . rm_so ) {
+      lua_pushboolean ( L, 0 ) ;
+      lua_pushboolean ( L, 0 ) ;
+    } else {
+      lua_pushinteger ( L, off + pm [ j ] . rm_so + 1 ) ;
+      lua_pushinteger ( L, off + pm [ j ] . rm_eo ) ;
+    }
+  }
+
+  return 2 * n ;
+}
+
+/* re:test ( str [, init] ) returns true if the regex matches */
+static int regex_test ( lua_State * const L )
+{
+  size_t len, off ;
+  const regex_obj_t * rp = regex_check ( L ) ;
+  const char * str = luaL_checklstring ( L, 2, & len ) ;
+
+  lua_pushboolean ( L, 0 <= regex_exec ( rp, str, len, luaL_optinteger ( L, 3, 1 ),
+    & off, NULL, 0 ) ) ;
+  return 1 ;
+}
+
+/* re:test_file ( path )
+ * returns true if the regex matches a line (or a \0 separated string,
+ * as in some /proc files) of a file, like grep -q. false if it does not
+ * match or the file can not be read.
+ */
+static int regex_test_file ( lua_State * const L )
+{
+  const regex_obj_t * rp = regex_check ( L ) ;
+  const char * path = luaL_checkstring ( L, 2 ) ;
+
+  lua_pushboolean ( L, file_regexec ( path, & rp -> re ) ) ;
+  return 1 ;
+}
+
+/* re:find ( str [, init] )
+ * returns start and end of the first match and of its captures, or nil.
+ * no substrings are created.
+ */
+static int regex_find ( lua_State * const L )
+{
+  int n ;
+  size_t len, off ;
+  const regex_obj_t * rp = regex_check ( L ) ;
+  const char * str = luaL_checklstring ( L, 2, & len ) ;
+  regmatch_t pm [ 1 + NSUB ] ;
+
+  n = regex_exec ( rp, str, len, luaL_optinteger ( L, 3, 1 ), & off, pm, ARRAY_SIZE( pm ) ) ;
+
+  if ( 0 > n ) {
+    lua_pushnil ( L ) ;
+    return 1 ;
+  } else if ( 0 == n ) {
+    /* REG_NOSUB */
+    lua_pushboolean ( L, 1 ) ;
+    return 1 ;
+  }
+
+  return regex_push_offsets ( L, pm, n, off ) ;
+}
+
+/* re:match ( str [, init] )
+ * like string.match(): returns the captures or the whole match, or nil
+ */
+static int regex_match ( lua_State * const L )
+{
+  int n, j ;
+  size_t len, off ;
+  const regex_obj_t * rp = regex_check ( L ) ;
+  const char * str = luaL_checklstring ( L, 2, & len ) ;
+  regmatch_t pm [ 1 + NSUB ] ;
+
+  n = regex_exec ( rp, str, len, luaL_optinteger ( L, 3, 1 ), & off, pm, ARRAY_SIZE( pm ) ) ;
+
+  if ( 0 > n ) {
+    lua_pushnil ( L ) ;
+    return 1 ;
+  } else if ( 0 == n ) {
+    lua_pushboolean ( L, 1 ) ;
+    return 1 ;
+  }
+
+  j = ( 1 < n ) ? 1 : 0 ;
+  luaL_checkstack ( L, n, "too many captures" ) ;
+
+  for ( ; n > j ; ++ j ) {
+    if ( 0 > pm [ j ] . rm_so ) { lua_pushboolean ( L, 0 ) ; }
+    else { (void) lua_pushlstring ( L, str + off + pm [ j ] . rm_so, pm [ j ] . rm_eo - pm [ j ] . rm_so ) ; }
+  }
+
+  return ( 1 < n ) ? n - 1 : 1 ;
+}
+
+/* iterator of re:gmatch(), the upvalues are the regex, the string and
+ * the next offset
+ */
+static int regex_gmatch_iter ( lua_State * const L )
+{
+  int n ;
+  size_t len, off ;
+  const regex_obj_t * rp = (const regex_obj_t *) lua_touserdata ( L, lua_upvalueindex( 1 ) ) ;
+  const char * str = lua_tolstring ( L, lua_upvalueindex( 2 ), & len ) ;
+  const lua_Integer init = lua_tointeger ( L, lua_upvalueindex( 3 ) ) ;
+  regmatch_t pm [ 1 + NSUB ] ;
+
+  if ( 0 == rp -> ok || (size_t) init > len + 1 ) { return 0 ; }
+  n = regex_exec ( rp, str, len, init, & off, pm, ARRAY_SIZE( pm ) ) ;
+  if ( 1 > n ) { return 0 ; }
+
+  /* step over empty matches */
+  lua_pushinteger ( L, off + pm [ 0 ] . rm_eo + ( ( pm [ 0 ] . rm_so == pm [ 0 ] . rm_eo ) ? 2 : 1 ) ) ;
+  lua_replace ( L, lua_upvalueindex( 3 ) ) ;
+
+  return regex_push_offsets ( L, pm, n, off ) ;
+}
+
+/* re:gmatch ( str )
+ * returns an iterator over all matches, each step returns the offsets
+ * like re:find()
+ */
+static int regex_gmatch ( lua_State * const L )
+{
+  (void) regex_check ( L ) ;
+  luaL_checktype ( L, 2, LUA_TSTRING ) ;
+  luaL_argcheck ( L, 0 == ( (regex_obj_t *) lua_touserdata ( L, 1 ) ) -> nosub, 1,
+    "regex compiled with REG_NOSUB" ) ;
+  lua_settop ( L, 2 ) ;
+  lua_pushinteger ( L, 1 ) ;
+  lua_pushcclosure ( L, regex_gmatch_iter, 3 ) ;
+
+  return 1 ;
+}
+
+/* re:nsub () returns the number of parenthesized subexpressions */
+static int regex_nsub ( lua_State * const L )
+{
+  const regex_obj_t * rp = regex_check ( L ) ;
+
+  lua_pushinteger ( L, rp -> re . re_nsub ) ;
+  return 1 ;
+}
+
+static int regex_gc ( lua_State * const L )
+{
+  regex_obj_t * rp = (regex_obj_t *) luaL_checkudata ( L, 1, REGEX_METATABLE ) ;
+
+  if ( rp -> ok ) {
+    regfree ( & rp -> re ) ;
+    rp -> ok = 0 ;
+  }
+
+  return 0 ;
+}
+
+/* creates the regex metatable */
+static int regex_create_meta ( lua_State * const L )
+{
+  luaL_newmetatable ( L, REGEX_METATABLE ) ;
+
+  /* method table */
+  lua_newtable ( L ) ;
+  lua_pushcfunction ( L, regex_test ) ;
+  lua_setfield ( L, -2, "test" ) ;
+  lua_pushcfunction ( L, regex_test_file ) ;
+  lua_setfield ( L, -2, "test_file" ) ;
+  lua_pushcfunction ( L, regex_find ) ;
+  lua_setfield ( L, -2, "find" ) ;
+  lua_pushcfunction ( L, regex_match ) ;
+  lua_setfield ( L, -2, "match" ) ;
+  lua_pushcfunction ( L, regex_gmatch ) ;
+  lua_setfield ( L, -2, "gmatch" ) ;
+  lua_pushcfunction ( L, regex_nsub ) ;
+  lua_setfield ( L, -2, "nsub" ) ;
+
+  /* metamethods */
+  lua_setfield ( L, -2, "__index" ) ;
+  lua_pushcfunction ( L, regex_gc ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+
+  return 1 ;
+}
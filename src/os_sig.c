@@ -222,34 +222,230 @@ static int Ltrap_sig ( lua_State * L ) {
   return 0 ;
 }
 
-/* get a new signal fd (Linux only) */
-/*
 #if defined (OSLinux)
-static int Lsignalfd ( lua_State * L )
-{
+/* signalfd objects: the signals of the set are blocked and queued on a
+ * fd that can be added to an epoll instance or passed to the poll based
+ * functions. read() drains up to maxbatch pending signals at once.
+ */
+#define SIGFD_METATABLE		"signalfd Metatable"
+#define SIGFD_BATCH		16
+
+typedef struct {
+  int fd ;
+  int max ;
   sigset_t ss ;
-  int i = signalfd ( -1, & ss, SFD_NONBLOCK | SFD_CLOEXEC ) ;
+  struct signalfd_siginfo si [ 1 ] ;
+} sigfd_t ;
 
-  if ( 0 > i ) {
-    return res_nil ( L ) ;
+static sigfd_t * sigfd_check ( lua_State * const L )
+{
+  sigfd_t * sp = (sigfd_t *) luaL_checkudata ( L, 1, SIGFD_METATABLE ) ;
+
+  luaL_argcheck ( L, 0 <= sp -> fd, 1, "closed signalfd" ) ;
+  return sp ;
+}
+
+/* add the signal(s) given at stack index i (a number or an array of
+ * numbers) to the signal set
+ */
+static void sigfd_get_sigs ( lua_State * const L, const int i, sigset_t * ssp )
+{
+  int j, s ;
+
+  if ( lua_istable ( L, i ) ) {
+    for ( j = 1 ; LUA_TNIL != lua_rawgeti ( L, i, j ) ; ++ j ) {
+      s = (int) lua_tointeger ( L, -1 ) ;
+      lua_pop ( L, 1 ) ;
+      luaL_argcheck ( L, 0 < s && NSIG > s, i, "invalid signal number" ) ;
+      (void) sigaddset ( ssp, s ) ;
+    }
+    lua_pop ( L, 1 ) ;
   } else {
-    lua_pushinteger ( L, i ) ;
-    return 1 ;
+    s = luaL_checkinteger ( L, i ) ;
+    luaL_argcheck ( L, 0 < s && NSIG > s, i, "invalid signal number" ) ;
+    (void) sigaddset ( ssp, s ) ;
   }
+}
 
-  return 0 ;
+/* block the signals of the set and make the fd watch exactly them */
+static int sigfd_apply ( sigfd_t * sp )
+{
+  if ( sigprocmask ( SIG_BLOCK, & sp -> ss, NULL ) ) { return -1 ; }
+
+  return signalfd ( sp -> fd, & sp -> ss, 0 ) ;
 }
-#endif
 
-static lua_State * SL = NULL ;
+/* add signal(s) to the watched set */
+static int sigfd_add ( lua_State * const L )
+{
+  sigfd_t * sp = sigfd_check ( L ) ;
+
+  sigfd_get_sigs ( L, 2, & sp -> ss ) ;
+  return resne0 ( L, "signalfd", ( 0 > sigfd_apply ( sp ) ) ? -1 : 0 ) ;
+}
+
+/* remove signal(s) from the watched set, they stay blocked */
+static int sigfd_del ( lua_State * const L )
+{
+  int s ;
+  sigset_t ss ;
+  sigfd_t * sp = sigfd_check ( L ) ;
+
+  (void) sigemptyset ( & ss ) ;
+  sigfd_get_sigs ( L, 2, & ss ) ;
+
+  for ( s = 1 ; NSIG > s ; ++ s ) {
+    if ( 1 == sigismember ( & ss, s ) ) { (void) sigdelset ( & sp -> ss, s ) ; }
+  }
+
+  return resne0 ( L, "signalfd", ( 0 > sigfd_apply ( sp ) ) ? -1 : 0 ) ;
+}
 
-static int sig_init ( lua_State * L )
+/* read pending signals. optional arg: timeout in milliseconds to wait
+ * for the first one (default 0, -1 waits forever).
+ * returns the number of signals read and an array of records
+ * { signo, code, pid, uid, status, errno, int, utime, stime }
+ * or 0 and an empty array if none were pending.
+ */
+static int sigfd_read ( lua_State * const L )
 {
-  SL = L ;
+  ssize_t r ;
+  int i, n ;
+  sigfd_t * sp = sigfd_check ( L ) ;
+  const int tmout = luaL_optinteger ( L, 2, 0 ) ;
+
+  if ( tmout ) {
+    struct pollfd pfd ;
+
+    pfd . fd = sp -> fd ;
+    pfd . events = POLLIN ;
+    pfd . revents = 0 ;
+    if ( 0 > poll ( & pfd, 1, tmout ) && EINTR != errno ) {
+      return res_nil ( L ) ;
+    }
+  }
+
+  do {
+    r = read ( sp -> fd, sp -> si, sp -> max * sizeof ( struct signalfd_siginfo ) ) ;
+  } while ( 0 > r && EINTR == errno ) ;
+
+  if ( 0 > r ) {
+    if ( EAGAIN != errno ) { return res_nil ( L ) ; }
+    r = 0 ;
+  }
+
+  n = r / sizeof ( struct signalfd_siginfo ) ;
+  lua_pushinteger ( L, n ) ;
+  lua_createtable ( L, n, 0 ) ;
+
+  for ( i = 0 ; n > i ; ++ i ) {
+    const struct signalfd_siginfo * sip = sp -> si + i ;
+
+    lua_createtable ( L, 0, 9 ) ;
+    lua_pushinteger ( L, sip -> ssi_signo ) ;
+    lua_setfield ( L, -2, "signo" ) ;
+    lua_pushinteger ( L, sip -> ssi_code ) ;
+    lua_setfield ( L, -2, "code" ) ;
+    lua_pushinteger ( L, sip -> ssi_pid ) ;
+    lua_setfield ( L, -2, "pid" ) ;
+    lua_pushinteger ( L, sip -> ssi_uid ) ;
+    lua_setfield ( L, -2, "uid" ) ;
+    lua_pushinteger ( L, sip -> ssi_status ) ;
+    lua_setfield ( L, -2, "status" ) ;
+    lua_pushinteger ( L, sip -> ssi_errno ) ;
+    lua_setfield ( L, -2, "errno" ) ;
+    lua_pushinteger ( L, sip -> ssi_int ) ;
+    lua_setfield ( L, -2, "int" ) ;
+    lua_pushinteger ( L, sip -> ssi_utime ) ;
+    lua_setfield ( L, -2, "utime" ) ;
+    lua_pushinteger ( L, sip -> ssi_stime ) ;
+    lua_setfield ( L, -2, "stime" ) ;
+    lua_rawseti ( L, -2, 1 + i ) ;
+  }
+
+  return 2 ;
+}
+
+static int sigfd_fileno ( lua_State * const L )
+{
+  sigfd_t * sp = sigfd_check ( L ) ;
+
+  lua_pushinteger ( L, sp -> fd ) ;
+  return 1 ;
+}
+
+/* closes the signal fd, the signals stay blocked */
+static int sigfd_close ( lua_State * const L )
+{
+  sigfd_t * sp = (sigfd_t *) luaL_checkudata ( L, 1, SIGFD_METATABLE ) ;
+
+  if ( 0 <= sp -> fd ) {
+    CLOSEFD( sp -> fd )
+    sp -> fd = -1 ;
+  }
 
   return 0 ;
 }
-*/
+
+/* get a new signal fd for the given signal(s) (Linux only).
+ * optional 2nd arg: max number of signals returned per read()
+ */
+static int Lsignalfd ( lua_State * const L )
+{
+  sigfd_t * sp = NULL ;
+  sigset_t ss ;
+  int n = luaL_optinteger ( L, 2, SIGFD_BATCH ) ;
+
+  n = ( 0 < n && 1024 >= n ) ? n : SIGFD_BATCH ;
+  (void) sigemptyset ( & ss ) ;
+  sigfd_get_sigs ( L, 1, & ss ) ;
+  sp = (sigfd_t *) lua_newuserdata ( L, sizeof ( sigfd_t )
+    + ( n - 1 ) * sizeof ( struct signalfd_siginfo ) ) ;
+  sp -> fd = -1 ;
+  sp -> max = n ;
+  sp -> ss = ss ;
+  luaL_getmetatable ( L, SIGFD_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+
+  if ( sigprocmask ( SIG_BLOCK, & ss, NULL ) ) {
+    return res_nil ( L ) ;
+  }
+
+  sp -> fd = signalfd ( -1, & ss, SFD_NONBLOCK | SFD_CLOEXEC ) ;
+
+  if ( 0 > sp -> fd ) {
+    return res_nil ( L ) ;
+  }
+
+  return 1 ;
+}
+
+/* creates signalfd metatable */
+static int sigfd_create_meta ( lua_State * const L )
+{
+  luaL_newmetatable ( L, SIGFD_METATABLE ) ;
+
+  /* method table */
+  lua_newtable ( L ) ;
+  lua_pushcfunction ( L, sigfd_read ) ;
+  lua_setfield ( L, -2, "read" ) ;
+  lua_pushcfunction ( L, sigfd_add ) ;
+  lua_setfield ( L, -2, "add" ) ;
+  lua_pushcfunction ( L, sigfd_del ) ;
+  lua_setfield ( L, -2, "del" ) ;
+  lua_pushcfunction ( L, sigfd_fileno ) ;
+  lua_setfield ( L, -2, "fileno" ) ;
+  lua_pushcfunction ( L, sigfd_close ) ;
+  lua_setfield ( L, -2, "close" ) ;
+
+  /* metamethods */
+  lua_setfield ( L, -2, "__index" ) ;
+  lua_pushcfunction ( L, sigfd_close ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+
+  return 1 ;
+}
+#endif
 
 /* set up our current sigmask */
 static void setup_sigmask ( sigset_t * ssp )
@@ -0,0 +1,893 @@
+/*
+ * spawn processes from a declarative spec table
+ *
+ * the spec is parsed and the executable is looked up in PATH in the
+ * parent, the child only applies the prepared settings and calls
+ * execve(2). on Linux the child is started with clone(2) using
+ * CLONE_VM | CLONE_VFORK (no page tables of the Lua VM are copied)
+ * or, when a cgroup fd is given, with clone3(2) using the same flags
+ * and CLONE_INTO_CGROUP (x86_64, elsewhere the child joins the cgroup
+ * itself). posix_spawn(3) is used on other systems.
+ *
+ * spec fields:
+ *   argv	array of strings (default: the array part of the spec)
+ *   path	executable to run instead of looking up argv [ 1 ]
+ *   env	array of "NAME=VALUE" strings (default: inherit)
+ *   fds	array of { "dup2", oldfd, newfd }, { "close", fd },
+ *		{ "open", fd, path [, flags [, mode ] ] } actions
+ *   sigmask	array of signals blocked in the child (default: inherit)
+ *   sigdefault	array of signals reset to SIG_DFL, true for all
+ *   setsid	true to start a new session
+ *   pgroup	process group to join, 0 for a new one
+ *   uid, gid	ids to switch to
+ *   rlimits	{ nofile = { soft, hard }, core = n, ... }
+ *   cwd	working directory of the child
+ *   cgroup	fd of the cgroup (v2) directory to start the child in
+ *   pidfd	true to return a process handle instead of the pid
+ */
+
+#define SPAWN_MAX_RLIMITS	16
+
+enum {
+  SPAWN_FA_DUP2 = 1,
+  SPAWN_FA_CLOSE,
+  SPAWN_FA_OPEN
+} ;
+
+typedef struct {
+  int op ;
+  int fd ;
+  int fd2 ;
+  int flags ;
+  mode_t mode ;
+  const char * path ;
+} spawn_fa_t ;
+
+typedef struct {
+  const char * path ;
+  char ** argv ;
+  char ** envp ;
+  const char * cwd ;
+  spawn_fa_t * fa ;
+  int nfa ;
+  int nrl ;
+  struct {
+    int res ;
+    struct rlimit rl ;
+  } rl [ SPAWN_MAX_RLIMITS ] ;
+  sigset_t mask ;
+  sigset_t omask ;
+  sigset_t defsig ;
+  char setmask ;
+  char setsid ;
+  char setuid ;
+  char setgid ;
+  char pidfd ;
+  char cgjoin ;
+  pid_t pgroup ;
+  uid_t uid ;
+  gid_t gid ;
+  int cgfd ;
+  volatile int err ;
+} spawn_spec_t ;
+
+/* resource names accepted in the rlimits table */
+static const struct {
+  const char * name ;
+  int res ;
+} spawn_rlimits [] = {
+#ifdef RLIMIT_AS
+  { "addrspace",	RLIMIT_AS },
+#endif
+  { "core",		RLIMIT_CORE },
+  { "cpu",		RLIMIT_CPU },
+  { "data",		RLIMIT_DATA },
+  { "fsize",		RLIMIT_FSIZE },
+#ifdef RLIMIT_LOCKS
+  { "locks",		RLIMIT_LOCKS },
+#endif
+#ifdef RLIMIT_MEMLOCK
+  { "memlock",		RLIMIT_MEMLOCK },
+#endif
+#ifdef RLIMIT_MSGQUEUE
+  { "msgqueue",		RLIMIT_MSGQUEUE },
+#endif
+#ifdef RLIMIT_NICE
+  { "nice",		RLIMIT_NICE },
+#endif
+  { "nofile",		RLIMIT_NOFILE },
+#ifdef RLIMIT_NPROC
+  { "nproc",		RLIMIT_NPROC },
+#endif
+#ifdef RLIMIT_RSS
+  { "rss",		RLIMIT_RSS },
+#endif
+#ifdef RLIMIT_RTPRIO
+  { "rtprio",		RLIMIT_RTPRIO },
+#endif
+#ifdef RLIMIT_RTTIME
+  { "rttime",		RLIMIT_RTTIME },
+#endif
+#ifdef RLIMIT_SIGPENDING
+  { "sigpending",	RLIMIT_SIGPENDING },
+#endif
+  { "stack",		RLIMIT_STACK },
+} ;
+
+/* returns the string stored in field k of the table at index t or NULL */
+static const char * spawn_opt_str ( lua_State * const L, const int t,
+  const char * const k )
+{
+  const char * s = NULL ;
+
+  if ( LUA_TNIL != lua_getfield ( L, t, k ) ) {
+    if ( LUA_TSTRING != lua_type ( L, -1 ) ) {
+      (void) luaL_error ( L, "spawn: string expected for field \"%s\"", k ) ;
+    }
+    /* the string stays referenced by the spec table */
+    s = lua_tostring ( L, -1 ) ;
+  }
+
+  lua_pop ( L, 1 ) ;
+  return s ;
+}
+
+/* returns the integer in field k of the table at index t or d */
+static lua_Integer spawn_opt_int ( lua_State * const L, const int t,
+  const char * const k, const lua_Integer d )
+{
+  lua_Integer i = d ;
+
+  if ( LUA_TNIL != lua_getfield ( L, t, k ) ) {
+    if ( 0 == lua_isinteger ( L, -1 ) ) {
+      (void) luaL_error ( L, "spawn: integer expected for field \"%s\"", k ) ;
+    }
+    i = lua_tointeger ( L, -1 ) ;
+  }
+
+  lua_pop ( L, 1 ) ;
+  return i ;
+}
+
+/* returns the integer at index i of the array at the stack top or d */
+static lua_Integer spawn_int_at ( lua_State * const L, const int i,
+  const lua_Integer d )
+{
+  lua_Integer r = d ;
+
+  if ( LUA_TNIL != lua_rawgeti ( L, -1, i ) ) {
+    if ( 0 == lua_isinteger ( L, -1 ) ) {
+      (void) luaL_error ( L, "spawn: integer expected" ) ;
+    }
+    r = lua_tointeger ( L, -1 ) ;
+  }
+
+  lua_pop ( L, 1 ) ;
+  return r ;
+}
+
+/* builds a NULL terminated string vector from the array at index t.
+ * the vector is a userdata left on the stack.
+ */
+static char ** spawn_strv ( lua_State * const L, const int t,
+  const char * const what )
+{
+  int i ;
+  const int n = lua_rawlen ( L, t ) ;
+  char ** v = (char **) lua_newuserdata ( L, ( 1 + n ) * sizeof ( char * ) ) ;
+
+  for ( i = 0 ; n > i ; ++ i ) {
+    if ( LUA_TSTRING != lua_rawgeti ( L, t, 1 + i ) ) {
+      (void) luaL_error ( L, "spawn: string expected in %s [ %d ]", what, 1 + i ) ;
+    }
+    v [ i ] = (char *) lua_tostring ( L, -1 ) ;
+    lua_pop ( L, 1 ) ;
+  }
+
+  v [ n ] = NULL ;
+  return v ;
+}
+
+/* adds the signals of the array at index t to a signal set */
+static void spawn_sigset ( lua_State * const L, const int t, sigset_t * ssp )
+{
+  int i, s ;
+
+  for ( i = 1 ; LUA_TNIL != lua_rawgeti ( L, t, i ) ; ++ i ) {
+    s = (int) lua_tointeger ( L, -1 ) ;
+    lua_pop ( L, 1 ) ;
+
+    if ( 1 > s || NSIG <= s ) {
+      (void) luaL_error ( L, "spawn: invalid signal number %d", s ) ;
+    }
+
+    (void) sigaddset ( ssp, s ) ;
+  }
+
+  lua_pop ( L, 1 ) ;
+}
+
+/* parses the fds array at the stack top */
+static void spawn_get_fa ( lua_State * const L, spawn_spec_t * const sp )
+{
+  int i ;
+  const char * op ;
+  const int t = lua_gettop ( L ) ;
+  const int n = lua_rawlen ( L, t ) ;
+
+  sp -> fa = (spawn_fa_t *) lua_newuserdata ( L, ( 1 + n ) * sizeof ( spawn_fa_t ) ) ;
+  sp -> nfa = n ;
+  /* keep the userdata referenced below the fds table */
+  lua_insert ( L, t ) ;
+
+  for ( i = 0 ; n > i ; ++ i ) {
+    spawn_fa_t * const fp = sp -> fa + i ;
+
+    if ( LUA_TTABLE != lua_rawgeti ( L, t + 1, 1 + i ) ) {
+      (void) luaL_error ( L, "spawn: table expected in fds [ %d ]", 1 + i ) ;
+    }
+
+    op = ( LUA_TSTRING == lua_rawgeti ( L, -1, 1 ) ) ? lua_tostring ( L, -1 ) : NULL ;
+    lua_pop ( L, 1 ) ;
+    fp -> fd = (int) spawn_int_at ( L, 2, -1 ) ;
+    fp -> fd2 = -1 ;
+    fp -> path = NULL ;
+    fp -> flags = 0 ;
+    fp -> mode = 0 ;
+
+    if ( NULL == op ) {
+      (void) luaL_error ( L, "spawn: action name expected in fds [ %d ]", 1 + i ) ;
+    } else if ( 0 == strcmp ( "dup2", op ) ) {
+      fp -> op = SPAWN_FA_DUP2 ;
+      fp -> fd2 = (int) spawn_int_at ( L, 3, -1 ) ;
+    } else if ( 0 == strcmp ( "close", op ) ) {
+      fp -> op = SPAWN_FA_CLOSE ;
+    } else if ( 0 == strcmp ( "open", op ) ) {
+      fp -> op = SPAWN_FA_OPEN ;
+      if ( LUA_TSTRING != lua_rawgeti ( L, -1, 3 ) ) {
+        (void) luaL_error ( L, "spawn: path expected in fds [ %d ]", 1 + i ) ;
+      }
+      fp -> path = lua_tostring ( L, -1 ) ;
+      lua_pop ( L, 1 ) ;
+      fp -> flags = (int) spawn_int_at ( L, 4, O_RDONLY ) ;
+      fp -> mode = (mode_t) spawn_int_at ( L, 5, 0644 ) ;
+    } else {
+      (void) luaL_error ( L, "spawn: unknown action \"%s\" in fds [ %d ]", op, 1 + i ) ;
+    }
+
+    if ( 0 > fp -> fd || ( SPAWN_FA_DUP2 == fp -> op && 0 > fp -> fd2 ) ) {
+      (void) luaL_error ( L, "spawn: invalid fd in fds [ %d ]", 1 + i ) ;
+    }
+
+    lua_pop ( L, 1 ) ;
+  }
+}
+
+/* parses the rlimits table at the stack top */
+static void spawn_get_rlimits ( lua_State * const L, spawn_spec_t * const sp )
+{
+  size_t j ;
+  const char * k ;
+
+  lua_pushnil ( L ) ;
+
+  while ( lua_next ( L, -2 ) ) {
+    k = ( LUA_TSTRING == lua_type ( L, -2 ) ) ? lua_tostring ( L, -2 ) : NULL ;
+
+    for ( j = 0 ; k && ARRAY_SIZE( spawn_rlimits ) > j ; ++ j ) {
+      if ( 0 == strcmp ( k, spawn_rlimits [ j ] . name ) ) { break ; }
+    }
+
+    if ( NULL == k || ARRAY_SIZE( spawn_rlimits ) <= j || SPAWN_MAX_RLIMITS <= sp -> nrl ) {
+      (void) luaL_error ( L, "spawn: invalid resource limit \"%s\"", k ? k : "?" ) ;
+    }
+
+    sp -> rl [ sp -> nrl ] . res = spawn_rlimits [ j ] . res ;
+
+    if ( lua_istable ( L, -1 ) ) {
+      /* { soft, hard } */
+      sp -> rl [ sp -> nrl ] . rl . rlim_cur = (rlim_t) spawn_int_at ( L, 1, 0 ) ;
+      sp -> rl [ sp -> nrl ] . rl . rlim_max = (rlim_t) spawn_int_at ( L, 2,
+        sp -> rl [ sp -> nrl ] . rl . rlim_cur ) ;
+    } else if ( lua_isinteger ( L, -1 ) ) {
+      sp -> rl [ sp -> nrl ] . rl . rlim_cur = (rlim_t) lua_tointeger ( L, -1 ) ;
+      sp -> rl [ sp -> nrl ] . rl . rlim_max = sp -> rl [ sp -> nrl ] . rl . rlim_cur ;
+    } else {
+      (void) luaL_error ( L, "spawn: invalid value for resource limit \"%s\"", k ) ;
+    }
+
+    ++ sp -> nrl ;
+    lua_pop ( L, 1 ) ;
+  }
+}
+
+/* looks up an executable in PATH, the result is pushed onto the stack.
+ * returns NULL and sets errno if nothing was found.
+ */
+static const char * spawn_find_exec ( lua_State * const L, const char * const name )
+{
+  size_t l, nl ;
+  struct stat st ;
+  const char * p = getenv ( "PATH" ) ;
+  const char * e ;
+  char buf [ 1 + PATH_MAX ] ;
+  int err = ENOENT ;
+
+  if ( strchr ( name, '/' ) ) {
+    return lua_pushstring ( L, name ) ;
+  }
+
+  if ( NULL == p || 0 == * p ) { p = _PATH_DEFPATH ; }
+  nl = strlen ( name ) ;
+
+  while ( * p ) {
+    e = strchr ( p, ':' ) ;
+    l = e ? (size_t) ( e - p ) : strlen ( p ) ;
+
+    if ( PATH_MAX > l + nl + 1 ) {
+      if ( l ) {
+        (void) memcpy ( buf, p, l ) ;
+        buf [ l ++ ] = '/' ;
+      }
+      (void) memcpy ( buf + l, name, 1 + nl ) ;
+
+      if ( 0 == access ( buf, X_OK ) && 0 == stat ( buf, & st ) && S_ISREG( st . st_mode ) ) {
+        return lua_pushstring ( L, buf ) ;
+      } else if ( EACCES == errno ) {
+        err = EACCES ;
+      }
+    }
+
+    if ( NULL == e ) { break ; }
+    p = e + 1 ;
+  }
+
+  errno = err ;
+  return NULL ;
+}
+
+/* parses the spec table at stack index t. strings are referenced by the
+ * spec, helper userdata are left on the stack.
+ * returns 0 on success or an errno value if the executable was not found.
+ */
+static int spawn_parse ( lua_State * const L, const int t, spawn_spec_t * const sp )
+{
+  lua_Integer id ;
+  const char * path ;
+
+  (void) memset ( sp, 0, sizeof ( spawn_spec_t ) ) ;
+  sp -> pgroup = -1 ;
+  sp -> cgfd = -1 ;
+  (void) sigemptyset ( & sp -> mask ) ;
+  (void) sigemptyset ( & sp -> defsig ) ;
+  luaL_checktype ( L, t, LUA_TTABLE ) ;
+
+  if ( LUA_TTABLE == lua_getfield ( L, t, "argv" ) ) {
+    sp -> argv = spawn_strv ( L, lua_gettop ( L ), "argv" ) ;
+    lua_remove ( L, -2 ) ;
+  } else {
+    lua_pop ( L, 1 ) ;
+    sp -> argv = spawn_strv ( L, t, "argv" ) ;
+  }
+
+  if ( NULL == sp -> argv [ 0 ] ) {
+    (void) luaL_error ( L, "spawn: empty argv" ) ;
+  }
+
+  if ( LUA_TTABLE == lua_getfield ( L, t, "env" ) ) {
+    sp -> envp = spawn_strv ( L, lua_gettop ( L ), "env" ) ;
+    lua_remove ( L, -2 ) ;
+  } else {
+    lua_pop ( L, 1 ) ;
+  }
+
+  if ( LUA_TTABLE == lua_getfield ( L, t, "fds" ) ) {
+    spawn_get_fa ( L, sp ) ;
+  }
+  lua_pop ( L, 1 ) ;
+
+  if ( LUA_TTABLE == lua_getfield ( L, t, "sigmask" ) ) {
+    sp -> setmask = 1 ;
+    spawn_sigset ( L, lua_gettop ( L ), & sp -> mask ) ;
+  }
+  lua_pop ( L, 1 ) ;
+
+  if ( LUA_TTABLE == lua_getfield ( L, t, "sigdefault" ) ) {
+    spawn_sigset ( L, lua_gettop ( L ), & sp -> defsig ) ;
+  } else if ( lua_toboolean ( L, -1 ) ) {
+    (void) sigfillset ( & sp -> defsig ) ;
+  }
+  lua_pop ( L, 1 ) ;
+
+  if ( LUA_TTABLE == lua_getfield ( L, t, "rlimits" ) ) {
+    spawn_get_rlimits ( L, sp ) ;
+  }
+  lua_pop ( L, 1 ) ;
+
+  (void) lua_getfield ( L, t, "setsid" ) ;
+  sp -> setsid = lua_toboolean ( L, -1 ) ;
+  (void) lua_getfield ( L, t, "pidfd" ) ;
+  sp -> pidfd = lua_toboolean ( L, -1 ) ;
+  lua_pop ( L, 2 ) ;
+
+  sp -> pgroup = (pid_t) spawn_opt_int ( L, t, "pgroup", -1 ) ;
+  sp -> cgfd = (int) spawn_opt_int ( L, t, "cgroup", -1 ) ;
+  id = spawn_opt_int ( L, t, "uid", -1 ) ;
+  sp -> setuid = (char) ( 0 <= id ) ;
+  sp -> uid = (uid_t) id ;
+  id = spawn_opt_int ( L, t, "gid", -1 ) ;
+  sp -> setgid = (char) ( 0 <= id ) ;
+  sp -> gid = (gid_t) id ;
+  sp -> cwd = spawn_opt_str ( L, t, "cwd" ) ;
+
+  /* look up the executable once in the parent */
+  path = spawn_opt_str ( L, t, "path" ) ;
+  sp -> path = spawn_find_exec ( L, path ? path : sp -> argv [ 0 ] ) ;
+
+  return sp -> path ? 0 : errno ;
+}
+
+#if defined (OSLinux)
+#define SPAWN_STACK		( 64 * 1024 )
+
+/* stack for the clone(2)d child, the parent is suspended while the
+ * child uses it, so a single one is sufficient.
+ */
+static char * spawn_stack = NULL ;
+
+/* the child shares the memory of the parent, the libc wrappers of the
+ * set*id functions would try to synchronize the credentials with the
+ * threads of the parent, so the raw syscalls are used.
+ */
+#if defined (SYS_setuid32)
+#  define SPAWN_SETUID		SYS_setuid32
+#  define SPAWN_SETGID		SYS_setgid32
+#  define SPAWN_SETGROUPS	SYS_setgroups32
+#else
+#  define SPAWN_SETUID		SYS_setuid
+#  define SPAWN_SETGID		SYS_setgid
+#  define SPAWN_SETGROUPS	SYS_setgroups
+#endif
+
+/* runs in the child: applies the spec and executes the program */
+static int spawn_child ( void * arg )
+{
+  int i, fd ;
+  spawn_spec_t * const sp = (spawn_spec_t *) arg ;
+  struct sigaction sa ;
+
+  /* no handlers of the parent may run in the child,
+   * reset them and the requested signals to the default.
+   */
+  for ( i = 1 ; NSIG > i ; ++ i ) {
+    if ( SIGKILL == i || SIGSTOP == i ) { continue ; }
+    if ( sigaction ( i, NULL, & sa ) ) { continue ; }
+    if ( 1 == sigismember ( & sp -> defsig, i ) ||
+      ( SIG_IGN != sa . sa_handler && SIG_DFL != sa . sa_handler ) )
+    {
+      sa . sa_handler = SIG_DFL ;
+      sa . sa_flags = 0 ;
+      (void) sigemptyset ( & sa . sa_mask ) ;
+      (void) sigaction ( i, & sa, NULL ) ;
+    }
+  }
+
+  if ( sp -> setsid && 0 > setsid () ) { goto fail ; }
+  if ( 0 <= sp -> pgroup && setpgid ( 0, sp -> pgroup ) ) { goto fail ; }
+
+  for ( i = 0 ; sp -> nrl > i ; ++ i ) {
+    if ( setrlimit ( sp -> rl [ i ] . res, & sp -> rl [ i ] . rl ) ) { goto fail ; }
+  }
+
+  if ( sp -> cgjoin ) {
+    /* no CLONE_INTO_CGROUP: move ourselves into the cgroup */
+    fd = openat ( sp -> cgfd, "cgroup.procs", O_WRONLY | O_CLOEXEC ) ;
+    if ( 0 > fd ) { goto fail ; }
+    if ( 1 != write ( fd, "0", 1 ) ) { goto fail ; }
+    (void) close ( fd ) ;
+  }
+
+  for ( i = 0 ; sp -> nfa > i ; ++ i ) {
+    const spawn_fa_t * const fp = sp -> fa + i ;
+
+    if ( SPAWN_FA_DUP2 == fp -> op ) {
+      if ( fp -> fd == fp -> fd2 ) {
+        /* keep the fd open across execve(2) */
+        if ( fcntl ( fp -> fd, F_SETFD, 0 ) ) { goto fail ; }
+      } else if ( 0 > dup2 ( fp -> fd, fp -> fd2 ) ) { goto fail ; }
+    } else if ( SPAWN_FA_CLOSE == fp -> op ) {
+      (void) close ( fp -> fd ) ;
+    } else if ( SPAWN_FA_OPEN == fp -> op ) {
+      fd = open ( fp -> path, fp -> flags, fp -> mode ) ;
+      if ( 0 > fd ) { goto fail ; }
+      if ( fd != fp -> fd ) {
+        if ( 0 > dup2 ( fd, fp -> fd ) ) { goto fail ; }
+        (void) close ( fd ) ;
+      }
+    }
+  }
+
+  if ( sp -> cwd && chdir ( sp -> cwd ) ) { goto fail ; }
+
+  if ( sp -> setgid ) {
+    if ( 0 == geteuid () && syscall ( SPAWN_SETGROUPS, 1, & sp -> gid ) ) { goto fail ; }
+    if ( syscall ( SPAWN_SETGID, sp -> gid ) ) { goto fail ; }
+  }
+
+  if ( sp -> setuid && syscall ( SPAWN_SETUID, sp -> uid ) ) { goto fail ; }
+
+  (void) sigprocmask ( SIG_SETMASK, sp -> setmask ? & sp -> mask : & sp -> omask, NULL ) ;
+  (void) execve ( sp -> path, sp -> argv, sp -> envp ? sp -> envp : environ ) ;
+
+fail :
+  /* report the error to the parent, which shares our memory */
+  sp -> err = errno ;
+  _exit ( 127 ) ;
+  return 127 ;
+}
+
+#if defined (__x86_64__) && defined (__GNUC__) && defined (SYS_clone3)
+/* clone3(2) with CLONE_VM | CLONE_VFORK | CLONE_INTO_CGROUP. the child
+ * starts on spawn_stack and can not return from the syscall like from
+ * fork(2), it calls spawn_child () right away, which never returns.
+ */
+static pid_t spawn_clone3 ( spawn_spec_t * const sp, int * const pfd )
+{
+  long r = SYS_clone3 ;
+  pidfd_clone_args_t ca ;
+
+  (void) memset ( & ca, 0, sizeof ( ca ) ) ;
+  ca . flags = CLONE_VM | CLONE_VFORK | CLONE_INTO_CGROUP | ( pfd ? CLONE_PIDFD : 0 ) ;
+  ca . pidfd = (uint64_t) (uintptr_t) pfd ;
+  ca . exit_signal = SIGCHLD ;
+  ca . stack = (uint64_t) (uintptr_t) spawn_stack ;
+  ca . stack_size = SPAWN_STACK ;
+  ca . cgroup = sp -> cgfd ;
+
+  __asm__ __volatile__ (
+    "syscall\n\t"
+    "test %%rax, %%rax\n\t"
+    "jnz 1f\n\t"
+    "xor %%ebp, %%ebp\n\t"
+    "mov %[arg], %%rdi\n\t"
+    "call *%[fn]\n\t"
+    "ud2\n"
+    "1:\n\t"
+    : "+a" ( r )
+    : "D" ( & ca ), "S" ( sizeof ( ca ) ), [fn] "r" ( spawn_child ), [arg] "r" ( sp )
+    : "rcx", "r11", "memory" ) ;
+
+  if ( 0 > r ) {
+    errno = - r ;
+    return -1 ;
+  }
+
+  return r ;
+}
+#else
+static pid_t spawn_clone3 ( spawn_spec_t * const sp, int * const pfd )
+{
+  errno = ENOSYS ;
+  return -1 ;
+}
+#endif
+
+/* starts the child process, stores a pidfd in * pfd if pfd is not NULL.
+ * returns the pid or -1 and sets errno.
+ */
+static pid_t spawn_run ( spawn_spec_t * const sp, int * const pfd )
+{
+  int e = 0, fd = -1 ;
+  pid_t pid = -1 ;
+  sigset_t ss ;
+
+  sp -> err = 0 ;
+  sp -> cgjoin = 0 ;
+  (void) sigfillset ( & ss ) ;
+  (void) sigprocmask ( SIG_SETMASK, & ss, & sp -> omask ) ;
+
+  if ( NULL == spawn_stack ) {
+    spawn_stack = (char *) mmap ( NULL, SPAWN_STACK, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0 ) ;
+
+    if ( MAP_FAILED == spawn_stack ) {
+      spawn_stack = NULL ;
+      e = ENOMEM ;
+      goto done ;
+    }
+  }
+
+  if ( 0 <= sp -> cgfd ) {
+    pid = spawn_clone3 ( sp, pfd ? & fd : NULL ) ;
+    e = errno ;
+
+    if ( 0 < pid || ( ENOSYS != e && E2BIG != e && EINVAL != e ) ) {
+      goto done ;
+    }
+
+    /* old kernel or no clone3(2) support here, let the child join the
+     * cgroup itself
+     */
+    sp -> cgjoin = 1 ;
+  }
+
+  pid = clone ( spawn_child, spawn_stack + SPAWN_STACK,
+    CLONE_VM | CLONE_VFORK | SIGCHLD | ( pfd ? CLONE_PIDFD : 0 ), sp, & fd ) ;
+
+  if ( 0 > pid && pfd && EINVAL == errno ) {
+    /* kernel without CLONE_PIDFD */
+    pid = clone ( spawn_child, spawn_stack + SPAWN_STACK,
+      CLONE_VM | CLONE_VFORK | SIGCHLD, sp, NULL ) ;
+    if ( 0 < pid && 0 == sp -> err ) { fd = sys_pidfd_open ( pid, 0 ) ; }
+  }
+
+  e = errno ;
+
+done :
+  (void) sigprocmask ( SIG_SETMASK, & sp -> omask, NULL ) ;
+
+  if ( 0 < pid && sp -> err ) {
+    /* the child failed before execve(2) or execve(2) itself failed */
+    e = sp -> err ;
+    while ( 0 > waitpid ( pid, NULL, 0 ) && EINTR == errno ) { ; }
+    pid = -1 ;
+  }
+
+  if ( 0 < pid && pfd ) {
+    * pfd = fd ;
+  } else if ( 0 <= fd ) {
+    (void) close ( fd ) ;
+  }
+
+  if ( 0 > pid ) { errno = e ; }
+
+  return pid ;
+}
+#else
+/* starts the child process with posix_spawn(3), pidfds are not
+ * available here.
+ */
+static pid_t spawn_run ( spawn_spec_t * const sp, int * const pfd )
+{
+  int i ;
+  short f = 0 ;
+  pid_t pid = -1 ;
+  posix_spawn_file_actions_t fa ;
+  posix_spawnattr_t at ;
+
+  if ( sp -> nrl || sp -> setuid || sp -> setgid || 0 <= sp -> cgfd || sp -> cwd ) {
+    errno = ENOTSUP ;
+    return -1 ;
+  }
+
+  if ( pfd ) { * pfd = -1 ; }
+  if ( ( i = posix_spawn_file_actions_init ( & fa ) ) ) { errno = i ; return -1 ; }
+  if ( ( i = posix_spawnattr_init ( & at ) ) ) {
+    (void) posix_spawn_file_actions_destroy ( & fa ) ;
+    errno = i ;
+    return -1 ;
+  }
+
+  for ( i = 0 ; sp -> nfa > i ; ++ i ) {
+    const spawn_fa_t * const fp = sp -> fa + i ;
+
+    if ( SPAWN_FA_DUP2 == fp -> op ) {
+      (void) posix_spawn_file_actions_adddup2 ( & fa, fp -> fd, fp -> fd2 ) ;
+    } else if ( SPAWN_FA_CLOSE == fp -> op ) {
+      (void) posix_spawn_file_actions_addclose ( & fa, fp -> fd ) ;
+    } else if ( SPAWN_FA_OPEN == fp -> op ) {
+      (void) posix_spawn_file_actions_addopen ( & fa, fp -> fd, fp -> path,
+        fp -> flags, fp -> mode ) ;
+    }
+  }
+
+  if ( sp -> setmask ) {
+    f |= POSIX_SPAWN_SETSIGMASK ;
+    (void) posix_spawnattr_setsigmask ( & at, & sp -> mask ) ;
+  }
+
+  f |= POSIX_SPAWN_SETSIGDEF ;
+  (void) posix_spawnattr_setsigdefault ( & at, & sp -> defsig ) ;
+
+  if ( 0 <= sp -> pgroup ) {
+    f |= POSIX_SPAWN_SETPGROUP ;
+    (void) posix_spawnattr_setpgroup ( & at, sp -> pgroup ) ;
+  }
+
+#if defined (POSIX_SPAWN_SETSID)
+  if ( sp -> setsid ) { f |= POSIX_SPAWN_SETSID ; }
+#endif
+
+  (void) posix_spawnattr_setflags ( & at, f ) ;
+  i = posix_spawn ( & pid, sp -> path, & fa, & at, sp -> argv,
+    sp -> envp ? sp -> envp : environ ) ;
+  (void) posix_spawnattr_destroy ( & at ) ;
+  (void) posix_spawn_file_actions_destroy ( & fa ) ;
+
+  if ( i ) {
+    errno = i ;
+    return -1 ;
+  }
+
+  return pid ;
+}
+#endif
+
+/* pushes the result of a successful spawn: the pid or a process handle */
+static void spawn_push_res ( lua_State * const L, const spawn_spec_t * const sp,
+  const pid_t pid, const int fd )
+{
+#if defined (OSLinux)
+  if ( sp -> pidfd ) {
+    (void) pidfd_push ( L, fd, pid ) ;
+    return ;
+  }
+#endif
+
+  lua_pushinteger ( L, pid ) ;
+}
+
+/* start a process as described by the given spec table.
+ * returns the pid (or a process handle if spec.pidfd is set)
+ * or nil, error message and errno.
+ */
+static int Lspawn ( lua_State * const L )
+{
+  int fd = -1 ;
+  pid_t pid ;
+  spawn_spec_t spec ;
+  const int e = spawn_parse ( L, 1, & spec ) ;
+
+  if ( e ) {
+    errno = e ;
+    return res_nil ( L ) ;
+  }
+
+  pid = spawn_run ( & spec, spec . pidfd ? & fd : NULL ) ;
+
+  if ( 0 > pid ) {
+    return res_nil ( L ) ;
+  }
+
+  spawn_push_res ( L, & spec, pid, fd ) ;
+  return 1 ;
+}
+
+/* waits until at least one of the tracked children has terminated and
+ * removes those from the set. the children are not reaped.
+ * children without a pidfd (fd -1) are waited for with waitid(2) and
+ * WNOWAIT, the oldest of them first. returns 0 or -1 if poll(2) failed.
+ */
+static int spawn_wait_slot ( struct pollfd * const pv, char * const own,
+  pid_t * const pids, int * const np )
+{
+  int i, j ;
+
+  for ( i = 0 ; * np > i && 0 <= pv [ i ] . fd ; ++ i ) { ; }
+
+  if ( * np > i ) {
+    siginfo_t si ;
+
+    /* ECHILD: already reaped elsewhere, the slot is free as well */
+    while ( waitid ( P_PID, pids [ i ], & si, WEXITED | WNOWAIT ) && EINTR == errno ) { ; }
+    pv [ i ] . revents = POLLIN ;
+  } else {
+    while ( 0 > poll ( pv, * np, -1 ) ) {
+      if ( EINTR != errno ) { return -1 ; }
+    }
+  }
+
+  for ( i = j = 0 ; * np > i ; ++ i ) {
+    if ( pv [ i ] . revents ) {
+      if ( own [ i ] ) { (void) close ( pv [ i ] . fd ) ; }
+    } else {
+      pv [ j ] = pv [ i ] ;
+      own [ j ] = own [ i ] ;
+      pids [ j ] = pids [ i ] ;
+      ++ j ;
+    }
+  }
+
+  * np = j ;
+  return 0 ;
+}
+
+/* start the processes described by an array of spec tables.
+ * optional 2nd arg: max number of children of this call running at
+ * the same time (default 0 = no limit). a slot is only freed when its
+ * child exits, so max is meant for short lived children: the call
+ * blocks as long as max of them keep running.
+ * returns the number of started processes, an array with the pid
+ * (or handle) or false for each spec and a table mapping the indices
+ * of the failed specs to their errno values.
+ */
+static int Lspawn_many ( lua_State * const L )
+{
+  int i, k, n, fd, base, nok = 0, nrun = 0 ;
+  pid_t pid ;
+  spawn_spec_t * sv ;
+  int * ev ;
+  struct pollfd * pv = NULL ;
+  char * own = NULL ;
+  pid_t * pids = NULL ;
+  const int max = luaL_optinteger ( L, 2, 0 ) ;
+
+  luaL_checktype ( L, 1, LUA_TTABLE ) ;
+  n = lua_rawlen ( L, 1 ) ;
+  lua_settop ( L, 2 ) ;
+  sv = (spawn_spec_t *) lua_newuserdata ( L, ( 1 + n ) * sizeof ( spawn_spec_t ) ) ;
+  ev = (int *) lua_newuserdata ( L, ( 1 + n ) * sizeof ( int ) ) ;
+
+  if ( 0 < max ) {
+    pv = (struct pollfd *) lua_newuserdata ( L, max * sizeof ( struct pollfd ) ) ;
+    own = (char *) lua_newuserdata ( L, max ) ;
+    pids = (pid_t *) lua_newuserdata ( L, max * sizeof ( pid_t ) ) ;
+  }
+
+  /* anchor for the helper userdata of the parsed specs */
+  lua_newtable ( L ) ;
+  base = lua_gettop ( L ) ;
+
+  /* parse all specs before the first process is started */
+  for ( i = k = 0 ; n > i ; ++ i ) {
+    if ( LUA_TTABLE != lua_rawgeti ( L, 1, 1 + i ) ) {
+      return luaL_error ( L, "spawn_many: table expected at index %d", 1 + i ) ;
+    }
+
+    ev [ i ] = spawn_parse ( L, base + 1, sv + i ) ;
+
+    while ( base + 1 < lua_gettop ( L ) ) {
+      lua_rawseti ( L, base, ++ k ) ;
+    }
+
+    lua_pop ( L, 1 ) ;
+  }
+
+  lua_createtable ( L, n, 0 ) ;
+  lua_newtable ( L ) ;
+
+  for ( i = 0 ; n > i ; ++ i ) {
+    /* no slot could be freed, the spec fails with the errno of poll(2) */
+    if ( 0 == ev [ i ] && 0 < max && max <= nrun && spawn_wait_slot ( pv, own, pids, & nrun ) ) {
+      ev [ i ] = errno ;
+    }
+
+    if ( 0 == ev [ i ] ) {
+      fd = -1 ;
+      pid = spawn_run ( sv + i, ( 0 < max || sv [ i ] . pidfd ) ? & fd : NULL ) ;
+
+      if ( 0 < pid ) {
+        ++ nok ;
+
+        if ( 0 < max ) {
+          /* poll(2) ignores the entries without a pidfd */
+          pv [ nrun ] . fd = fd ;
+          pv [ nrun ] . events = POLLIN ;
+          pv [ nrun ] . revents = 0 ;
+          pids [ nrun ] = pid ;
+          own [ nrun ++ ] = 0 <= fd && ! sv [ i ] . pidfd ;
+        }
+
+        spawn_push_res ( L, sv + i, pid, fd ) ;
+        lua_rawseti ( L, -3, 1 + i ) ;
+        continue ;
+      }
+
+      ev [ i ] = errno ;
+    }
+
+    lua_pushboolean ( L, 0 ) ;
+    lua_rawseti ( L, -3, 1 + i ) ;
+    lua_pushinteger ( L, ev [ i ] ) ;
+    lua_rawseti ( L, -2, 1 + i ) ;
+  }
+
+  /* close the pidfds only used to limit the parallelism */
+  for ( i = 0 ; nrun > i ; ++ i ) {
+    if ( own [ i ] ) { (void) close ( pv [ i ] . fd ) ; }
+  }
+
+  lua_pushinteger ( L, nok ) ;
+  lua_insert ( L, -3 ) ;
+  return 3 ;
+}
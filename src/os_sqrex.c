@@ -5,31 +5,31 @@
  * based on Squirrel's regex implementation
  */
 
-#include <setjmp.h>
-
-#ifdef SQUNICODE
-#include <wchar.h>
-#include <wctype.h>
-
-typedef wchar_t SQChar ;
-
-#ifdef _WIN32
-#define WCHAR_SIZE 2
-#define WCHAR_SHIFT_MUL 1
-#define MAX_CHAR 0xFFFF
-#else
-#define WCHAR_SIZE 4
-#define WCHAR_SHIFT_MUL 2
-#define MAX_CHAR 0xFFFFFFFF
-#endif
-
-#else
-
+/* only the char version is used here, errors are recorded in the
+ * SQRex struct instead of longjmp()ing out of the parser
+ */
 typedef char SQChar ;
+typedef long SQInteger ;
+typedef int SQBool ;
 
 #define MAX_CHAR 0xFF
 
-#endif
+#define SQTrue		1
+#define SQFalse		0
+#define _SC(a)		a
+#define scstrlen	strlen
+#define scisprint(c)	isprint ( (unsigned char) ( c ) )
+#define scprintf	printf
+#define sq_malloc(n)	malloc ( n )
+#define sq_realloc(p, o, n)	realloc ( p, n )
+#define sq_free(p, n)	free ( p )
+
+typedef struct {
+  const SQChar * begin ;
+  SQInteger len ;
+} SQRexMatch ;
+
+typedef struct SQRex SQRex ;
 
 #ifdef _DEBUG
 
@@ -90,11 +90,15 @@ struct SQRex {
     SQInteger _nsubexpr ;
     SQRexMatch *_matches ;
     SQInteger _currsubexp ;
-    void *_jmpbuf ;
-    const SQChar **_error ;
+    /* the first compile error, NULL if none */
+    const SQChar * _error ;
 } ;
 
+/* where the parser continues after an error, the zeros end every loop */
+static const SQChar sqrex_end [ 4 ] = { 0 } ;
+
 static SQInteger sqstd_rex_list ( SQRex * exp ) ;
+static void sqstd_rex_error ( SQRex * exp, const SQChar * error ) ;
 
 static SQInteger sqstd_rex_newnode ( SQRex * exp, SQRexNodeType type )
 {
@@ -106,8 +110,14 @@ static SQInteger sqstd_rex_newnode ( SQRex * exp, SQRexNodeType type )
         n.right = exp->_nsubexpr++;
     if(exp->_nallocated < (exp->_nsize + 1)) {
         SQInteger oldsize = exp->_nallocated;
+        SQRexNode *nodes = (SQRexNode *)sq_realloc(exp->_nodes, oldsize * sizeof(SQRexNode) ,2 * oldsize * sizeof(SQRexNode));
+        if(nodes == NULL) {
+            /* node 0 always exists, the result is thrown away anyway */
+            sqstd_rex_error(exp,_SC("out of memory"));
+            return 0;
+        }
+        exp->_nodes = nodes;
         exp->_nallocated *= 2;
-        exp->_nodes = (SQRexNode *)sq_realloc(exp->_nodes, oldsize * sizeof(SQRexNode) ,exp->_nallocated * sizeof(SQRexNode));
     }
     exp->_nodes[exp->_nsize++] = n;
     SQInteger newid = exp->_nsize - 1;
@@ -116,8 +126,8 @@ static SQInteger sqstd_rex_newnode ( SQRex * exp, SQRexNodeType type )
 
 static void sqstd_rex_error(SQRex *exp,const SQChar *error)
 {
-    if(exp->_error) *exp->_error = error;
-    longjmp(*((jmp_buf*)exp->_jmpbuf),-1);
+    if(exp->_error == NULL) exp->_error = error;
+    exp->_p = sqrex_end;
 }
 
 static void sqstd_rex_expect(SQRex *exp, SQInteger n){
@@ -130,6 +140,7 @@ static SQChar sqstd_rex_escapechar(SQRex *exp)
 {
     if(*exp->_p == SQREX_SYMBOL_ESCAPE_CHAR){
         exp->_p++;
+        if(*exp->_p == '\0') { sqstd_rex_error(exp,_SC("trailing escape")); return 0; }
         switch(*exp->_p) {
         case 'v': exp->_p++; return '\v';
         case 'n': exp->_p++; return '\n';
@@ -154,6 +165,7 @@ static SQInteger sqstd_rex_charnode(SQRex *exp,SQBool isclass)
     SQChar t;
     if(*exp->_p == SQREX_SYMBOL_ESCAPE_CHAR) {
         exp->_p++;
+        if(*exp->_p == '\0') { sqstd_rex_error(exp,_SC("trailing escape")); return 0; }
         switch(*exp->_p) {
             case 'n': exp->_p++; return sqstd_rex_newnode(exp,'\n');
             case 't': exp->_p++; return sqstd_rex_newnode(exp,'\t');
@@ -171,9 +183,9 @@ static SQInteger sqstd_rex_charnode(SQRex *exp,SQBool isclass)
                 {
                      SQChar cb, ce; //cb = character begin match ce = character end match
                      cb = *++exp->_p; //skip 'm'
-                     ce = *++exp->_p;
+                     ce = cb ? *++exp->_p : 0;
+                     if ((!cb) || (!ce)) { sqstd_rex_error(exp,_SC("balanced chars expected")); return 0; }
                      exp->_p++; //points to the next char to be parsed
-                     if ((!cb) || (!ce)) sqstd_rex_error(exp,_SC("balanced chars expected"));
                      if ( cb == ce ) sqstd_rex_error(exp,_SC("open/close char can't be the same"));
                      SQInteger node =  sqstd_rex_newnode(exp,OP_MB);
                      exp->_nodes[node].left = cb;
@@ -187,7 +199,8 @@ static SQInteger sqstd_rex_charnode(SQRex *exp,SQBool isclass)
                     exp->_nodes[node].left = *exp->_p;
                     exp->_p++;
                     return node;
-                } //else default
+                }
+                /* FALLTHROUGH */
             default:
                 t = *exp->_p; exp->_p++;
                 return sqstd_rex_newnode(exp,t);
@@ -211,10 +224,10 @@ static SQInteger sqstd_rex_class(SQRex *exp)
 
     if(*exp->_p == ']') sqstd_rex_error(exp,_SC("empty class"));
     chain = ret;
-    while(*exp->_p != ']' && exp->_p != exp->_eol) {
+    while(*exp->_p != ']' && exp->_p != exp->_eol && exp->_error == NULL) {
         if(*exp->_p == '-' && first != -1){
             SQInteger r;
-            if(*exp->_p++ == ']') sqstd_rex_error(exp,_SC("unfinished range"));
+            if(*++exp->_p == ']' || *exp->_p == '\0') { sqstd_rex_error(exp,_SC("unfinished range")); break; }
             r = sqstd_rex_newnode(exp,OP_RANGE);
             if(exp->_nodes[first].type>*exp->_p) sqstd_rex_error(exp,_SC("invalid range"));
             if(exp->_nodes[first].type == OP_CCLASS) sqstd_rex_error(exp,_SC("cannot use character classes in ranges"));
@@ -252,9 +265,9 @@ static SQInteger sqstd_rex_parsenumber(SQRex *exp)
     SQInteger ret = *exp->_p-'0';
     SQInteger positions = 10;
     exp->_p++;
-    while(isdigit(*exp->_p)) {
+    while(isdigit((unsigned char)*exp->_p)) {
         ret = ret*10+(*exp->_p++-'0');
-        if(positions==1000000000) sqstd_rex_error(exp,_SC("overflow in numeric constant"));
+        if(positions==1000000000) { sqstd_rex_error(exp,_SC("overflow in numeric constant")); break; }
         positions *= 10;
     };
     return ret;
@@ -304,7 +317,7 @@ static SQInteger sqstd_rex_element(SQRex *exp)
         case SQREX_SYMBOL_GREEDY_ZERO_OR_ONE: p0 = 0; p1 = 1; exp->_p++; isgreedy = SQTrue; break;
         case '{':
             exp->_p++;
-            if(!isdigit(*exp->_p)) sqstd_rex_error(exp,_SC("number expected"));
+            if(!isdigit((unsigned char)*exp->_p)) { sqstd_rex_error(exp,_SC("number expected")); return 0; }
             p0 = (unsigned short)sqstd_rex_parsenumber(exp);
             /*******************************/
             switch(*exp->_p) {
@@ -314,7 +327,7 @@ static SQInteger sqstd_rex_element(SQRex *exp)
         case ',':
             exp->_p++;
             p1 = 0xFFFF;
-            if(isdigit(*exp->_p)){
+            if(isdigit((unsigned char)*exp->_p)){
                 p1 = (unsigned short)sqstd_rex_parsenumber(exp);
             }
             sqstd_rex_expect(exp,'}');
@@ -334,6 +347,8 @@ static SQInteger sqstd_rex_element(SQRex *exp)
         ret = nnode;
     }
 
+    if(exp->_error) return 0;
+
     if((*exp->_p != SQREX_SYMBOL_BRANCH) && (*exp->_p != ')') && (*exp->_p != SQREX_SYMBOL_GREEDY_ZERO_OR_MORE) && (*exp->_p != SQREX_SYMBOL_GREEDY_ONE_OR_MORE) && (*exp->_p != '\0')) {
         SQInteger nnode = sqstd_rex_element(exp);
         exp->_nodes[ret].next = nnode;
@@ -367,8 +382,11 @@ static SQInteger sqstd_rex_list(SQRex *exp)
     return ret;
 }
 
-static SQBool sqstd_rex_matchcclass(SQInteger cclass,SQChar c)
+static SQBool sqstd_rex_matchcclass(SQInteger cclass,SQChar sc)
 {
+    /* the ctype functions need unsigned chars */
+    const int c = (unsigned char) sc;
+
     switch(cclass) {
     case 'a': return isalpha(c)?SQTrue:SQFalse;
     case 'A': return !isalpha(c)?SQTrue:SQFalse;
@@ -515,10 +533,10 @@ static const SQChar *sqstd_rex_matchnode(SQRex* exp,SQRexNode *node,const SQChar
             return cur;
     }
     case OP_WB:
-        if((str == exp->_bol && !isspace(*str))
-         || (str == exp->_eol && !isspace(*(str-1)))
-         || (!isspace(*str) && isspace(*(str+1)))
-         || (isspace(*str) && !isspace(*(str+1))) ) {
+        if((str == exp->_bol && !isspace((unsigned char)*str))
+         || (str == exp->_eol && !isspace((unsigned char)*(str-1)))
+         || (!isspace((unsigned char)*str) && isspace((unsigned char)*(str+1)))
+         || (isspace((unsigned char)*str) && !isspace((unsigned char)*(str+1))) ) {
             return (node->left == 'b')?str:NULL;
         }
         return (node->left == 'b')?NULL:str;
@@ -575,20 +593,31 @@ static const SQChar *sqstd_rex_matchnode(SQRex* exp,SQRexNode *node,const SQChar
 }
 
 /* public api */
-SQRex *sqstd_rex_compile(const SQChar *pattern,const SQChar **error)
+static void sqstd_rex_free ( SQRex * exp ) ;
+
+static SQRex *sqstd_rex_compile(const SQChar *pattern,const SQChar **error)
 {
-    SQRex * volatile exp = (SQRex *)sq_malloc(sizeof(SQRex)); // "volatile" is needed for setjmp()
+    SQRex *exp = (SQRex *)sq_malloc(sizeof(SQRex));
+    if(exp == NULL) {
+        if(error) *error = _SC("out of memory");
+        return NULL;
+    }
     exp->_eol = exp->_bol = NULL;
     exp->_p = pattern;
-    exp->_nallocated = (SQInteger)scstrlen(pattern) * sizeof(SQChar);
+    /* every pattern char adds one node at most, plus the first one */
+    exp->_nallocated = (SQInteger)scstrlen(pattern) + 2;
     exp->_nodes = (SQRexNode *)sq_malloc(exp->_nallocated * sizeof(SQRexNode));
     exp->_nsize = 0;
     exp->_matches = 0;
     exp->_nsubexpr = 0;
+    exp->_error = NULL;
+    if(exp->_nodes == NULL) {
+        if(error) *error = _SC("out of memory");
+        sqstd_rex_free(exp);
+        return NULL;
+    }
     exp->_first = sqstd_rex_newnode(exp,OP_EXPR);
-    exp->_error = error;
-    exp->_jmpbuf = sq_malloc(sizeof(jmp_buf));
-    if(setjmp(*((jmp_buf*)exp->_jmpbuf)) == 0) {
+    {
         SQInteger res = sqstd_rex_list(exp);
         exp->_nodes[exp->_first].left = res;
         if(*exp->_p!='\0')
@@ -610,46 +639,54 @@ SQRex *sqstd_rex_compile(const SQChar *pattern,const SQChar **error)
             scprintf(_SC("\n"));
         }
 #endif
-        exp->_matches = (SQRexMatch *) sq_malloc(exp->_nsubexpr * sizeof(SQRexMatch));
-        memset(exp->_matches,0,exp->_nsubexpr * sizeof(SQRexMatch));
+        if(exp->_error == NULL) {
+            exp->_matches = (SQRexMatch *) sq_malloc((1 + exp->_nsubexpr) * sizeof(SQRexMatch));
+            if(exp->_matches == NULL) sqstd_rex_error(exp,_SC("out of memory"));
+            else memset(exp->_matches,0,exp->_nsubexpr * sizeof(SQRexMatch));
+        }
     }
-    else{
+    if(exp->_error) {
+        if(error) *error = exp->_error;
         sqstd_rex_free(exp);
         return NULL;
     }
     return exp;
 }
 
-void sqstd_rex_free(SQRex *exp)
+static void sqstd_rex_free(SQRex *exp)
 {
     if(exp) {
         if(exp->_nodes) sq_free(exp->_nodes,exp->_nallocated * sizeof(SQRexNode));
-        if(exp->_jmpbuf) sq_free(exp->_jmpbuf,sizeof(jmp_buf));
         if(exp->_matches) sq_free(exp->_matches,exp->_nsubexpr * sizeof(SQRexMatch));
         sq_free(exp,sizeof(SQRex));
     }
 }
 
-SQBool sqstd_rex_match(SQRex* exp,const SQChar* text)
+static SQBool sqstd_rex_match(SQRex* exp,const SQChar* text)
 {
     const SQChar* res = NULL;
     exp->_bol = text;
     exp->_eol = text + scstrlen(text);
     exp->_currsubexp = 0;
+    memset(exp->_matches,0,exp->_nsubexpr * sizeof(SQRexMatch));
     res = sqstd_rex_matchnode(exp,exp->_nodes,text,NULL);
     if(res == NULL || res != exp->_eol)
         return SQFalse;
     return SQTrue;
 }
 
-SQBool sqstd_rex_searchrange(SQRex* exp,const SQChar* text_begin,const SQChar* text_end,const SQChar** out_begin, const SQChar** out_end)
+/* like sqstd_rex_searchrange, but the subject starts at bol (for ^ and
+ * \b) and the search at text_begin */
+static SQBool sqstd_rex_searchfrom(SQRex* exp,const SQChar* bol,const SQChar* text_begin,const SQChar* text_end,const SQChar** out_begin, const SQChar** out_end)
 {
     const SQChar *cur = NULL;
     SQInteger node = exp->_first;
     if(text_begin >= text_end) return SQFalse;
-    exp->_bol = text_begin;
+    exp->_bol = bol;
     exp->_eol = text_end;
     do {
+        /* no captures left over from an earlier attempt or subject */
+        memset(exp->_matches,0,exp->_nsubexpr * sizeof(SQRexMatch));
         cur = text_begin;
         while(node != -1) {
             exp->_currsubexp = 0;
@@ -671,20 +708,211 @@ SQBool sqstd_rex_searchrange(SQRex* exp,const SQChar* text_begin,const SQChar* t
     return SQTrue;
 }
 
-SQBool sqstd_rex_search(SQRex* exp,const SQChar* text, const SQChar** out_begin, const SQChar** out_end)
+static SQBool sqstd_rex_searchrange(SQRex* exp,const SQChar* text_begin,const SQChar* text_end,const SQChar** out_begin, const SQChar** out_end)
 {
-    return sqstd_rex_searchrange(exp,text,text + scstrlen(text),out_begin,out_end);
+    return sqstd_rex_searchfrom(exp,text_begin,text_begin,text_end,out_begin,out_end);
 }
 
-SQInteger sqstd_rex_getsubexpcount(SQRex* exp)
+static SQInteger sqstd_rex_getsubexpcount(SQRex* exp)
 {
     return exp->_nsubexpr;
 }
 
-SQBool sqstd_rex_getsubexp(SQRex* exp, SQInteger n, SQRexMatch *subexp)
+static SQBool sqstd_rex_getsubexp(SQRex* exp, SQInteger n, SQRexMatch *subexp)
 {
     if( n<0 || n >= exp->_nsubexpr) return SQFalse;
     *subexp = exp->_matches[n];
     return SQTrue;
 }
 
+/* Lua bindings */
+
+#define SQREX_METATABLE "SQRex Metatable"
+
+typedef struct {
+  SQRex * rex ;
+} sqrex_obj_t ;
+
+/* sqrex ( pattern )
+ * compiles a pattern for the small backtracking SQRex engine, an
+ * alternative to the POSIX functions for short (anchored) patterns:
+ * . [] [^] ^ $ * + ? {n,m} | () (?:), the classes \a \w \s \d \x \c
+ * \p \l \u (upper case negates), \b \B and \mXY (balanced X...Y).
+ * returns the compiled pattern or nil and an error message.
+ */
+static int Lsqrex ( lua_State * const L )
+{
+  sqrex_obj_t * sp ;
+  const SQChar * err = NULL ;
+  const char * pat = luaL_checkstring ( L, 1 ) ;
+
+  sp = (sqrex_obj_t *) lua_newuserdata ( L, sizeof ( sqrex_obj_t ) ) ;
+  sp -> rex = NULL ;
+  luaL_getmetatable ( L, SQREX_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+
+  sp -> rex = sqstd_rex_compile ( pat, & err ) ;
+
+  if ( NULL == sp -> rex ) {
+    lua_pushnil ( L ) ;
+    (void) lua_pushstring ( L, err ? err : "invalid pattern" ) ;
+    return 2 ;
+  }
+
+  return 1 ;
+}
+
+static SQRex * sqrex_check ( lua_State * const L )
+{
+  sqrex_obj_t * sp = (sqrex_obj_t *) luaL_checkudata ( L, 1, SQREX_METATABLE ) ;
+
+  luaL_argcheck ( L, NULL != sp -> rex, 1, "invalid sqrex" ) ;
+  return sp -> rex ;
+}
+
+/* rex:match ( str ) returns true if the whole string matches */
+static int sqrex_match ( lua_State * const L )
+{
+  SQRex * rex = sqrex_check ( L ) ;
+
+  lua_pushboolean ( L, sqstd_rex_match ( rex, luaL_checkstring ( L, 2 ) ) ) ;
+  return 1 ;
+}
+
+/* rex:find ( str [, init] )
+ * returns start and end of the first match, then of every capture
+ * (false if it did not take part), like the find method of regcomp()
+ * objects, or nil. ^ matches at the start of str only, not at init.
+ */
+static int sqrex_find ( lua_State * const L )
+{
+  size_t len, off ;
+  SQInteger i, n ;
+  SQRexMatch m ;
+  const SQChar * b, * e ;
+  SQRex * rex = sqrex_check ( L ) ;
+  const char * str = luaL_checklstring ( L, 2, & len ) ;
+  lua_Integer init = luaL_optinteger ( L, 3, 1 ) ;
+
+  if ( 0 > init ) { init += len + 1 ; }
+  if ( 1 > init ) { init = 1 ; }
+  off = init - 1 ;
+
+  if ( len < off || ! sqstd_rex_searchfrom ( rex, str, str + off, str + len, & b, & e ) ) {
+    lua_pushnil ( L ) ;
+    return 1 ;
+  }
+
+  /* capture 0 is the whole expression */
+  n = sqstd_rex_getsubexpcount ( rex ) ;
+  luaL_checkstack ( L, 2 * n + 2, "too many captures" ) ;
+  lua_pushinteger ( L, b - str + 1 ) ;
+  lua_pushinteger ( L, e - str ) ;
+
+  for ( i = 1 ; n > i ; ++ i ) {
+    if ( sqstd_rex_getsubexp ( rex, i, & m ) && ( m . begin || m . len ) ) {
+      lua_pushinteger ( L, m . begin - str + 1 ) ;
+      lua_pushinteger ( L, m . begin - str + m . len ) ;
+    } else {
+      lua_pushboolean ( L, 0 ) ;
+      lua_pushboolean ( L, 0 ) ;
+    }
+  }
+
+  return 2 * ( ( 0 < n ) ? n : 1 ) ;
+}
+
+/* rex:nsub () returns the number of capturing groups */
+static int sqrex_nsub ( lua_State * const L )
+{
+  SQRex * rex = sqrex_check ( L ) ;
+  const SQInteger n = sqstd_rex_getsubexpcount ( rex ) ;
+
+  lua_pushinteger ( L, ( 0 < n ) ? n - 1 : 0 ) ;
+  return 1 ;
+}
+
+static int sqrex_gc ( lua_State * const L )
+{
+  sqrex_obj_t * sp = (sqrex_obj_t *) luaL_checkudata ( L, 1, SQREX_METATABLE ) ;
+
+  sqstd_rex_free ( sp -> rex ) ;
+  sp -> rex = NULL ;
+
+  return 0 ;
+}
+
+static double sqrex_now ( void )
+{
+  struct timespec ts ;
+
+  (void) clock_gettime ( CLOCK_MONOTONIC, & ts ) ;
+  return 1e9 * ts . tv_sec + ts . tv_nsec ;
+}
+
+/* sqrex_bench ( pattern, str [, n [, posix pattern]] )
+ * searches str n times (default 10000) with SQRex and with POSIX
+ * regexec() and returns the nanoseconds per search of both engines and
+ * whether each one matched, so scripts can pick the faster engine per
+ * pattern. the POSIX (ERE) pattern defaults to pattern, its time is nil
+ * if it does not compile.
+ */
+static int Lsqrex_bench ( lua_State * const L )
+{
+  long i ;
+  int m1 = 0, m2 = 0 ;
+  double t ;
+  regex_t re ;
+  SQRex * rex ;
+  const SQChar * b, * e, * err = NULL ;
+  size_t len ;
+  const char * pat = luaL_checkstring ( L, 1 ) ;
+  const char * str = luaL_checklstring ( L, 2, & len ) ;
+  const long n = luaL_optinteger ( L, 3, 10000 ) ;
+  const char * ppat = luaL_optstring ( L, 4, pat ) ;
+
+  luaL_argcheck ( L, 0 < n, 3, "positive count expected" ) ;
+  rex = sqstd_rex_compile ( pat, & err ) ;
+  if ( NULL == rex ) { return luaL_argerror ( L, 1, err ? err : "invalid pattern" ) ; }
+
+  t = sqrex_now () ;
+  for ( i = 0 ; n > i ; ++ i ) { m1 = sqstd_rex_searchrange ( rex, str, str + len, & b, & e ) ; }
+  lua_pushnumber ( L, ( sqrex_now () - t ) / n ) ;
+  sqstd_rex_free ( rex ) ;
+
+  if ( regcomp ( & re, ppat, REG_EXTENDED | REG_NOSUB ) ) {
+    lua_pushnil ( L ) ;
+  } else {
+    t = sqrex_now () ;
+    for ( i = 0 ; n > i ; ++ i ) { m2 = 0 == regexec ( & re, str, 0, NULL, 0 ) ; }
+    lua_pushnumber ( L, ( sqrex_now () - t ) / n ) ;
+    regfree ( & re ) ;
+  }
+
+  lua_pushboolean ( L, m1 ) ;
+  lua_pushboolean ( L, m2 ) ;
+
+  return 4 ;
+}
+
+/* creates the sqrex metatable */
+static int sqrex_create_meta ( lua_State * const L )
+{
+  luaL_newmetatable ( L, SQREX_METATABLE ) ;
+
+  /* method table */
+  lua_newtable ( L ) ;
+  lua_pushcfunction ( L, sqrex_match ) ;
+  lua_setfield ( L, -2, "match" ) ;
+  lua_pushcfunction ( L, sqrex_find ) ;
+  lua_setfield ( L, -2, "find" ) ;
+  lua_pushcfunction ( L, sqrex_nsub ) ;
+  lua_setfield ( L, -2, "nsub" ) ;
+
+  /* metamethods */
+  lua_setfield ( L, -2, "__index" ) ;
+  lua_pushcfunction ( L, sqrex_gc ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+
+  return 1 ;
+}
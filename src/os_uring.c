@@ -0,0 +1,796 @@
+/*
+ * batched io using io_uring(7) (Linux)
+ *
+ * a ring object queues read/write/accept/openat/close/statx requests
+ * from Lua, hands them to the kernel with a single io_uring_enter(2)
+ * call and reaps the completions as a batch.
+ * on kernels without io_uring (or where it is disabled) the same
+ * object works in "sync" mode: queued requests are executed one by one
+ * with the plain syscalls when they are submitted.
+ *
+ * no liburing is needed, the rings are set up with the raw syscalls.
+ */
+
+#if defined (OSLinux)
+
+#define URING_METATABLE "Uring Metatable"
+#define URING_ENTRIES 64
+
+/* request types */
+enum {
+  UR_NONE = 0,
+  UR_READ,
+  UR_WRITE,
+  UR_ACCEPT,
+  UR_OPENAT,
+  UR_CLOSE,
+  UR_STATX
+} ;
+
+/* request states */
+enum {
+  UR_FREE = 0,
+  UR_QUEUED,
+  UR_SUBMITTED,
+  UR_DONE
+} ;
+
+typedef struct {
+  unsigned char op ;
+  unsigned char state ;
+  int fd ;
+  int flags ;
+  unsigned int mode ;
+  int res ;
+  off_t off ;
+  size_t len ;
+  char * buf ;
+  char * path ;
+#if defined (STATX_BASIC_STATS)
+  struct statx * stx ;
+#endif
+} uring_req_t ;
+
+typedef struct {
+  int fd ;		/* ring fd or -1 in sync mode */
+  unsigned int nreq ;	/* number of request slots */
+  unsigned int queued ;	/* requests queued, not yet submitted */
+  unsigned int prepped ;	/* queued requests already in the SQ ring */
+  unsigned int inflight ;	/* requests submitted, not yet done */
+  unsigned int ndone ;	/* completed requests not yet reaped */
+  uring_req_t * req ;
+  unsigned int * order ;	/* queue/completion order of slots */
+  unsigned int * done ;
+  /* kernel shared rings */
+  void * sq_ptr ;
+  void * cq_ptr ;
+  size_t sq_len ;
+  size_t cq_len ;
+  unsigned int * sq_head ;
+  unsigned int * sq_tail ;
+  unsigned int * sq_mask ;
+  unsigned int * sq_array ;
+  unsigned int sq_entries ;
+  unsigned int * cq_head ;
+  unsigned int * cq_tail ;
+  unsigned int * cq_mask ;
+#if defined (HAVE_IO_URING)
+  struct io_uring_sqe * sqes ;
+  struct io_uring_cqe * cqes ;
+#endif
+} uring_t ;
+
+/* release the buffers held by a request slot */
+static void uring_req_clear ( uring_req_t * const rp )
+{
+  if ( rp -> buf ) { free ( rp -> buf ) ; }
+  if ( rp -> path ) { free ( rp -> path ) ; }
+#if defined (STATX_BASIC_STATS)
+  if ( rp -> stx ) { free ( rp -> stx ) ; }
+#endif
+  (void) memset ( rp, 0, sizeof ( uring_req_t ) ) ;
+}
+
+#if defined (HAVE_IO_URING) && defined (SYS_io_uring_setup)
+/* checks that the kernel supports all opcodes used here, io_uring
+ * itself came with 5.1 but READ, WRITE, OPENAT, CLOSE and STATX only
+ * with 5.6 (older kernels fail them with EINVAL). returns 0 or -1.
+ */
+static int uring_probe ( const int fd )
+{
+  int r = 0 ;
+#if defined (IO_URING_OP_SUPPORTED) && defined (SYS_io_uring_register)
+  size_t i ;
+  struct io_uring_probe * pp ;
+  static const unsigned char ops [ ] = {
+    IORING_OP_READ, IORING_OP_WRITE, IORING_OP_ACCEPT,
+    IORING_OP_OPENAT, IORING_OP_CLOSE, IORING_OP_STATX,
+  } ;
+
+  pp = (struct io_uring_probe *) calloc ( 1, sizeof ( struct io_uring_probe )
+    + 256 * sizeof ( struct io_uring_probe_op ) ) ;
+  if ( NULL == pp ) { return -1 ; }
+
+  r = -1 ;
+  if ( 0 == syscall ( SYS_io_uring_register, fd, IORING_REGISTER_PROBE, pp, 256 ) ) {
+    for ( r = 0, i = 0 ; ARRAY_SIZE ( ops ) > i ; ++ i ) {
+      if ( pp -> last_op < ops [ i ]
+        || 0 == ( IO_URING_OP_SUPPORTED & pp -> ops [ ops [ i ] ] . flags ) )
+      {
+        r = -1 ;
+        break ;
+      }
+    }
+  }
+
+  free ( pp ) ;
+#endif
+
+  /* without the probe flags the CQEs of unsupported ops say EINVAL */
+  return r ;
+}
+
+static int uring_setup ( uring_t * const up, const unsigned int n )
+{
+  struct io_uring_params p ;
+  void * sq = NULL, * cq = NULL, * sqes = NULL ;
+  int fd ;
+  size_t sql, cql ;
+
+  (void) memset ( & p, 0, sizeof ( p ) ) ;
+  fd = syscall ( SYS_io_uring_setup, n, & p ) ;
+  if ( 0 > fd ) { return -1 ; }
+
+  if ( uring_probe ( fd ) ) {
+    errno = ENOSYS ;
+    goto fail ;
+  }
+
+  sql = p . sq_off . array + p . sq_entries * sizeof ( unsigned int ) ;
+  cql = p . cq_off . cqes + p . cq_entries * sizeof ( struct io_uring_cqe ) ;
+
+  if ( IORING_FEAT_SINGLE_MMAP & p . features ) {
+    sql = ( sql < cql ) ? cql : sql ;
+    cql = sql ;
+  }
+
+  sq = mmap ( NULL, sql, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+    fd, IORING_OFF_SQ_RING ) ;
+  if ( MAP_FAILED == sq ) { goto fail ; }
+
+  if ( IORING_FEAT_SINGLE_MMAP & p . features ) {
+    cq = sq ;
+  } else {
+    cq = mmap ( NULL, cql, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      fd, IORING_OFF_CQ_RING ) ;
+    if ( MAP_FAILED == cq ) { goto fail ; }
+  }
+
+  sqes = mmap ( NULL, p . sq_entries * sizeof ( struct io_uring_sqe ),
+    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES ) ;
+  if ( MAP_FAILED == sqes ) { goto fail ; }
+
+  up -> fd = fd ;
+  up -> sq_ptr = sq ;
+  up -> cq_ptr = cq ;
+  up -> sq_len = sql ;
+  up -> cq_len = cql ;
+  up -> sq_head = (unsigned int *) ( (char *) sq + p . sq_off . head ) ;
+  up -> sq_tail = (unsigned int *) ( (char *) sq + p . sq_off . tail ) ;
+  up -> sq_mask = (unsigned int *) ( (char *) sq + p . sq_off . ring_mask ) ;
+  up -> sq_array = (unsigned int *) ( (char *) sq + p . sq_off . array ) ;
+  up -> sq_entries = p . sq_entries ;
+  up -> cq_head = (unsigned int *) ( (char *) cq + p . cq_off . head ) ;
+  up -> cq_tail = (unsigned int *) ( (char *) cq + p . cq_off . tail ) ;
+  up -> cq_mask = (unsigned int *) ( (char *) cq + p . cq_off . ring_mask ) ;
+  up -> sqes = (struct io_uring_sqe *) sqes ;
+  up -> cqes = (struct io_uring_cqe *) ( (char *) cq + p . cq_off . cqes ) ;
+
+  return 0 ;
+
+fail :
+  {
+    const int e = errno ;
+
+    if ( sq && MAP_FAILED != sq ) { (void) munmap ( sq, sql ) ; }
+    if ( cq && MAP_FAILED != cq && cq != sq ) { (void) munmap ( cq, cql ) ; }
+    CLOSEFD( fd )
+    errno = e ;
+  }
+
+  return -1 ;
+}
+
+/* fill in a submission queue entry for a queued request */
+static void uring_prep_sqe ( uring_t * const up, const unsigned int i )
+{
+  uring_req_t * rp = up -> req + i ;
+  const unsigned int tail = * up -> sq_tail ;
+  const unsigned int idx = tail & * up -> sq_mask ;
+  struct io_uring_sqe * sqe = up -> sqes + idx ;
+
+  (void) memset ( sqe, 0, sizeof ( struct io_uring_sqe ) ) ;
+  sqe -> fd = rp -> fd ;
+  sqe -> user_data = i ;
+
+  switch ( rp -> op ) {
+    case UR_READ :
+      sqe -> opcode = IORING_OP_READ ;
+      sqe -> addr = (uintptr_t) rp -> buf ;
+      sqe -> len = rp -> len ;
+      sqe -> off = (uint64_t) rp -> off ;
+      break ;
+    case UR_WRITE :
+      sqe -> opcode = IORING_OP_WRITE ;
+      sqe -> addr = (uintptr_t) rp -> buf ;
+      sqe -> len = rp -> len ;
+      sqe -> off = (uint64_t) rp -> off ;
+      break ;
+    case UR_ACCEPT :
+      sqe -> opcode = IORING_OP_ACCEPT ;
+      sqe -> accept_flags = rp -> flags ;
+      break ;
+    case UR_OPENAT :
+      sqe -> opcode = IORING_OP_OPENAT ;
+      sqe -> addr = (uintptr_t) rp -> path ;
+      sqe -> len = rp -> mode ;
+      sqe -> open_flags = rp -> flags ;
+      break ;
+    case UR_CLOSE :
+      sqe -> opcode = IORING_OP_CLOSE ;
+      break ;
+#if defined (STATX_BASIC_STATS)
+    case UR_STATX :
+      sqe -> opcode = IORING_OP_STATX ;
+      sqe -> addr = (uintptr_t) rp -> path ;
+      sqe -> len = rp -> mode ;
+      sqe -> off = (uintptr_t) rp -> stx ;
+      sqe -> statx_flags = rp -> flags ;
+      break ;
+#endif
+  }
+
+  up -> sq_array [ idx ] = idx ;
+  __atomic_store_n ( up -> sq_tail, 1 + tail, __ATOMIC_RELEASE ) ;
+}
+
+/* move the available completions into the done list */
+static void uring_harvest ( uring_t * const up )
+{
+  unsigned int head = * up -> cq_head ;
+  const unsigned int tail = __atomic_load_n ( up -> cq_tail, __ATOMIC_ACQUIRE ) ;
+
+  while ( head != tail ) {
+    const struct io_uring_cqe * cqe = up -> cqes + ( head & * up -> cq_mask ) ;
+    const unsigned int i = (unsigned int) cqe -> user_data ;
+
+    if ( up -> nreq > i && UR_SUBMITTED == up -> req [ i ] . state ) {
+      up -> req [ i ] . res = cqe -> res ;
+      up -> req [ i ] . state = UR_DONE ;
+      up -> done [ up -> ndone ++ ] = i ;
+      -- up -> inflight ;
+    }
+
+    ++ head ;
+  }
+
+  __atomic_store_n ( up -> cq_head, head, __ATOMIC_RELEASE ) ;
+}
+
+static int uring_enter ( uring_t * const up, const unsigned int submit,
+  const unsigned int wait )
+{
+  int i ;
+
+  do {
+    i = syscall ( SYS_io_uring_enter, up -> fd, submit, wait,
+      wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0 ) ;
+  } while ( 0 > i && EINTR == errno ) ;
+
+  return i ;
+}
+#endif
+
+/* execute a queued request with the plain syscalls (sync mode) */
+static void uring_run_sync ( uring_t * const up, const unsigned int i )
+{
+  long int r = -1 ;
+  uring_req_t * rp = up -> req + i ;
+
+  switch ( rp -> op ) {
+    case UR_READ :
+      if ( 0 > rp -> off ) { NOINTR(r = read ( rp -> fd, rp -> buf, rp -> len )) }
+      else { NOINTR(r = pread ( rp -> fd, rp -> buf, rp -> len, rp -> off )) }
+      break ;
+    case UR_WRITE :
+      if ( 0 > rp -> off ) { NOINTR(r = write ( rp -> fd, rp -> buf, rp -> len )) }
+      else { NOINTR(r = pwrite ( rp -> fd, rp -> buf, rp -> len, rp -> off )) }
+      break ;
+    case UR_ACCEPT :
+      NOINTR(r = accept4 ( rp -> fd, NULL, NULL, rp -> flags ))
+      break ;
+    case UR_OPENAT :
+      NOINTR(r = openat ( rp -> fd, rp -> path, rp -> flags, rp -> mode ))
+      break ;
+    case UR_CLOSE :
+      r = close ( rp -> fd ) ;
+      break ;
+#if defined (STATX_BASIC_STATS)
+    case UR_STATX :
+      r = statx ( rp -> fd, rp -> path, rp -> flags, rp -> mode, rp -> stx ) ;
+      break ;
+#endif
+    default :
+      errno = EINVAL ;
+      break ;
+  }
+
+  rp -> res = ( 0 > r ) ? - errno : (int) r ;
+  rp -> state = UR_DONE ;
+  up -> done [ up -> ndone ++ ] = i ;
+}
+
+static uring_t * uring_check ( lua_State * const L )
+{
+  uring_t * up = (uring_t *) luaL_checkudata ( L, 1, URING_METATABLE ) ;
+
+  luaL_argcheck ( L, NULL != up -> req, 1, "closed ring" ) ;
+  return up ;
+}
+
+/* submit all queued requests, optionally waiting for "wait" completions.
+ * returns the number of requests the kernel took or -1, the others stay
+ * queued (their SQEs stay in the ring and are not written again).
+ */
+static int uring_flush ( uring_t * const up, unsigned int wait )
+{
+  unsigned int i ;
+
+  if ( 0 > up -> fd ) {
+    for ( i = 0 ; up -> queued > i ; ++ i ) {
+      uring_run_sync ( up, up -> order [ i ] ) ;
+    }
+
+    i = up -> queued ;
+    up -> queued = 0 ;
+    return i ;
+  }
+
+#if defined (HAVE_IO_URING) && defined (SYS_io_uring_setup)
+  {
+    int r ;
+    const unsigned int n = up -> queued ;
+
+    for ( ; n > up -> prepped ; ++ up -> prepped ) {
+      uring_prep_sqe ( up, up -> order [ up -> prepped ] ) ;
+    }
+
+    /* the kernel does not wait after a short submission */
+    wait = ( wait > up -> inflight + n ) ? up -> inflight + n : wait ;
+    r = uring_enter ( up, n, wait ) ;
+    if ( 0 > r ) { return -1 ; }
+
+    /* the SQEs are consumed in ring order */
+    for ( i = 0 ; (unsigned int) r > i ; ++ i ) {
+      up -> req [ up -> order [ i ] ] . state = UR_SUBMITTED ;
+    }
+
+    (void) memmove ( up -> order, up -> order + r, ( n - r ) * sizeof ( unsigned int ) ) ;
+    up -> queued -= r ;
+    up -> prepped -= r ;
+    up -> inflight += r ;
+    uring_harvest ( up ) ;
+
+    return r ;
+  }
+#endif
+
+  return 0 ;
+}
+
+/* get a free request slot, submitting queued requests when the
+ * submission queue is full
+ */
+static unsigned int uring_slot ( lua_State * const L, uring_t * const up,
+  const int op )
+{
+  unsigned int i ;
+
+  if ( up -> queued >= up -> sq_entries ) {
+    if ( 0 > uring_flush ( up, 0 ) ) {
+      return luaL_error ( L, "io_uring_enter() failed: %s", strerror ( errno ) ) ;
+    }
+
+    if ( up -> queued >= up -> sq_entries ) {
+      return luaL_error ( L, "submission queue full, reap some first" ) ;
+    }
+  }
+
+  for ( i = 0 ; up -> nreq > i ; ++ i ) {
+    if ( UR_FREE == up -> req [ i ] . state ) {
+      up -> req [ i ] . op = op ;
+      up -> req [ i ] . state = UR_QUEUED ;
+      up -> order [ up -> queued ++ ] = i ;
+      return i ;
+    }
+  }
+
+  return luaL_error ( L, "too many outstanding requests, reap some first" ) ;
+}
+
+/* give back the slot of the most recently queued request */
+static int uring_unslot ( lua_State * const L, uring_t * const up,
+  const unsigned int i )
+{
+  uring_req_clear ( up -> req + i ) ;
+  -- up -> queued ;
+  return luaL_error ( L, "out of memory" ) ;
+}
+
+/* helper for pushing the id of a queued request */
+static int uring_queued ( lua_State * const L, const unsigned int i )
+{
+  lua_pushinteger ( L, 1 + i ) ;
+  return 1 ;
+}
+
+/* ring:read ( fd, len [, offset] ) */
+static int uring_read ( lua_State * const L )
+{
+  uring_t * up = uring_check ( L ) ;
+  const int fd = luaL_checkinteger ( L, 2 ) ;
+  const lua_Integer len = luaL_checkinteger ( L, 3 ) ;
+  const lua_Integer off = luaL_optinteger ( L, 4, -1 ) ;
+  unsigned int i ;
+
+  luaL_argcheck ( L, 0 <= fd, 2, "invalid fd" ) ;
+  luaL_argcheck ( L, 0 < len && INT_MAX > len, 3, "invalid length" ) ;
+  i = uring_slot ( L, up, UR_READ ) ;
+
+  if ( NULL == ( up -> req [ i ] . buf = (char *) malloc ( len ) ) ) {
+    return uring_unslot ( L, up, i ) ;
+  }
+
+  up -> req [ i ] . fd = fd ;
+  up -> req [ i ] . len = len ;
+  up -> req [ i ] . off = off ;
+  return uring_queued ( L, i ) ;
+}
+
+/* ring:write ( fd, str [, offset] ) */
+static int uring_write ( lua_State * const L )
+{
+  size_t len = 0 ;
+  uring_t * up = uring_check ( L ) ;
+  const int fd = luaL_checkinteger ( L, 2 ) ;
+  const char * str = luaL_checklstring ( L, 3, & len ) ;
+  const lua_Integer off = luaL_optinteger ( L, 4, -1 ) ;
+  unsigned int i ;
+
+  luaL_argcheck ( L, 0 <= fd, 2, "invalid fd" ) ;
+  i = uring_slot ( L, up, UR_WRITE ) ;
+
+  /* the Lua string may be collected before the write completes */
+  if ( NULL == ( up -> req [ i ] . buf = (char *) malloc ( 1 + len ) ) ) {
+    return uring_unslot ( L, up, i ) ;
+  }
+
+  (void) memcpy ( up -> req [ i ] . buf, str, len ) ;
+  up -> req [ i ] . fd = fd ;
+  up -> req [ i ] . len = len ;
+  up -> req [ i ] . off = off ;
+  return uring_queued ( L, i ) ;
+}
+
+/* ring:accept ( fd [, flags] ) */
+static int uring_accept ( lua_State * const L )
+{
+  uring_t * up = uring_check ( L ) ;
+  const int fd = luaL_checkinteger ( L, 2 ) ;
+  const int flags = luaL_optinteger ( L, 3, SOCK_CLOEXEC ) ;
+  unsigned int i ;
+
+  luaL_argcheck ( L, 0 <= fd, 2, "invalid fd" ) ;
+  i = uring_slot ( L, up, UR_ACCEPT ) ;
+  up -> req [ i ] . fd = fd ;
+  up -> req [ i ] . flags = flags ;
+  return uring_queued ( L, i ) ;
+}
+
+/* ring:openat ( dirfd, path [, flags [, mode]] ) */
+static int uring_openat ( lua_State * const L )
+{
+  uring_t * up = uring_check ( L ) ;
+  const int fd = luaL_checkinteger ( L, 2 ) ;
+  const char * path = luaL_checkstring ( L, 3 ) ;
+  const int flags = luaL_optinteger ( L, 4, O_RDONLY | O_CLOEXEC ) ;
+  const unsigned int mode = luaL_optinteger ( L, 5, 00600 ) ;
+  unsigned int i ;
+
+  luaL_argcheck ( L, '\0' != * path, 3, "empty path" ) ;
+  i = uring_slot ( L, up, UR_OPENAT ) ;
+
+  if ( NULL == ( up -> req [ i ] . path = strdup ( path ) ) ) {
+    return uring_unslot ( L, up, i ) ;
+  }
+
+  up -> req [ i ] . fd = fd ;
+  up -> req [ i ] . flags = flags ;
+  up -> req [ i ] . mode = mode ;
+  return uring_queued ( L, i ) ;
+}
+
+/* ring:close ( fd ) */
+static int uring_close_fd ( lua_State * const L )
+{
+  uring_t * up = uring_check ( L ) ;
+  const int fd = luaL_checkinteger ( L, 2 ) ;
+  unsigned int i ;
+
+  luaL_argcheck ( L, 0 <= fd, 2, "invalid fd" ) ;
+  i = uring_slot ( L, up, UR_CLOSE ) ;
+  up -> req [ i ] . fd = fd ;
+  return uring_queued ( L, i ) ;
+}
+
+/* ring:statx ( dirfd, path [, flags [, mask]] ) */
+static int uring_statx ( lua_State * const L )
+{
+#if defined (STATX_BASIC_STATS)
+  uring_t * up = uring_check ( L ) ;
+  const int fd = luaL_checkinteger ( L, 2 ) ;
+  const char * path = luaL_checkstring ( L, 3 ) ;
+  const int flags = luaL_optinteger ( L, 4, 0 ) ;
+  const unsigned int mask = luaL_optinteger ( L, 5, STATX_BASIC_STATS ) ;
+  unsigned int i = uring_slot ( L, up, UR_STATX ) ;
+
+  up -> req [ i ] . path = strdup ( path ) ;
+  up -> req [ i ] . stx = (struct statx *) calloc ( 1, sizeof ( struct statx ) ) ;
+
+  if ( NULL == up -> req [ i ] . path || NULL == up -> req [ i ] . stx ) {
+    return uring_unslot ( L, up, i ) ;
+  }
+
+  up -> req [ i ] . fd = fd ;
+  up -> req [ i ] . flags = flags ;
+  up -> req [ i ] . mode = mask ;
+  return uring_queued ( L, i ) ;
+#else
+  return x_os_not_sup ( L ) ;
+#endif
+}
+
+/* ring:submit ( [wait_nr] )
+ * hands all queued requests to the kernel (or runs them in sync mode).
+ * returns the number of requests submitted.
+ */
+static int uring_submit ( lua_State * const L )
+{
+  uring_t * up = uring_check ( L ) ;
+  const lua_Integer w = luaL_optinteger ( L, 2, 0 ) ;
+  const int n = uring_flush ( up, ( 0 < w ) ? w : 0 ) ;
+
+  if ( 0 > n ) {
+    return res_nil ( L ) ;
+  }
+
+  lua_pushinteger ( L, n ) ;
+  return 1 ;
+}
+
+/* ring:reap ( [min] )
+ * submits what is still queued, waits for at least min completions
+ * (default 0) and returns an array of completion records
+ * { id = , op = , res = [, errno = ] [, data = ] }.
+ * res is the syscall result or -errno on failure; data holds the string
+ * read by a read request or the stat table of a statx request.
+ */
+static int uring_reap ( lua_State * const L )
+{
+  static const char * const opname [ ] = {
+    "none", "read", "write", "accept", "openat", "close", "statx"
+  } ;
+  uring_t * up = uring_check ( L ) ;
+  lua_Integer w = luaL_optinteger ( L, 2, 0 ) ;
+  unsigned int i ;
+
+  if ( 0 > uring_flush ( up, 0 ) ) {
+    return res_nil ( L ) ;
+  }
+
+#if defined (HAVE_IO_URING) && defined (SYS_io_uring_setup)
+  if ( 0 <= up -> fd ) {
+    uring_harvest ( up ) ;
+    w = ( w > up -> inflight + up -> ndone ) ? up -> inflight + up -> ndone : w ;
+
+    if ( w > up -> ndone ) {
+      if ( 0 > uring_enter ( up, 0, w - up -> ndone ) ) {
+        return res_nil ( L ) ;
+      }
+
+      uring_harvest ( up ) ;
+    }
+  }
+#endif
+
+  lua_createtable ( L, up -> ndone, 0 ) ;
+
+  for ( i = 0 ; up -> ndone > i ; ++ i ) {
+    uring_req_t * rp = up -> req + up -> done [ i ] ;
+
+    lua_createtable ( L, 0, 5 ) ;
+    lua_pushinteger ( L, 1 + up -> done [ i ] ) ;
+    lua_setfield ( L, -2, "id" ) ;
+    (void) lua_pushstring ( L, opname [ rp -> op ] ) ;
+    lua_setfield ( L, -2, "op" ) ;
+    lua_pushinteger ( L, rp -> res ) ;
+    lua_setfield ( L, -2, "res" ) ;
+
+    if ( 0 > rp -> res ) {
+      lua_pushinteger ( L, - rp -> res ) ;
+      lua_setfield ( L, -2, "errno" ) ;
+    } else if ( UR_READ == rp -> op ) {
+      (void) lua_pushlstring ( L, rp -> buf, rp -> res ) ;
+      lua_setfield ( L, -2, "data" ) ;
+    }
+#if defined (STATX_BASIC_STATS)
+    else if ( UR_STATX == rp -> op ) {
+      (void) get_statx_res ( L, rp -> stx ) ;
+      lua_setfield ( L, -2, "data" ) ;
+    }
+#endif
+
+    lua_rawseti ( L, -2, 1 + i ) ;
+    uring_req_clear ( rp ) ;
+  }
+
+  up -> ndone = 0 ;
+  return 1 ;
+}
+
+/* ring:pending () returns the number of queued and in flight requests */
+static int uring_pending ( lua_State * const L )
+{
+  uring_t * up = uring_check ( L ) ;
+
+  lua_pushinteger ( L, up -> queued ) ;
+  lua_pushinteger ( L, up -> inflight ) ;
+  return 2 ;
+}
+
+/* ring:mode () returns "uring" or "sync" */
+static int uring_mode ( lua_State * const L )
+{
+  uring_t * up = uring_check ( L ) ;
+
+  if ( 0 > up -> fd ) {
+    (void) lua_pushliteral ( L, "sync" ) ;
+  } else {
+    (void) lua_pushliteral ( L, "uring" ) ;
+  }
+
+  return 1 ;
+}
+
+/* unmaps the rings and closes the ring fd */
+static void uring_teardown ( uring_t * const up )
+{
+#if defined (HAVE_IO_URING) && defined (SYS_io_uring_setup)
+  if ( 0 <= up -> fd ) {
+    (void) munmap ( up -> sqes, up -> sq_entries * sizeof ( struct io_uring_sqe ) ) ;
+    if ( up -> cq_ptr != up -> sq_ptr ) { (void) munmap ( up -> cq_ptr, up -> cq_len ) ; }
+    (void) munmap ( up -> sq_ptr, up -> sq_len ) ;
+    CLOSEFD( up -> fd )
+    up -> fd = -1 ;
+  }
+#endif
+}
+
+/* closes io rings */
+static int uring_close ( lua_State * const L )
+{
+  unsigned int i ;
+  uring_t * up = (uring_t *) luaL_checkudata ( L, 1, URING_METATABLE ) ;
+
+  if ( NULL == up -> req ) { return 0 ; }
+  uring_teardown ( up ) ;
+
+  /* buffers of requests still in flight might be written to by the
+   * kernel after the ring is gone, so they are not released.
+   */
+  for ( i = 0 ; up -> nreq > i ; ++ i ) {
+    if ( UR_SUBMITTED != up -> req [ i ] . state ) {
+      uring_req_clear ( up -> req + i ) ;
+    }
+  }
+
+  free ( up -> req ) ;
+  up -> req = NULL ;
+  up -> order = up -> done = NULL ;
+  return 0 ;
+}
+
+/* create a new io ring. arg 1: number of submission queue entries,
+ * arg 2: true to force sync mode (plain syscalls).
+ */
+static int Luring ( lua_State * const L )
+{
+  uring_t * up = NULL ;
+  lua_Integer n = luaL_optinteger ( L, 1, URING_ENTRIES ) ;
+  const int sync = lua_toboolean ( L, 2 ) ;
+
+  n = ( 0 < n && 4096 >= n ) ? n : URING_ENTRIES ;
+  up = (uring_t *) lua_newuserdata ( L, sizeof ( uring_t ) ) ;
+  (void) memset ( up, 0, sizeof ( uring_t ) ) ;
+  up -> fd = -1 ;
+  luaL_getmetatable ( L, URING_METATABLE ) ;
+  lua_setmetatable ( L, -2 ) ;
+
+#if defined (HAVE_IO_URING) && defined (SYS_io_uring_setup)
+  /* fall back to sync mode on ENOSYS, EPERM (io_uring_disabled),
+   * missing opcodes etc. */
+  if ( 0 == sync && uring_setup ( up, n ) ) {
+    up -> fd = -1 ;
+  }
+#endif
+
+  if ( 0 > up -> fd ) {
+    up -> sq_entries = n ;
+  }
+
+  /* the completion queue is twice the size of the submission queue */
+  up -> nreq = 2 * up -> sq_entries ;
+  up -> req = (uring_req_t *) calloc ( up -> nreq,
+    sizeof ( uring_req_t ) + 2 * sizeof ( unsigned int ) ) ;
+
+  if ( NULL == up -> req ) {
+    /* __gc does nothing without req */
+    uring_teardown ( up ) ;
+    return luaL_error ( L, "out of memory" ) ;
+  }
+
+  up -> order = (unsigned int *) ( up -> req + up -> nreq ) ;
+  up -> done = up -> order + up -> nreq ;
+  return 1 ;
+}
+
+/* creates io ring metatable */
+static int uring_create_meta ( lua_State * const L )
+{
+  luaL_newmetatable ( L, URING_METATABLE ) ;
+
+  /* method table */
+  lua_newtable ( L ) ;
+  lua_pushcfunction ( L, uring_read ) ;
+  lua_setfield ( L, -2, "read" ) ;
+  lua_pushcfunction ( L, uring_write ) ;
+  lua_setfield ( L, -2, "write" ) ;
+  lua_pushcfunction ( L, uring_accept ) ;
+  lua_setfield ( L, -2, "accept" ) ;
+  lua_pushcfunction ( L, uring_openat ) ;
+  lua_setfield ( L, -2, "openat" ) ;
+  lua_pushcfunction ( L, uring_close_fd ) ;
+  lua_setfield ( L, -2, "close_fd" ) ;
+  lua_pushcfunction ( L, uring_statx ) ;
+  lua_setfield ( L, -2, "statx" ) ;
+  lua_pushcfunction ( L, uring_submit ) ;
+  lua_setfield ( L, -2, "submit" ) ;
+  lua_pushcfunction ( L, uring_reap ) ;
+  lua_setfield ( L, -2, "reap" ) ;
+  lua_pushcfunction ( L, uring_pending ) ;
+  lua_setfield ( L, -2, "pending" ) ;
+  lua_pushcfunction ( L, uring_mode ) ;
+  lua_setfield ( L, -2, "mode" ) ;
+  lua_pushcfunction ( L, uring_close ) ;
+  lua_setfield ( L, -2, "close" ) ;
+
+  /* metamethods */
+  lua_setfield ( L, -2, "__index" ) ;
+  lua_pushcfunction ( L, uring_close ) ;
+  lua_setfield ( L, -2, "__gc" ) ;
+
+  return 1 ;
+}
+
+#endif
+
@@ -0,0 +1,343 @@
+/*
+ * multi pattern literal matcher (Aho-Corasick)
+ *
+ * all patterns are compiled into one DFA over byte classes, so a text
+ * is scanned once regardless of the number of patterns. the state is
+ * carried from call to call, data can be fed in chunks and matches that
+ * straddle chunk boundaries are still found.
+ * while the automaton is in its start state, bytes that can not start
+ * a pattern are skipped with memchr(3) or SSE2/AVX2 compares (picked at
+ * run time), so most of the text is never looked at byte by byte.
+ *
+ * public domain code
+ */
+
+#define PATSET_CHUNK		65536
+
+/* prefilters for the start state */
+enum {
+  PATSET_SKIP_TABLE		= 0,
+  PATSET_SKIP_MEMCHR,
+  PATSET_SKIP_SSE2,
+  PATSET_SKIP_AVX2,
+} ;
+
+typedef struct {
+  size_t npat ;
+  size_t nstates ;
+  /* number of byte classes, class 0 are the bytes not in any pattern */
+  size_t ncls ;
+  /* up to 257 classes if the patterns use every byte value */
+  uint16_t cls [ 256 ] ;
+  /* transitions, nstates * ncls */
+  uint32_t * delta ;
+  /* per state: a pattern ending here or -1 */
+  int32_t * out ;
+  /* per state: the first state with output on the suffix chain
+   * (the state itself if it has output), 0 if none
+   */
+  uint32_t * term ;
+  /* per state: term of the suffix link */
+  uint32_t * olink ;
+  /* per pattern: the next pattern with the same text or -1 */
+  int32_t * same ;
+  size_t * plen ;
+  char icase ;
+  /* bytes that can start a pattern */
+  char skip ;
+  int nfirst ;
+  unsigned char fb [ 3 ] ;
+  unsigned char first [ 256 ] ;
+} patset_t ;
+
+/* called for every match with the pattern index and the offset after
+ * the match, a non zero return value stops the scan
+ */
+typedef int patset_cb_t ( void * ctx, size_t pat, size_t end ) ;
+
+static void patset_free ( patset_t * const ps )
+{
+  free ( ps -> delta ) ;
+  free ( ps -> out ) ;
+  free ( ps -> term ) ;
+  free ( ps -> olink ) ;
+  free ( ps -> same ) ;
+  free ( ps -> plen ) ;
+  (void) memset ( ps, 0, sizeof ( patset_t ) ) ;
+}
+
+static int patset_fold ( const patset_t * const ps, const int c )
+{
+  return ps -> icase ? tolower ( c ) : c ;
+}
+
+/* compiles n patterns (with lengths lens), which must not be empty.
+ * returns 0 or -1 (errno set).
+ */
+static int patset_build ( patset_t * const ps, const char * const * const pats,
+  const size_t * const lens, const size_t n, const int icase )
+{
+  size_t i, j, c, max = 1, head = 0, tail = 0 ;
+  uint32_t s, t, f ;
+  uint32_t * fail = NULL, * queue = NULL ;
+
+  (void) memset ( ps, 0, sizeof ( patset_t ) ) ;
+  ps -> icase = icase ? 1 : 0 ;
+
+  if ( 0 == n ) {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  /* byte classes */
+  ps -> ncls = 1 ;
+
+  for ( i = 0 ; n > i ; ++ i ) {
+    if ( 0 == lens [ i ] ) {
+      errno = EINVAL ;
+      return -1 ;
+    }
+
+    max += lens [ i ] ;
+
+    for ( j = 0 ; lens [ i ] > j ; ++ j ) {
+      c = patset_fold ( ps, (unsigned char) pats [ i ] [ j ] ) ;
+      if ( 0 == ps -> cls [ c ] ) { ps -> cls [ c ] = ps -> ncls ++ ; }
+    }
+
+    c = (unsigned char) pats [ i ] [ 0 ] ;
+    ps -> first [ patset_fold ( ps, c ) ] = 1 ;
+    if ( icase ) { ps -> first [ toupper ( c ) ] = 1 ; }
+  }
+
+  if ( icase ) {
+    for ( c = 0 ; 256 > c ; ++ c ) { ps -> cls [ c ] = ps -> cls [ tolower ( c ) ] ; }
+  }
+
+  ps -> npat = n ;
+  ps -> delta = (uint32_t *) calloc ( max * ps -> ncls, sizeof ( uint32_t ) ) ;
+  ps -> out = (int32_t *) malloc ( max * sizeof ( int32_t ) ) ;
+  ps -> term = (uint32_t *) calloc ( max, sizeof ( uint32_t ) ) ;
+  ps -> olink = (uint32_t *) calloc ( max, sizeof ( uint32_t ) ) ;
+  ps -> same = (int32_t *) malloc ( n * sizeof ( int32_t ) ) ;
+  ps -> plen = (size_t *) malloc ( n * sizeof ( size_t ) ) ;
+  fail = (uint32_t *) calloc ( max, sizeof ( uint32_t ) ) ;
+  queue = (uint32_t *) malloc ( max * sizeof ( uint32_t ) ) ;
+
+  if ( NULL == ps -> delta || NULL == ps -> out || NULL == ps -> term
+    || NULL == ps -> olink || NULL == ps -> same || NULL == ps -> plen
+    || NULL == fail || NULL == queue )
+  {
+    free ( fail ) ;
+    free ( queue ) ;
+    patset_free ( ps ) ;
+    errno = ENOMEM ;
+    return -1 ;
+  }
+
+  for ( i = 0 ; max > i ; ++ i ) { ps -> out [ i ] = -1 ; }
+
+  /* the trie, 0 is the root and no child of anything */
+  ps -> nstates = 1 ;
+
+  for ( i = 0 ; n > i ; ++ i ) {
+    for ( s = 0, j = 0 ; lens [ i ] > j ; ++ j ) {
+      c = ps -> cls [ (unsigned char) pats [ i ] [ j ] ] ;
+      t = ps -> delta [ s * ps -> ncls + c ] ;
+
+      if ( 0 == t ) {
+        t = ps -> nstates ++ ;
+        ps -> delta [ s * ps -> ncls + c ] = t ;
+      }
+
+      s = t ;
+    }
+
+    ps -> plen [ i ] = lens [ i ] ;
+    ps -> same [ i ] = ps -> out [ s ] ;
+    ps -> out [ s ] = i ;
+  }
+
+  /* breadth first: suffix links and the missing transitions */
+  for ( c = 0 ; ps -> ncls > c ; ++ c ) {
+    t = ps -> delta [ c ] ;
+    if ( t ) { queue [ tail ++ ] = t ; }
+  }
+
+  while ( head < tail ) {
+    s = queue [ head ++ ] ;
+    f = fail [ s ] ;
+    ps -> olink [ s ] = ps -> term [ f ] ;
+    ps -> term [ s ] = ( 0 <= ps -> out [ s ] ) ? s : ps -> term [ f ] ;
+
+    for ( c = 0 ; ps -> ncls > c ; ++ c ) {
+      t = ps -> delta [ s * ps -> ncls + c ] ;
+
+      if ( t ) {
+        fail [ t ] = ps -> delta [ f * ps -> ncls + c ] ;
+        queue [ tail ++ ] = t ;
+      } else {
+        ps -> delta [ s * ps -> ncls + c ] = ps -> delta [ f * ps -> ncls + c ] ;
+      }
+    }
+  }
+
+  free ( fail ) ;
+  free ( queue ) ;
+
+  /* pick the prefilter */
+  for ( c = 0 ; 256 > c ; ++ c ) {
+    if ( ps -> first [ c ] ) {
+      if ( 3 > ps -> nfirst ) { ps -> fb [ ps -> nfirst ] = c ; }
+      ++ ps -> nfirst ;
+    }
+  }
+
+  ps -> skip = ( 1 == ps -> nfirst ) ? PATSET_SKIP_MEMCHR : PATSET_SKIP_TABLE ;
+
+#if defined (__x86_64__) && defined (__GNUC__)
+  if ( 1 < ps -> nfirst && 3 >= ps -> nfirst ) {
+    __builtin_cpu_init () ;
+    ps -> skip = __builtin_cpu_supports ( "avx2" ) ? PATSET_SKIP_AVX2 : PATSET_SKIP_SSE2 ;
+  }
+#endif
+
+  return 0 ;
+}
+
+#if defined (__x86_64__) && defined (__GNUC__)
+/* returns the offset of the first of up to 3 bytes in buf or len */
+static size_t patset_skip_sse2 ( const patset_t * const ps, const char * const buf,
+  size_t i, const size_t len )
+{
+  const __m128i a = _mm_set1_epi8 ( ps -> fb [ 0 ] ) ;
+  const __m128i b = _mm_set1_epi8 ( ps -> fb [ 1 ] ) ;
+  const __m128i c = _mm_set1_epi8 ( ps -> fb [ ( 2 < ps -> nfirst ) ? 2 : 1 ] ) ;
+
+  for ( ; len >= i + 16 ; i += 16 ) {
+    const __m128i x = _mm_loadu_si128 ( (const __m128i *) ( buf + i ) ) ;
+    const int m = _mm_movemask_epi8 ( _mm_or_si128 ( _mm_or_si128 (
+      _mm_cmpeq_epi8 ( x, a ), _mm_cmpeq_epi8 ( x, b ) ), _mm_cmpeq_epi8 ( x, c ) ) ) ;
+
+    if ( m ) { return i + __builtin_ctz ( m ) ; }
+  }
+
+  while ( len > i && 0 == ps -> first [ (unsigned char) buf [ i ] ] ) { ++ i ; }
+  return i ;
+}
+
+__attribute__ ( ( target ( "avx2" ) ) )
+static size_t patset_skip_avx2 ( const patset_t * const ps, const char * const buf,
+  size_t i, const size_t len )
+{
+  const __m256i a = _mm256_set1_epi8 ( ps -> fb [ 0 ] ) ;
+  const __m256i b = _mm256_set1_epi8 ( ps -> fb [ 1 ] ) ;
+  const __m256i c = _mm256_set1_epi8 ( ps -> fb [ ( 2 < ps -> nfirst ) ? 2 : 1 ] ) ;
+
+  for ( ; len >= i + 32 ; i += 32 ) {
+    const __m256i x = _mm256_loadu_si256 ( (const __m256i *) ( buf + i ) ) ;
+    const unsigned int m = _mm256_movemask_epi8 ( _mm256_or_si256 ( _mm256_or_si256 (
+      _mm256_cmpeq_epi8 ( x, a ), _mm256_cmpeq_epi8 ( x, b ) ), _mm256_cmpeq_epi8 ( x, c ) ) ) ;
+
+    if ( m ) { return i + __builtin_ctz ( m ) ; }
+  }
+
+  while ( len > i && 0 == ps -> first [ (unsigned char) buf [ i ] ] ) { ++ i ; }
+  return i ;
+}
+#endif
+
+/* skips the bytes that can not start a match */
+static size_t patset_skip ( const patset_t * const ps, const char * const buf,
+  size_t i, const size_t len )
+{
+  const char * p ;
+
+  switch ( ps -> skip ) {
+    case PATSET_SKIP_MEMCHR :
+      p = (const char *) memchr ( buf + i, ps -> fb [ 0 ], len - i ) ;
+      return p ? (size_t) ( p - buf ) : len ;
+#if defined (__x86_64__) && defined (__GNUC__)
+    case PATSET_SKIP_SSE2 :
+      return patset_skip_sse2 ( ps, buf, i, len ) ;
+    case PATSET_SKIP_AVX2 :
+      return patset_skip_avx2 ( ps, buf, i, len ) ;
+#endif
+    default :
+      break ;
+  }
+
+  while ( len > i && 0 == ps -> first [ (unsigned char) buf [ i ] ] ) { ++ i ; }
+  return i ;
+}
+
+/* feeds len bytes to the automaton, * sp is the state (0 at the start),
+ * base the offset of buf in the whole text. cb is called for every
+ * match. returns 1 if cb stopped the scan, 0 otherwise.
+ */
+static int patset_scan ( const patset_t * const ps, const char * const buf,
+  const size_t len, uint32_t * const sp, const size_t base,
+  patset_cb_t * const cb, void * const ctx )
+{
+  size_t i = 0 ;
+  int32_t p ;
+  uint32_t t, s = * sp ;
+
+  while ( len > i ) {
+    if ( 0 == s ) {
+      i = patset_skip ( ps, buf, i, len ) ;
+      if ( len <= i ) { break ; }
+    }
+
+    s = ps -> delta [ s * ps -> ncls + ps -> cls [ (unsigned char) buf [ i ++ ] ] ] ;
+
+    for ( t = ps -> term [ s ] ; t ; t = ps -> olink [ t ] ) {
+      for ( p = ps -> out [ t ] ; 0 <= p ; p = ps -> same [ p ] ) {
+        if ( cb ( ctx, p, base + i ) ) {
+          * sp = s ;
+          return 1 ;
+        }
+      }
+    }
+  }
+
+  * sp = s ;
+  return 0 ;
+}
+
+/* scans everything readable from fd in chunks.
+ * returns the number of bytes read or -1.
+ */
+static ssize_t patset_scan_fd ( const patset_t * const ps, const int fd,
+  patset_cb_t * const cb, void * const ctx )
+{
+  ssize_t r ;
+  size_t n = 0 ;
+  uint32_t s = 0 ;
+  char * buf = (char *) malloc ( PATSET_CHUNK ) ;
+
+  if ( NULL == buf ) { return -1 ; }
+
+  for ( ; ; ) {
+    r = read ( fd, buf, PATSET_CHUNK ) ;
+
+    if ( 0 > r ) {
+      if ( EINTR == errno ) { continue ; }
+      n = -1 ;
+      break ;
+    } else if ( 0 == r ) {
+      break ;
+    }
+
+    if ( patset_scan ( ps, buf, r, & s, n, cb, ctx ) ) {
+      n += r ;
+      break ;
+    }
+
+    n += r ;
+  }
+
+  free ( buf ) ;
+
+  return n ;
+}
@@ -0,0 +1,330 @@
+/*
+ * process table scanner (Linux)
+ *
+ * walks /proc once and reads <pid>/stat and <pid>/status (and
+ * <pid>/cmdline, <pid>/exe, <pid>/cgroup only when they are needed)
+ * relative to the /proc dir fd into a single reused buffer. the cheap
+ * filters are applied before the more expensive files are read at all.
+ *
+ * public domain code
+ */
+
+#if defined (OSLinux)
+
+#define PTAB_PF_KTHREAD		0x00200000
+#define PTAB_BUFSIZE		4096
+
+/* optional fields */
+enum {
+  PTAB_EXE			= 0x0001,
+  PTAB_ARGV			= 0x0002,
+  PTAB_CGROUP			= 0x0004,
+} ;
+
+/* a process, exe, argv and cgroup are only set when requested
+ * (or needed by a filter) and point into the scan buffers.
+ */
+typedef struct {
+  pid_t pid ;
+  pid_t ppid ;
+  pid_t pgid ;
+  pid_t sid ;
+  uid_t uid ;
+  gid_t gid ;
+  char state ;
+  unsigned int flags ;
+  /* clock ticks after boot */
+  unsigned long long start ;
+  /* resident set size in pages */
+  long rss ;
+  char comm [ 64 ] ;
+  const char * exe ;
+  /* NUL separated arguments */
+  const char * argv ;
+  size_t argvlen ;
+  const char * cgroup ;
+} ptab_proc_t ;
+
+/* called for every matching process, a non zero return value stops
+ * the scan
+ */
+typedef int ptab_cb_t ( void * ctx, const ptab_proc_t * pp ) ;
+
+typedef struct {
+  /* fields to fetch (PTAB_*) */
+  unsigned int want ;
+  /* include kernel threads */
+  char kthreads ;
+  /* filters, negative (or NULL) if unused */
+  pid_t ppid ;
+  pid_t pgid ;
+  pid_t sid ;
+  uid_t uid ;
+  char has_uid ;
+  const char * comm ;
+  /* a path or just the file name */
+  const char * exe ;
+  /* leading arguments that have to match */
+  const char * const * argv ;
+  size_t argc ;
+  /* the cgroup (v2) or one of its ancestors */
+  const char * cgroup ;
+  /* scratch buffer, may be reallocated */
+  char * buf ;
+  size_t cap ;
+  /* if set, holds the /proc DIR during the scan, so the caller can
+   * close it when a callback does not return
+   */
+  DIR ** dirpp ;
+} ptab_t ;
+
+static void ptab_init ( ptab_t * const pt )
+{
+  (void) memset ( pt, 0, sizeof ( ptab_t ) ) ;
+  pt -> ppid = pt -> pgid = pt -> sid = -1 ;
+}
+
+/* appends the contents of the file pid/name to the scan buffer at off
+ * and terminates it with a NUL. returns the length read or -1.
+ */
+static ssize_t ptab_read ( ptab_t * const pt, const int procfd, const char * const pid,
+  const char * const name, const size_t off )
+{
+  int fd ;
+  ssize_t r ;
+  size_t n = 0 ;
+  char * p ;
+  char path [ 64 ] ;
+
+  (void) snprintf ( path, sizeof ( path ), "%.16s/%.32s", pid, name ) ;
+  fd = openat ( procfd, path, O_RDONLY | O_CLOEXEC | O_NOCTTY ) ;
+  if ( 0 > fd ) { return -1 ; }
+
+  for ( ; ; ) {
+    if ( pt -> cap < off + n + 2 ) {
+      p = (char *) realloc ( pt -> buf, pt -> cap ? 2 * pt -> cap + off : PTAB_BUFSIZE + off ) ;
+
+      if ( NULL == p ) {
+        n = 0 ;
+        break ;
+      }
+
+      pt -> cap = pt -> cap ? 2 * pt -> cap + off : PTAB_BUFSIZE + off ;
+      pt -> buf = p ;
+    }
+
+    r = read ( fd, pt -> buf + off + n, pt -> cap - off - n - 1 ) ;
+
+    if ( 0 < r ) {
+      n += r ;
+    } else if ( 0 == r || EINTR != errno ) {
+      break ;
+    }
+  }
+
+  CLOSEFD( fd )
+  if ( pt -> buf ) { pt -> buf [ off + n ] = '\0' ; }
+
+  return n ;
+}
+
+/* parses <pid>/stat, comm may contain blanks and parens */
+static int ptab_parse_stat ( const char * const s, ptab_proc_t * const pp )
+{
+  size_t l ;
+  const char * b = strchr ( s, '(' ) ;
+  const char * e = strrchr ( s, ')' ) ;
+
+  if ( NULL == b || NULL == e || b > e ) { return -1 ; }
+
+  l = e - b - 1 ;
+  if ( sizeof ( pp -> comm ) <= l ) { l = sizeof ( pp -> comm ) - 1 ; }
+  (void) memcpy ( pp -> comm, b + 1, l ) ;
+  pp -> comm [ l ] = '\0' ;
+
+  /* fields 3 to 24 */
+  if ( 7 != sscanf ( e + 1, " %c %d %d %d %*d %*d %u %*u %*u %*u %*u %*u %*u"
+    " %*d %*d %*d %*d %*d %*d %llu %*u %ld", & pp -> state, & pp -> ppid,
+    & pp -> pgid, & pp -> sid, & pp -> flags, & pp -> start, & pp -> rss ) )
+  {
+    return -1 ;
+  }
+
+  return 0 ;
+}
+
+/* gets the effective uid and gid from <pid>/status, unlike the owner
+ * of /proc/<pid> they are right for non dumpable processes too
+ */
+static int ptab_parse_status ( const char * const s, ptab_proc_t * const pp )
+{
+  unsigned int id ;
+  const char * p = strstr ( s, "\nUid:" ) ;
+
+  if ( NULL == p || 1 != sscanf ( p + 5, "%*u %u", & id ) ) { return -1 ; }
+  pp -> uid = id ;
+
+  p = strstr ( p, "\nGid:" ) ;
+  if ( NULL == p || 1 != sscanf ( p + 5, "%*u %u", & id ) ) { return -1 ; }
+  pp -> gid = id ;
+
+  return 0 ;
+}
+
+/* compares a path with a pattern that is either a path or a file name */
+static int ptab_path_match ( const char * const pat, const char * const path )
+{
+  const char * p ;
+
+  if ( strchr ( pat, '/' ) ) { return 0 == strcmp ( pat, path ) ; }
+  p = strrchr ( path, '/' ) ;
+
+  return 0 == strcmp ( pat, p ? p + 1 : path ) ;
+}
+
+/* scans /proc and calls cb for every process that passes the filters.
+ * returns the number of matching processes or -1.
+ */
+static long ptab_scan ( ptab_t * const pt, ptab_cb_t * const cb, void * const ctx )
+{
+  int procfd ;
+  long n = 0 ;
+  ssize_t r ;
+  size_t off, aoff = 0, coff = 0 ;
+  DIR * dirp ;
+  struct dirent * de ;
+  ptab_proc_t pr ;
+  char exe [ PATH_MAX + 1 ] ;
+  const unsigned int want = pt -> want
+    | ( pt -> exe ? PTAB_EXE : 0 )
+    | ( pt -> argc ? PTAB_ARGV : 0 )
+    | ( pt -> cgroup ? PTAB_CGROUP : 0 ) ;
+
+  dirp = opendir ( "/proc" ) ;
+  if ( NULL == dirp ) { return -1 ; }
+  procfd = dirfd ( dirp ) ;
+  if ( pt -> dirpp ) { * pt -> dirpp = dirp ; }
+
+  while ( NULL != ( de = readdir ( dirp ) ) ) {
+    if ( '1' > de -> d_name [ 0 ] || '9' < de -> d_name [ 0 ] ) { continue ; }
+
+    (void) memset ( & pr, 0, sizeof ( pr ) ) ;
+    pr . pid = atoi ( de -> d_name ) ;
+
+    /* the process may be gone by now */
+    if ( 0 >= ptab_read ( pt, procfd, de -> d_name, "stat", 0 )
+      || ptab_parse_stat ( pt -> buf, & pr ) )
+    {
+      continue ;
+    }
+
+    if ( 0 == pt -> kthreads && ( PTAB_PF_KTHREAD & pr . flags ) ) { continue ; }
+    if ( 0 <= pt -> ppid && pt -> ppid != pr . ppid ) { continue ; }
+    if ( 0 <= pt -> pgid && pt -> pgid != pr . pgid ) { continue ; }
+    if ( 0 <= pt -> sid && pt -> sid != pr . sid ) { continue ; }
+    if ( pt -> comm && strcmp ( pt -> comm, pr . comm ) ) { continue ; }
+
+    /* the effective uid/gid of the process */
+    if ( 0 >= ptab_read ( pt, procfd, de -> d_name, "status", 0 )
+      || ptab_parse_status ( pt -> buf, & pr ) )
+    {
+      continue ;
+    }
+
+    if ( pt -> has_uid && pt -> uid != pr . uid ) { continue ; }
+
+    if ( PTAB_EXE & want ) {
+      char path [ 64 ] ;
+
+      (void) snprintf ( path, sizeof ( path ), "%.16s/exe", de -> d_name ) ;
+      r = readlinkat ( procfd, path, exe, sizeof ( exe ) - 1 ) ;
+
+      if ( 0 < r ) {
+        exe [ r ] = '\0' ;
+        /* the binary has been replaced or removed */
+        if ( 10 < r && 0 == strcmp ( exe + r - 10, " (deleted)" ) ) { exe [ r - 10 ] = '\0' ; }
+        pr . exe = exe ;
+      }
+
+      if ( pt -> exe && ( NULL == pr . exe || 0 == ptab_path_match ( pt -> exe, exe ) ) ) {
+        continue ;
+      }
+    }
+
+    off = 0 ;
+
+    if ( PTAB_ARGV & want ) {
+      r = ptab_read ( pt, procfd, de -> d_name, "cmdline", 0 ) ;
+      if ( 0 > r ) { continue ; }
+      pr . argvlen = r ;
+      aoff = 0 ;
+      off = r + 1 ;
+
+      if ( pt -> argc ) {
+        size_t i, l ;
+        const char * a = pt -> buf ;
+
+        for ( i = 0, l = 0 ; pt -> argc > i ; ++ i ) {
+          if ( l >= pr . argvlen ) { break ; }
+          if ( 0 == i ? 0 == ptab_path_match ( pt -> argv [ 0 ], a + l )
+            : 0 != strcmp ( pt -> argv [ i ], a + l ) )
+          {
+            break ;
+          }
+
+          l += 1 + strlen ( a + l ) ;
+        }
+
+        if ( pt -> argc > i ) { continue ; }
+      }
+    }
+
+    if ( PTAB_CGROUP & want ) {
+      char * p ;
+
+      r = ptab_read ( pt, procfd, de -> d_name, "cgroup", off ) ;
+
+      if ( 0 <= r ) {
+        /* the cgroup v2 entry is "0::/path" */
+        for ( p = pt -> buf + off ; p && * p ; ) {
+          if ( 0 == strncmp ( p, "0::", 3 ) ) {
+            coff = p + 3 - pt -> buf ;
+            p = strchr ( pt -> buf + coff, '\n' ) ;
+            if ( p ) { * p = '\0' ; }
+            pr . cgroup = pt -> buf ;
+            break ;
+          }
+
+          p = strchr ( p, '\n' ) ;
+          if ( p ) { ++ p ; }
+        }
+      }
+
+      if ( pt -> cgroup ) {
+        size_t l = strlen ( pt -> cgroup ) ;
+
+        while ( 1 < l && '/' == pt -> cgroup [ l - 1 ] ) { -- l ; }
+
+        if ( NULL == pr . cgroup || strncmp ( pt -> cgroup, pt -> buf + coff, l )
+          || ( '\0' != pt -> buf [ coff + l ] && '/' != pt -> buf [ coff + l ] && 1 < l ) )
+        {
+          continue ;
+        }
+      }
+    }
+
+    /* the buffer may have been moved by the reads */
+    if ( PTAB_ARGV & want ) { pr . argv = pt -> buf + aoff ; }
+    if ( pr . cgroup ) { pr . cgroup = pt -> buf + coff ; }
+
+    ++ n ;
+    if ( cb && cb ( ctx, & pr ) ) { break ; }
+  }
+
+  (void) closedir ( dirp ) ;
+  if ( pt -> dirpp ) { * pt -> dirpp = NULL ; }
+
+  return n ;
+}
+
+#endif
@@ -13,6 +13,7 @@
 #include "os_aux.c"
 #include "rc_aux.c"
 #include "rc_utils.c"
+#include "rc_net.c"
 
 /* OS specific functions */
 #if defined (OSbsd)
@@ -69,12 +70,13 @@ static const luaL_Reg sys_func [ ] =
   /* begin of struct array for exported Lua C functions */
 
   /* functions imported from "rc_net.c": */
-  /*
+  { "setup_iface_lo",		l_setup_iface_lo	},
   { "if_up",			Lif_up		},
   { "if_down",			Lif_down	},
+  { "if_down_all",		Lif_down_all	},
   { "route_add_netmask",	Lroute_add_netmask	},
   { "route_add_defgw",		Lroute_add_defgw	},
-  */
+  { "net_config",		Lnet_config	},
   /* end of imported functions from "rc_net.c" */
 
   /* functions imported from "rc_utils.c" : */
@@ -1,445 +1,907 @@
 /*
  * functions to configure/shutdown network interfaces
+ *
+ * uses a NETLINK_ROUTE socket (Linux). all changes of one call are
+ * queued as rtnetlink messages into one buffer, sent with a single
+ * sendmsg(2), and the kernel's acknowledgements are collected after
+ * that. so a whole boot time network setup takes only a few syscalls
+ * instead of one ioctl per attribute.
  */
 
-/* enable the loopback interface */
-static int l_setup_iface_lo ( lua_State * const L )
+#if defined (OSLinux)
+
+#define RTNL_BUFSIZE		32768
+
+/* an interface, from RTM_GETLINK dumps */
+typedef struct {
+  int index ;
+  unsigned int flags ;
+  char name [ IFNAMSIZ ] ;
+} rtnl_link_t ;
+
+typedef struct {
+  int fd ;
+  /* sequence number of the first message of the batch */
+  uint32_t seq ;
+  /* queued messages */
+  size_t n ;
+  size_t len ;
+  size_t cap ;
+  /* offset of the message that is being built */
+  size_t cur ;
+  char * buf ;
+  /* per message errno after rtnl_commit */
+  int * err ;
+  size_t nerr ;
+  /* interfaces, dumped on first use */
+  rtnl_link_t * links ;
+  size_t nlinks ;
+  char dumped ;
+} rtnl_t ;
+
+/* an address with an optional prefix length */
+typedef struct {
+  int family ;
+  int plen ;
+  unsigned char addr [ 16 ] ;
+} rtnl_prefix_t ;
+
+static void rtnl_close ( rtnl_t * const rt )
+{
+  if ( 0 <= rt -> fd ) { CLOSEFD( rt -> fd ) }
+  free ( rt -> buf ) ;
+  free ( rt -> err ) ;
+  free ( rt -> links ) ;
+  (void) memset ( rt, 0, sizeof ( rtnl_t ) ) ;
+  rt -> fd = -1 ;
+}
+
+static int rtnl_open ( rtnl_t * const rt )
 {
-#if 0
-  int i = socket ( PF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_IP ) ;
-
-  if ( 0 > i ) {
-    i = errno ;
-    return luaL_error ( L, "socket() failed: %s (errno %d)",
-      strerror ( i ), i ) ;
-  } else {
-    struct sockaddr_in ifaddr ;
-    struct ifreq ipreq ;
-
-    ifaddr . sin_family = AF_INET ;
-    /* 127.0.0.1 */
-    ifaddr . sin_addr = 16777343 ;
-    ipreq . ifr_name = "lo" ;
-    ipreq . ifr_addr = * ( (struct sockaddr *) & ifaddr ) ;
-    (void) ioctl ( i, SIOCSIFADDR, & ipreq ) ;
-    ipreq . ifr_flags = IFF_UP | IFF_LOOPBACK | IFF_RUNNING ;
-    (void) ioctl ( i, SIOCSIFFLAGS, & ipreq ) ;
-    (void) close_fd ( i ) ;
+  struct sockaddr_nl sa ;
+
+  (void) memset ( rt, 0, sizeof ( rtnl_t ) ) ;
+  rt -> fd = socket ( PF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE ) ;
+  if ( 0 > rt -> fd ) { return -1 ; }
+
+  (void) memset ( & sa, 0, sizeof ( sa ) ) ;
+  sa . nl_family = AF_NETLINK ;
+
+  if ( bind ( rt -> fd, (struct sockaddr *) & sa, sizeof ( sa ) ) ) {
+    const int e = errno ;
+    rtnl_close ( rt ) ;
+    errno = e ;
+    return -1 ;
+  }
+
+#if defined (NETLINK_CAP_ACK)
+  {
+    /* acks without a copy of the request */
+    const int one = 1 ;
+    (void) setsockopt ( rt -> fd, SOL_NETLINK, NETLINK_CAP_ACK, & one, sizeof ( one ) ) ;
   }
 #endif
 
+  rt -> seq = (uint32_t) time ( NULL ) ;
+
   return 0 ;
 }
 
-#if 0
-/* network commands of general utility */
-struct ifconfigtable {
-  char * name ;
-  int ioctlname ;
-  struct sockaddr * where ;
-} ;
-
-static const struct ifconfigtable param_table [ ] = {
-  { "addr", SIOCSIFADDR, & req . ifr_addr },
-  { "netmask", SIOCSIFNETMASK, & req . ifr_netmask },
-  { "broadcast", SIOCSIFBRDADDR, & req . ifr_broadaddr },
-  { "pointopoint", SIOCSIFDSTADDR, & req . ifr_dstaddr },
-  { NULL, 0, NULL }
-} ;
-
-static int Lnet_config ( lua_State * L )
+/* makes room for n more bytes in the batch */
+static int rtnl_reserve ( rtnl_t * const rt, const size_t n )
 {
-  int i, flags = 0 ;
-  int fd = -1 ;
-  struct ifreq req ;
-  struct rtentry rte ;
-  char string [ 128 ] = { 0 } ;
-
-  switch ( argv [ 0 ] [ 0 ] ) {
-      case 'i' : /* ifconfig */
-        if ( argc == 1 || argc > 4 ) goto wna ;
-
-	strncpy ( req . ifr_name, argv [ 1 ], IFNAMSIZ - 1 ) ; /* ifname */
-
-	if ( 0 > ioctl ( fd, SIOCGIFFLAGS, & req ) ) goto ioctlerr ;
-
-	flags = req . ifr_flags ;
-
-	if ( argc == 2 ) { /* report about one interface */
-	    sprintf ( string,"%s: %s", req . ifr_name,
-		    flags & IFF_UP ? "up" : "down" ) ;
-
-	    if ( ioctl ( fd, SIOCGIFADDR, & req ) < 0 ) goto ioctlerr ;
-	    sprintf ( string," addr %s ",
-		    inet_ntoa ( ( * (struct sockaddr_in *)
-			       & req . ifr_addr ) . sin_addr ) ) ;
-
-	    if ( ioctl ( fd, SIOCGIFNETMASK, & req ) < 0 ) goto ioctlerr ;
-	    sprintf ( string," mask %s ",
-		    inet_ntoa ( ( * (struct sockaddr_in *)
-			       & req . ifr_netmask ) . sin_addr ) ) ;
-
-	    if ( ioctl ( fd, SIOCGIFBRDADDR, & req ) < 0 ) goto ioctlerr ;
-	    sprintf ( string," bcast %s\n",
-		    inet_ntoa ( ( * (struct sockaddr_in *)
-			       & req . ifr_broadaddr ) . sin_addr ) ) ;
-
-	    if ( ioctl ( fd, SIOCGIFDSTADDR, & req ) < 0 ) goto ioctlerr ;
-	    sprintf ( string,"\tpointopoint %s ",
-		    inet_ntoa ( ( * (struct sockaddr_in *)
-			       & req . ifr_addr ) . sin_addr ) ) ;
-	    Tcl_AppendResult ( interp, string, NULL ) ;
-
-	    if ( ioctl ( fd, SIOCGIFHWADDR, & req ) < 0 ) goto ioctlerr ;
-	    sprintf ( string, " hwaddr %02x:%02x:%02x:%02x:%02x:%02x ",
-		    req . ifr_hwaddr . sa_data [ 0 ] & 0xff,
-		    req . ifr_hwaddr . sa_data [ 1 ] & 0xff,
-		    req . ifr_hwaddr . sa_data [ 2 ] & 0xff,
-		    req . ifr_hwaddr . sa_data [ 3 ] & 0xff,
-		    req . ifr_hwaddr . sa_data [ 4 ] & 0xff,
-		    req . ifr_hwaddr . sa_data [ 5 ] & 0xff ) ;
-	    Tcl_AppendResult ( interp, string, NULL ) ;
-
-	    if ( ioctl ( fd, SIOCGIFMTU, & req ) < 0 ) goto ioctlerr ;
-	    sprintf ( string, " mtu %i ", (int) req . ifr_mtu ) ;
-	    Tcl_AppendResult ( interp, string, NULL ) ;
-
-	    return TCL_OK ;
-	}
-
-	if ( argc == 3 ) { /* up or down */
-	    i = 0 ; /* number of successfull operations */
-
-	    if ( 0 == strcmp ( argv [ 2 ], "up" ) ) {
-		i++ ; flags |= IFF_UP ;
-	    }
-
-	    if ( 0 == strcmp ( argv [ 2 ], "down" ) ) {
-		i ++ ; flags &= ~ ( IFF_UP ) ;
-	    }
-
-	    if ( i ) {
-		req . ifr_flags = flags ;
-		if ( ioctl ( fd, SIOCSIFFLAGS, & req ) < 0 ) goto ioctlerr ;
-		return TCL_OK ;
-	    }
-	}
-
-	if ( argc == 4 ) {
-	    struct in_addr addr ;
-
-	    if ( 0 == inet_aton ( argv [ 3 ], & addr ) ) goto wna ;
-
-	    for ( i = 0 ; param_table [ i ] . name ; i ++ ) {
-		if ( 0 == strcmp ( param_table [ i ] . name, argv [ 2 ] ) ) {
-		    (* (struct sockaddr_in *) ( param_table [ i ] . where ) )
-			. sin_addr = addr ;
-		    param_table [ i ] . where -> sa_family = AF_INET ;
-		    if ( ioctl ( fd, param_table [ i ] . ioctlname, & req ) )
-			goto ioctlerr ;
-		    return TCL_OK ;
-		}
-	    }
-	}
-  }
-
-  return TCL_ERROR ;
+  size_t s ;
+  char * p ;
+
+  if ( rt -> cap - rt -> len >= n ) { return 0 ; }
+  for ( s = rt -> cap ? rt -> cap : RTNL_BUFSIZE ; s - rt -> len < n ; s *= 2 ) { ; }
+  p = (char *) realloc ( rt -> buf, s ) ;
+  if ( NULL == p ) { return -1 ; }
+  (void) memset ( p + rt -> cap, 0, s - rt -> cap ) ;
+  rt -> buf = p ;
+  rt -> cap = s ;
+
+  return 0 ;
+}
+
+/* starts a new message with a (zeroed) family header of size hlen and
+ * returns a pointer to that header. it is only valid until the next
+ * attribute is added.
+ */
+static void * rtnl_msg ( rtnl_t * const rt, const int type, const int flags,
+  const size_t hlen )
+{
+  struct nlmsghdr * nh ;
+  const size_t l = NLMSG_LENGTH ( hlen ) ;
+
+  if ( rtnl_reserve ( rt, NLMSG_ALIGN ( l ) ) ) { return NULL ; }
+
+  rt -> cur = rt -> len ;
+  nh = (struct nlmsghdr *) ( rt -> buf + rt -> cur ) ;
+  (void) memset ( nh, 0, NLMSG_ALIGN ( l ) ) ;
+  nh -> nlmsg_len = l ;
+  nh -> nlmsg_type = type ;
+  nh -> nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags ;
+  nh -> nlmsg_seq = rt -> seq + rt -> n ;
+  rt -> len += NLMSG_ALIGN ( l ) ;
+  ++ rt -> n ;
+
+  return NLMSG_DATA ( nh ) ;
+}
+
+/* appends an attribute to the current message */
+static int rtnl_attr ( rtnl_t * const rt, const int type, const void * const data,
+  const size_t len )
+{
+  struct nlmsghdr * nh ;
+  struct rtattr * ra ;
+  const size_t l = RTA_LENGTH ( len ) ;
+
+  if ( rtnl_reserve ( rt, RTA_ALIGN ( l ) ) ) { return -1 ; }
+
+  ra = (struct rtattr *) ( rt -> buf + rt -> len ) ;
+  ra -> rta_type = type ;
+  ra -> rta_len = l ;
+  if ( len ) { (void) memcpy ( RTA_DATA ( ra ), data, len ) ; }
+  (void) memset ( (char *) ra + l, 0, RTA_ALIGN ( l ) - l ) ;
+  rt -> len += RTA_ALIGN ( l ) ;
+
+  nh = (struct nlmsghdr *) ( rt -> buf + rt -> cur ) ;
+  nh -> nlmsg_len = rt -> len - rt -> cur ;
+
+  return 0 ;
 }
 
-/* maximal number of interfaces */
-#define MAX_IFS	64
+static int rtnl_attr_u32 ( rtnl_t * const rt, const int type, const uint32_t v )
+{
+  return rtnl_attr ( rt, type, & v, sizeof ( v ) ) ;
+}
 
-/* First, we find all shaper devices and down them.
- * Then we down all real interfaces.
+/* sends the queued messages and waits for their acks. rt -> err holds
+ * the errno of every message afterwards (0 on success) and the batch
+ * is emptied. returns the number of failed messages or -1.
  */
-static int Lif_down_all ( lua_State * L )
+static long rtnl_commit ( rtnl_t * const rt )
 {
-  int numif, shaper, i = 0 ;
-  struct ifreq ifr [ MAX_IFS ] ;
-  struct ifconf ifc ;
-  const int fd = socket ( AF_INET, SOCK_DGRAM, 0 ) ;
-
-  if ( 0 > fd ) {
-    (void) fprintf ( stderr, "ifdown: " ) ;
-    perror ( "socket(2)" ) ;
-    return -1 ;
+  ssize_t r ;
+  long failed = 0 ;
+  size_t i, acked = 0 ;
+  struct nlmsghdr * nh ;
+  struct nlmsgerr * ne ;
+  struct sockaddr_nl sa ;
+  struct iovec iov ;
+  struct msghdr mh ;
+  char buf [ RTNL_BUFSIZE ] ;
+
+  free ( rt -> err ) ;
+  rt -> err = NULL ;
+  rt -> nerr = 0 ;
+  if ( 0 == rt -> n ) { return 0 ; }
+
+  rt -> err = (int *) malloc ( rt -> n * sizeof ( int ) ) ;
+  if ( NULL == rt -> err ) { return -1 ; }
+  for ( i = 0 ; rt -> n > i ; ++ i ) { rt -> err [ i ] = EIO ; }
+  rt -> nerr = rt -> n ;
+
+  (void) memset ( & sa, 0, sizeof ( sa ) ) ;
+  sa . nl_family = AF_NETLINK ;
+  iov . iov_base = rt -> buf ;
+  iov . iov_len = rt -> len ;
+  (void) memset ( & mh, 0, sizeof ( mh ) ) ;
+  mh . msg_name = & sa ;
+  mh . msg_namelen = sizeof ( sa ) ;
+  mh . msg_iov = & iov ;
+  mh . msg_iovlen = 1 ;
+
+  do { r = sendmsg ( rt -> fd, & mh, 0 ) ; }
+  while ( 0 > r && EINTR == errno ) ;
+  if ( 0 > r ) { return -1 ; }
+
+  while ( rt -> n > acked ) {
+    r = recv ( rt -> fd, buf, sizeof ( buf ), 0 ) ;
+
+    if ( 0 > r ) {
+      if ( EINTR == errno ) { continue ; }
+      return -1 ;
+    } else if ( 0 == r ) {
+      break ;
+    }
+
+    for ( nh = (struct nlmsghdr *) buf ; NLMSG_OK ( nh, (size_t) r ) ; nh = NLMSG_NEXT ( nh, r ) ) {
+      i = nh -> nlmsg_seq - rt -> seq ;
+      if ( NLMSG_ERROR != nh -> nlmsg_type || rt -> n <= i ) { continue ; }
+
+      ne = (struct nlmsgerr *) NLMSG_DATA ( nh ) ;
+      rt -> err [ i ] = - ne -> error ;
+      if ( ne -> error ) { ++ failed ; }
+      ++ acked ;
+    }
   }
 
-  ifc . ifc_len = sizeof ( ifr ) ;
-  ifc . ifc_req = ifr ;
+  /* messages without an ack keep EIO */
+  failed += rt -> n - acked ;
+  rt -> seq += rt -> n ;
+  rt -> n = rt -> len = 0 ;
+
+  return failed ;
+}
+
+/* dumps the interfaces into rt -> links. returns 0 or -1. */
+static int rtnl_dump_links ( rtnl_t * const rt )
+{
+  int done = 0 ;
+  ssize_t r ;
+  size_t n ;
+  rtnl_link_t * lp ;
+  struct nlmsghdr * nh ;
+  struct ifinfomsg * ifi ;
+  struct rtattr * ra ;
+  struct {
+    struct nlmsghdr nh ;
+    struct ifinfomsg ifi ;
+  } req ;
+  char buf [ RTNL_BUFSIZE ] ;
+
+  (void) memset ( & req, 0, sizeof ( req ) ) ;
+  req . nh . nlmsg_len = NLMSG_LENGTH ( sizeof ( struct ifinfomsg ) ) ;
+  req . nh . nlmsg_type = RTM_GETLINK ;
+  req . nh . nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP ;
+  /* not part of a batch */
+  req . nh . nlmsg_seq = rt -> seq - 1 ;
+  req . ifi . ifi_family = AF_UNSPEC ;
+
+  if ( 0 > send ( rt -> fd, & req, req . nh . nlmsg_len, 0 ) ) { return -1 ; }
+
+  rt -> nlinks = 0 ;
+
+  while ( 0 == done ) {
+    r = recv ( rt -> fd, buf, sizeof ( buf ), 0 ) ;
+
+    if ( 0 > r ) {
+      if ( EINTR == errno ) { continue ; }
+      return -1 ;
+    } else if ( 0 == r ) {
+      break ;
+    }
+
+    for ( nh = (struct nlmsghdr *) buf ; NLMSG_OK ( nh, (size_t) r ) ; nh = NLMSG_NEXT ( nh, r ) ) {
+      if ( req . nh . nlmsg_seq != nh -> nlmsg_seq ) { continue ; }
+
+      if ( NLMSG_DONE == nh -> nlmsg_type ) {
+        done = 1 ;
+        break ;
+      } else if ( NLMSG_ERROR == nh -> nlmsg_type ) {
+        errno = - ( (struct nlmsgerr *) NLMSG_DATA ( nh ) ) -> error ;
+        return -1 ;
+      } else if ( RTM_NEWLINK != nh -> nlmsg_type ) {
+        continue ;
+      }
+
+      lp = (rtnl_link_t *) realloc ( rt -> links, ( 1 + rt -> nlinks ) * sizeof ( rtnl_link_t ) ) ;
+      if ( NULL == lp ) { return -1 ; }
+      rt -> links = lp ;
+      lp += rt -> nlinks ;
+      (void) memset ( lp, 0, sizeof ( rtnl_link_t ) ) ;
+      ifi = (struct ifinfomsg *) NLMSG_DATA ( nh ) ;
+      lp -> index = ifi -> ifi_index ;
+      lp -> flags = ifi -> ifi_flags ;
+      n = IFLA_PAYLOAD ( nh ) ;
+
+      for ( ra = IFLA_RTA ( ifi ) ; RTA_OK ( ra, n ) ; ra = RTA_NEXT ( ra, n ) ) {
+        if ( IFLA_IFNAME == ra -> rta_type ) {
+          (void) snprintf ( lp -> name, sizeof ( lp -> name ), "%.*s",
+            (int) RTA_PAYLOAD ( ra ), (const char *) RTA_DATA ( ra ) ) ;
+        }
+      }
 
-  if ( 0 > ioctl ( fd, SIOCGIFCONF, & ifc ) ) {
-	(void) fprintf ( stderr, "ifdown: " ) ;
-	perror ( "SIOCGIFCONF" ) ;
-	(void) close_fd ( fd ) ;
-	return -1 ;
+      ++ rt -> nlinks ;
+    }
   }
 
-  numif = ifc . ifc_len / sizeof ( struct ifreq ) ;
+  rt -> dumped = 1 ;
 
-  for ( shaper = 1 ; shaper >= 0 ; -- shaper ) {
-	for ( i = 0 ; i < numif ; ++ i ) {
-			if ( ( strncmp ( ifr [ i ] . ifr_name, "shaper", 6 ) == 0 )
-			    != shaper) continue;
+  return 0 ;
+}
 
-			if ( strcmp ( ifr [ i ] . ifr_name, "lo" ) == 0 )
-				continue ;
+/* returns the index of an interface or 0 (errno set) */
+static int rtnl_ifindex ( rtnl_t * const rt, const char * const name )
+{
+  size_t i ;
 
-			if ( strchr ( ifr [ i ] . ifr_name, ':' ) != NULL )
-				continue ;
+  if ( 0 == rt -> dumped && rtnl_dump_links ( rt ) ) { return 0 ; }
 
-			/* read interface flags */
-			if ( ioctl ( fd, SIOCGIFFLAGS, & ifr [ i ] ) < 0 ) {
-				(void) fprintf ( stderr, "ifdown: shutdown " ) ;
-				perror ( ifr [ i ] . ifr_name ) ;
-				continue ;
-			}
+  for ( i = 0 ; rt -> nlinks > i ; ++ i ) {
+    if ( 0 == strcmp ( name, rt -> links [ i ] . name ) ) { return rt -> links [ i ] . index ; }
+  }
 
-#ifdef ifr_flags
-# define IRFFLAGS	ifr_flags
-#else
-/* Present on kFreeBSD */
-# define IRFFLAGS	ifr_flagshigh
-#endif
-        if ( ifr [ i ] . IRFFLAGS & IFF_UP ) {
-		ifr [ i ] . IRFFLAGS &= ~ ( IFF_UP ) ;
-		if ( ioctl ( fd, SIOCSIFFLAGS, & ifr [ i ] ) < 0 ) {
-			fprintf ( stderr, "ifdown: shutdown " ) ;
-			perror ( ifr [ i ] . ifr_name ) ;
-		}
-        }
-#undef IRFFLAGS
-		}
+  errno = ENODEV ;
+  return 0 ;
+}
+
+/* parses "addr[/plen]", "default" is the empty prefix of any family.
+ * returns 0 or -1.
+ */
+static int rtnl_parse_prefix ( const char * const s, rtnl_prefix_t * const pp )
+{
+  long l ;
+  char * e ;
+  char buf [ INET6_ADDRSTRLEN + 8 ] ;
+  char * slash ;
+
+  (void) memset ( pp, 0, sizeof ( rtnl_prefix_t ) ) ;
+  if ( 0 == strcmp ( "default", s ) ) { return 0 ; }
+  if ( sizeof ( buf ) <= strlen ( s ) ) { return -1 ; }
+  (void) strcpy ( buf, s ) ;
+  slash = strchr ( buf, '/' ) ;
+  if ( slash ) { * slash ++ = '\0' ; }
+
+  pp -> family = strchr ( buf, ':' ) ? AF_INET6 : AF_INET ;
+  if ( 1 != inet_pton ( pp -> family, buf, pp -> addr ) ) { return -1 ; }
+  pp -> plen = ( AF_INET6 == pp -> family ) ? 128 : 32 ;
+
+  if ( slash ) {
+    l = strtol ( slash, & e, 10 ) ;
+    if ( slash == e || '\0' != * e || 0 > l || pp -> plen < l ) { return -1 ; }
+    pp -> plen = l ;
   }
 
-  (void) close_fd ( fd ) ;
   return 0 ;
 }
+
+/* converts a dotted IPv4 netmask into a prefix length or -1 */
+static int rtnl_mask_len ( const char * const mask )
+{
+  int n = 0 ;
+  uint32_t m ;
+  struct in_addr a ;
+
+  if ( 1 != inet_pton ( AF_INET, mask, & a ) ) { return -1 ; }
+
+  for ( m = ntohl ( a . s_addr ) ; 0x80000000U & m ; m <<= 1 ) { ++ n ; }
+
+  /* no holes */
+  return m ? -1 : n ;
+}
+
+/* the prefix length of the class of an IPv4 address, like the kernel
+ * sets it for SIOCSIFADDR without a netmask
+ */
+static int rtnl_class_len ( const unsigned char * const addr )
+{
+  if ( 128 > addr [ 0 ] ) { return 8 ; }
+  if ( 192 > addr [ 0 ] ) { return 16 ; }
+  if ( 224 > addr [ 0 ] ) { return 24 ; }
+
+  return 32 ;
+}
+
+static size_t rtnl_addr_len ( const int family )
+{
+  return ( AF_INET6 == family ) ? 16 : 4 ;
+}
+
+/* queues setting the state and/or mtu of an interface, up < 0: keep */
+static int rtnl_link_set ( rtnl_t * const rt, const char * const name,
+  const int up, const uint32_t mtu )
+{
+  struct ifinfomsg * ifi ;
+
+  ifi = (struct ifinfomsg *) rtnl_msg ( rt, RTM_SETLINK, 0, sizeof ( struct ifinfomsg ) ) ;
+  if ( NULL == ifi ) { return -1 ; }
+  ifi -> ifi_family = AF_UNSPEC ;
+
+  if ( 0 <= up ) {
+    ifi -> ifi_change = IFF_UP ;
+    ifi -> ifi_flags = up ? IFF_UP : 0 ;
+  }
+
+  /* the kernel looks the interface up by name */
+  if ( rtnl_attr ( rt, IFLA_IFNAME, name, 1 + strlen ( name ) ) ) { return -1 ; }
+  if ( mtu && rtnl_attr_u32 ( rt, IFLA_MTU, mtu ) ) { return -1 ; }
+
+  return 0 ;
+}
+
+/* queues adding (or deleting) an address of an interface */
+static int rtnl_addr_set ( rtnl_t * const rt, const int index, const rtnl_prefix_t * const pp,
+  const int del, const int bcast )
+{
+  struct ifaddrmsg * ifa ;
+  const size_t alen = rtnl_addr_len ( pp -> family ) ;
+
+  ifa = (struct ifaddrmsg *) rtnl_msg ( rt, del ? RTM_DELADDR : RTM_NEWADDR,
+    del ? 0 : NLM_F_CREATE | NLM_F_REPLACE, sizeof ( struct ifaddrmsg ) ) ;
+  if ( NULL == ifa ) { return -1 ; }
+  ifa -> ifa_family = pp -> family ;
+  ifa -> ifa_prefixlen = pp -> plen ;
+  ifa -> ifa_index = index ;
+  ifa -> ifa_scope = RT_SCOPE_UNIVERSE ;
+
+  /* like ip(8): loopback addresses are host scoped */
+  if ( ( AF_INET == pp -> family && 127 == pp -> addr [ 0 ] )
+    || ( AF_INET6 == pp -> family && IN6_IS_ADDR_LOOPBACK ( (const struct in6_addr *) pp -> addr ) ) )
+  {
+    ifa -> ifa_scope = RT_SCOPE_HOST ;
+  }
+
+  if ( rtnl_attr ( rt, IFA_LOCAL, pp -> addr, alen )
+    || rtnl_attr ( rt, IFA_ADDRESS, pp -> addr, alen ) )
+  {
+    return -1 ;
+  }
+
+  if ( bcast && AF_INET == pp -> family && 31 > pp -> plen ) {
+    uint32_t a ;
+
+    (void) memcpy ( & a, pp -> addr, 4 ) ;
+    a |= htonl ( 0xffffffffU >> pp -> plen ) ;
+    if ( rtnl_attr ( rt, IFA_BROADCAST, & a, 4 ) ) { return -1 ; }
+  }
+
+  return 0 ;
+}
+
+/* queues adding (or deleting) a route. via may have family 0 (none),
+ * index 0 means any interface, table 0 the main table.
+ */
+static int rtnl_route_set ( rtnl_t * const rt, const rtnl_prefix_t * const dst,
+  const rtnl_prefix_t * const via, const int index, const uint32_t metric,
+  const uint32_t table, const int del )
+{
+  struct rtmsg * rtm ;
+  const int family = dst -> family ? dst -> family : ( via -> family ? via -> family : AF_INET ) ;
+
+  rtm = (struct rtmsg *) rtnl_msg ( rt, del ? RTM_DELROUTE : RTM_NEWROUTE,
+    del ? 0 : NLM_F_CREATE | NLM_F_REPLACE, sizeof ( struct rtmsg ) ) ;
+  if ( NULL == rtm ) { return -1 ; }
+  rtm -> rtm_family = family ;
+  rtm -> rtm_dst_len = dst -> plen ;
+  rtm -> rtm_table = ( 0 == table ) ? RT_TABLE_MAIN : ( ( 256 > table ) ? table : RT_TABLE_UNSPEC ) ;
+  rtm -> rtm_protocol = del ? RTPROT_UNSPEC : RTPROT_BOOT ;
+  rtm -> rtm_scope = del ? RT_SCOPE_NOWHERE : ( via -> family ? RT_SCOPE_UNIVERSE : RT_SCOPE_LINK ) ;
+  rtm -> rtm_type = del ? RTN_UNSPEC : RTN_UNICAST ;
+
+  if ( dst -> family && dst -> plen
+    && rtnl_attr ( rt, RTA_DST, dst -> addr, rtnl_addr_len ( family ) ) )
+  {
+    return -1 ;
+  }
+
+  if ( via -> family && rtnl_attr ( rt, RTA_GATEWAY, via -> addr, rtnl_addr_len ( via -> family ) ) ) {
+    return -1 ;
+  }
+
+  if ( index && rtnl_attr_u32 ( rt, RTA_OIF, index ) ) { return -1 ; }
+  if ( metric && rtnl_attr_u32 ( rt, RTA_PRIORITY, metric ) ) { return -1 ; }
+  if ( 255 < table && rtnl_attr_u32 ( rt, RTA_TABLE, table ) ) { return -1 ; }
+
+  return 0 ;
+}
+
+/* commits the batch of a single call and pushes the result like
+ * res_zero() with the errno of the first failed message
+ */
+static int rtnl_done ( lua_State * const L, rtnl_t * const rt )
+{
+  int e ;
+  size_t i ;
+  long r = rtnl_commit ( rt ) ;
+
+  for ( i = 0 ; 0 < r && rt -> nerr > i ; ++ i ) {
+    if ( rt -> err [ i ] ) {
+      errno = rt -> err [ i ] ;
+      break ;
+    }
+  }
+
+  e = errno ;
+  rtnl_close ( rt ) ;
+  errno = e ;
+
+  return res_zero ( L, r ) ;
+}
+
+/* reads an optional integer field at index (0 if nil) into * vp without
+ * raising errors, returns -1 if it is neither nil nor an integer
+ */
+static int rtnl_optint ( lua_State * const L, const int index, lua_Integer * const vp )
+{
+  int ok = 1 ;
+
+  * vp = lua_isnil ( L, index ) ? 0 : lua_tointegerx ( L, index, & ok ) ;
+  return ok ? 0 : -1 ;
+}
 #endif
 
-/* if_* - basic ifconfig like operations on a given interface */
-static int Lif_up ( lua_State * L )
+/* net_config ( ops )
+ * applies an array of changes in one batch, every op is a table:
+ *   { link = "eth0" [, up = true|false] [, mtu = 9000] }
+ *   { addr = "10.0.0.2/24", dev = "eth0" [, broadcast = true] [, del = true] }
+ *   { route = "10.1.0.0/16" | "default" [, via = "10.0.0.1"] [, dev = "eth0"]
+ *     [, metric = 1] [, table = 100] [, del = true] }
+ * returns true or false, the message of the first error, its errno and
+ * a table that maps the indices of the failed ops to their errno. an
+ * unknown dev fails only its own op (ENODEV), the others are applied.
+ */
+static int Lnet_config ( lua_State * const L )
 {
 #if defined (OSLinux)
-  const int n = lua_gettop ( L ) ;
-
-  if ( 0 < n && 0 != lua_isstring ( L, 1 ) ) {
-    int fd, i, r = 0 ;
-    struct ifreq ifr ;
-    struct sockaddr_in * sin = (struct sockaddr_in *) & ifr . ifr_addr ;
-    const char * ifname = luaL_checkstring ( L, 1 ) ;
-    const char * addr = ( 1 < n ) ? luaL_checkstring ( L, 2 ) : NULL ;
-    const char * mask = ( 2 < n ) ? luaL_checkstring ( L, 3 ) : NULL ;
-
-    if ( ! ( ifname && * ifname ) ) {
-      return luaL_argerror ( L, 1, "invalid interface name" ) ;
+  size_t i, n, skipped = 0 ;
+  long r ;
+  int e ;
+  int * oerr ;
+  size_t * mop ;
+  rtnl_t rt ;
+  rtnl_prefix_t dst, via ;
+  const char * s, * dev ;
+
+  luaL_checktype ( L, 1, LUA_TTABLE ) ;
+  lua_settop ( L, 1 ) ;
+  n = lua_rawlen ( L, 1 ) ;
+  /* the op of every queued message and the errno of every op */
+  mop = (size_t *) lua_newuserdata ( L, n * ( sizeof ( size_t ) + sizeof ( int ) ) ) ;
+  oerr = (int *) ( mop + n ) ;
+  (void) memset ( oerr, 0, n * sizeof ( int ) ) ;
+  if ( rtnl_open ( & rt ) ) { return res_bool_zero ( L, -1 ) ; }
+
+  for ( i = 1 ; n >= i ; ++ i ) {
+    lua_rawgeti ( L, 1, i ) ;
+
+    if ( ! lua_istable ( L, -1 ) ) {
+      rtnl_close ( & rt ) ;
+      return luaL_error ( L, "op %d: table expected", (int) i ) ;
     }
 
-    fd = socket ( PF_INET, SOCK_DGRAM, IPPROTO_IP ) ;
+    lua_getfield ( L, -1, "link" ) ;
+    lua_getfield ( L, -2, "addr" ) ;
+    lua_getfield ( L, -3, "route" ) ;
+    lua_getfield ( L, -4, "dev" ) ;
+    dev = lua_tostring ( L, -1 ) ;
+    r = 0 ;
+
+    if ( ( s = lua_tostring ( L, -4 ) ) ) {
+      int up = -1 ;
+      lua_Integer mtu ;
+
+      lua_getfield ( L, -5, "up" ) ;
+      if ( ! lua_isnil ( L, -1 ) ) { up = lua_toboolean ( L, -1 ) ; }
+      lua_getfield ( L, -6, "mtu" ) ;
+      e = rtnl_optint ( L, -1, & mtu ) ;
+      lua_pop ( L, 2 ) ;
+
+      if ( e || 0 > mtu || UINT32_MAX < mtu || IFNAMSIZ <= strlen ( s ) ) {
+        rtnl_close ( & rt ) ;
+        return luaL_error ( L, "op %d: invalid interface or mtu", (int) i ) ;
+      }
 
-    if ( 0 > fd ) {
-      i = errno ;
-      lua_pushinteger ( L, -9 ) ;
-      lua_pushinteger ( L, i ) ;
-      return 2 ;
-    }
+      r = rtnl_link_set ( & rt, s, up, mtu ) ;
+    } else if ( ( s = lua_tostring ( L, -3 ) ) ) {
+      int index, del, bcast ;
 
-    (void) memset( & ifr, 0, sizeof ( ifr ) ) ;
-    ifr . ifr_addr . sa_family = AF_INET ;
-    (void) strncpy ( ifr . ifr_name, ifname, IFNAMSIZ - 1 ) ;
+      if ( rtnl_parse_prefix ( s, & dst ) || 0 == dst . family || NULL == dev ) {
+        rtnl_close ( & rt ) ;
+        return luaL_error ( L, "op %d: invalid address or no dev", (int) i ) ;
+      }
+
+      index = rtnl_ifindex ( & rt, dev ) ;
 
-    if ( addr && * addr ) {
-      if ( 1 == inet_pton ( AF_INET, addr, & sin -> sin_addr ) ) {
-        r = ioctl ( fd, SIOCSIFADDR, & ifr ) ;
+      if ( 0 == index ) {
+        oerr [ i - 1 ] = errno ;
+        ++ skipped ;
+        lua_pop ( L, 5 ) ;
+        continue ;
       }
 
-      if ( mask && strcmp ( addr, "0.0.0.0" ) &&
-        ( 1 == inet_pton ( AF_INET, mask, & sin -> sin_addr ) ) )
+      lua_getfield ( L, -5, "del" ) ;
+      del = lua_toboolean ( L, -1 ) ;
+      lua_getfield ( L, -6, "broadcast" ) ;
+      bcast = lua_toboolean ( L, -1 ) ;
+      lua_pop ( L, 2 ) ;
+      r = rtnl_addr_set ( & rt, index, & dst, del, bcast ) ;
+    } else if ( ( s = lua_tostring ( L, -2 ) ) ) {
+      int index = 0, del ;
+      lua_Integer metric, table ;
+
+      lua_getfield ( L, -5, "via" ) ;
+      lua_getfield ( L, -6, "del" ) ;
+      lua_getfield ( L, -7, "metric" ) ;
+      lua_getfield ( L, -8, "table" ) ;
+      del = lua_toboolean ( L, -3 ) ;
+      e = rtnl_optint ( L, -2, & metric ) | rtnl_optint ( L, -1, & table ) ;
+      (void) memset ( & via, 0, sizeof ( via ) ) ;
+
+      if ( e || rtnl_parse_prefix ( s, & dst )
+        || ( lua_isstring ( L, -4 ) && ( rtnl_parse_prefix ( lua_tostring ( L, -4 ), & via )
+          || 0 == via . family ) )
+        || ( dst . family && via . family && dst . family != via . family )
+        || ( NULL == dev && 0 == via . family )
+        || 0 > metric || UINT32_MAX < metric || 0 > table || UINT32_MAX < table )
       {
-        /* set netmask of non-zero ip address */
-        r += ioctl ( fd, SIOCSIFNETMASK, & ifr ) ;
+        rtnl_close ( & rt ) ;
+        return luaL_error ( L, "op %d: invalid route", (int) i ) ;
       }
-    }
 
-    i = ioctl ( fd, SIOCGIFFLAGS, & ifr ) ;
-    r += i ;
+      lua_pop ( L, 4 ) ;
 
-    if ( 0 == i ) {
-      ifr . ifr_flags |= IFF_UP ;
-      r += ioctl ( fd, SIOCSIFFLAGS, & ifr ) ;
+      if ( dev && 0 == ( index = rtnl_ifindex ( & rt, dev ) ) ) {
+        oerr [ i - 1 ] = errno ;
+        ++ skipped ;
+        lua_pop ( L, 5 ) ;
+        continue ;
+      }
+
+      r = rtnl_route_set ( & rt, & dst, & via, index, metric, table, del ) ;
+    } else {
+      rtnl_close ( & rt ) ;
+      return luaL_error ( L, "op %d: link, addr or route expected", (int) i ) ;
     }
 
-    i = errno ;
-    (void) close_fd ( fd ) ;
-    lua_pushinteger ( L, r ) ;
+    lua_pop ( L, 5 ) ;
 
     if ( r ) {
-      lua_pushinteger ( L, ( 0 < i ) ? i : errno ) ;
-      return 2 ;
+      e = errno ;
+      rtnl_close ( & rt ) ;
+      errno = e ;
+      return res_bool_zero ( L, -1 ) ;
     }
 
+    mop [ rt . n - 1 ] = i - 1 ;
+  }
+
+  r = rtnl_commit ( & rt ) ;
+
+  if ( 0 > r ) {
+    e = errno ;
+    rtnl_close ( & rt ) ;
+    errno = e ;
+    return res_bool_zero ( L, -1 ) ;
+  } else if ( 0 == r && 0 == skipped ) {
+    rtnl_close ( & rt ) ;
+    lua_pushboolean ( L, 1 ) ;
     return 1 ;
   }
 
-  return luaL_error ( L, "interface name expected" ) ;
+  for ( i = 0 ; rt . nerr > i ; ++ i ) { oerr [ mop [ i ] ] = rt . err [ i ] ; }
+
+  lua_pushboolean ( L, 0 ) ;
+  lua_pushnil ( L ) ;
+  lua_pushnil ( L ) ;
+  lua_newtable ( L ) ;
+
+  for ( i = 0, e = 0 ; n > i ; ++ i ) {
+    if ( oerr [ i ] ) {
+      if ( 0 == e ) { e = oerr [ i ] ; }
+      lua_pushinteger ( L, oerr [ i ] ) ;
+      lua_rawseti ( L, -2, 1 + i ) ;
+    }
+  }
+
+  (void) lua_pushfstring ( L, "%s (errno %d)", strerror ( e ), e ) ;
+  lua_replace ( L, -4 ) ;
+  lua_pushinteger ( L, e ) ;
+  lua_replace ( L, -3 ) ;
+  rtnl_close ( & rt ) ;
+
+  return 4 ;
 #else
   return luaL_error ( L, "OS not supported" ) ;
 #endif
 }
 
-static int Lif_down ( lua_State * L )
+/* enable the loopback interface */
+static int l_setup_iface_lo ( lua_State * const L )
 {
 #if defined (OSLinux)
+  int index ;
+  rtnl_t rt ;
+  rtnl_prefix_t lo ;
+
+  if ( rtnl_open ( & rt ) ) { return res_zero ( L, -1 ) ; }
+  (void) rtnl_parse_prefix ( "127.0.0.1/8", & lo ) ;
+  index = rtnl_ifindex ( & rt, "lo" ) ;
+
+  if ( 0 == index || rtnl_addr_set ( & rt, index, & lo, 0, 0 )
+    || rtnl_link_set ( & rt, "lo", 1, 0 ) )
+  {
+    const int e = errno ;
+    rtnl_close ( & rt ) ;
+    errno = e ;
+    return res_zero ( L, -1 ) ;
+  }
+
+  return rtnl_done ( L, & rt ) ;
+#else
+  return luaL_error ( L, "OS not supported" ) ;
+#endif
+}
+
+/* if_* - basic ifconfig like operations on a given interface */
+
+/* if_up ( ifname [, addr [, netmask]] )
+ * without a netmask the address gets the length of its class
+ */
+static int Lif_up ( lua_State * const L )
+{
+#if defined (OSLinux)
+  int index ;
+  rtnl_t rt ;
+  rtnl_prefix_t pre ;
   const char * ifname = luaL_checkstring ( L, 1 ) ;
+  const char * addr = luaL_optstring ( L, 2, NULL ) ;
+  const char * mask = luaL_optstring ( L, 3, NULL ) ;
 
-  if ( ifname && * ifname ) {
-    int i, r = 0 ;
-    struct ifreq ifr ;
-    const int fd = socket ( PF_INET, SOCK_DGRAM, IPPROTO_IP ) ;
+  if ( 0 == * ifname || IFNAMSIZ <= strlen ( ifname ) ) {
+    return luaL_argerror ( L, 1, "invalid interface name" ) ;
+  }
 
-    if ( 0 > fd ) {
-      i = errno ;
-      lua_pushinteger ( L, -9 ) ;
-      lua_pushinteger ( L, i ) ;
-      return 2 ;
-    }
+  if ( addr && * addr && ( rtnl_parse_prefix ( addr, & pre ) || AF_INET != pre . family ) ) {
+    return luaL_argerror ( L, 2, "invalid ip address" ) ;
+  }
 
-    (void) memset( & ifr, 0, sizeof ( ifr ) ) ;
-    ifr . ifr_addr . sa_family = AF_INET ;
-    (void) strncpy ( ifr . ifr_name, ifname, IFNAMSIZ - 1 ) ;
-    r = ioctl ( fd, SIOCGIFFLAGS, & ifr ) ;
+  if ( addr && * addr && mask && * mask && 0 > ( pre . plen = rtnl_mask_len ( mask ) ) ) {
+    return luaL_argerror ( L, 3, "invalid netmask" ) ;
+  }
 
-    if ( 0 == r ) {
-      ifr . ifr_flags &= ~ ( IFF_UP ) ;
-      r += ioctl ( fd, SIOCSIFFLAGS, & ifr ) ;
-    }
+  if ( addr && * addr && ( NULL == mask || 0 == * mask ) && NULL == strchr ( addr, '/' ) ) {
+    pre . plen = rtnl_class_len ( pre . addr ) ;
+  }
 
-    i = errno ;
-    (void) close_fd ( fd ) ;
-    lua_pushinteger ( L, r ) ;
+  if ( rtnl_open ( & rt ) ) { return res_zero ( L, -1 ) ; }
 
-    if ( r ) {
-      lua_pushinteger ( L, ( 0 < i ) ? i : errno ) ;
-      return 2 ;
+  /* 0.0.0.0 only brings the interface up */
+  if ( addr && * addr && ( pre . addr [ 0 ] || pre . addr [ 1 ] || pre . addr [ 2 ] || pre . addr [ 3 ] ) ) {
+    index = rtnl_ifindex ( & rt, ifname ) ;
+
+    if ( 0 == index || rtnl_addr_set ( & rt, index, & pre, 0, 1 ) ) {
+      const int e = errno ;
+      rtnl_close ( & rt ) ;
+      errno = e ;
+      return res_zero ( L, -1 ) ;
     }
+  }
 
-    return 1 ;
+  if ( rtnl_link_set ( & rt, ifname, 1, 0 ) ) {
+    rtnl_close ( & rt ) ;
+    return res_zero ( L, -1 ) ;
   }
 
-  return luaL_argerror ( L, 1, "invalid interface name" ) ;
+  return rtnl_done ( L, & rt ) ;
 #else
   return luaL_error ( L, "OS not supported" ) ;
 #endif
 }
 
-/*
- * some route(8) functionality.
- * this is *way* incomplete for now.
- * it can only be used to set the netmask and default gateway
- * of network interfaces.
- */
-
-/* sets the netmask */
-static int Lroute_add_netmask ( lua_State * L )
+/* if_down ( ifname ) */
+static int Lif_down ( lua_State * const L )
 {
 #if defined (OSLinux)
+  rtnl_t rt ;
   const char * ifname = luaL_checkstring ( L, 1 ) ;
-  const char * addr = luaL_checkstring ( L, 2 ) ;
-  const char * mask = luaL_checkstring ( L, 3 ) ;
 
-  if ( addr && mask && ifname && * addr && * mask && * ifname ) {
-    int i, fd ;
-    struct rtentry rte ;
+  if ( 0 == * ifname || IFNAMSIZ <= strlen ( ifname ) ) {
+    return luaL_argerror ( L, 1, "invalid interface name" ) ;
+  }
+
+  if ( rtnl_open ( & rt ) ) { return res_zero ( L, -1 ) ; }
 
-    (void) memset ( & rte, 0, sizeof ( rte ) ) ;
-    rte . rt_dst . sa_family = AF_INET ;
-    rte . rt_genmask . sa_family = AF_INET ;
-    rte . rt_gateway . sa_family = AF_INET ;
-    rte . rt_flags = RTF_UP ;
-    rte . rt_metric = 0 ;
-    rte . rt_dev = (char *) ifname ;
+  if ( rtnl_link_set ( & rt, ifname, 0, 0 ) ) {
+    rtnl_close ( & rt ) ;
+    return res_zero ( L, -1 ) ;
+  }
 
-    i = inet_aton ( addr,
-      & ( ( * (struct sockaddr_in *) & rte . rt_dst ) . sin_addr ) ) ;
+  return rtnl_done ( L, & rt ) ;
+#else
+  return luaL_error ( L, "OS not supported" ) ;
+#endif
+}
 
-    if ( 0 == i ) {
-      return luaL_argerror ( L, 2, "invalid ip address" ) ;
-    }
+/* if_down_all ()
+ * brings all interfaces but the loopback down in one batch,
+ * traffic shapers first.
+ */
+static int Lif_down_all ( lua_State * const L )
+{
+#if defined (OSLinux)
+  int shaper ;
+  size_t i ;
+  rtnl_t rt ;
 
-    i = inet_aton ( mask,
-      & ( ( * (struct sockaddr_in *) & rte . rt_genmask ) . sin_addr ) ) ;
+  if ( rtnl_open ( & rt ) ) { return res_zero ( L, -1 ) ; }
 
-    if ( 0 == i ) {
-      return luaL_argerror ( L, 3, "invalid netmask" ) ;
-    }
+  if ( rtnl_dump_links ( & rt ) ) {
+    const int e = errno ;
+    rtnl_close ( & rt ) ;
+    errno = e ;
+    return res_zero ( L, -1 ) ;
+  }
 
-    fd = socket ( AF_INET, SOCK_RAW | SOCK_CLOEXEC, IPPROTO_RAW ) ;
+  for ( shaper = 1 ; 0 <= shaper ; -- shaper ) {
+    for ( i = 0 ; rt . nlinks > i ; ++ i ) {
+      const rtnl_link_t * lp = rt . links + i ;
 
-    if ( 0 > fd ) {
-      i = errno ;
-      lua_pushinteger ( L, -3 ) ;
-      lua_pushinteger ( L, i ) ;
-      return 2 ;
-    }
+      if ( ( IFF_LOOPBACK & lp -> flags ) || 0 == ( IFF_UP & lp -> flags ) ) { continue ; }
+      if ( ( 0 == strncmp ( lp -> name, "shaper", 6 ) ) != shaper ) { continue ; }
 
-    i = ioctl ( fd, SIOCADDRT, & rte ) ;
-    if ( i ) { i = errno ? errno : -1 ; }
-    (void) close_fd ( fd ) ;
-    if ( 0 < i ) { errno = i ; }
-    return res_zero ( L, i ) ;
+      if ( rtnl_link_set ( & rt, lp -> name, 0, 0 ) ) {
+        rtnl_close ( & rt ) ;
+        return res_zero ( L, -1 ) ;
+      }
+    }
   }
 
-  return luaL_error ( L, "3 non empty string args expected" ) ;
+  return rtnl_done ( L, & rt ) ;
 #else
   return luaL_error ( L, "OS not supported" ) ;
 #endif
 }
 
-/* sets the default gateway */
-static int Lroute_add_defgw ( lua_State * L )
+/*
+ * some route(8) functionality, see net_config() for more.
+ */
+
+/* route_add_netmask ( ifname, addr, netmask ) adds a link route */
+static int Lroute_add_netmask ( lua_State * const L )
 {
 #if defined (OSLinux)
+  int index ;
+  rtnl_t rt ;
+  rtnl_prefix_t dst, via ;
   const char * ifname = luaL_checkstring ( L, 1 ) ;
-  const char * gw = luaL_checkstring ( L, 2 ) ;
+  const char * addr = luaL_checkstring ( L, 2 ) ;
+  const char * mask = luaL_checkstring ( L, 3 ) ;
 
-  if ( gw && ifname && * gw && * ifname ) {
-    int i, fd ;
-    struct rtentry rte ;
+  if ( rtnl_parse_prefix ( addr, & dst ) || AF_INET != dst . family ) {
+    return luaL_argerror ( L, 2, "invalid ip address" ) ;
+  }
 
-    (void) memset ( & rte, 0, sizeof ( rte ) ) ;
-    rte . rt_dst . sa_family = AF_INET ;
-    rte . rt_genmask . sa_family = AF_INET ;
-    rte . rt_gateway . sa_family = AF_INET ;
-    rte . rt_flags = RTF_UP | RTF_GATEWAY ;
-    rte . rt_metric = 1 ;
-    rte . rt_dev = (char *) ifname ;
+  if ( 0 > ( dst . plen = rtnl_mask_len ( mask ) ) ) {
+    return luaL_argerror ( L, 3, "invalid netmask" ) ;
+  }
 
-    i = inet_aton ( gw,
-      & ( ( * (struct sockaddr_in *) & rte . rt_gateway ) . sin_addr ) ) ;
+  (void) memset ( & via, 0, sizeof ( via ) ) ;
+  if ( rtnl_open ( & rt ) ) { return res_zero ( L, -1 ) ; }
+  index = rtnl_ifindex ( & rt, ifname ) ;
 
-    if ( 0 == i ) {
-      return luaL_argerror ( L, 2, "invalid ip address" ) ;
-    }
+  if ( 0 == index || rtnl_route_set ( & rt, & dst, & via, index, 0, 0, 0 ) ) {
+    const int e = errno ;
+    rtnl_close ( & rt ) ;
+    errno = e ;
+    return res_zero ( L, -1 ) ;
+  }
 
-    fd = socket ( AF_INET, SOCK_RAW | SOCK_CLOEXEC, IPPROTO_RAW ) ;
+  return rtnl_done ( L, & rt ) ;
+#else
+  return luaL_error ( L, "OS not supported" ) ;
+#endif
+}
 
-    if ( 0 > fd ) {
-      i = errno ;
-      lua_pushinteger ( L, -3 ) ;
-      lua_pushinteger ( L, i ) ;
-      return 2 ;
-    }
+/* route_add_defgw ( ifname, gateway ) sets the default gateway */
+static int Lroute_add_defgw ( lua_State * const L )
+{
+#if defined (OSLinux)
+  int index ;
+  rtnl_t rt ;
+  rtnl_prefix_t dst, via ;
+  const char * ifname = luaL_checkstring ( L, 1 ) ;
+  const char * gw = luaL_checkstring ( L, 2 ) ;
+
+  if ( rtnl_parse_prefix ( gw, & via ) || 0 == via . family ) {
+    return luaL_argerror ( L, 2, "invalid ip address" ) ;
+  }
+
+  (void) memset ( & dst, 0, sizeof ( dst ) ) ;
+  if ( rtnl_open ( & rt ) ) { return res_zero ( L, -1 ) ; }
+  index = rtnl_ifindex ( & rt, ifname ) ;
 
-    i = ioctl ( fd, SIOCADDRT, & rte ) ;
-    if ( i ) { i = errno ? errno : -1 ; }
-    (void) close_fd ( fd ) ;
-    if ( 0 < i ) { errno = i ; }
-    return res_zero ( L, i ) ;
+  if ( 0 == index || rtnl_route_set ( & rt, & dst, & via, index, 0, 0, 0 ) ) {
+    const int e = errno ;
+    rtnl_close ( & rt ) ;
+    errno = e ;
+    return res_zero ( L, -1 ) ;
   }
 
-  return luaL_error ( L, "2 non empty string args expected" ) ;
+  return rtnl_done ( L, & rt ) ;
 #else
   return luaL_error ( L, "OS not supported" ) ;
 #endif
 }
-
@@ -0,0 +1,374 @@
+/*
+ * recursive removal of directory trees
+ *
+ * directories are read in bulk with getdents64(2) (Linux) and the d_type
+ * of the entries is used to avoid a fstatat(2) per entry. every directory
+ * is a job on a shared stack that can be processed by a bounded pool of
+ * threads, a directory is removed by whoever finishes its last entry.
+ * all paths are resolved relative to the fd of the parent directory.
+ *
+ * public domain code
+ */
+
+#define RMTREE_BUFSIZE		( 64 * 1024 )
+#define RMTREE_MAX_THREADS	64
+#define RMTREE_MAX_FAILED	64
+
+typedef struct rmtree_dir_s rmtree_dir_t ;
+
+struct rmtree_dir_s {
+  rmtree_dir_t * parent ;
+  rmtree_dir_t * next ;
+  int fd ;
+  /* entries not yet removed, + 1 while the dir is read */
+  int pending ;
+  char failed ;
+  char name [ 1 ] ;
+} ;
+
+typedef struct {
+  /* options */
+  int threads ;
+  char one_fs ;
+  char dry_run ;
+  /* results */
+  unsigned long files ;
+  unsigned long dirs ;
+  unsigned long errors ;
+  int nfailed ;
+  struct {
+    int err ;
+    char * path ;
+  } failed [ RMTREE_MAX_FAILED ] ;
+  /* state of the current run */
+  int rootfd ;
+  dev_t dev ;
+  int busy ;
+  char done ;
+  rmtree_dir_t * stack ;
+  pthread_mutex_t mu ;
+  pthread_cond_t cv ;
+} rmtree_t ;
+
+static void rmtree_init ( rmtree_t * const rt, const int threads,
+  const char one_fs, const char dry_run )
+{
+  (void) memset ( rt, 0, sizeof ( rmtree_t ) ) ;
+  rt -> threads = ( 0 < threads ) ? threads : 1 ;
+  if ( RMTREE_MAX_THREADS < rt -> threads ) { rt -> threads = RMTREE_MAX_THREADS ; }
+  rt -> one_fs = one_fs ;
+  rt -> dry_run = dry_run ;
+  (void) pthread_mutex_init ( & rt -> mu, NULL ) ;
+  (void) pthread_cond_init ( & rt -> cv, NULL ) ;
+}
+
+static void rmtree_free ( rmtree_t * const rt )
+{
+  int i ;
+
+  for ( i = 0 ; rt -> nfailed > i ; ++ i ) { free ( rt -> failed [ i ] . path ) ; }
+
+  rt -> nfailed = 0 ;
+  (void) pthread_mutex_destroy ( & rt -> mu ) ;
+  (void) pthread_cond_destroy ( & rt -> cv ) ;
+}
+
+/* records an error for the entry name in dir dp (or dp itself) */
+static void rmtree_fail ( rmtree_t * const rt, const rmtree_dir_t * const dp,
+  const char * const name, const int err )
+{
+  size_t l = name ? 1 + strlen ( name ) : 0 ;
+  char * p = NULL ;
+  const rmtree_dir_t * d ;
+
+  for ( d = dp ; d ; d = d -> parent ) { l += 1 + strlen ( d -> name ) ; }
+
+  (void) pthread_mutex_lock ( & rt -> mu ) ;
+  ++ rt -> errors ;
+
+  if ( RMTREE_MAX_FAILED > rt -> nfailed && NULL != ( p = (char *) malloc ( l ) ) ) {
+    /* build the path from the end */
+    p [ -- l ] = '\0' ;
+
+    if ( name ) {
+      l -= strlen ( name ) ;
+      (void) memcpy ( p + l, name, strlen ( name ) ) ;
+      p [ -- l ] = '/' ;
+    }
+
+    for ( d = dp ; d ; d = d -> parent ) {
+      l -= strlen ( d -> name ) ;
+      (void) memcpy ( p + l, d -> name, strlen ( d -> name ) ) ;
+      if ( l ) { p [ -- l ] = '/' ; }
+    }
+
+    rt -> failed [ rt -> nfailed ] . err = err ;
+    rt -> failed [ rt -> nfailed ++ ] . path = p ;
+  }
+
+  (void) pthread_mutex_unlock ( & rt -> mu ) ;
+}
+
+/* queues a subdir of dp */
+static void rmtree_push ( rmtree_t * const rt, rmtree_dir_t * const dp,
+  const char * const name )
+{
+  const size_t l = strlen ( name ) ;
+  rmtree_dir_t * const cp = (rmtree_dir_t *) malloc ( sizeof ( rmtree_dir_t ) + l ) ;
+
+  if ( NULL == cp ) {
+    rmtree_fail ( rt, dp, name, ENOMEM ) ;
+    (void) pthread_mutex_lock ( & rt -> mu ) ;
+    if ( dp ) { dp -> failed = 1 ; }
+    (void) pthread_mutex_unlock ( & rt -> mu ) ;
+    return ;
+  }
+
+  cp -> parent = dp ;
+  cp -> fd = -1 ;
+  cp -> pending = 1 ;
+  cp -> failed = 0 ;
+  (void) memcpy ( cp -> name, name, 1 + l ) ;
+
+  (void) pthread_mutex_lock ( & rt -> mu ) ;
+  if ( dp ) { ++ dp -> pending ; }
+  cp -> next = rt -> stack ;
+  rt -> stack = cp ;
+  (void) pthread_cond_signal ( & rt -> cv ) ;
+  (void) pthread_mutex_unlock ( & rt -> mu ) ;
+}
+
+/* called when dp has been read completely (or could not be read) and
+ * whenever one of its subdirs is done. the last call removes dp and
+ * continues with its parent.
+ */
+static void rmtree_finish ( rmtree_t * const rt, rmtree_dir_t * dp, char failed )
+{
+  int i ;
+  rmtree_dir_t * pp ;
+
+  while ( dp ) {
+    (void) pthread_mutex_lock ( & rt -> mu ) ;
+    if ( failed ) { dp -> failed = 1 ; }
+    i = -- dp -> pending ;
+    failed = dp -> failed ;
+    (void) pthread_mutex_unlock ( & rt -> mu ) ;
+
+    if ( 0 < i ) { return ; }
+
+    pp = dp -> parent ;
+    if ( 0 <= dp -> fd ) { CLOSEFD( dp -> fd ) }
+
+    /* a dir with entries left can not be removed, its parent neither,
+     * but only the entries that failed are reported.
+     */
+    if ( 0 == failed ) {
+      if ( rt -> dry_run || 0 == unlinkat ( pp ? pp -> fd : rt -> rootfd,
+        dp -> name, AT_REMOVEDIR ) )
+      {
+        (void) pthread_mutex_lock ( & rt -> mu ) ;
+        ++ rt -> dirs ;
+        (void) pthread_mutex_unlock ( & rt -> mu ) ;
+      } else {
+        rmtree_fail ( rt, dp, NULL, errno ) ;
+        failed = 1 ;
+      }
+    }
+
+    free ( dp ) ;
+    dp = pp ;
+  }
+}
+
+/* removes a single entry of dir dp, subdirs are queued.
+ * returns 0 or an errno value.
+ */
+static int rmtree_entry ( rmtree_t * const rt, rmtree_dir_t * const dp,
+  const char * const name, unsigned char type, unsigned long * const np )
+{
+  struct stat st ;
+
+  if ( '.' == name [ 0 ] && ( '\0' == name [ 1 ]
+    || ( '.' == name [ 1 ] && '\0' == name [ 2 ] ) ) )
+  {
+    return 0 ;
+  }
+
+  if ( DT_UNKNOWN == type ) {
+    if ( fstatat ( dp -> fd, name, & st, AT_SYMLINK_NOFOLLOW ) ) {
+      return ( ENOENT == errno ) ? 0 : errno ;
+    }
+    type = S_ISDIR( st . st_mode ) ? DT_DIR : DT_REG ;
+  }
+
+  if ( DT_DIR == type ) {
+    rmtree_push ( rt, dp, name ) ;
+  } else if ( rt -> dry_run || 0 == unlinkat ( dp -> fd, name, 0 ) ) {
+    ++ * np ;
+  } else if ( ENOENT != errno ) {
+    return errno ;
+  }
+
+  return 0 ;
+}
+
+/* reads the directory dp and removes/queues its entries */
+static void rmtree_scan ( rmtree_t * const rt, rmtree_dir_t * const dp, char * const buf )
+{
+  int e = 0 ;
+  char failed = 0 ;
+  unsigned long n = 0 ;
+  struct stat st ;
+
+  dp -> fd = openat ( dp -> parent ? dp -> parent -> fd : rt -> rootfd, dp -> name,
+    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC | O_NOCTTY ) ;
+
+  if ( 0 > dp -> fd ) {
+    rmtree_fail ( rt, dp, NULL, errno ) ;
+    rmtree_finish ( rt, dp, 1 ) ;
+    return ;
+  }
+
+  /* do not cross into other file systems (mount points) */
+  if ( rt -> one_fs && ( fstat ( dp -> fd, & st ) || st . st_dev != rt -> dev ) ) {
+    rmtree_fail ( rt, dp, NULL, EXDEV ) ;
+    rmtree_finish ( rt, dp, 1 ) ;
+    return ;
+  }
+
+#if defined (OSLinux) && defined (SYS_getdents64)
+  {
+    long r ;
+    size_t o ;
+    struct rmtree_dirent64 {
+      uint64_t d_ino ;
+      int64_t d_off ;
+      unsigned short d_reclen ;
+      unsigned char d_type ;
+      char d_name [ 1 ] ;
+    } * de ;
+
+    while ( 0 < ( r = syscall ( SYS_getdents64, dp -> fd, buf, RMTREE_BUFSIZE ) ) ) {
+      for ( o = 0 ; (size_t) r > o ; o += de -> d_reclen ) {
+        de = (struct rmtree_dirent64 *) ( buf + o ) ;
+
+        if ( ( e = rmtree_entry ( rt, dp, de -> d_name, de -> d_type, & n ) ) ) {
+          rmtree_fail ( rt, dp, de -> d_name, e ) ;
+          failed = 1 ;
+        }
+      }
+    }
+
+    if ( 0 > r ) {
+      rmtree_fail ( rt, dp, NULL, errno ) ;
+      failed = 1 ;
+    }
+  }
+#else
+  {
+    DIR * dirp ;
+    struct dirent * de ;
+    const int fd = dup ( dp -> fd ) ;
+
+    dirp = ( 0 <= fd ) ? fdopendir ( fd ) : NULL ;
+
+    if ( NULL == dirp ) {
+      rmtree_fail ( rt, dp, NULL, errno ) ;
+      if ( 0 <= fd ) { CLOSEFD( fd ) }
+      failed = 1 ;
+    } else {
+      while ( NULL != ( de = readdir ( dirp ) ) ) {
+        if ( ( e = rmtree_entry ( rt, dp, de -> d_name, de -> d_type, & n ) ) ) {
+          rmtree_fail ( rt, dp, de -> d_name, e ) ;
+          failed = 1 ;
+        }
+      }
+
+      (void) closedir ( dirp ) ;
+    }
+  }
+#endif
+
+  (void) pthread_mutex_lock ( & rt -> mu ) ;
+  rt -> files += n ;
+  (void) pthread_mutex_unlock ( & rt -> mu ) ;
+  rmtree_finish ( rt, dp, failed ) ;
+}
+
+/* takes queued dirs off the stack until all work is done */
+static void * rmtree_worker ( void * arg )
+{
+  rmtree_t * const rt = (rmtree_t *) arg ;
+  rmtree_dir_t * dp ;
+  char * const buf = (char *) malloc ( RMTREE_BUFSIZE ) ;
+
+  (void) pthread_mutex_lock ( & rt -> mu ) ;
+
+  while ( buf ) {
+    while ( NULL == rt -> stack && 0 == rt -> done ) {
+      if ( 0 == rt -> busy ) {
+        rt -> done = 1 ;
+        (void) pthread_cond_broadcast ( & rt -> cv ) ;
+      } else {
+        (void) pthread_cond_wait ( & rt -> cv, & rt -> mu ) ;
+      }
+    }
+
+    if ( rt -> done ) { break ; }
+
+    dp = rt -> stack ;
+    rt -> stack = dp -> next ;
+    ++ rt -> busy ;
+    (void) pthread_mutex_unlock ( & rt -> mu ) ;
+    rmtree_scan ( rt, dp, buf ) ;
+    (void) pthread_mutex_lock ( & rt -> mu ) ;
+    -- rt -> busy ;
+  }
+
+  (void) pthread_mutex_unlock ( & rt -> mu ) ;
+  free ( buf ) ;
+
+  return NULL ;
+}
+
+/* removes path (relative to dirfd) and everything below it.
+ * returns the number of errors of this call, the details are added
+ * to rt.
+ */
+static unsigned long rmtree ( const int dirfd, const char * const path,
+  rmtree_t * const rt )
+{
+  int i, n = 0 ;
+  struct stat st ;
+  pthread_t tid [ RMTREE_MAX_THREADS ] ;
+  const unsigned long e = rt -> errors ;
+
+  if ( fstatat ( dirfd, path, & st, AT_SYMLINK_NOFOLLOW ) ) {
+    if ( ENOENT != errno ) { rmtree_fail ( rt, NULL, path, errno ) ; }
+    return rt -> errors - e ;
+  }
+
+  if ( ! S_ISDIR( st . st_mode ) ) {
+    if ( rt -> dry_run || 0 == unlinkat ( dirfd, path, 0 ) ) { ++ rt -> files ; }
+    else { rmtree_fail ( rt, NULL, path, errno ) ; }
+    return rt -> errors - e ;
+  }
+
+  rt -> rootfd = dirfd ;
+  rt -> dev = st . st_dev ;
+  rt -> busy = 0 ;
+  rt -> done = 0 ;
+  rt -> stack = NULL ;
+  rmtree_push ( rt, NULL, path ) ;
+
+  for ( i = 1 ; rt -> threads > i ; ++ i ) {
+    if ( pthread_create ( tid + n, NULL, rmtree_worker, rt ) ) { break ; }
+    ++ n ;
+  }
+
+  (void) rmtree_worker ( rt ) ;
+
+  for ( i = 0 ; n > i ; ++ i ) { (void) pthread_join ( tid [ i ], NULL ) ; }
+
+  return rt -> errors - e ;
+}
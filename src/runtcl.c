@@ -64,6 +64,7 @@ objcmds:
 
 #include "common.h"
 #include <tcl.h>
+#include "fcopy.c"
 
 #ifdef WANT_TK
 # include <tk.h>
@@ -1659,9 +1660,18 @@ static int objcmd_fs_copy_file ( ClientData cd, Tcl_Interp * const T,
 {
   if ( 2 < objc ) {
     int i ;
+    const char * src = Tcl_FSGetNativePath ( objv [ 1 ] ) ;
+    const char * dst = NULL ;
 
     for ( i = 2 ; objc > i ; ++ i ) {
-      if ( Tcl_FSCopyFile ( objv [ 1 ], objv [ i ] ) != TCL_OK ) {
+      dst = src ? Tcl_FSGetNativePath ( objv [ i ] ) : NULL ;
+
+      if ( src && dst ) {
+        /* native files: copy data, permissions and times like "file copy" */
+        if ( fcopy_path ( src, dst, FCOPY_MODE | FCOPY_TIMES ) ) {
+          return psx_err ( T, errno, "copy_file" ) ;
+        }
+      } else if ( Tcl_FSCopyFile ( objv [ 1 ], objv [ i ] ) != TCL_OK ) {
         Tcl_AddErrorInfo ( T, "FSCopyFile() failed" ) ;
         return TCL_ERROR ;
       }
@@ -5,6 +5,11 @@
 /*
 */
 #include "common.h"
+#include "fcopy.c"
+#include "rmtree.c"
+#include "walk.c"
+#include "ptab.c"
+#include "patset.c"
 #include "helpers.c"
 #include "os_main.c"
 
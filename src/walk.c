@@ -0,0 +1,558 @@
+/*
+ * directory tree walker
+ *
+ * like nftw(3), but everything is done relative to the fd of the parent
+ * directory, directories are read in bulk with getdents64(2) (Linux) and
+ * entries are only stat'ed when a filter or the caller needs it.
+ * the entries are filtered in C and collected as records that the caller
+ * fetches in batches. subtrees can be walked by a pool of threads, which
+ * are throttled when the caller does not keep up.
+ *
+ * public domain code
+ */
+
+#define WALK_BUFSIZE		( 64 * 1024 )
+#define WALK_MAX_THREADS	64
+
+typedef struct walk_dir_s walk_dir_t ;
+
+struct walk_dir_s {
+  walk_dir_t * parent ;
+  walk_dir_t * next ;
+  int fd ;
+  /* 1 while the dir is read + subdirs not yet opened */
+  int refs ;
+  int depth ;
+  size_t plen ;
+  size_t name ;
+  char path [ 1 ] ;
+} ;
+
+/* a walked entry */
+typedef struct {
+  char * path ;
+  size_t name ;
+  int depth ;
+  int err ;
+  unsigned char type ;
+  char has_stat ;
+  uint64_t ino ;
+  mode_t mode ;
+  uid_t uid ;
+  gid_t gid ;
+  uint64_t nlink ;
+  int64_t size ;
+  int64_t mtime ;
+} walk_rec_t ;
+
+typedef struct {
+  /* options, set before walk_start() */
+  int threads ;
+  int maxdepth ;
+  int batch ;
+  char one_fs ;
+  char need_stat ;
+  char has_re ;
+  /* bit (1 << DT_xxx) set for the types to report, 0: all types */
+  unsigned int types ;
+  char * glob ;
+  regex_t re ;
+  int64_t min_size ;
+  int64_t max_size ;
+  int64_t newer ;
+  int64_t older ;
+  /* state */
+  int rootfd ;
+  dev_t dev ;
+  int nthreads ;
+  /* set while the walk is done by worker threads */
+  char bg ;
+  int busy ;
+  char done ;
+  char cancel ;
+  walk_dir_t * stack ;
+  size_t nrec ;
+  size_t maxrec ;
+  walk_rec_t * recs ;
+  pthread_t tid [ WALK_MAX_THREADS ] ;
+  pthread_mutex_t mu ;
+  pthread_cond_t cv ;
+} walk_t ;
+
+static void walk_init ( walk_t * const w )
+{
+  (void) memset ( w, 0, sizeof ( walk_t ) ) ;
+  w -> threads = 1 ;
+  w -> maxdepth = -1 ;
+  w -> batch = 256 ;
+  w -> min_size = -1 ;
+  w -> max_size = -1 ;
+  w -> rootfd = AT_FDCWD ;
+  (void) pthread_mutex_init ( & w -> mu, NULL ) ;
+  (void) pthread_cond_init ( & w -> cv, NULL ) ;
+}
+
+/* maps d_type values to the type letters used by find(1) */
+static char walk_type_char ( const unsigned char type )
+{
+  switch ( type ) {
+    case DT_REG : return 'f' ;
+    case DT_DIR : return 'd' ;
+    case DT_LNK : return 'l' ;
+    case DT_CHR : return 'c' ;
+    case DT_BLK : return 'b' ;
+    case DT_FIFO : return 'p' ;
+    case DT_SOCK : return 's' ;
+  }
+
+  return '?' ;
+}
+
+/* fills in the stat fields of rp, returns 0 or -1 */
+static int walk_stat ( const int dirfd, const char * const name, walk_rec_t * const rp )
+{
+#if defined (OSLinux) && defined (STATX_BASIC_STATS)
+  struct statx stx ;
+
+  if ( statx ( dirfd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+    STATX_TYPE | STATX_MODE | STATX_INO | STATX_UID | STATX_GID | STATX_NLINK
+    | STATX_SIZE | STATX_MTIME, & stx ) )
+  {
+    return -1 ;
+  }
+
+  rp -> mode = stx . stx_mode ;
+  rp -> ino = stx . stx_ino ;
+  rp -> uid = stx . stx_uid ;
+  rp -> gid = stx . stx_gid ;
+  rp -> nlink = stx . stx_nlink ;
+  rp -> size = stx . stx_size ;
+  rp -> mtime = stx . stx_mtime . tv_sec ;
+#else
+  struct stat st ;
+
+  if ( fstatat ( dirfd, name, & st, AT_SYMLINK_NOFOLLOW ) ) { return -1 ; }
+
+  rp -> mode = st . st_mode ;
+  rp -> ino = st . st_ino ;
+  rp -> uid = st . st_uid ;
+  rp -> gid = st . st_gid ;
+  rp -> nlink = st . st_nlink ;
+  rp -> size = st . st_size ;
+  rp -> mtime = st . st_mtime ;
+#endif
+
+  rp -> has_stat = 1 ;
+  rp -> type = IFTODT( rp -> mode ) ;
+
+  return 0 ;
+}
+
+/* checks the filters that do not need the path */
+static int walk_match ( const walk_t * const w, const walk_rec_t * const rp,
+  const char * const name )
+{
+  if ( w -> types && 0 == ( ( 1U << rp -> type ) & w -> types ) ) { return 0 ; }
+  if ( w -> glob && fnmatch ( w -> glob, name, 0 ) ) { return 0 ; }
+
+  if ( rp -> has_stat ) {
+    if ( 0 <= w -> min_size && w -> min_size > rp -> size ) { return 0 ; }
+    if ( 0 <= w -> max_size && w -> max_size < rp -> size ) { return 0 ; }
+    if ( w -> newer && w -> newer >= rp -> mtime ) { return 0 ; }
+    if ( w -> older && w -> older <= rp -> mtime ) { return 0 ; }
+  }
+
+  return 1 ;
+}
+
+/* adds a record, the path is copied */
+static void walk_emit ( walk_t * const w, const walk_rec_t * const rp,
+  const char * const path, const size_t plen )
+{
+  walk_rec_t * np ;
+  char * p = (char *) malloc ( 1 + plen ) ;
+
+  if ( NULL == p ) { return ; }
+  (void) memcpy ( p, path, plen ) ;
+  p [ plen ] = '\0' ;
+
+  (void) pthread_mutex_lock ( & w -> mu ) ;
+
+  /* throttle the workers until the caller has fetched some records */
+  while ( w -> bg && 0 == w -> cancel && 4 * (size_t) w -> batch <= w -> nrec ) {
+    (void) pthread_cond_wait ( & w -> cv, & w -> mu ) ;
+  }
+
+  if ( w -> nrec == w -> maxrec ) {
+    np = (walk_rec_t *) realloc ( w -> recs,
+      ( w -> maxrec + w -> batch ) * sizeof ( walk_rec_t ) ) ;
+
+    if ( NULL == np ) {
+      (void) pthread_mutex_unlock ( & w -> mu ) ;
+      free ( p ) ;
+      return ;
+    }
+
+    w -> recs = np ;
+    w -> maxrec += w -> batch ;
+  }
+
+  w -> recs [ w -> nrec ] = * rp ;
+  w -> recs [ w -> nrec ++ ] . path = p ;
+  if ( (size_t) w -> batch <= w -> nrec ) { (void) pthread_cond_broadcast ( & w -> cv ) ; }
+  (void) pthread_mutex_unlock ( & w -> mu ) ;
+}
+
+/* queues a subdir of dp (or the root dir if dp is NULL) */
+static void walk_push ( walk_t * const w, walk_dir_t * const dp,
+  const char * const path, const size_t plen, const size_t name, const int depth )
+{
+  walk_dir_t * const cp = (walk_dir_t *) malloc ( sizeof ( walk_dir_t ) + plen ) ;
+
+  if ( NULL == cp ) { return ; }
+
+  cp -> parent = dp ;
+  cp -> fd = -1 ;
+  cp -> refs = 1 ;
+  cp -> depth = depth ;
+  cp -> plen = plen ;
+  cp -> name = name ;
+  (void) memcpy ( cp -> path, path, plen ) ;
+  cp -> path [ plen ] = '\0' ;
+
+  (void) pthread_mutex_lock ( & w -> mu ) ;
+  if ( dp ) { ++ dp -> refs ; }
+  cp -> next = w -> stack ;
+  w -> stack = cp ;
+  (void) pthread_cond_broadcast ( & w -> cv ) ;
+  (void) pthread_mutex_unlock ( & w -> mu ) ;
+}
+
+static void walk_unref ( walk_t * const w, walk_dir_t * const dp )
+{
+  int i ;
+
+  (void) pthread_mutex_lock ( & w -> mu ) ;
+  i = -- dp -> refs ;
+  (void) pthread_mutex_unlock ( & w -> mu ) ;
+
+  if ( 0 == i ) {
+    if ( 0 <= dp -> fd ) { CLOSEFD( dp -> fd ) }
+    free ( dp ) ;
+  }
+}
+
+/* reports an error for the dir dp */
+static void walk_error ( walk_t * const w, const walk_dir_t * const dp, const int err )
+{
+  walk_rec_t r ;
+
+  (void) memset ( & r, 0, sizeof ( r ) ) ;
+  r . type = DT_DIR ;
+  r . depth = dp -> depth ;
+  r . name = dp -> name ;
+  r . err = err ;
+  walk_emit ( w, & r, dp -> path, dp -> plen ) ;
+}
+
+/* handles one entry of the dir dp, pbuf is a scratch buffer for the path */
+static void walk_entry ( walk_t * const w, walk_dir_t * const dp,
+  const char * const name, const unsigned char type, const uint64_t ino,
+  char ** const pbuf, size_t * const psize )
+{
+  size_t l, n ;
+  int descend ;
+  walk_rec_t r ;
+
+  if ( '.' == name [ 0 ] && ( '\0' == name [ 1 ]
+    || ( '.' == name [ 1 ] && '\0' == name [ 2 ] ) ) )
+  {
+    return ;
+  }
+
+  r . depth = 1 + dp -> depth ;
+  r . err = 0 ;
+  r . type = type ;
+  r . has_stat = 0 ;
+  r . ino = ino ;
+
+  if ( ( w -> need_stat || DT_UNKNOWN == type ) && walk_stat ( dp -> fd, name, & r ) ) {
+    /* removed in the meantime */
+    if ( ENOENT == errno ) { return ; }
+    r . err = errno ;
+  }
+
+  descend = DT_DIR == r . type && ( 0 > w -> maxdepth || w -> maxdepth > r . depth ) ;
+  if ( 0 == descend && 0 == walk_match ( w, & r, name ) ) { return ; }
+
+  /* dir path + '/' + name */
+  n = strlen ( name ) ;
+  l = dp -> plen + 1 + n ;
+  if ( dp -> plen && '/' == dp -> path [ dp -> plen - 1 ] ) { -- l ; }
+
+  if ( * psize <= l ) {
+    char * p = (char *) realloc ( * pbuf, 256 + l ) ;
+
+    if ( NULL == p ) { return ; }
+    * pbuf = p ;
+    * psize = 256 + l ;
+  }
+
+  (void) memcpy ( * pbuf, dp -> path, dp -> plen ) ;
+  if ( l > dp -> plen + n ) { ( * pbuf ) [ dp -> plen ] = '/' ; }
+  (void) memcpy ( * pbuf + l - n, name, n ) ;
+  ( * pbuf ) [ l ] = '\0' ;
+  r . name = l - n ;
+
+  if ( descend ) { walk_push ( w, dp, * pbuf, l, l - n, r . depth ) ; }
+
+  if ( ( 0 == descend || walk_match ( w, & r, name ) )
+    && ( 0 == w -> has_re || 0 == regexec ( & w -> re, * pbuf, 0, NULL, 0 ) ) )
+  {
+    walk_emit ( w, & r, * pbuf, l ) ;
+  }
+}
+
+/* reads the dir dp */
+static void walk_scan ( walk_t * const w, walk_dir_t * const dp, char * const buf,
+  char ** const pbuf, size_t * const psize )
+{
+  struct stat st ;
+
+  /* the root is followed like it was stat'ed, symlinks below are not */
+  dp -> fd = openat ( dp -> parent ? dp -> parent -> fd : w -> rootfd,
+    dp -> parent ? dp -> path + dp -> name : dp -> path,
+    O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOCTTY | ( dp -> parent ? O_NOFOLLOW : 0 ) ) ;
+
+  if ( dp -> parent ) { walk_unref ( w, dp -> parent ) ; }
+
+  if ( 0 > dp -> fd ) {
+    walk_error ( w, dp, errno ) ;
+    walk_unref ( w, dp ) ;
+    return ;
+  }
+
+  /* mount points are reported, but not descended into */
+  if ( w -> one_fs && ( fstat ( dp -> fd, & st ) || st . st_dev != w -> dev ) ) {
+    walk_unref ( w, dp ) ;
+    return ;
+  }
+
+#if defined (OSLinux) && defined (SYS_getdents64)
+  {
+    long r = 0 ;
+    size_t o ;
+    struct walk_dirent64 {
+      uint64_t d_ino ;
+      int64_t d_off ;
+      unsigned short d_reclen ;
+      unsigned char d_type ;
+      char d_name [ 1 ] ;
+    } * de ;
+
+    while ( 0 == w -> cancel
+      && 0 < ( r = syscall ( SYS_getdents64, dp -> fd, buf, WALK_BUFSIZE ) ) )
+    {
+      for ( o = 0 ; (size_t) r > o ; o += de -> d_reclen ) {
+        de = (struct walk_dirent64 *) ( buf + o ) ;
+        walk_entry ( w, dp, de -> d_name, de -> d_type, de -> d_ino, pbuf, psize ) ;
+      }
+    }
+
+    if ( 0 > r ) { walk_error ( w, dp, errno ) ; }
+  }
+#else
+  {
+    DIR * dirp ;
+    struct dirent * de ;
+    const int fd = dup ( dp -> fd ) ;
+
+    dirp = ( 0 <= fd ) ? fdopendir ( fd ) : NULL ;
+
+    if ( NULL == dirp ) {
+      walk_error ( w, dp, errno ) ;
+      if ( 0 <= fd ) { CLOSEFD( fd ) }
+    } else {
+      while ( 0 == w -> cancel && NULL != ( de = readdir ( dirp ) ) ) {
+        walk_entry ( w, dp, de -> d_name, de -> d_type, de -> d_ino, pbuf, psize ) ;
+      }
+
+      (void) closedir ( dirp ) ;
+    }
+  }
+#endif
+
+  walk_unref ( w, dp ) ;
+}
+
+/* processes queued dirs. a worker thread runs until the walk is done,
+ * when called by walk_next() it returns as soon as a batch of records
+ * is available.
+ */
+static void * walk_worker ( void * arg )
+{
+  walk_t * const w = (walk_t *) arg ;
+  walk_dir_t * dp ;
+  size_t psize = 0 ;
+  char * pbuf = NULL ;
+  char * const buf = (char *) malloc ( WALK_BUFSIZE ) ;
+
+  (void) pthread_mutex_lock ( & w -> mu ) ;
+
+  while ( buf ) {
+    if ( 0 == w -> bg && (size_t) w -> batch <= w -> nrec ) { break ; }
+
+    while ( NULL == w -> stack && 0 == w -> done ) {
+      if ( 0 == w -> busy ) {
+        w -> done = 1 ;
+        (void) pthread_cond_broadcast ( & w -> cv ) ;
+      } else {
+        (void) pthread_cond_wait ( & w -> cv, & w -> mu ) ;
+      }
+    }
+
+    if ( w -> done || w -> cancel ) { break ; }
+
+    dp = w -> stack ;
+    w -> stack = dp -> next ;
+    ++ w -> busy ;
+    (void) pthread_mutex_unlock ( & w -> mu ) ;
+    walk_scan ( w, dp, buf, & pbuf, & psize ) ;
+    (void) pthread_mutex_lock ( & w -> mu ) ;
+    -- w -> busy ;
+  }
+
+  if ( NULL == buf ) { w -> done = 1 ; }
+  (void) pthread_cond_broadcast ( & w -> cv ) ;
+  (void) pthread_mutex_unlock ( & w -> mu ) ;
+  free ( pbuf ) ;
+  free ( buf ) ;
+
+  return NULL ;
+}
+
+/* starts to walk path (relative to dirfd). the root is reported as well,
+ * a symlink is followed for the root only.
+ * returns 0 or an errno value.
+ */
+static int walk_start ( walk_t * const w, const int dirfd, const char * const path )
+{
+  int i ;
+  size_t l = strlen ( path ), n ;
+  walk_rec_t r ;
+  struct stat st ;
+
+  if ( fstatat ( dirfd, path, & st, 0 ) ) { return errno ; }
+
+  if ( 0 >= w -> batch ) { w -> batch = 256 ; }
+  if ( WALK_MAX_THREADS < w -> threads ) { w -> threads = WALK_MAX_THREADS ; }
+  w -> rootfd = dirfd ;
+  w -> dev = st . st_dev ;
+
+  for ( n = l ; 0 < n && '/' != path [ n - 1 ] ; -- n ) { ; }
+
+  (void) memset ( & r, 0, sizeof ( r ) ) ;
+  r . name = n ;
+  r . type = IFTODT( st . st_mode ) ;
+  r . ino = st . st_ino ;
+  r . has_stat = 1 ;
+  r . mode = st . st_mode ;
+  r . uid = st . st_uid ;
+  r . gid = st . st_gid ;
+  r . nlink = st . st_nlink ;
+  r . size = st . st_size ;
+  r . mtime = st . st_mtime ;
+
+  if ( walk_match ( w, & r, path + n )
+    && ( 0 == w -> has_re || 0 == regexec ( & w -> re, path, 0, NULL, 0 ) ) )
+  {
+    if ( 0 == w -> need_stat ) { r . has_stat = 0 ; }
+    walk_emit ( w, & r, path, l ) ;
+  }
+
+  if ( S_ISDIR( st . st_mode ) && 0 != w -> maxdepth ) {
+    walk_push ( w, NULL, path, l, n, 0 ) ;
+  }
+
+  /* the walk is done in the background when more threads are requested */
+  w -> bg = 1 < w -> threads ;
+
+  for ( i = 0 ; w -> bg && w -> threads > i ; ++ i ) {
+    if ( pthread_create ( w -> tid + w -> nthreads, NULL, walk_worker, w ) ) { break ; }
+    ++ w -> nthreads ;
+  }
+
+  if ( 0 == w -> nthreads ) { w -> bg = 0 ; }
+
+  return 0 ;
+}
+
+/* moves up to w -> batch records to rp, returns their number, 0 when
+ * the walk is done. the paths have to be freed by the caller.
+ */
+static size_t walk_next ( walk_t * const w, walk_rec_t * const rp )
+{
+  size_t n ;
+
+  if ( 0 == w -> bg && 0 == w -> done ) { (void) walk_worker ( w ) ; }
+
+  (void) pthread_mutex_lock ( & w -> mu ) ;
+
+  while ( 0 == w -> done && (size_t) w -> batch > w -> nrec ) {
+    (void) pthread_cond_wait ( & w -> cv, & w -> mu ) ;
+  }
+
+  n = ( (size_t) w -> batch < w -> nrec ) ? (size_t) w -> batch : w -> nrec ;
+
+  if ( n ) {
+    (void) memcpy ( rp, w -> recs, n * sizeof ( walk_rec_t ) ) ;
+    w -> nrec -= n ;
+    (void) memmove ( w -> recs, w -> recs + n, w -> nrec * sizeof ( walk_rec_t ) ) ;
+    (void) pthread_cond_broadcast ( & w -> cv ) ;
+  }
+
+  (void) pthread_mutex_unlock ( & w -> mu ) ;
+
+  return n ;
+}
+
+/* stops the walk and frees all resources */
+static void walk_stop ( walk_t * const w )
+{
+  int i ;
+  size_t j ;
+  walk_dir_t * dp ;
+
+  (void) pthread_mutex_lock ( & w -> mu ) ;
+  w -> cancel = 1 ;
+  (void) pthread_cond_broadcast ( & w -> cv ) ;
+  (void) pthread_mutex_unlock ( & w -> mu ) ;
+
+  for ( i = 0 ; w -> nthreads > i ; ++ i ) { (void) pthread_join ( w -> tid [ i ], NULL ) ; }
+  w -> nthreads = 0 ;
+  w -> bg = 0 ;
+
+  /* dirs not yet read still hold a reference to their parent */
+  while ( NULL != ( dp = w -> stack ) ) {
+    w -> stack = dp -> next ;
+    if ( dp -> parent ) { walk_unref ( w, dp -> parent ) ; }
+    walk_unref ( w, dp ) ;
+  }
+
+  for ( j = 0 ; w -> nrec > j ; ++ j ) { free ( w -> recs [ j ] . path ) ; }
+  free ( w -> recs ) ;
+  w -> recs = NULL ;
+  w -> nrec = w -> maxrec = 0 ;
+  w -> done = 1 ;
+
+  free ( w -> glob ) ;
+  w -> glob = NULL ;
+
+  if ( w -> has_re ) {
+    regfree ( & w -> re ) ;
+    w -> has_re = 0 ;
+  }
+
+  (void) pthread_mutex_destroy ( & w -> mu ) ;
+  (void) pthread_cond_destroy ( & w -> cv ) ;
+}